@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cjson/cJSON.h>
+#include "string-builder.h"
+#include "tmem.h"
+#include "cjson-converters.h"
+
+#define PAGE_ITEMS 50
+#define DEFAULT_PASSES 2000
+
+/*
+ * Converters benchmark:
+ * Measures the time taken by cJSON_to_page to convert a page of saved
+ * tracks. The page is either read from the file given as first argument
+ * (e.g. a response recorded from the "me/tracks" endpoint) or, if there
+ * is none or it is "-", generated with every member the Web API sends,
+ * including those the converters skip.
+ * The second argument is the number of passes.
+ */
+
+/*
+ * SAVED_TRACK_FORMAT:
+ * A saved track as sent by the Web API; takes the item's index four times.
+ */
+#define SAVED_TRACK_FORMAT \
+  "{\"added_at\":\"2024-03-01T12:00:00Z\",\"track\":{" \
+  "\"album\":{\"album_type\":\"album\",\"total_tracks\":12," \
+  "\"available_markets\":[\"CA\",\"FR\",\"US\"]," \
+  "\"external_urls\":{\"spotify\":\"https://open.spotify.com/album/x\"}," \
+  "\"href\":\"https://api.spotify.com/v1/albums/4aawyAB9vmqN3uQ7FjRGTy\"," \
+  "\"id\":\"4aawyAB9vmqN3uQ7FjRGTy\",\"images\":[{\"url\":\"https://i.scdn." \
+  "co/image/ab67616d0000b273\",\"height\":640,\"width\":640}]," \
+  "\"name\":\"Album %d\",\"release_date\":\"2012-11-19\"," \
+  "\"release_date_precision\":\"day\",\"type\":\"album\"," \
+  "\"uri\":\"spotify:album:4aawyAB9vmqN3uQ7FjRGTy\",\"artists\":[{" \
+  "\"external_urls\":{\"spotify\":\"https://open.spotify.com/artist/x\"}," \
+  "\"href\":\"https://api.spotify.com/v1/artists/0TnOYISbd1XYRBk9myaseg\"," \
+  "\"id\":\"0TnOYISbd1XYRBk9myaseg\",\"name\":\"Artist\",\"type\":" \
+  "\"artist\",\"uri\":\"spotify:artist:0TnOYISbd1XYRBk9myaseg\"}]}," \
+  "\"artists\":[{" \
+  "\"external_urls\":{\"spotify\":\"https://open.spotify.com/artist/x\"}," \
+  "\"href\":\"https://api.spotify.com/v1/artists/0TnOYISbd1XYRBk9myaseg\"," \
+  "\"id\":\"0TnOYISbd1XYRBk9myaseg\",\"name\":\"Artist\",\"type\":" \
+  "\"artist\",\"uri\":\"spotify:artist:0TnOYISbd1XYRBk9myaseg\"}]," \
+  "\"available_markets\":[\"CA\",\"FR\",\"US\"],\"disc_number\":1," \
+  "\"duration_ms\":207959,\"explicit\":false," \
+  "\"external_ids\":{\"isrc\":\"USUM71212345\"}," \
+  "\"external_urls\":{\"spotify\":\"https://open.spotify.com/track/x\"}," \
+  "\"href\":\"https://api.spotify.com/v1/tracks/11dFghVXANMlKmJXsNCb%02d\"," \
+  "\"id\":\"11dFghVXANMlKmJXsNCb%02d\",\"is_local\":false," \
+  "\"name\":\"Track %d\",\"popularity\":63,\"preview_url\":null," \
+  "\"track_number\":1,\"type\":\"track\"," \
+  "\"uri\":\"spotify:track:11dFghVXANMlKmJXsNCbNu\"}}"
+
+/*
+ * generate_page:
+ * Returns a page of PAGE_ITEMS saved tracks, or a null pointer if not
+ * enough memory was available.
+ */
+static string generate_page(void);
+
+/*
+ * read_file:
+ * Returns the content of the file at path, or a null pointer if it
+ * couldn't be read.
+ */
+static string read_file(string path);
+
+int main(int argc, char **argv) {
+  string payload = argc > 1 && strcmp(argv[1], "-") != 0
+    ? read_file(argv[1])
+    : generate_page();
+  int passes = argc > 2 ? atoi(argv[2]) : DEFAULT_PASSES;
+  if (payload == NULL || passes <= 0) {
+    fprintf(stderr, "usage: %s [page.json|-] [passes]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  cJSON *cJSON_page = cJSON_Parse(payload);
+  free(payload);
+  if (cJSON_page == NULL) {
+    fprintf(stderr, "invalid payload\n");
+    return EXIT_FAILURE;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < passes; i++) {
+    talloc_begin_arena();
+    Page page = cJSON_to_page(cJSON_page, cJSON_to_saved_track);
+    free_page(talloc_end_arena(page));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double elapsed = (end.tv_sec - start.tv_sec) * 1e9
+    + (end.tv_nsec - start.tv_nsec);
+  int items = cJSON_GetArraySize(cJSON_GetObjectItem(cJSON_page, "items"));
+  printf("%d passes over %d items: %.1f us per page, %.0f ns per item\n",
+         passes, items, elapsed / passes / 1e3,
+         items > 0 ? elapsed / passes / items : 0);
+
+  cJSON_Delete(cJSON_page);
+  return EXIT_SUCCESS;
+}
+
+static string generate_page(void) {
+  StringBuilder builder = new_string_builder();
+  if (builder == NULL) return NULL;
+  string_builder_appendf(builder, "{\"href\":\"https://api.spotify.com/v1/me/"
+                         "tracks?offset=0&limit=%d\",\"limit\":%d,"
+                         "\"next\":null,\"offset\":0,\"previous\":null,"
+                         "\"total\":%d,\"items\":[",
+                         PAGE_ITEMS, PAGE_ITEMS, PAGE_ITEMS);
+  for (int i = 0; i < PAGE_ITEMS; i++) {
+    if (i > 0) string_builder_append(builder, ",");
+    string_builder_appendf(builder, SAVED_TRACK_FORMAT, i, i, i, i);
+  }
+  string_builder_append(builder, "]}");
+  return string_builder_finish(builder);
+}
+
+static string read_file(string path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+  string content = NULL;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long size = ftell(file);
+    content = size >= 0 ? malloc(size + 1) : NULL;
+    if (content != NULL && (fseek(file, 0, SEEK_SET) != 0
+        || fread(content, 1, size, file) != (size_t) size)) {
+      free(content);
+      content = NULL;
+    } else if (content != NULL) content[size] = '\0';
+  }
+  fclose(file);
+  return content;
+}
@@ -0,0 +1,73 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Arena:
+ * This module provides a region allocator. Memory is handed out from large
+ * chunks by moving a cursor forward, and is never released individually:
+ * everything allocated from an arena is released at once when the arena
+ * is reset or freed.
+ */
+typedef struct arena *Arena;
+
+/*
+ * new_arena:
+ * Returns a pointer to a new, empty arena structure.
+ * Returns null if not enough memory was available to create a new structure.
+ */
+Arena new_arena(void);
+
+/*
+ * free_arena:
+ * Releases space taken by the arena structure and by everything that was
+ * allocated from it.
+ */
+void free_arena(Arena arena);
+
+/*
+ * arena_alloc:
+ * Allocates size bytes from arena, suitably aligned for any type.
+ * Returns a pointer to the allocated memory, or null if not enough memory
+ * was available.
+ */
+void *arena_alloc(Arena arena, size_t size);
+
+/*
+ * arena_reset:
+ * Releases everything that was allocated from arena at once, keeping
+ * its first chunk so that it can be reused without allocating again.
+ */
+void arena_reset(Arena arena);
+
+/*
+ * arena_owns:
+ * Returns true if ptr points to memory allocated from arena, else false.
+ */
+bool arena_owns(Arena arena, const void *ptr);
+
+/*
+ * arena_of:
+ * Returns the arena from whose chunks ptr was allocated, or null if ptr
+ * wasn't allocated from an arena. Unlike arena_owns, it doesn't depend on
+ * the number of arenas nor of chunks and can be called without any lock.
+ */
+Arena arena_of(const void *ptr);
+
+/*
+ * arena_set_owner:
+ * Attaches owner to arena, so that it can be retrieved from a pointer
+ * allocated in arena using arena_of and arena_owner.
+ */
+void arena_set_owner(Arena arena, void *owner);
+
+/*
+ * arena_owner:
+ * Returns the pointer last attached to arena using arena_set_owner,
+ * or null if there is none.
+ */
+void *arena_owner(Arena arena);
+
+#endif
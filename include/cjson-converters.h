@@ -15,6 +15,8 @@
  * the function will return a pointer to the created structure.
  * If any required information  couldn't be found,
  * the function will end the program prematurely.
+ * The members of each object are read in a single pass; members that no
+ * structure field uses are skipped.
  */
 
 /*
@@ -143,4 +145,51 @@ void *cJSON_to_restrictions(cJSON *cJSON_restrictions);
  */
 void *cJSON_to_search(cJSON *cJSON_search);
 
+/*
+ * Lazy Tracks
+ * List views only print the essentials of each track, so converting its
+ * album, artists and restrictions is mostly wasted. Between a call of
+ * cJSON_begin_lazy and a call of cJSON_end_lazy, cJSON_to_track validates
+ * the whole track but only converts its id, name, duration and popularity,
+ * keeping the track's cJSON object to convert the rest on first access.
+ * The album, artists and restrictions of any track must thus be read
+ * through track_album, track_artists and track_restrictions.
+ */
+
+/*
+ * cJSON_begin_lazy:
+ * Starts converting tracks lazily for the calling thread, which must have
+ * a current arena (see talloc_begin_arena).
+ * cJSON_root, the tree the tracks are converted from, then belongs to
+ * the arena and is deleted when the arena is released.
+ * Returns false if cJSON_root couldn't be given to the arena, in which case
+ * the caller keeps ownership of it and tracks are converted as usual.
+ */
+bool cJSON_begin_lazy(cJSON *cJSON_root);
+
+/*
+ * cJSON_end_lazy:
+ * Stops converting tracks lazily for the calling thread.
+ */
+void cJSON_end_lazy(void);
+
+/*
+ * track_album:
+ * Returns the album of track, converting it first if track is lazy.
+ */
+SimplifiedAlbum track_album(Track track);
+
+/*
+ * track_artists:
+ * Returns the artists of track, converting them first if track is lazy.
+ */
+SimplifiedArtist *track_artists(Track track);
+
+/*
+ * track_restrictions:
+ * Returns the restrictions of track, if any, converting them first if
+ * track is lazy.
+ */
+Restrictions track_restrictions(Track track);
+
 #endif
@@ -0,0 +1,104 @@
+#ifndef ENTITY_CACHE_H
+#define ENTITY_CACHE_H
+
+#include <cjson/cJSON.h>
+#include "types.h"
+
+#define ENTITY_CACHE_BUDGET (4 * 1024 * 1024)
+
+/*
+ * EntityCache:
+ * This module keeps single entities (albums, artists, tracks and playlists)
+ * in memory once converted from the API's responses, keyed by the entity's
+ * type and Spotify ID, so that an entity that was already fetched doesn't
+ * have to be fetched nor converted again. IDs are packed (see the
+ * "spotify-id" header), so that entries are hashed and compared as integers.
+ * Entities are converted in their own arena (see talloc_begin_arena) and
+ * shared with the callers using talloc_share: a caller releases the entity
+ * it got as usual (e.g. using free_album), but mustn't modify it.
+ * Once the entities kept take more space than the cache's budget,
+ * the least recently used ones are evicted.
+ * Every function of this module can be called from any thread.
+ */
+
+/*
+ * entity_type:
+ * Type of the entities that can be cached.
+ */
+enum entity_type {
+  ENTITY_ALBUM, ENTITY_ARTIST, ENTITY_TRACK, ENTITY_PLAYLIST
+};
+
+/*
+ * entity_cache_stats:
+ * Measures taken since the cache was last cleared.
+ * hits and misses are the number of lookups that found (or didn't find)
+ * the entity, evictions the number of entities evicted to stay within
+ * the budget, entries the number of entities currently kept and bytes
+ * the estimated space taken by the responses they were converted from.
+ */
+struct entity_cache_stats {
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  size_t entries;
+  size_t bytes;
+};
+
+/*
+ * entity_cache_get:
+ * Searches the cache for the entity of type with an id of id.
+ * If found, marks it as the most recently used one and returns it, shared
+ * with the caller. Else returns a null pointer.
+ */
+void *entity_cache_get(enum entity_type type, string id);
+
+/*
+ * entity_cache_contains:
+ * Returns true if the entity of type with an id of id is stored, without
+ * counting the lookup in the stats nor marking the entity as used.
+ */
+bool entity_cache_contains(enum entity_type type, string id);
+
+/*
+ * entity_cache_put:
+ * Converts cJSON_entity, the response for the entity of type with an id
+ * of id, using cJSON_to_type and releases it.
+ * Stores the entity, released using free_type once evicted, replacing
+ * the one stored before if any, and evicts the least recently used entities
+ * if needed. The entity isn't stored if it's bigger than the budget or
+ * if id isn't a Spotify ID.
+ * Returns the entity, shared with the caller if it was stored.
+ */
+void *entity_cache_put(enum entity_type type, string id, cJSON *cJSON_entity,
+                       void *(*cJSON_to_type)(cJSON *item),
+                       void (*free_type)(void *type_struct_ptr));
+
+/*
+ * entity_cache_remove:
+ * Removes the entity of type with an id of id from the cache, if it was
+ * stored. Should be called whenever the entity is modified using the API.
+ */
+void entity_cache_remove(enum entity_type type, string id);
+
+/*
+ * entity_cache_set_budget:
+ * Sets the estimated space, in bytes, that the stored responses can take
+ * (ENTITY_CACHE_BUDGET by default) and evicts entities if needed.
+ * A budget of 0 disables the cache.
+ */
+void entity_cache_set_budget(size_t bytes);
+
+/*
+ * entity_cache_clear:
+ * Removes every entity from the cache and resets its stats.
+ */
+void entity_cache_clear(void);
+
+/*
+ * entity_cache_get_stats:
+ * Returns the measures taken since the cache was last cleared.
+ */
+struct entity_cache_stats entity_cache_get_stats(void);
+
+#endif
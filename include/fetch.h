@@ -3,17 +3,361 @@
 
 #include <cjson/cJSON.h>
 #include "types.h"
+#include "stream-converters.h"
+
+#define MAX_STREAMS 16
+#define RATE_LIMIT 20
+#define MAX_THROTTLED_RETRIES 5
+#define MAX_ATTEMPTS 4
+#define REQUEST_DEADLINE_MS (60 * 1000)
+#define PREFETCH_BUDGET 4
+
+/*
+ * FetchRequest:
+ * A request handled by the asynchronous request engine.
+ * The engine runs in its own thread and drives every submitted request
+ * using a single curl multi handle, so that many requests can be in flight
+ * at the same time without blocking the calling thread.
+ */
+typedef struct fetch_request *FetchRequest;
+
+/*
+ * fetch_request_stats:
+ * Measures taken once a request is done.
+ * time_us is the wall time of the request in microseconds,
+ * connections is the number of new connections it had to open (0 if it
+ * reused or multiplexed over an existing one) and http2 tells whether it
+ * was made using HTTP/2.
+ * received_bytes is the size of the response's body as it was
+ * transferred, which is compressed if the server supports it, and
+ * decoded_bytes is its size once decompressed.
+ */
+struct fetch_request_stats {
+  long time_us;
+  long connections;
+  bool http2;
+  size_t received_bytes;
+  size_t decoded_bytes;
+};
+
+/*
+ * fetch_stats:
+ * Measures accumulated over every request made since fetch_init.
+ * requests is the number of requests done, coalesced ones included,
+ * connections the number of connections opened by them and http2_requests
+ * the number of requests made using HTTP/2.
+ * received_bytes and decoded_bytes are the sums of the sizes of the
+ * responses' bodies before and after decompression.
+ * total_time_us and max_time_us are the sum and the maximum of the wall
+ * time of the requests, in microseconds.
+ * cached_responses is the number of responses read from the response cache
+ * without calling the API, and revalidated_responses the number of requests
+ * answered with a 304 status, whose stored response was reused.
+ * throttled_requests is the number of responses with a 429 status, each of
+ * them being either retried (retried_requests) or, if the request was
+ * retried too many times already, dropped (dropped_requests).
+ * retried_requests also counts the GET requests made again after
+ * a transient error, and failed_requests is the number of requests whose
+ * error (a curl error or a 5xx status) was returned to the caller.
+ * coalesced_requests is the number of GET requests that weren't made
+ * because an identical request was already in flight, whose response
+ * was used instead.
+ * prefetched_requests is the number of requests started by fetch_prefetch,
+ * prefetch_hits the number of them whose response was used by fetch and
+ * cancelled_prefetches the number of them dropped by
+ * fetch_cancel_prefetches. skipped_prefetches is the number of prefetches
+ * that weren't started because the prefetch budget was used up.
+ */
+struct fetch_stats {
+  size_t requests;
+  size_t connections;
+  size_t http2_requests;
+  size_t received_bytes;
+  size_t decoded_bytes;
+  long total_time_us;
+  long max_time_us;
+  size_t cached_responses;
+  size_t revalidated_responses;
+  size_t throttled_requests;
+  size_t retried_requests;
+  size_t dropped_requests;
+  size_t failed_requests;
+  size_t coalesced_requests;
+  size_t prefetched_requests;
+  size_t prefetch_hits;
+  size_t cancelled_prefetches;
+  size_t skipped_prefetches;
+};
+
+/*
+ * fetch_init:
+ * Initializes the fetch context used by every request made by this module.
+ * The context lives until fetch_cleanup is called and owns a pool of
+ * reusable curl handles, which keep their connections alive between
+ * requests so that consecutive requests to the same host reuse the same
+ * connection, as well as a DNS and TLS session cache shared between them.
+ * Requests are made using HTTP/2 when the server supports it, so that
+ * concurrent requests are multiplexed over a single TLS connection.
+ * Responses are requested compressed (gzip, brotli, ...) and decompressed
+ * by curl as they are received.
+ * When the response cache is enabled (see response-cache.h), responses to
+ * GET requests are stored on disk: fresh responses are reused without
+ * calling the API and stale ones are revalidated using their ETag.
+ * Requests are started at a limited rate (see fetch_set_rate_limit).
+ * When the API answers that too many requests were made (429 status), every
+ * request waits for the delay asked by the API (Retry-After header) or for
+ * an exponential backoff if it's longer, and the throttled request is made
+ * again.
+ * GET requests failing with a transient error (e.g. a connection that
+ * couldn't be opened or was reset, a timeout or a 5xx status) are made
+ * again after an exponential backoff, up to MAX_ATTEMPTS times and until
+ * REQUEST_DEADLINE_MS passed since their first attempt (see
+ * fetch_set_max_attempts and fetch_set_request_deadline).
+ * GET requests made while an identical request (same URL) is in flight
+ * aren't made: they wait for the request in flight and receive their own
+ * copy of its response.
+ * Calling fetch without calling this function first initializes the
+ * context automatically.
+ * Returns true if the context could be initialized (or already was),
+ * else returns false.
+ */
+bool fetch_init(void);
+
+/*
+ * fetch_cleanup:
+ * Releases every resource owned by the fetch context, closing the
+ * connections that were kept alive.
+ * fetch_init must be called again before using the module after
+ * calling this function.
+ */
+void fetch_cleanup(void);
 
 /*
  * fetch:
  * Fetches data using the provided URL and method.
+ * url is used as is: its query's values must already be percent-encoded.
  * If body isn't null, includes it as the body of the request.
  * The method argument must be one of "GET", "POST", "PUT" and "DELETE".
  * Once the data has been fetched, parses it using cJSON module.
- * Returns the parsed data if no error occurred, else terminates program.
+ * Returns the parsed data. If the request failed, returns an error object
+ * in the same format as the API's errors:
+ * { "error": { "status": status, "message": message } }
+ * where status is the response's HTTP status, or 0 if no response could
+ * be received.
  * The returned pointer can be a null pointer if no data was returned in
  * the request's response, but no error occurred during the request.
+ * If url was prefetched (see fetch_prefetch) and method is "GET", returns
+ * the prefetched response instead, waiting for it if it's still in flight.
  */
 cJSON *fetch(string url, string method, string body);
 
+/*
+ * fetch_struct:
+ * GETs url and converts the response to the structure of type as its
+ * content is received (see the "stream-converters" header), so that
+ * the response is never parsed into a cJSON tree.
+ * The request is made through the engine (see fetch_submit), so that it's
+ * multiplexed with the requests in flight instead of opening a connection
+ * of its own. Like fetch, uses the response cache, but the request isn't
+ * shared with the concurrent requests to url nor taken from the prefetched
+ * responses.
+ * Returns the structure, which must be released using its "free"
+ * deallocation function. If the request failed, or if the response didn't
+ * describe a structure of type, returns null and sets error to an error
+ * object (see fetch), else sets error to null.
+ * If url is null or if not enough memory was available, terminates
+ * the program.
+ */
+void *fetch_struct(string url, enum stream_type type, cJSON **error);
+
+/*
+ * fetch_prefetch:
+ * Starts a GET request to url in the background, whose response is kept
+ * until fetch is called with url, so that the caller doesn't have to wait
+ * for it if the response was received meanwhile.
+ * At most as many prefetched requests as the prefetch budget allows (see
+ * fetch_set_prefetch_budget) can be in flight or kept at the same time,
+ * those cancelled but still in flight included: once the budget is used
+ * up, url isn't prefetched.
+ * Returns true if url was prefetched (or already was), else returns false.
+ */
+bool fetch_prefetch(string url);
+
+/*
+ * fetch_cancel_prefetches:
+ * Drops every prefetched response that wasn't used by fetch yet.
+ * Prefetched requests the engine didn't start yet are never made, the
+ * others are left to complete, their responses being released once
+ * received.
+ * Should be called whenever the prefetched responses became unlikely to be
+ * used (e.g. when the user navigates away from the results they were
+ * prefetched for).
+ */
+void fetch_cancel_prefetches(void);
+
+/*
+ * new_fetch_request:
+ * Returns a pointer to a new request using url, method and body, that
+ * can be submitted to the engine using fetch_submit.
+ * url, method and body must remain valid until the request is done.
+ * The method argument must be one of "GET", "POST", "PUT" and "DELETE",
+ * else terminates program.
+ * Returns a null pointer if not enough memory was available.
+ */
+FetchRequest new_fetch_request(string url, string method, string body);
+
+/*
+ * free_fetch_request:
+ * Releases the space taken by request, waiting for it to be done if it
+ * was submitted. The response not retrieved with fetch_wait is released too.
+ */
+void free_fetch_request(FetchRequest request);
+
+/*
+ * fetch_request_convert:
+ * Makes request, a GET request that wasn't submitted yet, convert its
+ * response to the structure of type as it's received (see fetch_struct)
+ * instead of parsing it. The structure must then be retrieved using
+ * fetch_wait_struct.
+ * Returns false if request isn't such a request or if not enough memory
+ * was available, else returns true.
+ */
+bool fetch_request_convert(FetchRequest request, enum stream_type type);
+
+/*
+ * fetch_submit:
+ * Submits request to the engine and returns without waiting for it.
+ * If callback isn't null, it will be called with request and data as
+ * arguments once the request is done. The callback is called from the
+ * engine's thread, thus it must not block or call fetch_wait.
+ * If a fresh response is stored for the request's URL in the response cache,
+ * the request is done before this function returns, and the callback is
+ * called from the calling thread. If an identical GET request is already
+ * in flight, the request waits for it and the callback is called from
+ * the thread that receives its response.
+ * Returns true if the request was submitted, else returns false.
+ */
+bool fetch_submit(FetchRequest request,
+                  void (*callback)(FetchRequest request, void *data),
+                  void *data);
+
+/*
+ * fetch_is_done:
+ * Returns true if request is done, else returns false.
+ * Never blocks.
+ */
+bool fetch_is_done(FetchRequest request);
+
+/*
+ * fetch_wait:
+ * Waits for request to be done and returns its response parsed using
+ * cJSON module. The caller becomes the owner of the response, which can
+ * be a null pointer if no data was returned, or an error object (see fetch)
+ * if the request failed.
+ */
+cJSON *fetch_wait(FetchRequest request);
+
+/*
+ * fetch_wait_struct:
+ * Waits for request, which converts its response (see
+ * fetch_request_convert), to be done and returns the structure converted,
+ * to be released using its "free" deallocation function. If the request
+ * failed, or if the response didn't describe the structure expected,
+ * returns null and sets error to an error object (see fetch), else sets
+ * error to null.
+ */
+void *fetch_wait_struct(FetchRequest request, cJSON **error);
+
+/*
+ * fetch_many:
+ * Fetches every URL of the null-terminated urls array using method,
+ * keeping the requests in flight at the same time.
+ * If bodies isn't null, bodies[i] is used as the body of the request
+ * made to urls[i].
+ * Returns an array containing as many responses as urls, the response
+ * at index i being the response to urls[i] (or a null pointer if no data
+ * was returned, or an error object if the request failed, see fetch).
+ * The array and the responses must be released by the caller.
+ * If not enough memory was available, terminates program.
+ */
+cJSON **fetch_many(string *urls, string method, string *bodies);
+
+/*
+ * fetch_all_pages:
+ * GETs the first page of the paginated resource at url, limit items per
+ * page, through the engine (see fetch_submit), then uses its total and
+ * limit to compute the offset of every page that comes after it, fetches
+ * those pages keeping at most max_in_flight requests in flight, and appends
+ * their items, in order, to the items of the first page, whose next is set
+ * to null.
+ * url mustn't hold a query: the limit and offset of each page are appended
+ * to it.
+ * Returns the first page holding every item, or an error object (see fetch)
+ * if any page couldn't be fetched, the error of the first page that failed.
+ * If not enough memory was available, terminates program.
+ */
+cJSON *fetch_all_pages(string url, size_t limit, size_t max_in_flight);
+
+/*
+ * fetch_set_max_streams:
+ * Sets the maximum number of requests the engine keeps in flight at the
+ * same time, which is also the maximum number of concurrent HTTP/2
+ * streams opened on a single connection.
+ * Defaults to MAX_STREAMS. A value of 0 is ignored.
+ */
+void fetch_set_max_streams(size_t max_streams);
+
+/*
+ * fetch_set_rate_limit:
+ * Sets the number of requests that can be started per second, allowing
+ * bursts of up to as many requests (RATE_LIMIT by default).
+ * A value of 0 disables the limit. Negative values are ignored.
+ */
+void fetch_set_rate_limit(double requests_per_second);
+
+/*
+ * fetch_set_max_throttled_retries:
+ * Sets the maximum number of times a request throttled by the API is made
+ * again (MAX_THROTTLED_RETRIES by default). Once a request was retried that
+ * many times, its 429 response is returned as is.
+ */
+void fetch_set_max_throttled_retries(size_t max_retries);
+
+/*
+ * fetch_set_max_attempts:
+ * Sets the maximum number of times a GET request failing with a transient
+ * error is made (MAX_ATTEMPTS by default), its first attempt included.
+ * A value of 1 disables retries. A value of 0 is ignored.
+ */
+void fetch_set_max_attempts(size_t max_attempts);
+
+/*
+ * fetch_set_request_deadline:
+ * Sets the time in milliseconds a request can take, counted from its first
+ * attempt and including the retries (REQUEST_DEADLINE_MS by default).
+ * Once it passed, the request is aborted and its error is returned.
+ * A value of 0 disables the deadline. Negative values are ignored.
+ */
+void fetch_set_request_deadline(long deadline_ms);
+
+/*
+ * fetch_set_prefetch_budget:
+ * Sets the maximum number of prefetched requests that can be in flight or
+ * kept at the same time (PREFETCH_BUDGET by default).
+ * A value of 0 disables prefetching.
+ */
+void fetch_set_prefetch_budget(size_t budget);
+
+/*
+ * fetch_request_stats:
+ * Returns the measures taken for request, which must be done.
+ */
+struct fetch_request_stats fetch_request_stats(FetchRequest request);
+
+/*
+ * fetch_get_stats:
+ * Returns the measures accumulated over every request done so far.
+ */
+struct fetch_stats fetch_get_stats(void);
+
 #endif
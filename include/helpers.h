@@ -2,6 +2,14 @@
 #define HELPERS_H
 
 #include "types.h"
+#include "ptrarray.h"
+
+/*
+ * PREFETCHED_RESULTS:
+ * Number of results of a page whose details are prefetched while the user
+ * chooses one of them (see the "query_prefetch_" functions).
+ */
+#define PREFETCHED_RESULTS 2
 
 /*
  * Helpers:
@@ -19,17 +27,113 @@
 int handle_option_choice(size_t options_count, ...);
 
 /*
- * update_playlists:
- * Queries the API for user's owned and followed playlists and uses
- * the response to update owned_playlists and followed_playlists.
+ * query_failed:
+ * If result, the value returned by a query, is a null pointer, tells
+ * the user that the query failed and returns true, else returns false.
+ */
+bool query_failed(void *result);
+
+/*
+ * print_query_error:
+ * Tells the user that a query failed with status, the error's status as
+ * returned by query_last_error.
+ */
+void print_query_error(long status);
+
+/*
+ * last_query_failed:
+ * If the last query made by the calling thread failed (see
+ * query_last_error), tells the user that it failed and returns true, else
+ * returns false. Used after the queries that return nothing, such as edits.
+ */
+bool last_query_failed(void);
+
+/*
+ * page_items:
+ * Returns the items of page along with their count, or an empty array if
+ * page is a null pointer.
+ */
+SizedArray page_items(Page page);
+
+/*
+ * set_playlists:
+ * Updates owned_playlists and followed_playlists with the playlists of
+ * playlists_page (none if it is a null pointer), telling them apart using
+ * user's name. The helpers become the owner of playlists_page.
+ */
+void set_playlists(Page playlists_page);
+
+/*
+ * fetch_followed_artists:
+ * Queries the API for every page of the user's followed artists.
+ * Returns a ptr_array holding the pages. If a query failed, sets *failed
+ * to true, the pages holding the artists fetched before.
+ */
+PtrArray fetch_followed_artists(bool *failed);
+
+/*
+ * set_followed_artists:
+ * Updates followed_artists with the artists of the pages held by pages,
+ * a ptr_array such as the one returned by fetch_followed_artists.
+ * The helpers become the owner of pages and of its pages.
+ */
+void set_followed_artists(PtrArray pages);
+
+/*
+ * Patching:
+ * Once an edit succeeded, the functions below apply it to owned_playlists,
+ * followed_playlists and followed_artists in place, without querying
+ * the API again. The items they add are copies owned by the helpers, and
+ * each patch increments library_version, so that a fetch of the library
+ * started before the edit is dropped rather than undoing it.
+ */
+
+/*
+ * patch_playlist:
+ * Updates the name, description and snapshot id of the user's playlist
+ * (owned or followed) with the same id as playlist to playlist's, after
+ * playlist was edited. Its number of tracks changes by tracks_delta.
+ * Does nothing if the user has no such playlist.
+ */
+void patch_playlist(Playlist playlist, long tracks_delta);
+
+/*
+ * add_followed_playlist:
+ * Adds playlist to the user's playlists, after it was followed.
+ * Does nothing if it is already one of them.
+ */
+void add_followed_playlist(Playlist playlist);
+
+/*
+ * remove_followed_playlist:
+ * Removes the playlist with an id of id from the user's playlists, after
+ * it was unfollowed.
+ */
+void remove_followed_playlist(string id);
+
+/*
+ * add_followed_artist:
+ * Adds artist to followed_artists, after it was followed.
+ * Does nothing if it is already one of them.
+ */
+void add_followed_artist(Artist artist);
+
+/*
+ * remove_followed_artist:
+ * Removes the artist with an id of id from followed_artists, after it was
+ * unfollowed.
  */
-void update_playlists(void);
+void remove_followed_artist(string id);
 
 /*
- * update_followed_artists:
- * Queries the API for the user's followed artists and uses the response 
- * to update followed_artists.
+ * save_library:
+ * Saves user, their playlists and followed artists, and the given pages of
+ * favorite artists and tracks to the library snapshot at path, for user
+ * and with token (see the "library-snapshot" header). Does nothing if path
+ * is a null pointer.
+ * Returns false if the snapshot couldn't be saved, else returns true.
  */
-void update_followed_artists(void);
+bool save_library(string path, string token, Page top_artists,
+                  Page top_tracks);
 
 #endif
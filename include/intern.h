@@ -0,0 +1,63 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "types.h"
+
+/*
+ * Intern:
+ * This module keeps a single copy of strings that are repeated across
+ * many structures (e.g. an album type, a genre or the name of an artist),
+ * so that the structures share it instead of each owning a copy.
+ * Interned strings live until intern_clear is called: they must never be
+ * released using free (intern_owns tells whether a string was interned).
+ * As the pool is only cleared at exit, only strings taking few distinct
+ * values should be interned, or the pool would grow with every structure.
+ * Every function of this module can be called from any thread.
+ */
+
+/*
+ * intern_stats:
+ * Measures taken since the pool was last cleared.
+ * lookups is the number of strings interned and hits the number of them
+ * that were already in the pool, strings the number of distinct strings
+ * kept and bytes the space they take.
+ * saved_bytes is the space the hits would have taken if they had been
+ * copied.
+ */
+struct intern_stats {
+  size_t lookups;
+  size_t hits;
+  size_t strings;
+  size_t bytes;
+  size_t saved_bytes;
+};
+
+/*
+ * intern_string:
+ * Returns the pool's copy of str, adding str to the pool if it wasn't
+ * interned yet.
+ * Returns null if not enough memory was available.
+ */
+string intern_string(string str);
+
+/*
+ * intern_owns:
+ * Returns true if str is a string returned by intern_string (as opposed to
+ * another copy of the same string), else returns false.
+ */
+bool intern_owns(string str);
+
+/*
+ * intern_clear:
+ * Releases every interned string. Must only be called once no structure
+ * uses them anymore.
+ */
+void intern_clear(void);
+
+/*
+ * intern_get_stats:
+ * Returns the measures taken since the pool was last cleared.
+ */
+struct intern_stats intern_get_stats(void);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * JsonStream:
+ * This module parses a JSON document incrementally, as its content is
+ * received chunk by chunk, and reports what it reads as a sequence of events
+ * (an object starts, a key is read, a string is read...) instead of
+ * building a tree: the caller keeps what it needs from each event.
+ * The content never needs to be kept in memory as a whole: only the token
+ * being read (e.g. a string split between two chunks) is buffered.
+ */
+typedef struct json_stream *JsonStream;
+
+#define JSON_STREAM_MAX_DEPTH 512
+
+/*
+ * json_event:
+ * The events reported while a document is parsed. JSON_KEY comes before
+ * the value of each member of an object.
+ */
+enum json_event {
+  JSON_OBJECT_START, JSON_OBJECT_END, JSON_ARRAY_START, JSON_ARRAY_END,
+  JSON_KEY, JSON_STRING, JSON_NUMBER, JSON_TRUE, JSON_FALSE, JSON_NULL
+};
+
+/*
+ * JsonHandler:
+ * Function called for each event, with the data given to new_json_stream.
+ * For JSON_KEY and JSON_STRING, value is the unescaped string, of length
+ * characters, and for JSON_NUMBER the number as written in the document.
+ * value is null-terminated and only valid during the call, and is a null
+ * pointer for the other events.
+ * Returns false to stop parsing, the document then being invalid,
+ * else returns true.
+ */
+typedef bool (*JsonHandler)(void *data, enum json_event event,
+                            const char *value, size_t length);
+
+/*
+ * new_json_stream:
+ * Returns a pointer to a new json_stream structure, ready to be fed,
+ * which reports its events to handler along with data.
+ * Returns null if not enough memory was available to create a new structure.
+ */
+JsonStream new_json_stream(JsonHandler handler, void *data);
+
+/*
+ * free_json_stream:
+ * Releases space taken by the json_stream structure.
+ */
+void free_json_stream(JsonStream stream);
+
+/*
+ * json_stream_feed:
+ * Parses the size first characters of chunk, continuing the document
+ * where the previous chunk stopped, and reports the events read.
+ * Returns false if the document is invalid, if the handler stopped parsing
+ * or if not enough memory was available, in which case every following
+ * chunk is ignored. Else returns true.
+ */
+bool json_stream_feed(JsonStream stream, const char *chunk, size_t size);
+
+/*
+ * json_stream_finish:
+ * Ends the document fed to stream, reporting the number it ended with,
+ * if any.
+ * Returns true if a complete and valid document was fed, else returns false.
+ */
+bool json_stream_finish(JsonStream stream);
+
+/*
+ * json_stream_reset:
+ * Discards what was fed to stream, which is then ready to be fed a new
+ * document.
+ */
+void json_stream_reset(JsonStream stream);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef LIBRARY_SNAPSHOT_H
+#define LIBRARY_SNAPSHOT_H
+
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * LibrarySnapshot:
+ * This module saves the parts of the user's library that the menus show
+ * right away (the user, their playlists, followed artists and favorite
+ * artists and tracks) to a single binary file, so that the next run of
+ * the program can show them before any request to the API is answered.
+ * The file starts with a header, giving the format's version and the place
+ * of each section. Each section is an array of fixed-width records of
+ * a single kind (playlists, artists, tracks...), which refer to each other
+ * by index, and to their strings by offset in the string table: the file
+ * holds no pointer, so it can be mapped at any address.
+ * Loading a snapshot maps the file in memory (see mmap) and only checks
+ * that the offsets it holds are in bounds: the strings of the structures
+ * loaded point into the mapping, which is released along with the last of
+ * them.
+ * A snapshot is saved for its user, its owner, with the authorization
+ * token of the session, of which the header only keeps hashes. It is only
+ * loaded for the same owner or with the same token, so that a user never
+ * sees the library of another one: the token, known right away, lets it
+ * be shown before any request is answered, and the owner's id, known once
+ * the user is fetched, lets it outlive the token, which expires quickly.
+ * A snapshot written with another version of the format, or on a machine
+ * of another byte order, is never loaded.
+ */
+
+#define LIBRARY_SNAPSHOT_VERSION 3
+
+/*
+ * library_snapshot:
+ * The parts of the library saved in a snapshot.
+ * Every page's items are a null terminated array, and any page can be
+ * a null pointer when saving, in which case it is saved as empty.
+ */
+struct library_snapshot {
+  User user;
+  Page playlists;
+  Page followed_artists;
+  Page top_artists;
+  Page top_tracks;
+};
+
+/*
+ * library_snapshot_save:
+ * Saves snapshot to the file at path for its user and with token (which
+ * can be null), replacing it atomically.
+ * Returns false if the file couldn't be written or if not enough memory
+ * was available, else returns true.
+ */
+bool library_snapshot_save(string path, string token,
+                           struct library_snapshot *snapshot);
+
+/*
+ * library_snapshot_load:
+ * Loads the snapshot saved in the file at path for the user with an id of
+ * owner, or with token, into snapshot. Either can be a null pointer, which
+ * matches no snapshot.
+ * The user and each page are the roots of their own arena (see
+ * talloc_begin_arena): they must be released using free_user and
+ * free_page, which also release the structures they hold.
+ * Returns false if the file doesn't exist, isn't a valid snapshot of
+ * the current version, matches neither owner nor token or if not enough
+ * memory was available, in which case snapshot is left untouched, else
+ * returns true.
+ */
+bool library_snapshot_load(string path, string owner, string token,
+                           struct library_snapshot *snapshot);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PLAYLIST_STORE_H
+#define PLAYLIST_STORE_H
+
+#include <cjson/cJSON.h>
+#include "types.h"
+
+/*
+ * PlaylistStore:
+ * This module keeps the complete list of tracks of playlists on disk,
+ * keyed by the playlist's id and snapshot id, so that the tracks of
+ * a playlist that didn't change since they were last fetched can be read
+ * locally instead of being fetched page by page.
+ * As a playlist's snapshot id changes each time the playlist is modified,
+ * the stored tracks are never used once they are out of date.
+ * Each playlist is stored in its own file in the store's directory, as
+ * compact JSON.
+ * The store is disabled until a directory is set using
+ * playlist_store_set_dir.
+ */
+
+/*
+ * playlist_store_stats:
+ * Measures taken since the store's directory was last set.
+ * hits and misses are the number of lookups that found (or didn't find)
+ * the tracks of a playlist for the requested snapshot.
+ */
+struct playlist_store_stats {
+  size_t hits;
+  size_t misses;
+};
+
+/*
+ * playlist_store_set_dir:
+ * Sets the directory where playlists are stored, creating it if it doesn't
+ * exist yet (its parent must exist), and enables the store.
+ * If dir is null, disables the store.
+ * Returns false if the directory couldn't be created, in which case the
+ * store is disabled, else returns true.
+ */
+bool playlist_store_set_dir(string dir);
+
+/*
+ * playlist_store_get:
+ * Returns the page of tracks stored for the playlist having an id of id,
+ * parsed using cJSON module, if it was stored for snapshot_id.
+ * Else returns a null pointer.
+ * The caller becomes the owner of the returned page.
+ */
+cJSON *playlist_store_get(string id, string snapshot_id);
+
+/*
+ * playlist_store_put:
+ * Stores cJSON_tracks, the page containing every track of the playlist
+ * having an id of id at snapshot_id, replacing the tracks stored before
+ * for the playlist.
+ * cJSON_tracks is compacted in place beforehand: the fields that are never
+ * read by the converters (e.g. available_markets) are removed from it.
+ * Returns true if the tracks were stored, else returns false.
+ */
+bool playlist_store_put(string id, string snapshot_id, cJSON *cJSON_tracks);
+
+/*
+ * playlist_store_remove:
+ * Removes the tracks stored for the playlist having an id of id, if any.
+ */
+void playlist_store_remove(string id);
+
+/*
+ * playlist_store_get_stats:
+ * Returns the measures taken since the store's directory was last set.
+ */
+struct playlist_store_stats playlist_store_get_stats(void);
+
+#endif
@@ -9,9 +9,22 @@
  * This module helps in the creation of an array of pointers.
  * A ptr_array structure always keep track of the length of its
  * content (i.e. number of pointers stored) and is always null terminated.
+ * Its capacity doubles whenever it has to grow, so adding items takes
+ * constant amortized time, and its size can be read in constant time using
+ * get_size.
  */
 typedef struct ptr_array *PtrArray;
 
+/*
+ * SizedArray:
+ * A null-terminated array of pointers along with its length, so that
+ * the number of its items can be read without walking the array.
+ */
+typedef struct sized_array {
+  size_t length;
+  void **items;
+} SizedArray;
+
 /*
  * new_ptr_array:
  * Returns a pointer to a new ptr_array structure.
@@ -43,6 +56,30 @@ void free_ptr_array(PtrArray ptr_array, bool free_content,
  */
 size_t add_item(PtrArray ptr_array, void *ptr);
 
+/*
+ * add_items:
+ * Add the count first pointers of items to the ptr_array's array.
+ * Returns the size of ptr_array's array after adding items.
+ * Returns 0 if not enough space was available to store
+ * items in ptr_array's array.
+ */
+size_t add_items(PtrArray ptr_array, void **items, size_t count);
+
+/*
+ * reserve_ptr_array:
+ * Makes ptr_array able to store at least size pointers without growing
+ * (e.g. using the total of a page before adding its items).
+ * Returns false if not enough space was available, else returns true.
+ */
+bool reserve_ptr_array(PtrArray ptr_array, size_t size);
+
+/*
+ * shrink_ptr_array:
+ * Releases the space ptr_array reserved beyond the pointers it stores.
+ * Returns false if the array couldn't be resized, else returns true.
+ */
+bool shrink_ptr_array(PtrArray ptr_array);
+
 /*
  * get_size:
  * Returns the number of items stored in ptr_array's array.
@@ -57,4 +94,34 @@ size_t get_size(PtrArray ptr_array);
  */
 void **get_array(PtrArray ptr_array);
 
+/*
+ * get_sized_array:
+ * Returns the array stored in ptr_array along with its length.
+ */
+SizedArray get_sized_array(PtrArray ptr_array);
+
+/*
+ * copy_array:
+ * Returns a copy of the array stored in ptr_array, taking exactly the space
+ * it needs and allocated using allocate (e.g. malloc), along with its length.
+ * The copy's items are null if allocate couldn't allocate enough space.
+ */
+SizedArray copy_array(PtrArray ptr_array, void *(*allocate)(size_t size));
+
+/*
+ * allocate_array:
+ * Returns an array of length null pointers, allocated using allocate
+ * (e.g. tmalloc), to be filled by the caller. Like the arrays returned by
+ * copy_array, it is null terminated.
+ * Returns null if allocate couldn't allocate enough space.
+ */
+void **allocate_array(size_t length, void *(*allocate)(size_t size));
+
+/*
+ * array_length:
+ * Returns the number of items of the null-terminated array, which can have
+ * been allocated in any way, or 0 if array is null.
+ */
+size_t array_length(void *array);
+
 #endif
@@ -4,6 +4,14 @@
 #include "types.h"
 
 #define LIMIT 20
+#define PAGES_CONCURRENCY 8
+#define SEVERAL_ALBUMS_LIMIT 20
+#define SEVERAL_ARTISTS_LIMIT 50
+#define SEVERAL_TRACKS_LIMIT 50
+#define SAVE_ALBUMS_LIMIT 20
+#define SAVE_TRACKS_LIMIT 50
+#define FOLLOW_ARTISTS_LIMIT 50
+#define PLAYLIST_EDIT_LIMIT 100
 
 /*
  * Query:
@@ -14,9 +22,44 @@
  * "cjson-converters" header.
  * If a "cJSON_to_" function was called, its return value will be returned,
  * else the function doesn't return anything.
- * Any error will cause the program to terminate.
+ * If the API returned an error, or couldn't be called after retrying
+ * transient errors (see fetch), the function returns a null pointer and
+ * the error's status can be read using query_last_error.
+ * The "query_get_all_" functions read the first page of a resource, then
+ * use its total to fetch every remaining page concurrently, returning a
+ * single page containing every item in order.
+ * Albums, artists, tracks and playlists queried by id are kept in the
+ * "entity-cache" module and only fetched again once evicted, or once
+ * modified using one of this module's functions.
+ * The tracks of playlists are kept on disk by the "playlist-store" module
+ * and only fetched again once the playlist's snapshot id changed.
+ * The "query_put_", "query_post_" and "query_delete_" functions accept any
+ * number of items and split them into requests of at most as many items as
+ * the API allows (e.g. SAVE_TRACKS_LIMIT). Those requests are sent
+ * concurrently, except for playlist edits, which are sent one after
+ * the other so that each one applies to the snapshot left by the previous
+ * one. If a request fails, its error is the one read by query_last_error.
+ * The "query_prefetch_" functions start fetching in the background what
+ * the matching "query_get_" function would fetch with the same arguments
+ * (see fetch_prefetch), so that calling it later doesn't wait for the API.
+ * Entities already kept by the entity cache aren't prefetched.
  */
 
+/*
+ * query_set_pages_concurrency:
+ * Sets the maximum number of pages fetched at the same time by the
+ * "query_get_all_" functions (PAGES_CONCURRENCY by default).
+ */
+void query_set_pages_concurrency(size_t max_pages);
+
+/*
+ * query_last_error:
+ * Returns the HTTP status of the error returned by the last API call made
+ * by a query of the calling thread (0 if no response could be received),
+ * or -1 if that call succeeded.
+ */
+long query_last_error(void);
+
 
 // Album queries
 
@@ -24,9 +67,22 @@
  * query_get_album:
  * Queries the API for an album with and id of id.
  * Returns the album if found, else returns a null pointer.
+ * The album is shared with the entity cache: it mustn't be modified.
  */
 Album query_get_album(string id);
 
+/*
+ * query_get_several_albums:
+ * Queries the API for the albums whose id is in ids, a null terminated
+ * array, using as few requests as possible (SEVERAL_ALBUMS_LIMIT albums
+ * per request). Albums found in the entity cache aren't queried again,
+ * and the queried ones are added to it (like query_get_album's, the albums
+ * mustn't be modified).
+ * Returns a null terminated array of the albums found, in the order of
+ * ids, or a null pointer if the API returned an error.
+ */
+Album *query_get_several_albums(string *ids);
+
 /*
  * query_get_album_tracks:
  * Queries the API for tracks of an album with an id of id,
@@ -68,9 +124,17 @@ Page query_get_new_albums(size_t offset);
  * query_get_artist:
  * Queries the API for an artist with and id of id.
  * Returns the artist if found, else returns a null pointer.
+ * The artist is shared with the entity cache: it mustn't be modified.
  */
 Artist query_get_artist(string id);
 
+/*
+ * query_get_several_artists:
+ * Queries the API for the artists whose id is in ids, like
+ * query_get_several_albums, SEVERAL_ARTISTS_LIMIT artists per request.
+ */
+Artist *query_get_several_artists(string *ids);
+
 /*
  * query_get_artist_albums:
  * Queries the API for albums of the artist having an id of id, 
@@ -92,6 +156,7 @@ Track *query_get_artist_top_tracks(string id);
  * query_get_playlist:
  * Queries the API for a playlist with an id of id.
  * Returns the playlist if found, else returns a null pointer.
+ * The playlist is shared with the entity cache: it mustn't be modified.
  */
 Playlist query_get_playlist(string id);
 
@@ -109,17 +174,36 @@ void query_put_playlist_details(Playlist playlist);
  */
 Page query_get_playlist_tracks(string id, size_t offset);
 
+/*
+ * query_get_all_playlist_tracks:
+ * Queries the API for every track of the playlist having an id of id,
+ * whose current snapshot id is snapshot_id.
+ * If the tracks were stored by the "playlist-store" module for snapshot_id,
+ * reads them from the store instead, else stores them once fetched.
+ * Returns the tracks as a single page structure.
+ */
+Page query_get_all_playlist_tracks(string id, string snapshot_id);
+
 /*
  * query_put_playlist_tracks:
- * Queries the API to add tracks to playlist.
+ * Queries the API to add tracks to playlist, in order, by chunks of at most
+ * PLAYLIST_EDIT_LIMIT tracks, stopping at the first chunk that fails.
+ * playlist isn't modified, as it may be shared with the entity cache.
+ * Returns the snapshot id of the last chunk added, which has to be freed,
+ * or a null pointer if none was.
  */
-void query_post_playlist_tracks(Playlist playlist, Track *tracks);
+string query_post_playlist_tracks(Playlist playlist, Track *tracks);
 
 /*
  * query_delete_playlist_tracks:
- * Queries the API to delete tracks from playlist.
+ * Queries the API to delete tracks from playlist, by chunks of at most
+ * PLAYLIST_EDIT_LIMIT tracks, each chunk being deleted from the snapshot
+ * returned for the previous one, and stopping at the first chunk that fails.
+ * playlist isn't modified, as it may be shared with the entity cache.
+ * Returns the snapshot id of the last chunk deleted, or a copy of playlist's
+ * if none was, which has to be freed.
  */
-void query_delete_playlist_tracks(Playlist playlist, Track *tracks);
+string query_delete_playlist_tracks(Playlist playlist, Track *tracks);
 
 /*
  * query_get_user_playlists:
@@ -129,6 +213,13 @@ void query_delete_playlist_tracks(Playlist playlist, Track *tracks);
  */
 Page query_get_user_playlists(size_t offset);
 
+/*
+ * query_get_all_user_playlists:
+ * Queries the API for every playlist owned or followed by the user.
+ * Returns the playlists as a single page structure.
+ */
+Page query_get_all_user_playlists(void);
+
 /*
  * query_post_playlist:
  * Queries the API to create a new playlist as user.
@@ -194,9 +285,17 @@ Search query_get_tracks(string track, string artist, string year,
  * query_get_track:
  * Queries the API for a track having an id of id.
  * Returns the track if found, else returns a null pointer.
+ * The track is shared with the entity cache: it mustn't be modified.
  */
 Track query_get_track(string id);
 
+/*
+ * query_get_several_tracks:
+ * Queries the API for the tracks whose id is in ids, like
+ * query_get_several_albums, SEVERAL_TRACKS_LIMIT tracks per request.
+ */
+Track *query_get_several_tracks(string *ids);
+
 /*
  * query_get_user_saved_tracks:
  * Queries the API for tracks saved by user, skipping the first offset tracks.
@@ -274,4 +373,31 @@ void query_put_follow_artists(Artist *artists);
  */
 void query_delete_unfollow_artists(Artist *artists);
 
+// Prefetching
+
+/*
+ * query_prefetch_*:
+ * Prefetch the response of the matching query_get_ function.
+ */
+void query_prefetch_album(string id);
+void query_prefetch_album_tracks(string id, size_t offset);
+void query_prefetch_artist_albums(string id, size_t offset);
+void query_prefetch_playlist_tracks(string id, size_t offset);
+void query_prefetch_playlist(string id);
+void query_prefetch_albums(string album, string artist, string year,
+                           bool new, bool hipster, size_t offset);
+void query_prefetch_artists(string artist, string year, string genre,
+                            size_t offset);
+void query_prefetch_playlists(string playlist, size_t offset);
+void query_prefetch_tracks(string track, string artist, string year,
+                           string album, string genre, size_t offset);
+void query_prefetch_track(string id);
+
+/*
+ * query_cancel_prefetches:
+ * Cancels every prefetch whose response wasn't used yet (see
+ * fetch_cancel_prefetches).
+ */
+void query_cancel_prefetches(void);
+
 #endif
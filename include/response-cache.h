@@ -0,0 +1,159 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "types.h"
+
+#define RESPONSE_CACHE_LIMIT (32 * 1024 * 1024)
+
+/*
+ * ResponseCache:
+ * This module keeps the bodies of GET responses on disk, keyed by URL
+ * and by the owner they were requested for (the authorization token),
+ * along with their ETag and the expiry date given by their Cache-Control
+ * header, so that they survive from one run of the program to the next.
+ * A response that is still fresh can be reused without calling the API,
+ * and a stale one can be revalidated using a conditional request: if the
+ * resource didn't change, the API answers with a 304 status and no body,
+ * and the stored body is reused.
+ * The cache can be invalidated after a request modifying resources, so
+ * that every response stored until then has to be revalidated.
+ * Each response is stored in its own file in the cache's directory.
+ * Once the files take more space than the cache's limit, they are evicted
+ * following the cache's eviction policy.
+ * The cache is disabled until a directory is set using
+ * response_cache_set_dir.
+ * Every function of this module can be called from any thread, but a single
+ * entry mustn't be used by several threads at the same time.
+ */
+
+/*
+ * ResponseCacheEntry:
+ * The cached state of the response to a single URL, used while the
+ * response is requested: it holds what was stored for the URL (if anything)
+ * and records the new response as it is received.
+ */
+typedef struct response_cache_entry *ResponseCacheEntry;
+
+/*
+ * response_cache_eviction:
+ * Policies used to choose which responses are evicted first.
+ * RESPONSE_CACHE_LRU evicts the least recently used responses,
+ * RESPONSE_CACHE_FIFO evicts the responses that were stored first.
+ */
+enum response_cache_eviction {
+  RESPONSE_CACHE_LRU, RESPONSE_CACHE_FIFO
+};
+
+/*
+ * response_cache_set_dir:
+ * Sets the directory where responses are stored, creating it (and its
+ * parents) if it doesn't exist yet, and enables the cache.
+ * If dir is null, disables the cache.
+ * Returns false if the directory couldn't be created, in which case the
+ * cache is disabled, else returns true.
+ */
+bool response_cache_set_dir(string dir);
+
+/*
+ * response_cache_invalidate:
+ * Makes every stored response stale, so that it is revalidated the next
+ * time it is requested. Does nothing if the cache is disabled.
+ */
+void response_cache_invalidate(void);
+
+/*
+ * response_cache_set_limit:
+ * Sets the space, in bytes, that the stored responses can take
+ * (RESPONSE_CACHE_LIMIT by default). Responses are evicted the next time
+ * a response is stored if they take more space than the limit.
+ * A limit of 0 prevents any response from being stored.
+ */
+void response_cache_set_limit(size_t bytes);
+
+/*
+ * response_cache_set_eviction:
+ * Sets the policy used to evict responses (RESPONSE_CACHE_LRU by default).
+ */
+void response_cache_set_eviction(enum response_cache_eviction eviction);
+
+/*
+ * new_response_cache_entry:
+ * Returns a pointer to a new entry for url requested for owner (which can
+ * be null), loading what was stored for url and owner if anything.
+ * Only a hash of owner is stored.
+ * Returns null if the cache is disabled or if not enough memory
+ * was available.
+ */
+ResponseCacheEntry new_response_cache_entry(string url, string owner);
+
+/*
+ * free_response_cache_entry:
+ * Releases space taken by entry, discarding the response recorded
+ * with it if it wasn't stored.
+ */
+void free_response_cache_entry(ResponseCacheEntry entry);
+
+/*
+ * response_cache_etag:
+ * Returns the ETag of the response stored for entry's URL, to be sent
+ * in an If-None-Match header, or null if there is none.
+ */
+string response_cache_etag(ResponseCacheEntry entry);
+
+/*
+ * response_cache_is_fresh:
+ * Returns true if a response is stored for entry's URL, hasn't expired and
+ * wasn't stored before the cache was last invalidated, else returns false.
+ */
+bool response_cache_is_fresh(ResponseCacheEntry entry);
+
+/*
+ * response_cache_header:
+ * Records the response header line of size characters received
+ * for entry's URL (the status line, ETag and Cache-Control are kept,
+ * other headers are ignored).
+ * Does nothing if entry is null.
+ */
+void response_cache_header(ResponseCacheEntry entry, const char *line,
+                           size_t size);
+
+/*
+ * response_cache_write:
+ * Records size bytes of the body received for entry's URL.
+ * Does nothing if entry is null or if the response isn't a 200 response
+ * that can be stored.
+ */
+void response_cache_write(ResponseCacheEntry entry, const void *chunk,
+                          size_t size);
+
+/*
+ * response_cache_store:
+ * Stores the response recorded with entry, replacing the one stored before,
+ * and evicts responses if the cache takes more space than its limit.
+ * Returns true if the response was stored, else returns false.
+ */
+bool response_cache_store(ResponseCacheEntry entry);
+
+/*
+ * response_cache_read:
+ * Reads the body stored for entry's URL, calling consume with data and
+ * each chunk of the body, and marks the response as used.
+ * If the recorded response is a 304 response, updates the stored expiry
+ * date using its Cache-Control header first.
+ * Returns false if no body could be read, else returns true.
+ */
+bool response_cache_read(ResponseCacheEntry entry,
+                         void (*consume)(void *data, const char *chunk,
+                                         size_t size),
+                         void *data);
+
+/*
+ * response_cache_status:
+ * Returns the status of the response recorded with entry, or 0 if no status
+ * line was recorded.
+ */
+long response_cache_status(ResponseCacheEntry entry);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SPOTIFY_ID_H
+#define SPOTIFY_ID_H
+
+#include <stdint.h>
+#include "types.h"
+
+/*
+ * SpotifyId:
+ * This module packs Spotify IDs (at most SPOTIFY_ID_LENGTH characters,
+ * see the "types" header) into fixed-size keys, so that ID-keyed tables can
+ * hash and compare them as a few integers instead of as strings.
+ * A key holds the ID's characters padded with null characters, which is
+ * also how the id fields of the type structures store them, making those
+ * fields usable as strings.
+ */
+
+/*
+ * spotify_id:
+ * A packed Spotify ID, compared and hashed in constant time.
+ */
+struct spotify_id {
+  uint64_t words[SPOTIFY_ID_SIZE / sizeof(uint64_t)];
+};
+
+/*
+ * spotify_id_copy:
+ * Copies str into dest, an id field of SPOTIFY_ID_SIZE characters, padding
+ * it with null characters.
+ * Returns false if str is null or longer than SPOTIFY_ID_LENGTH, in which
+ * case dest is set to an empty string, else returns true.
+ */
+bool spotify_id_copy(char *dest, string str);
+
+/*
+ * spotify_id_pack:
+ * Packs str into id.
+ * Returns false if str is null or longer than SPOTIFY_ID_LENGTH, else
+ * returns true.
+ */
+bool spotify_id_pack(struct spotify_id *id, string str);
+
+/*
+ * spotify_id_equal:
+ * Returns true if id and other_id are the same ID, else returns false.
+ */
+bool spotify_id_equal(struct spotify_id id, struct spotify_id other_id);
+
+/*
+ * spotify_id_hash:
+ * Returns the hash of id.
+ */
+size_t spotify_id_hash(struct spotify_id id);
+
+#endif
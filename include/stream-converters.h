@@ -0,0 +1,85 @@
+#ifndef STREAM_CONVERTERS_H
+#define STREAM_CONVERTERS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * StreamConverter:
+ * This module converts a JSON document to the type structure it describes
+ * as the document is received, chunk by chunk: the structure is filled
+ * from the events of a JSON stream (see the "json-stream" header), so that
+ * neither the whole document nor a cJSON tree of it is ever kept in memory.
+ * Like the cJSON converters (see the "cjson-converters" header), the keys
+ * that aren't fields of a structure are skipped, and albums' types,
+ * artists' genres and the names of the artists credited on albums and
+ * tracks are interned.
+ * The structure and everything it holds are allocated in a single arena
+ * (see talloc_begin_arena), which the converter sets aside between two
+ * chunks: several documents can be converted at the same time, and each
+ * chunk can be fed by any thread.
+ */
+typedef struct stream_converter *StreamConverter;
+
+/*
+ * stream_type:
+ * The structures a converter can build: a user, or a page of artists,
+ * tracks, saved tracks or saved albums. STREAM_FOLLOWED_ARTISTS_PAGE is
+ * a page of artists listed under the "artists" key of the document, as
+ * the followed artists are.
+ */
+enum stream_type {
+  STREAM_USER, STREAM_ARTISTS_PAGE, STREAM_TRACKS_PAGE,
+  STREAM_SAVED_TRACKS_PAGE, STREAM_SAVED_ALBUMS_PAGE,
+  STREAM_FOLLOWED_ARTISTS_PAGE
+};
+
+/*
+ * new_stream_converter:
+ * Returns a pointer to a new stream_converter structure, ready to be fed
+ * a document describing a structure of type.
+ * Returns null if not enough memory was available to create a new structure.
+ */
+StreamConverter new_stream_converter(enum stream_type type);
+
+/*
+ * free_stream_converter:
+ * Releases space taken by the stream_converter structure, including
+ * the structure being converted if it wasn't retrieved using
+ * stream_converter_finish.
+ */
+void free_stream_converter(StreamConverter converter);
+
+/*
+ * stream_converter_feed:
+ * Converts the size first characters of chunk, continuing the document
+ * where the previous chunk stopped.
+ * Returns false if the document is invalid or doesn't describe
+ * the structure expected (e.g. a field is missing or has another type),
+ * in which case every following chunk is ignored. Else returns true.
+ * Terminates program if not enough memory was available.
+ */
+bool stream_converter_feed(StreamConverter converter, const char *chunk,
+                           size_t size);
+
+/*
+ * stream_converter_finish:
+ * Ends the document fed to converter and returns the structure converted,
+ * root of its arena: releasing it using its "free" deallocation function
+ * (free_user or free_page) releases everything it holds.
+ * Returns null if the document was incomplete, invalid or didn't describe
+ * the structure expected.
+ * The converter can't be fed anymore, unless it's reset.
+ */
+void *stream_converter_finish(StreamConverter converter);
+
+/*
+ * stream_converter_reset:
+ * Discards what was fed to converter and the structure being converted,
+ * so that a new document can be fed, e.g. when a request is made again.
+ * Terminates program if not enough memory was available.
+ */
+void stream_converter_reset(StreamConverter converter);
+
+#endif
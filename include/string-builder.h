@@ -0,0 +1,90 @@
+#ifndef STRING_BUILDER_H
+#define STRING_BUILDER_H
+
+#include <stdarg.h>
+#include "types.h"
+
+/*
+ * StringBuilder:
+ * This module builds a string by appending pieces to it, e.g. the URL or
+ * the body of a request.
+ * Its capacity doubles whenever it has to grow, so appending takes time
+ * proportional to the length of the piece appended, never to the length of
+ * the string built so far.
+ * If not enough memory was available to append a piece, the builder fails:
+ * the following appends are ignored and string_builder_finish returns null,
+ * so that callers only have to check for errors once.
+ */
+typedef struct string_builder *StringBuilder;
+
+/*
+ * new_string_builder:
+ * Returns a pointer to a new string_builder structure, holding an empty
+ * string.
+ * Returns null if not enough memory was available to create a new structure.
+ */
+StringBuilder new_string_builder(void);
+
+/*
+ * free_string_builder:
+ * Releases space taken by the string_builder structure and by the string
+ * it holds.
+ */
+void free_string_builder(StringBuilder builder);
+
+/*
+ * string_builder_append:
+ * Appends str to the string held by builder.
+ * Returns false if builder failed, else returns true.
+ */
+bool string_builder_append(StringBuilder builder, string str);
+
+/*
+ * string_builder_appendf:
+ * Appends the string formatted using format and the other arguments
+ * (see printf) to the string held by builder.
+ * Returns false if builder failed, else returns true.
+ */
+bool string_builder_appendf(StringBuilder builder, string format, ...);
+
+/*
+ * string_builder_vappendf:
+ * Equivalent to string_builder_appendf, the format's values being read
+ * from args.
+ */
+bool string_builder_vappendf(StringBuilder builder, string format,
+                             va_list args);
+
+/*
+ * string_builder_append_url:
+ * Appends str to the string held by builder, percent-encoding every
+ * character that isn't unreserved in a URL (i.e. anything but letters,
+ * digits, '-', '.', '_' and '~'), e.g. a space becomes "%20".
+ * Returns false if builder failed, else returns true.
+ */
+bool string_builder_append_url(StringBuilder builder, string str);
+
+/*
+ * string_builder_append_json:
+ * Appends str as a JSON string (i.e. between double quotes, with quotes,
+ * backslashes and control characters escaped) to the string held by
+ * builder, or appends null if str is a null pointer.
+ * Returns false if builder failed, else returns true.
+ */
+bool string_builder_append_json(StringBuilder builder, string str);
+
+/*
+ * string_builder_length:
+ * Returns the length of the string held by builder.
+ */
+size_t string_builder_length(StringBuilder builder);
+
+/*
+ * string_builder_finish:
+ * Releases space taken by the string_builder structure and returns
+ * the string it holds, which must be released by the caller using free.
+ * Returns null if builder failed.
+ */
+string string_builder_finish(StringBuilder builder);
+
+#endif
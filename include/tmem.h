@@ -1,6 +1,9 @@
 #ifndef TMEM_H
 #define TMEM_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
 /*
  * Type Structures Memory Allocation functions
  * Each function allocates the memory needed for the specified type structure.
@@ -19,6 +22,93 @@
  */
 void *talloc(void *(*new_type)(void));
 
+/*
+ * tmalloc:
+ * Allocates size bytes for a structure's field (e.g. a string or an array).
+ * Like the structures, the memory is taken from the current arena
+ * if one was started by talloc_begin_arena.
+ * Returns a pointer to the allocated memory, or a null pointer if not enough
+ * memory was available.
+ */
+void *tmalloc(size_t size);
+
+/*
+ * Type Structures Arenas
+ * Between a call of talloc_begin_arena and a call of talloc_end_arena,
+ * every structure allocated by the calling thread using one of the "new"
+ * allocation functions (or tmalloc) is taken from a single arena instead of
+ * being allocated individually.
+ * The structure passed to talloc_end_arena becomes the arena's root:
+ * calling its "free" deallocation function releases the whole arena at once.
+ * Calling a "free" deallocation function with any other structure of
+ * the arena does nothing, so existing code releasing each nested structure
+ * keeps working, but the structures mustn't be used after their root
+ * was released.
+ */
+
+/*
+ * talloc_begin_arena:
+ * Starts a new arena for the calling thread.
+ * Returns false if not enough memory was available, else returns true.
+ */
+bool talloc_begin_arena(void);
+
+/*
+ * talloc_end_arena:
+ * Ends the calling thread's arena and makes root its root structure.
+ * If root is null, releases the arena right away.
+ * Returns root.
+ */
+void *talloc_end_arena(void *root);
+
+/*
+ * talloc_share:
+ * Adds a reference to root, the root of an ended arena, so that its "free"
+ * deallocation function only releases the arena once it was called
+ * for every reference (the one returned by talloc_end_arena included).
+ * Returns false if root isn't the root of an ended arena, else returns true.
+ */
+bool talloc_share(void *root);
+
+/*
+ * talloc_keep:
+ * Makes ptr released using release along with the calling thread's
+ * current arena, e.g. the cJSON tree its structures still refer to.
+ * Returns false if the calling thread has no current arena or if not enough
+ * memory was available, in which case the caller keeps ownership of ptr,
+ * else returns true.
+ */
+bool talloc_keep(void *ptr, void (*release)(void *));
+
+/*
+ * talloc_reenter_arena:
+ * Makes the ended arena in which ptr was allocated the calling thread's
+ * current arena again, until talloc_leave_arena is called, so that
+ * structures added later to ptr are released along with it.
+ * The caller must make sure that no other thread allocates from the arena
+ * meanwhile.
+ * Returns false if ptr wasn't allocated in an arena, else returns true.
+ */
+bool talloc_reenter_arena(const void *ptr);
+
+/*
+ * talloc_leave_arena:
+ * Restores the calling thread's current arena as it was before
+ * talloc_reenter_arena was called.
+ */
+void talloc_leave_arena(void);
+
+/*
+ * talloc_swap_arena:
+ * Makes arena the calling thread's current arena, and returns the arena
+ * that was current before, or a null pointer if there was none.
+ * arena must be a null pointer or an arena returned by this function:
+ * an arena started by talloc_begin_arena can thus be set aside and made
+ * current again later, possibly by another thread, to be filled in several
+ * steps while other arenas are used meanwhile.
+ */
+void *talloc_swap_arena(void *arena);
+
 /*
  * new_album:
  * Allocates memory for an album structure and returns a pointer to it.
@@ -157,6 +247,8 @@ void tfree(void (*free_type)(void *type_struct_ptr), void *type_struct_ptr);
  * The first argument should be a pointer to the first element of an array.
  * The second argument should be a function that will release the memory of
  * its argument item. This function will be called for every item in array.
+ * Does nothing if array was allocated in an arena, as its items then
+ * belong to the same arena.
  */
 void free_array(void **array, void (*free_item)(void *item));
 
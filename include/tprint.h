@@ -158,7 +158,7 @@ void print_simplified_user_details(SimplifiedUser simplified_user);
 void print_simplified_user_essentials(SimplifiedUser simplified_user);
 
 
-FILE *print_stream;
+extern FILE *print_stream;
 
 
 #endif
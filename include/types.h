@@ -6,6 +6,15 @@
 
 typedef char *string;
 
+/*
+ * Spotify IDs of albums, artists, playlists and tracks are stored in place
+ * (see the "spotify-id" header): SPOTIFY_ID_LENGTH characters at most,
+ * padded with null characters up to SPOTIFY_ID_SIZE.
+ * Users' IDs are usernames of any length, thus stored as strings.
+ */
+#define SPOTIFY_ID_LENGTH 22
+#define SPOTIFY_ID_SIZE 24
+
 // API Types
 
 typedef struct album *Album;
@@ -30,12 +39,17 @@ typedef struct followers {
   size_t total;
 } *Followers;
 
+/*
+ * count is the number of items held by the page (total being the number of
+ * items of every page), so that it can be read without walking items.
+ */
 typedef struct page {
   string href;
   size_t limit;
   string next;
   size_t total;
   void *items;
+  size_t count;
 } *Page;
 
 typedef struct restrictions {
@@ -55,7 +69,7 @@ typedef struct search {
 struct album {
   string album_type;
   size_t total_tracks;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   string name;
   string release_date;
   Restrictions restrictions;
@@ -68,7 +82,7 @@ struct simplified_album {
   string album_type;
   size_t total_tracks;
   string href;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   string name;
   string release_date;
   Restrictions restrictions;
@@ -86,14 +100,14 @@ struct saved_album {
 struct artist {
   Followers followers;
   string *genres;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   string name;
   size_t popularity;
 };
 
 struct simplified_artist {
   string href;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   string name;
 };
 
@@ -102,7 +116,7 @@ struct simplified_artist {
 
 struct playlist {
   string description;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   string name;
   SimplifiedUser owner; 
   bool public;
@@ -113,7 +127,7 @@ struct playlist {
 struct simplified_playlist {
   string description;
   string href;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   string name;
   SimplifiedUser owner;
   bool public;
@@ -136,21 +150,27 @@ struct playlist_track {
 
 // Tracks
 
+/*
+ * A track converted lazily (see cJSON_begin_lazy) keeps in pending the cJSON
+ * object it was converted from until its album, artists and restrictions
+ * are first read through track_album, track_artists and track_restrictions.
+ */
 struct track {
   SimplifiedAlbum album;
   SimplifiedArtist *artists;
   size_t duration_ms;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   Restrictions restrictions;
   string name;
   size_t popularity;
+  void *pending;
 };
 
 struct simplified_track {
   SimplifiedArtist *artists;
   size_t duration_ms;
   string href;
-  string id;
+  char id[SPOTIFY_ID_SIZE];
   Restrictions restrictions;
   string name;
 };
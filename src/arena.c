@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "arena.h"
+
+#define CHUNK_SHIFT 14
+#define CHUNK_SIZE ((size_t) 1 << CHUNK_SHIFT)
+#define ALIGNMENT _Alignof(max_align_t)
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+#define ALIGN_CHUNK(size) (((size) + CHUNK_SIZE - 1) & ~(CHUNK_SIZE - 1))
+#define ADDRESS_BITS 48
+#define LEAF_BITS 16
+#define ROOT_BITS (ADDRESS_BITS - CHUNK_SHIFT - LEAF_BITS)
+#define LEAF_MASK (((size_t) 1 << LEAF_BITS) - 1)
+
+/*
+ * chunk:
+ * A block of memory from which allocations are made, aligned on and
+ * spanning a multiple of CHUNK_SIZE bytes.
+ * size is the number of bytes available in data, used the number of bytes
+ * already handed out, and next the chunk that was filled before this one.
+ */
+struct chunk {
+  struct chunk *next;
+  size_t size;
+  size_t used;
+  _Alignas(max_align_t) unsigned char data[];
+};
+
+/*
+ * arena:
+ * chunks is the list of the arena's chunks, the most recent one first,
+ * and owner the pointer given to arena_set_owner.
+ */
+struct arena {
+  struct chunk *chunks;
+  void *owner;
+};
+
+/*
+ * chunk_map:
+ * Map from the CHUNK_SIZE-aligned blocks of the address space to the arena
+ * whose chunk covers them, so that arena_of never walks the chunks nor
+ * takes a lock. It has two levels indexed by the block's number, the leaves
+ * being allocated the first time one of their blocks is used and never
+ * released (like the arena's first chunk, they are reused).
+ */
+static _Atomic(_Atomic(Arena) *) chunk_map[(size_t) 1 << ROOT_BITS];
+
+/*
+ * new_chunk:
+ * Allocates a chunk able to hold at least size bytes and pushes it
+ * in front of arena's chunks.
+ * Returns the new chunk, or null if not enough memory was available.
+ */
+static struct chunk *new_chunk(Arena arena, size_t size);
+
+/*
+ * free_chunk:
+ * Removes chunk from the chunk map and releases it.
+ */
+static void free_chunk(struct chunk *chunk);
+
+/*
+ * map_chunk:
+ * Makes the chunk map point every block covered by chunk to arena
+ * (which can be null to remove chunk from the map).
+ * Returns false if not enough memory was available, else returns true.
+ */
+static bool map_chunk(struct chunk *chunk, Arena arena);
+
+/*
+ * find_slot:
+ * Returns a pointer to the entry of the chunk map for the block containing
+ * address, allocating its leaf if create is true.
+ * Returns a null pointer if address is out of the map's range, if the leaf
+ * doesn't exist and create is false or if not enough memory was available.
+ */
+static _Atomic(Arena) *find_slot(uintptr_t address, bool create);
+
+Arena new_arena(void) {
+  Arena arena = malloc(sizeof(struct arena));
+  if (arena == NULL) return arena;
+  arena->chunks = NULL;
+  arena->owner = NULL;
+  return arena;
+}
+
+void free_arena(Arena arena) {
+  if (arena == NULL) return;
+  struct chunk *chunk = arena->chunks;
+  while (chunk != NULL) {
+    struct chunk *next = chunk->next;
+    free_chunk(chunk);
+    chunk = next;
+  }
+  free(arena);
+}
+
+void *arena_alloc(Arena arena, size_t size) {
+  size = ALIGN(size ? size : 1);
+  struct chunk *chunk = arena->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    chunk = new_chunk(arena, size);
+    if (chunk == NULL) return NULL;
+  }
+  void *ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+void arena_reset(Arena arena) {
+  struct chunk *chunk = arena->chunks;
+  if (chunk == NULL) return;
+  while (chunk->next != NULL) {
+    struct chunk *next = chunk->next;
+    free_chunk(chunk);
+    chunk = next;
+  }
+  chunk->used = 0;
+  arena->chunks = chunk;
+}
+
+bool arena_owns(Arena arena, const void *ptr) {
+  uintptr_t address = (uintptr_t) ptr;
+  for (struct chunk *chunk = arena->chunks; chunk != NULL;
+       chunk = chunk->next) {
+    uintptr_t start = (uintptr_t) chunk->data;
+    if (address >= start && address < start + chunk->used) return true;
+  }
+  return false;
+}
+
+Arena arena_of(const void *ptr) {
+  _Atomic(Arena) *slot = find_slot((uintptr_t) ptr, false);
+  return slot != NULL ? atomic_load_explicit(slot, memory_order_acquire)
+                      : NULL;
+}
+
+void arena_set_owner(Arena arena, void *owner) {
+  arena->owner = owner;
+}
+
+void *arena_owner(Arena arena) {
+  return arena->owner;
+}
+
+static struct chunk *new_chunk(Arena arena, size_t size) {
+  size_t total_size = ALIGN_CHUNK(sizeof(struct chunk) + size);
+  struct chunk *chunk = aligned_alloc(CHUNK_SIZE, total_size);
+  if (chunk == NULL) return chunk;
+  chunk->size = total_size - sizeof(struct chunk);
+  if (!map_chunk(chunk, arena)) {
+    free_chunk(chunk);
+    return NULL;
+  }
+  chunk->used = 0;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+  return chunk;
+}
+
+static void free_chunk(struct chunk *chunk) {
+  map_chunk(chunk, NULL);
+  free(chunk);
+}
+
+static bool map_chunk(struct chunk *chunk, Arena arena) {
+  uintptr_t start = (uintptr_t) chunk;
+  uintptr_t end = start + sizeof(struct chunk) + chunk->size;
+  for (uintptr_t address = start; address < end; address += CHUNK_SIZE) {
+    _Atomic(Arena) *slot = find_slot(address, arena != NULL);
+    if (slot != NULL) {
+      atomic_store_explicit(slot, arena, memory_order_release);
+    } else if (arena != NULL) return false;
+  }
+  return true;
+}
+
+static _Atomic(Arena) *find_slot(uintptr_t address, bool create) {
+  if (address >> ADDRESS_BITS) return NULL;
+  uintptr_t block = address >> CHUNK_SHIFT;
+  _Atomic(_Atomic(Arena) *) *root = &chunk_map[block >> LEAF_BITS];
+  _Atomic(Arena) *leaf = atomic_load_explicit(root, memory_order_acquire);
+  if (leaf == NULL && create) {
+    _Atomic(Arena) *new_leaf = calloc(LEAF_MASK + 1, sizeof(_Atomic(Arena)));
+    if (new_leaf == NULL) return NULL;
+    if (atomic_compare_exchange_strong_explicit(root, &leaf, new_leaf,
+                                                memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      leaf = new_leaf;
+    } else free(new_leaf);
+  }
+  return leaf != NULL ? &leaf[block & LEAF_MASK] : NULL;
+}
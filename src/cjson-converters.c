@@ -1,34 +1,162 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "ptrarray.h"
 #include "tmem.h"
+#include "spotify-id.h"
+#include "intern.h"
 #include "cjson-converters.h"
 
 #define cJSON_to_number(cJSON_number) ((cJSON_number)->valueint)
 
 /*
- * cJSON_get_item_safe:
- * Searches an item inside cJSON_object that has a key of key.
- * If an item is found, check that it has the expected type using
- * the function pointed by cJSON_isType.
- * If the item has the expected type, returns it.
- * If any error occurs or any condition isn't met, terminates program.
+ * lazy:
+ * Whether cJSON_to_track converts tracks lazily for the calling thread
+ * (see cJSON_begin_lazy).
+ * lazy_lock serializes the conversion of the lazy tracks' members, which
+ * also reenters the arenas the tracks were allocated in.
  */
-static cJSON *get_cJSON_item_safe(cJSON *cJSON_object, string key, 
-                            int (*cJSON_IsType)(const cJSON *));
+static _Thread_local bool lazy = false;
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define FIELDS_SLOTS 32
+
+/*
+ * field:
+ * A field read by a converter.
+ * cJSON_IsType checks the type of the field's item; if null, the item only
+ * has to be present. An optional field is neither required nor checked.
+ */
+struct field {
+  string key;
+  int (*cJSON_IsType)(const cJSON *);
+  bool optional;
+};
+
+/*
+ * fields:
+ * The fields read by a converter, and a perfect hash of their keys:
+ * slots maps the hash of a key, seeded with seed, to its index in list
+ * plus one, or to 0 if no field has this hash.
+ * The seed is chosen beforehand, when the table is written, and the slots
+ * are filled on the first use of the table (see build_fields).
+ */
+struct fields {
+  const struct field *list;
+  size_t count;
+  uint32_t seed;
+  unsigned char slots[FIELDS_SLOTS];
+  atomic_bool ready;
+};
+
+/*
+ * FIELDS:
+ * Initializer of a fields table listing fields_count fields, whose keys
+ * have different slots for fields_seed.
+ * Each table comes with an enum naming the index of each of its fields,
+ * whose last member is fields_count. The enum designates the fields in
+ * the table and the items filled by read_fields.
+ */
+#define FIELDS(fields_count, fields_seed, ...) { \
+  .list = (const struct field [fields_count]) { __VA_ARGS__ }, \
+  .count = fields_count, \
+  .seed = fields_seed, \
+}
+
+/*
+ * read_fields:
+ * Stores in items the item of each field of fields, at the field's index,
+ * going once over the children of cJSON_object. Children whose key isn't
+ * one of the fields are skipped. Missing optional fields are set to null.
+ * If cJSON_object isn't an object, or if a field that isn't optional is
+ * missing or hasn't the expected type, terminates program.
+ */
+static void read_fields(cJSON *cJSON_object, struct fields *fields,
+                        cJSON **items);
+
+/*
+ * build_fields:
+ * Fills fields' slots using fields' seed. Terminates program if two keys
+ * of fields have the same slot, which means that another seed has to be
+ * chosen for the table.
+ */
+static void build_fields(struct fields *fields);
+
+/*
+ * hash_key:
+ * Returns the slot of key for the given seed, hashing (FNV-1a) its length
+ * and its first, middle and last characters only: keys sharing them are
+ * told apart by the comparison following the lookup.
+ */
+static size_t hash_key(string key, uint32_t seed);
+
+/*
+ * convert_track_members:
+ * Converts the album, artists and restrictions of track.
+ */
+static void convert_track_members(Track track, cJSON *cJSON_album,
+                                  cJSON *cJSON_artists,
+                                  cJSON *cJSON_restrictions);
+
+/*
+ * materialize_track:
+ * Converts the members of track that were left pending by a lazy
+ * conversion, allocating them in the arena of track if it has one.
+ */
+static void materialize_track(Track track);
+
+/*
+ * cJSON_to_sized_array:
+ * Same as cJSON_to_array, but also returns the length of the array.
+ */
+static SizedArray cJSON_to_sized_array(cJSON *cJSON_array,
+                                       void *(*cJSON_to_item_type)(cJSON *));
+
+/*
+ * delete_cJSON:
+ * Deletes cJSON_item, as a release function of talloc_keep.
+ */
+static void delete_cJSON(void *cJSON_item);
+
 /*
  * cJSON_to_string:
- * Copy cJSON_string's value into a new string.
+ * Copy cJSON_string's value into a new string, allocated using tmalloc.
  * Returns a pointer to the first character of the string if no error occurred,
  * else terminates program.
  */
 static void *cJSON_to_string(cJSON *cJSON_string);
 
+/*
+ * cJSON_to_interned_string:
+ * Returns the interned copy of cJSON_string's value (see the "intern"
+ * header), used for the fields taking few distinct values, repeated across
+ * many structures (albums' types, artists' genres and the names of
+ * the artists credited on albums and tracks).
+ * Terminates program if not enough memory was available.
+ */
+static void *cJSON_to_interned_string(cJSON *cJSON_string);
+
+/*
+ * cJSON_to_id:
+ * Copies cJSON_id's value into id, an id field of a type structure
+ * (see spotify_id_copy).
+ * Terminates program if the value isn't a valid Spotify ID.
+ */
+static void cJSON_to_id(cJSON *cJSON_id, char *id);
+
 void **cJSON_to_array(cJSON *cJSON_array,
                       void *(*cJSON_to_item_type)(cJSON *item)) {
+  return cJSON_to_sized_array(cJSON_array, cJSON_to_item_type).items;
+}
+
+static SizedArray cJSON_to_sized_array(cJSON *cJSON_array,
+                                       void *(*cJSON_to_item_type)(cJSON *)) {
   END_IF(!cJSON_IsArray(cJSON_array));
   PtrArray ptr_array = new_ptr_array();
-  END_IF(IS_NULL(ptr_array));
+  END_IF(IS_NULL(ptr_array) ||
+         !reserve_ptr_array(ptr_array, cJSON_GetArraySize(cJSON_array)));
   cJSON *cJSON_item = NULL;
   int i = 0;
   cJSON_ArrayForEach(cJSON_item, cJSON_array) {
@@ -38,31 +166,47 @@ void **cJSON_to_array(cJSON *cJSON_array,
       END_IF(add_item(ptr_array, item) != ++i);
     }
   }
-  void **array = get_array(ptr_array);
-  free_ptr_array(ptr_array, false, NULL);
+  SizedArray array = copy_array(ptr_array, tmalloc);
+  END_IF(IS_NULL(array.items));
+  free_ptr_array(ptr_array, true, NULL);
   return array;
 }
 
+enum album_field {
+  ALBUM_ALBUM_TYPE, ALBUM_TOTAL_TRACKS, ALBUM_ID, ALBUM_NAME,
+  ALBUM_RELEASE_DATE, ALBUM_RESTRICTIONS, ALBUM_ARTISTS, ALBUM_TRACKS,
+  ALBUM_POPULARITY, ALBUM_FIELDS_COUNT
+};
+
+static struct fields album_fields = FIELDS(
+  ALBUM_FIELDS_COUNT, 3,
+  [ALBUM_ALBUM_TYPE] = { "album_type", cJSON_IsString, false },
+  [ALBUM_TOTAL_TRACKS] = { "total_tracks", cJSON_IsNumber, false },
+  [ALBUM_ID] = { "id", cJSON_IsString, false },
+  [ALBUM_NAME] = { "name", cJSON_IsString, false },
+  [ALBUM_RELEASE_DATE] = { "release_date", cJSON_IsString, false },
+  [ALBUM_RESTRICTIONS] = { "restrictions", NULL, true },
+  [ALBUM_ARTISTS] = { "artists", cJSON_IsArray, false },
+  [ALBUM_TRACKS] = { "tracks", cJSON_IsObject, false },
+  [ALBUM_POPULARITY] = { "popularity", cJSON_IsNumber, false }
+);
 
 void *cJSON_to_album(cJSON *cJSON_album) {
   END_IF(!cJSON_IsObject(cJSON_album));
   Album album = talloc(new_album);
   END_IF(IS_NULL(album));
 
-  cJSON *cJSON_album_type = 
-    get_cJSON_item_safe(cJSON_album, "album_type", cJSON_IsString),
-  *cJSON_total_tracks = 
-    get_cJSON_item_safe(cJSON_album, "total_tracks", cJSON_IsNumber),
-  *cJSON_id = get_cJSON_item_safe(cJSON_album, "id", cJSON_IsString),
-  *cJSON_name = get_cJSON_item_safe(cJSON_album, "name", cJSON_IsString),
-  *cJSON_release_date =
-    get_cJSON_item_safe(cJSON_album, "release_date", cJSON_IsString),
-  *cJSON_restrictions = 
-    cJSON_GetObjectItemCaseSensitive(cJSON_album, "restrictions"),
-  *cJSON_artists = get_cJSON_item_safe(cJSON_album, "artists", cJSON_IsArray),
-  *cJSON_tracks = get_cJSON_item_safe(cJSON_album, "tracks", cJSON_IsObject),
-  *cJSON_popularity =
-    get_cJSON_item_safe(cJSON_album, "popularity", cJSON_IsNumber);
+  cJSON *items[ALBUM_FIELDS_COUNT];
+  read_fields(cJSON_album, &album_fields, items);
+  cJSON *cJSON_album_type = items[ALBUM_ALBUM_TYPE],
+        *cJSON_total_tracks = items[ALBUM_TOTAL_TRACKS],
+        *cJSON_id = items[ALBUM_ID],
+        *cJSON_name = items[ALBUM_NAME],
+        *cJSON_release_date = items[ALBUM_RELEASE_DATE],
+        *cJSON_restrictions = items[ALBUM_RESTRICTIONS],
+        *cJSON_artists = items[ALBUM_ARTISTS],
+        *cJSON_tracks = items[ALBUM_TRACKS],
+        *cJSON_popularity = items[ALBUM_POPULARITY];
 
   album->restrictions = cJSON_IsObject(cJSON_restrictions) 
     ? cJSON_to_restrictions(cJSON_restrictions) 
@@ -74,8 +218,8 @@ void *cJSON_to_album(cJSON *cJSON_album) {
 
   album->tracks = cJSON_to_page(cJSON_tracks, cJSON_to_simplified_track);
 
-  album->album_type = cJSON_to_string(cJSON_album_type); 
-  album->id = cJSON_to_string(cJSON_id);
+  album->album_type = cJSON_to_interned_string(cJSON_album_type); 
+  cJSON_to_id(cJSON_id, album->id);
   album->name = cJSON_to_string(cJSON_name);
   album->release_date = cJSON_to_string(cJSON_release_date);
   
@@ -85,29 +229,40 @@ void *cJSON_to_album(cJSON *cJSON_album) {
   return album;
 }
 
+enum simplified_album_field {
+  SIMPLIFIED_ALBUM_ALBUM_TYPE, SIMPLIFIED_ALBUM_TOTAL_TRACKS,
+  SIMPLIFIED_ALBUM_HREF, SIMPLIFIED_ALBUM_ID, SIMPLIFIED_ALBUM_NAME,
+  SIMPLIFIED_ALBUM_RELEASE_DATE, SIMPLIFIED_ALBUM_RESTRICTIONS,
+  SIMPLIFIED_ALBUM_ARTISTS, SIMPLIFIED_ALBUM_FIELDS_COUNT
+};
+
+static struct fields simplified_album_fields = FIELDS(
+  SIMPLIFIED_ALBUM_FIELDS_COUNT, 2,
+  [SIMPLIFIED_ALBUM_ALBUM_TYPE] = { "album_type", cJSON_IsString, false },
+  [SIMPLIFIED_ALBUM_TOTAL_TRACKS] = { "total_tracks", cJSON_IsNumber, false },
+  [SIMPLIFIED_ALBUM_HREF] = { "href", cJSON_IsString, false },
+  [SIMPLIFIED_ALBUM_ID] = { "id", cJSON_IsString, false },
+  [SIMPLIFIED_ALBUM_NAME] = { "name", cJSON_IsString, false },
+  [SIMPLIFIED_ALBUM_RELEASE_DATE] = { "release_date", cJSON_IsString, false },
+  [SIMPLIFIED_ALBUM_RESTRICTIONS] = { "restrictions", NULL, true },
+  [SIMPLIFIED_ALBUM_ARTISTS] = { "artists", cJSON_IsArray, false }
+);
+
 void *cJSON_to_simplified_album(cJSON *cJSON_simplified_album) {
   END_IF(!cJSON_IsObject(cJSON_simplified_album));
   SimplifiedAlbum simplified_album = talloc(new_simplified_album);
   END_IF(IS_NULL(simplified_album));
 
-  cJSON *cJSON_album_type =
-    get_cJSON_item_safe(cJSON_simplified_album, "album_type", cJSON_IsString),
-  *cJSON_total_tracks =
-    get_cJSON_item_safe(cJSON_simplified_album, "total_tracks",
-                        cJSON_IsNumber),
-  *cJSON_href =
-    get_cJSON_item_safe(cJSON_simplified_album, "href", cJSON_IsString),
-  *cJSON_id =
-    get_cJSON_item_safe(cJSON_simplified_album, "id", cJSON_IsString),
-  *cJSON_name =
-    get_cJSON_item_safe(cJSON_simplified_album, "name", cJSON_IsString),
-  *cJSON_release_date =
-    get_cJSON_item_safe(cJSON_simplified_album, "release_date",
-                        cJSON_IsString),
-  *cJSON_restrictions = 
-    cJSON_GetObjectItemCaseSensitive(cJSON_simplified_album, "restrictions"),
-  *cJSON_artists =
-    get_cJSON_item_safe(cJSON_simplified_album, "artists", cJSON_IsArray);
+  cJSON *items[SIMPLIFIED_ALBUM_FIELDS_COUNT];
+  read_fields(cJSON_simplified_album, &simplified_album_fields, items);
+  cJSON *cJSON_album_type = items[SIMPLIFIED_ALBUM_ALBUM_TYPE],
+        *cJSON_total_tracks = items[SIMPLIFIED_ALBUM_TOTAL_TRACKS],
+        *cJSON_href = items[SIMPLIFIED_ALBUM_HREF],
+        *cJSON_id = items[SIMPLIFIED_ALBUM_ID],
+        *cJSON_name = items[SIMPLIFIED_ALBUM_NAME],
+        *cJSON_release_date = items[SIMPLIFIED_ALBUM_RELEASE_DATE],
+        *cJSON_restrictions = items[SIMPLIFIED_ALBUM_RESTRICTIONS],
+        *cJSON_artists = items[SIMPLIFIED_ALBUM_ARTISTS];
 
   simplified_album->restrictions = cJSON_IsObject(cJSON_restrictions)
     ? cJSON_to_restrictions(cJSON_restrictions)
@@ -117,9 +272,9 @@ void *cJSON_to_simplified_album(cJSON *cJSON_simplified_album) {
     (SimplifiedArtist *) cJSON_to_array(cJSON_artists,
                                         cJSON_to_simplified_artist);
 
-  simplified_album->album_type = cJSON_to_string(cJSON_album_type);
+  simplified_album->album_type = cJSON_to_interned_string(cJSON_album_type);
   simplified_album->href = cJSON_to_string(cJSON_href);
-  simplified_album->id = cJSON_to_string(cJSON_id);
+  cJSON_to_id(cJSON_id, simplified_album->id);
   simplified_album->name = cJSON_to_string(cJSON_name);
   simplified_album->release_date = cJSON_to_string(cJSON_release_date);
 
@@ -128,15 +283,25 @@ void *cJSON_to_simplified_album(cJSON *cJSON_simplified_album) {
   return simplified_album;
 }
 
+enum saved_album_field {
+  SAVED_ALBUM_ADDED_AT, SAVED_ALBUM_ALBUM, SAVED_ALBUM_FIELDS_COUNT
+};
+
+static struct fields saved_album_fields = FIELDS(
+  SAVED_ALBUM_FIELDS_COUNT, 0,
+  [SAVED_ALBUM_ADDED_AT] = { "added_at", cJSON_IsString, false },
+  [SAVED_ALBUM_ALBUM] = { "album", cJSON_IsObject, false }
+);
+
 void *cJSON_to_saved_album(cJSON *cJSON_saved_album) {
   END_IF(!cJSON_IsObject(cJSON_saved_album));
   SavedAlbum saved_album = talloc(new_saved_album);
   END_IF(IS_NULL(saved_album));
 
-  cJSON *cJSON_added_at =
-    get_cJSON_item_safe(cJSON_saved_album, "added_at", cJSON_IsString),
-  *cJSON_album = 
-    get_cJSON_item_safe(cJSON_saved_album, "album", cJSON_IsObject);
+  cJSON *items[SAVED_ALBUM_FIELDS_COUNT];
+  read_fields(cJSON_saved_album, &saved_album_fields, items);
+  cJSON *cJSON_added_at = items[SAVED_ALBUM_ADDED_AT],
+        *cJSON_album = items[SAVED_ALBUM_ALBUM];
 
   saved_album->album = cJSON_to_album(cJSON_album);
 
@@ -145,24 +310,38 @@ void *cJSON_to_saved_album(cJSON *cJSON_saved_album) {
   return saved_album;
 }
 
+enum artist_field {
+  ARTIST_FOLLOWERS, ARTIST_GENRES, ARTIST_ID, ARTIST_NAME, ARTIST_POPULARITY,
+  ARTIST_FIELDS_COUNT
+};
+
+static struct fields artist_fields = FIELDS(
+  ARTIST_FIELDS_COUNT, 0,
+  [ARTIST_FOLLOWERS] = { "followers", cJSON_IsObject, false },
+  [ARTIST_GENRES] = { "genres", cJSON_IsArray, false },
+  [ARTIST_ID] = { "id", cJSON_IsString, false },
+  [ARTIST_NAME] = { "name", cJSON_IsString, false },
+  [ARTIST_POPULARITY] = { "popularity", cJSON_IsNumber, false }
+);
+
 void *cJSON_to_artist(cJSON *cJSON_artist) {
   END_IF(!cJSON_IsObject(cJSON_artist));
   Artist artist = talloc(new_artist);
   END_IF(IS_NULL(artist));
 
-  cJSON *cJSON_followers =
-    get_cJSON_item_safe(cJSON_artist, "followers", cJSON_IsObject),
-  *cJSON_genres = get_cJSON_item_safe(cJSON_artist, "genres", cJSON_IsArray),
-  *cJSON_id = get_cJSON_item_safe(cJSON_artist, "id", cJSON_IsString),
-  *cJSON_name = get_cJSON_item_safe(cJSON_artist, "name", cJSON_IsString),
-  *cJSON_popularity = 
-    get_cJSON_item_safe(cJSON_artist, "popularity", cJSON_IsNumber);
+  cJSON *items[ARTIST_FIELDS_COUNT];
+  read_fields(cJSON_artist, &artist_fields, items);
+  cJSON *cJSON_followers = items[ARTIST_FOLLOWERS],
+        *cJSON_genres = items[ARTIST_GENRES],
+        *cJSON_id = items[ARTIST_ID],
+        *cJSON_name = items[ARTIST_NAME],
+        *cJSON_popularity = items[ARTIST_POPULARITY];
 
   artist->followers = cJSON_to_followers(cJSON_followers);
   artist->genres = 
-    (string *) cJSON_to_array(cJSON_genres, cJSON_to_string);
+    (string *) cJSON_to_array(cJSON_genres, cJSON_to_interned_string);
 
-  artist->id = cJSON_to_string(cJSON_id);
+  cJSON_to_id(cJSON_id, artist->id);
   artist->name = cJSON_to_string(cJSON_name);
 
   artist->popularity = cJSON_to_number(cJSON_popularity);
@@ -171,42 +350,66 @@ void *cJSON_to_artist(cJSON *cJSON_artist) {
 }
 
 
+enum simplified_artist_field {
+  SIMPLIFIED_ARTIST_HREF, SIMPLIFIED_ARTIST_ID, SIMPLIFIED_ARTIST_NAME,
+  SIMPLIFIED_ARTIST_FIELDS_COUNT
+};
+
+static struct fields simplified_artist_fields = FIELDS(
+  SIMPLIFIED_ARTIST_FIELDS_COUNT, 0,
+  [SIMPLIFIED_ARTIST_HREF] = { "href", cJSON_IsString, false },
+  [SIMPLIFIED_ARTIST_ID] = { "id", cJSON_IsString, false },
+  [SIMPLIFIED_ARTIST_NAME] = { "name", cJSON_IsString, false }
+);
+
 void *cJSON_to_simplified_artist(cJSON *cJSON_simplified_artist) {
   END_IF(!cJSON_IsObject(cJSON_simplified_artist));
   SimplifiedArtist simplified_artist = talloc(new_simplified_artist);
   END_IF(IS_NULL(simplified_artist));
 
-  cJSON *cJSON_href = 
-    get_cJSON_item_safe(cJSON_simplified_artist, "href", cJSON_IsString),
-  *cJSON_id = 
-    get_cJSON_item_safe(cJSON_simplified_artist, "id", cJSON_IsString),
-  *cJSON_name =
-    get_cJSON_item_safe(cJSON_simplified_artist, "name", cJSON_IsString);
+  cJSON *items[SIMPLIFIED_ARTIST_FIELDS_COUNT];
+  read_fields(cJSON_simplified_artist, &simplified_artist_fields, items);
+  cJSON *cJSON_href = items[SIMPLIFIED_ARTIST_HREF],
+        *cJSON_id = items[SIMPLIFIED_ARTIST_ID],
+        *cJSON_name = items[SIMPLIFIED_ARTIST_NAME];
 
   simplified_artist->href = cJSON_to_string(cJSON_href);
-  simplified_artist->id = cJSON_to_string(cJSON_id);
-  simplified_artist->name = cJSON_to_string(cJSON_name);
+  cJSON_to_id(cJSON_id, simplified_artist->id);
+  simplified_artist->name = cJSON_to_interned_string(cJSON_name);
 
   return simplified_artist;
 }
 
+enum playlist_field {
+  PLAYLIST_DESCRIPTION, PLAYLIST_ID, PLAYLIST_NAME, PLAYLIST_OWNER,
+  PLAYLIST_PUBLIC, PLAYLIST_SNAPSHOT_ID, PLAYLIST_TRACKS, PLAYLIST_FIELDS_COUNT
+};
+
+static struct fields playlist_fields = FIELDS(
+  PLAYLIST_FIELDS_COUNT, 1,
+  [PLAYLIST_DESCRIPTION] = { "description", NULL, true },
+  [PLAYLIST_ID] = { "id", cJSON_IsString, false },
+  [PLAYLIST_NAME] = { "name", cJSON_IsString, false },
+  [PLAYLIST_OWNER] = { "owner", cJSON_IsObject, false },
+  [PLAYLIST_PUBLIC] = { "public", NULL, false },
+  [PLAYLIST_SNAPSHOT_ID] = { "snapshot_id", cJSON_IsString, false },
+  [PLAYLIST_TRACKS] = { "tracks", cJSON_IsObject, false }
+);
+
 void *cJSON_to_playlist(cJSON *cJSON_playlist) {
   END_IF(!cJSON_IsObject(cJSON_playlist));
   Playlist playlist = talloc(new_playlist);
   END_IF(IS_NULL(playlist));
 
-  cJSON *cJSON_description =
-    cJSON_GetObjectItemCaseSensitive(cJSON_playlist, "description"),
-  *cJSON_id = get_cJSON_item_safe(cJSON_playlist, "id", cJSON_IsString),
-  *cJSON_name = get_cJSON_item_safe(cJSON_playlist, "name", cJSON_IsString),
-  *cJSON_owner =
-    get_cJSON_item_safe(cJSON_playlist, "owner", cJSON_IsObject),
-  *cJSON_public =
-    get_cJSON_item_safe(cJSON_playlist, "public", NULL),
-  *cJSON_snapshot_id =
-    get_cJSON_item_safe(cJSON_playlist, "snapshot_id", cJSON_IsString),
-  *cJSON_tracks =
-    get_cJSON_item_safe(cJSON_playlist, "tracks", cJSON_IsObject);
+  cJSON *items[PLAYLIST_FIELDS_COUNT];
+  read_fields(cJSON_playlist, &playlist_fields, items);
+  cJSON *cJSON_description = items[PLAYLIST_DESCRIPTION],
+        *cJSON_id = items[PLAYLIST_ID],
+        *cJSON_name = items[PLAYLIST_NAME],
+        *cJSON_owner = items[PLAYLIST_OWNER],
+        *cJSON_public = items[PLAYLIST_PUBLIC],
+        *cJSON_snapshot_id = items[PLAYLIST_SNAPSHOT_ID],
+        *cJSON_tracks = items[PLAYLIST_TRACKS];
 
   playlist->owner = cJSON_to_simplified_user(cJSON_owner);
   playlist->tracks = cJSON_to_page(cJSON_tracks, cJSON_to_playlist_track);
@@ -214,7 +417,7 @@ void *cJSON_to_playlist(cJSON *cJSON_playlist) {
   playlist->description = cJSON_IsString(cJSON_description)
     ? cJSON_to_string(cJSON_description)
     : NULL;
-  playlist->id = cJSON_to_string(cJSON_id);
+  cJSON_to_id(cJSON_id, playlist->id);
   playlist->name = cJSON_to_string(cJSON_name);
   playlist->snapshot_id = cJSON_to_string(cJSON_snapshot_id);
 
@@ -223,38 +426,60 @@ void *cJSON_to_playlist(cJSON *cJSON_playlist) {
   return playlist;
 }
 
+enum simplified_playlist_field {
+  SIMPLIFIED_PLAYLIST_DESCRIPTION, SIMPLIFIED_PLAYLIST_HREF,
+  SIMPLIFIED_PLAYLIST_ID, SIMPLIFIED_PLAYLIST_NAME, SIMPLIFIED_PLAYLIST_OWNER,
+  SIMPLIFIED_PLAYLIST_PUBLIC, SIMPLIFIED_PLAYLIST_SNAPSHOT_ID,
+  SIMPLIFIED_PLAYLIST_TRACKS, SIMPLIFIED_PLAYLIST_FIELDS_COUNT
+};
+
+static struct fields simplified_playlist_fields = FIELDS(
+  SIMPLIFIED_PLAYLIST_FIELDS_COUNT, 1,
+  [SIMPLIFIED_PLAYLIST_DESCRIPTION] = { "description", NULL, true },
+  [SIMPLIFIED_PLAYLIST_HREF] = { "href", cJSON_IsString, false },
+  [SIMPLIFIED_PLAYLIST_ID] = { "id", cJSON_IsString, false },
+  [SIMPLIFIED_PLAYLIST_NAME] = { "name", cJSON_IsString, false },
+  [SIMPLIFIED_PLAYLIST_OWNER] = { "owner", cJSON_IsObject, false },
+  [SIMPLIFIED_PLAYLIST_PUBLIC] = { "public", NULL, false },
+  [SIMPLIFIED_PLAYLIST_SNAPSHOT_ID] = { "snapshot_id", cJSON_IsString, false },
+  [SIMPLIFIED_PLAYLIST_TRACKS] = { "tracks", cJSON_IsObject, false }
+);
+
+enum playlist_tracks_field {
+  PLAYLIST_TRACKS_HREF, PLAYLIST_TRACKS_TOTAL, PLAYLIST_TRACKS_FIELDS_COUNT
+};
+
+static struct fields playlist_tracks_fields = FIELDS(
+  PLAYLIST_TRACKS_FIELDS_COUNT, 0,
+  [PLAYLIST_TRACKS_HREF] = { "href", cJSON_IsString, false },
+  [PLAYLIST_TRACKS_TOTAL] = { "total", cJSON_IsNumber, false }
+);
+
 void *cJSON_to_simplified_playlist(cJSON *cJSON_simplified_playlist) {
   END_IF(!cJSON_IsObject(cJSON_simplified_playlist));
   SimplifiedPlaylist simplified_playlist = talloc(new_simplified_playlist);
   END_IF(IS_NULL(simplified_playlist));
 
-  cJSON *cJSON_description =
-    cJSON_GetObjectItemCaseSensitive(cJSON_simplified_playlist, "description"),
-  *cJSON_href = 
-    get_cJSON_item_safe(cJSON_simplified_playlist, "href", cJSON_IsString),
-  *cJSON_id =
-    get_cJSON_item_safe(cJSON_simplified_playlist, "id", cJSON_IsString),
-  *cJSON_name =
-    get_cJSON_item_safe(cJSON_simplified_playlist, "name", cJSON_IsString),
-  *cJSON_owner =
-    get_cJSON_item_safe(cJSON_simplified_playlist, "owner", cJSON_IsObject),
-  *cJSON_public =
-    get_cJSON_item_safe(cJSON_simplified_playlist, "public", NULL),
-  *cJSON_snapshot_id =
-    get_cJSON_item_safe(cJSON_simplified_playlist, "snapshot_id",
-                        cJSON_IsString),
-  *cJSON_tracks =
-    get_cJSON_item_safe(cJSON_simplified_playlist, "tracks", cJSON_IsObject);
-  cJSON *cJSON_tracks_href =
-    get_cJSON_item_safe(cJSON_tracks, "href", cJSON_IsString),
-  *cJSON_tracks_total = 
-    get_cJSON_item_safe(cJSON_tracks, "total", cJSON_IsNumber);
+  cJSON *items[SIMPLIFIED_PLAYLIST_FIELDS_COUNT];
+  read_fields(cJSON_simplified_playlist, &simplified_playlist_fields, items);
+  cJSON *cJSON_description = items[SIMPLIFIED_PLAYLIST_DESCRIPTION],
+        *cJSON_href = items[SIMPLIFIED_PLAYLIST_HREF],
+        *cJSON_id = items[SIMPLIFIED_PLAYLIST_ID],
+        *cJSON_name = items[SIMPLIFIED_PLAYLIST_NAME],
+        *cJSON_owner = items[SIMPLIFIED_PLAYLIST_OWNER],
+        *cJSON_public = items[SIMPLIFIED_PLAYLIST_PUBLIC],
+        *cJSON_snapshot_id = items[SIMPLIFIED_PLAYLIST_SNAPSHOT_ID],
+        *cJSON_tracks = items[SIMPLIFIED_PLAYLIST_TRACKS];
+  cJSON *tracks_items[PLAYLIST_TRACKS_FIELDS_COUNT];
+  read_fields(cJSON_tracks, &playlist_tracks_fields, tracks_items);
+  cJSON *cJSON_tracks_href = tracks_items[PLAYLIST_TRACKS_HREF],
+        *cJSON_tracks_total = tracks_items[PLAYLIST_TRACKS_TOTAL];
 
   simplified_playlist->owner = cJSON_to_simplified_user(cJSON_owner);
   
   simplified_playlist->description = cJSON_to_string(cJSON_description);
   simplified_playlist->href = cJSON_to_string(cJSON_href);
-  simplified_playlist->id = cJSON_to_string(cJSON_id);
+  cJSON_to_id(cJSON_id, simplified_playlist->id);
   simplified_playlist->name = cJSON_to_string(cJSON_name);
   simplified_playlist->snapshot_id = cJSON_to_string(cJSON_snapshot_id);
   simplified_playlist->tracks.href = cJSON_to_string(cJSON_tracks_href);
@@ -266,26 +491,46 @@ void *cJSON_to_simplified_playlist(cJSON *cJSON_simplified_playlist) {
   return simplified_playlist;
 }
 
+enum playlist_track_field {
+  PLAYLIST_TRACK_ADDED_AT, PLAYLIST_TRACK_ADDED_BY, PLAYLIST_TRACK_TRACK,
+  PLAYLIST_TRACK_FIELDS_COUNT
+};
+
+static struct fields playlist_track_fields = FIELDS(
+  PLAYLIST_TRACK_FIELDS_COUNT, 0,
+  [PLAYLIST_TRACK_ADDED_AT] = { "added_at", cJSON_IsString, false },
+  [PLAYLIST_TRACK_ADDED_BY] = { "added_by", cJSON_IsObject, false },
+  [PLAYLIST_TRACK_TRACK] = { "track", cJSON_IsObject, false }
+);
+
+enum added_by_field {
+  ADDED_BY_HREF, ADDED_BY_ID, ADDED_BY_FIELDS_COUNT
+};
+
+static struct fields added_by_fields = FIELDS(
+  ADDED_BY_FIELDS_COUNT, 0,
+  [ADDED_BY_HREF] = { "href", cJSON_IsString, false },
+  [ADDED_BY_ID] = { "id", cJSON_IsString, false }
+);
+
 void *cJSON_to_playlist_track(cJSON *cJSON_playlist_track) {
   END_IF(!cJSON_IsObject(cJSON_playlist_track));
   PlaylistTrack playlist_track = talloc(new_playlist_track);
   END_IF(IS_NULL(playlist_track));
 
-  cJSON *cJSON_added_at =
-    get_cJSON_item_safe(cJSON_playlist_track, "added_at", cJSON_IsString),
-  *cJSON_added_by =
-    get_cJSON_item_safe(cJSON_playlist_track, "added_by", cJSON_IsObject),
-  *cJSON_track =
-    get_cJSON_item_safe(cJSON_playlist_track, "track", cJSON_IsObject);
-  cJSON *cJSON_added_by_href =
-    get_cJSON_item_safe(cJSON_added_by, "href", cJSON_IsString),
-  *cJSON_added_by_id =
-    get_cJSON_item_safe(cJSON_added_by, "id", cJSON_IsString);
+  cJSON *items[PLAYLIST_TRACK_FIELDS_COUNT];
+  read_fields(cJSON_playlist_track, &playlist_track_fields, items);
+  cJSON *cJSON_added_at = items[PLAYLIST_TRACK_ADDED_AT],
+        *cJSON_added_by = items[PLAYLIST_TRACK_ADDED_BY],
+        *cJSON_track = items[PLAYLIST_TRACK_TRACK];
+  cJSON *added_by_items[ADDED_BY_FIELDS_COUNT];
+  read_fields(cJSON_added_by, &added_by_fields, added_by_items);
+  cJSON *cJSON_added_by_href = added_by_items[ADDED_BY_HREF],
+        *cJSON_added_by_id = added_by_items[ADDED_BY_ID];
 
   if (cJSON_GetObjectItemCaseSensitive(cJSON_track, "album")) {
     playlist_track->track = cJSON_to_track(cJSON_track);
   } else return NULL;
-  playlist_track->track = cJSON_to_track(cJSON_track);
   playlist_track->added_at = cJSON_to_string(cJSON_added_at);
   playlist_track->added_by.href = cJSON_to_string(cJSON_added_by_href);
   playlist_track->added_by.id = cJSON_to_string(cJSON_added_by_id);
@@ -293,33 +538,43 @@ void *cJSON_to_playlist_track(cJSON *cJSON_playlist_track) {
   return playlist_track;
 }
 
+enum track_field {
+  TRACK_ALBUM, TRACK_ARTISTS, TRACK_DURATION_MS, TRACK_ID, TRACK_RESTRICTIONS,
+  TRACK_NAME, TRACK_POPULARITY, TRACK_FIELDS_COUNT
+};
+
+static struct fields track_fields = FIELDS(
+  TRACK_FIELDS_COUNT, 2,
+  [TRACK_ALBUM] = { "album", cJSON_IsObject, false },
+  [TRACK_ARTISTS] = { "artists", cJSON_IsArray, false },
+  [TRACK_DURATION_MS] = { "duration_ms", cJSON_IsNumber, false },
+  [TRACK_ID] = { "id", cJSON_IsString, false },
+  [TRACK_RESTRICTIONS] = { "restrictions", NULL, true },
+  [TRACK_NAME] = { "name", cJSON_IsString, false },
+  [TRACK_POPULARITY] = { "popularity", cJSON_IsNumber, false }
+);
+
 void *cJSON_to_track(cJSON *cJSON_track) {
   END_IF(!cJSON_IsObject(cJSON_track));
   Track track = talloc(new_track);
   END_IF(IS_NULL(track));
 
-  cJSON *cJSON_album = 
-    get_cJSON_item_safe(cJSON_track, "album", cJSON_IsObject),
-  *cJSON_artists = get_cJSON_item_safe(cJSON_track, "artists", cJSON_IsArray),
-  *cJSON_duration_ms =
-    get_cJSON_item_safe(cJSON_track, "duration_ms", cJSON_IsNumber),
-  *cJSON_id = get_cJSON_item_safe(cJSON_track, "id", cJSON_IsString),
-  *cJSON_restrictions =
-    cJSON_GetObjectItemCaseSensitive(cJSON_track, "description"),
-  *cJSON_name = get_cJSON_item_safe(cJSON_track, "name", cJSON_IsString),
-  *cJSON_popularity =
-    get_cJSON_item_safe(cJSON_track, "popularity", cJSON_IsNumber);
-
-  track->restrictions = IS_NULL(cJSON_restrictions)
-    ? NULL
-    : cJSON_to_restrictions(cJSON_restrictions);
-
-  track->album = cJSON_to_simplified_album(cJSON_album);
-  track->artists = 
-    (SimplifiedArtist *) cJSON_to_array(cJSON_artists, 
-                                        cJSON_to_simplified_artist);
-  
-  track->id = cJSON_to_string(cJSON_id);
+  cJSON *items[TRACK_FIELDS_COUNT];
+  read_fields(cJSON_track, &track_fields, items);
+  cJSON *cJSON_album = items[TRACK_ALBUM],
+        *cJSON_artists = items[TRACK_ARTISTS],
+        *cJSON_duration_ms = items[TRACK_DURATION_MS],
+        *cJSON_id = items[TRACK_ID],
+        *cJSON_restrictions = items[TRACK_RESTRICTIONS],
+        *cJSON_name = items[TRACK_NAME],
+        *cJSON_popularity = items[TRACK_POPULARITY];
+
+  if (lazy) {
+    track->pending = cJSON_track;
+  } else convert_track_members(track, cJSON_album, cJSON_artists,
+                               cJSON_restrictions);
+
+  cJSON_to_id(cJSON_id, track->id);
   track->name = cJSON_to_string(cJSON_name);
 
   track->duration_ms = cJSON_to_number(cJSON_duration_ms);
@@ -328,23 +583,35 @@ void *cJSON_to_track(cJSON *cJSON_track) {
   return track;
 }
 
+enum simplified_track_field {
+  SIMPLIFIED_TRACK_ARTISTS, SIMPLIFIED_TRACK_DURATION_MS, SIMPLIFIED_TRACK_HREF,
+  SIMPLIFIED_TRACK_ID, SIMPLIFIED_TRACK_RESTRICTIONS, SIMPLIFIED_TRACK_NAME,
+  SIMPLIFIED_TRACK_FIELDS_COUNT
+};
+
+static struct fields simplified_track_fields = FIELDS(
+  SIMPLIFIED_TRACK_FIELDS_COUNT, 2,
+  [SIMPLIFIED_TRACK_ARTISTS] = { "artists", cJSON_IsArray, false },
+  [SIMPLIFIED_TRACK_DURATION_MS] = { "duration_ms", cJSON_IsNumber, false },
+  [SIMPLIFIED_TRACK_HREF] = { "href", cJSON_IsString, false },
+  [SIMPLIFIED_TRACK_ID] = { "id", cJSON_IsString, false },
+  [SIMPLIFIED_TRACK_RESTRICTIONS] = { "restrictions", NULL, true },
+  [SIMPLIFIED_TRACK_NAME] = { "name", cJSON_IsString, false }
+);
+
 void *cJSON_to_simplified_track(cJSON *cJSON_simplified_track) {
   END_IF(!cJSON_IsObject(cJSON_simplified_track));
   SimplifiedTrack simplified_track = talloc(new_simplified_track);
   END_IF(IS_NULL(simplified_track));
 
-  cJSON *cJSON_artists =
-    get_cJSON_item_safe(cJSON_simplified_track, "artists", cJSON_IsArray),
-  *cJSON_duration_ms =
-    get_cJSON_item_safe(cJSON_simplified_track, "duration_ms", cJSON_IsNumber),
-  *cJSON_href =
-    get_cJSON_item_safe(cJSON_simplified_track, "href", cJSON_IsString),
-  *cJSON_id =
-    get_cJSON_item_safe(cJSON_simplified_track, "id", cJSON_IsString),
-  *cJSON_restrictions =
-    cJSON_GetObjectItemCaseSensitive(cJSON_simplified_track, "restrictions"),
-  *cJSON_name =
-    get_cJSON_item_safe(cJSON_simplified_track, "name", cJSON_IsString);
+  cJSON *items[SIMPLIFIED_TRACK_FIELDS_COUNT];
+  read_fields(cJSON_simplified_track, &simplified_track_fields, items);
+  cJSON *cJSON_artists = items[SIMPLIFIED_TRACK_ARTISTS],
+        *cJSON_duration_ms = items[SIMPLIFIED_TRACK_DURATION_MS],
+        *cJSON_href = items[SIMPLIFIED_TRACK_HREF],
+        *cJSON_id = items[SIMPLIFIED_TRACK_ID],
+        *cJSON_restrictions = items[SIMPLIFIED_TRACK_RESTRICTIONS],
+        *cJSON_name = items[SIMPLIFIED_TRACK_NAME];
 
   simplified_track->restrictions = cJSON_IsObject(cJSON_restrictions)
     ? cJSON_to_restrictions(cJSON_restrictions)
@@ -355,7 +622,7 @@ void *cJSON_to_simplified_track(cJSON *cJSON_simplified_track) {
                                         cJSON_to_simplified_artist);
   
   simplified_track->href = cJSON_to_string(cJSON_href);
-  simplified_track->id = cJSON_to_string(cJSON_id);
+  cJSON_to_id(cJSON_id, simplified_track->id);
   simplified_track->name = cJSON_to_string(cJSON_name);
   
   simplified_track->duration_ms = cJSON_to_number(cJSON_duration_ms);
@@ -363,15 +630,25 @@ void *cJSON_to_simplified_track(cJSON *cJSON_simplified_track) {
   return simplified_track;
 }
 
+enum saved_track_field {
+  SAVED_TRACK_ADDED_AT, SAVED_TRACK_TRACK, SAVED_TRACK_FIELDS_COUNT
+};
+
+static struct fields saved_track_fields = FIELDS(
+  SAVED_TRACK_FIELDS_COUNT, 0,
+  [SAVED_TRACK_ADDED_AT] = { "added_at", cJSON_IsString, false },
+  [SAVED_TRACK_TRACK] = { "track", cJSON_IsObject, false }
+);
+
 void *cJSON_to_saved_track(cJSON *cJSON_saved_track) {
   END_IF(!cJSON_IsObject(cJSON_saved_track));
   SavedTrack saved_track = talloc(new_saved_track);
   END_IF(IS_NULL(saved_track));
 
-  cJSON *cJSON_added_at =
-    get_cJSON_item_safe(cJSON_saved_track, "added_at", cJSON_IsString),
-  *cJSON_track = 
-    get_cJSON_item_safe(cJSON_saved_track, "track", cJSON_IsObject);
+  cJSON *items[SAVED_TRACK_FIELDS_COUNT];
+  read_fields(cJSON_saved_track, &saved_track_fields, items);
+  cJSON *cJSON_added_at = items[SAVED_TRACK_ADDED_AT],
+        *cJSON_track = items[SAVED_TRACK_TRACK];
 
   saved_track->track = cJSON_to_track(cJSON_track);
   
@@ -380,16 +657,27 @@ void *cJSON_to_saved_track(cJSON *cJSON_saved_track) {
   return saved_track;
 }
 
+enum user_field {
+  USER_DISPLAY_NAME, USER_FOLLOWERS, USER_ID, USER_FIELDS_COUNT
+};
+
+static struct fields user_fields = FIELDS(
+  USER_FIELDS_COUNT, 1,
+  [USER_DISPLAY_NAME] = { "display_name", NULL, false },
+  [USER_FOLLOWERS] = { "followers", cJSON_IsObject, false },
+  [USER_ID] = { "id", cJSON_IsString, false }
+);
+
 void *cJSON_to_user(cJSON *cJSON_user) {
   END_IF(!cJSON_IsObject(cJSON_user));
   User user = talloc(new_user);
   END_IF(IS_NULL(user));
 
-  cJSON *cJSON_display_name = 
-    get_cJSON_item_safe(cJSON_user, "display_name", NULL),
-  *cJSON_followers = 
-    get_cJSON_item_safe(cJSON_user, "followers", cJSON_IsObject),
-  *cJSON_id = get_cJSON_item_safe(cJSON_user, "id", cJSON_IsString);
+  cJSON *items[USER_FIELDS_COUNT];
+  read_fields(cJSON_user, &user_fields, items);
+  cJSON *cJSON_display_name = items[USER_DISPLAY_NAME],
+        *cJSON_followers = items[USER_FOLLOWERS],
+        *cJSON_id = items[USER_ID];
 
   user->display_name = cJSON_IsString(cJSON_display_name)
     ? cJSON_to_string(cJSON_display_name)
@@ -402,16 +690,28 @@ void *cJSON_to_user(cJSON *cJSON_user) {
   return user;
 }
 
+enum simplified_user_field {
+  SIMPLIFIED_USER_HREF, SIMPLIFIED_USER_ID, SIMPLIFIED_USER_DISPLAY_NAME,
+  SIMPLIFIED_USER_FIELDS_COUNT
+};
+
+static struct fields simplified_user_fields = FIELDS(
+  SIMPLIFIED_USER_FIELDS_COUNT, 0,
+  [SIMPLIFIED_USER_HREF] = { "href", cJSON_IsString, false },
+  [SIMPLIFIED_USER_ID] = { "id", cJSON_IsString, false },
+  [SIMPLIFIED_USER_DISPLAY_NAME] = { "display_name", NULL, false }
+);
+
 void *cJSON_to_simplified_user(cJSON *cJSON_simplified_user) {
   END_IF(!cJSON_IsObject(cJSON_simplified_user));
   SimplifiedUser simplified_user = talloc(new_simplified_user);
   END_IF(IS_NULL(simplified_user));
 
-  cJSON *cJSON_href =
-    get_cJSON_item_safe(cJSON_simplified_user, "href", cJSON_IsString),
-  *cJSON_id = get_cJSON_item_safe(cJSON_simplified_user, "id", cJSON_IsString),
-  *cJSON_display_name =
-    get_cJSON_item_safe(cJSON_simplified_user, "display_name", NULL);
+  cJSON *items[SIMPLIFIED_USER_FIELDS_COUNT];
+  read_fields(cJSON_simplified_user, &simplified_user_fields, items);
+  cJSON *cJSON_href = items[SIMPLIFIED_USER_HREF],
+        *cJSON_id = items[SIMPLIFIED_USER_ID],
+        *cJSON_display_name = items[SIMPLIFIED_USER_DISPLAY_NAME];
 
   simplified_user->display_name = cJSON_IsString(cJSON_display_name)
     ? cJSON_to_string(cJSON_display_name)
@@ -423,36 +723,64 @@ void *cJSON_to_simplified_user(cJSON *cJSON_simplified_user) {
   return simplified_user;
 }
 
+enum followers_field {
+  FOLLOWERS_TOTAL, FOLLOWERS_FIELDS_COUNT
+};
+
+static struct fields followers_fields = FIELDS(
+  FOLLOWERS_FIELDS_COUNT, 0,
+  [FOLLOWERS_TOTAL] = { "total", cJSON_IsNumber, false }
+);
+
 void *cJSON_to_followers(cJSON *cJSON_followers) {
   END_IF(!cJSON_IsObject(cJSON_followers));
   Followers followers = talloc(new_followers);
   END_IF(IS_NULL(followers));
 
-  cJSON *cJSON_total = 
-    get_cJSON_item_safe(cJSON_followers, "total", cJSON_IsNumber);
+  cJSON *items[FOLLOWERS_FIELDS_COUNT];
+  read_fields(cJSON_followers, &followers_fields, items);
+  cJSON *cJSON_total = items[FOLLOWERS_TOTAL];
 
   followers->total = cJSON_to_number(cJSON_total);
 
   return followers;
 }
 
+enum page_field {
+  PAGE_HREF, PAGE_LIMIT, PAGE_NEXT, PAGE_TOTAL, PAGE_ITEMS, PAGE_FIELDS_COUNT
+};
+
+static struct fields page_fields = FIELDS(
+  PAGE_FIELDS_COUNT, 0,
+  [PAGE_HREF] = { "href", cJSON_IsString, false },
+  [PAGE_LIMIT] = { "limit", cJSON_IsNumber, false },
+  [PAGE_NEXT] = { "next", NULL, false },
+  [PAGE_TOTAL] = { "total", cJSON_IsNumber, false },
+  [PAGE_ITEMS] = { "items", cJSON_IsArray, false }
+);
+
 void *cJSON_to_page(cJSON *cJSON_page,
                     void *(*cJSON_to_item_type)(cJSON *item)) {
   END_IF(!cJSON_IsObject(cJSON_page));
   Page page = talloc(new_page);
   END_IF(IS_NULL(page));
 
-  cJSON *cJSON_href = get_cJSON_item_safe(cJSON_page, "href", cJSON_IsString),
-  *cJSON_limit = get_cJSON_item_safe(cJSON_page, "limit", cJSON_IsNumber),
-  *cJSON_next = get_cJSON_item_safe(cJSON_page, "next", NULL),
-  *cJSON_total = get_cJSON_item_safe(cJSON_page, "total", cJSON_IsNumber),
-  *cJSON_items = get_cJSON_item_safe(cJSON_page, "items", cJSON_IsArray);
+  cJSON *items[PAGE_FIELDS_COUNT];
+  read_fields(cJSON_page, &page_fields, items);
+  cJSON *cJSON_href = items[PAGE_HREF],
+        *cJSON_limit = items[PAGE_LIMIT],
+        *cJSON_next = items[PAGE_NEXT],
+        *cJSON_total = items[PAGE_TOTAL],
+        *cJSON_items = items[PAGE_ITEMS];
 
   page->next = cJSON_IsString(cJSON_next)
     ? cJSON_to_string(cJSON_next)
     : NULL;
 
-  page->items = cJSON_to_array(cJSON_items, cJSON_to_item_type);
+  SizedArray page_items = cJSON_to_sized_array(cJSON_items,
+                                               cJSON_to_item_type);
+  page->items = page_items.items;
+  page->count = page_items.length;
   
   page->href = cJSON_to_string(cJSON_href);
 
@@ -462,30 +790,53 @@ void *cJSON_to_page(cJSON *cJSON_page,
   return page;
 }
 
+enum restrictions_field {
+  RESTRICTIONS_REASON, RESTRICTIONS_FIELDS_COUNT
+};
+
+static struct fields restrictions_fields = FIELDS(
+  RESTRICTIONS_FIELDS_COUNT, 0,
+  [RESTRICTIONS_REASON] = { "reason", cJSON_IsString, false }
+);
+
 void *cJSON_to_restrictions(cJSON *cJSON_restrictions) {
   END_IF(!cJSON_IsObject(cJSON_restrictions));
   Restrictions restrictions = talloc(new_restrictions);
   END_IF(IS_NULL(restrictions));
 
-  cJSON *cJSON_reason = 
-    get_cJSON_item_safe(cJSON_restrictions, "reason", cJSON_IsString);
+  cJSON *items[RESTRICTIONS_FIELDS_COUNT];
+  read_fields(cJSON_restrictions, &restrictions_fields, items);
+  cJSON *cJSON_reason = items[RESTRICTIONS_REASON];
 
   restrictions->reason = cJSON_to_string(cJSON_reason);
 
   return restrictions;
 }
 
+enum search_field {
+  SEARCH_TRACKS, SEARCH_ARTISTS, SEARCH_ALBUMS, SEARCH_PLAYLISTS,
+  SEARCH_FIELDS_COUNT
+};
+
+static struct fields search_fields = FIELDS(
+  SEARCH_FIELDS_COUNT, 0,
+  [SEARCH_TRACKS] = { "tracks", NULL, true },
+  [SEARCH_ARTISTS] = { "artists", NULL, true },
+  [SEARCH_ALBUMS] = { "albums", NULL, true },
+  [SEARCH_PLAYLISTS] = { "playlists", NULL, true }
+);
+
 void *cJSON_to_search(cJSON *cJSON_search) {
   END_IF(!cJSON_IsObject(cJSON_search));
   Search search = talloc(new_search);
   END_IF(IS_NULL(search));
 
-  cJSON *cJSON_tracks =
-    cJSON_GetObjectItemCaseSensitive(cJSON_search, "tracks"),
-  *cJSON_artists = cJSON_GetObjectItemCaseSensitive(cJSON_search, "artists"),
-  *cJSON_albums = cJSON_GetObjectItemCaseSensitive(cJSON_search, "albums"),
-  *cJSON_playlists = 
-    cJSON_GetObjectItemCaseSensitive(cJSON_search, "playlists");
+  cJSON *items[SEARCH_FIELDS_COUNT];
+  read_fields(cJSON_search, &search_fields, items);
+  cJSON *cJSON_tracks = items[SEARCH_TRACKS],
+        *cJSON_artists = items[SEARCH_ARTISTS],
+        *cJSON_albums = items[SEARCH_ALBUMS],
+        *cJSON_playlists = items[SEARCH_PLAYLISTS];
 
   search->tracks = cJSON_IsObject(cJSON_tracks)
     ? cJSON_to_page(cJSON_tracks, cJSON_to_track)
@@ -506,18 +857,132 @@ void *cJSON_to_search(cJSON *cJSON_search) {
   return search;
 }
 
-static cJSON *get_cJSON_item_safe(cJSON *cJSON_object, string key, 
-                            int (*cJSON_IsType)(const cJSON *)) {
-  cJSON *cJSON_item = cJSON_GetObjectItemCaseSensitive(cJSON_object, key);
-  if (!IS_NULL(cJSON_IsType)) {
-    END_IF(!cJSON_IsType(cJSON_item));
-  } else END_IF(IS_NULL(cJSON_item));
-  return cJSON_item;
+bool cJSON_begin_lazy(cJSON *cJSON_root) {
+  if (!talloc_keep(cJSON_root, delete_cJSON)) return false;
+  lazy = true;
+  return true;
+}
+
+void cJSON_end_lazy(void) {
+  lazy = false;
+}
+
+SimplifiedAlbum track_album(Track track) {
+  materialize_track(track);
+  return track->album;
+}
+
+SimplifiedArtist *track_artists(Track track) {
+  materialize_track(track);
+  return track->artists;
+}
+
+Restrictions track_restrictions(Track track) {
+  materialize_track(track);
+  return track->restrictions;
+}
+
+static void convert_track_members(Track track, cJSON *cJSON_album,
+                                  cJSON *cJSON_artists,
+                                  cJSON *cJSON_restrictions) {
+  track->restrictions = cJSON_IsObject(cJSON_restrictions)
+    ? cJSON_to_restrictions(cJSON_restrictions)
+    : NULL;
+
+  track->album = cJSON_to_simplified_album(cJSON_album);
+  track->artists =
+    (SimplifiedArtist *) cJSON_to_array(cJSON_artists,
+                                        cJSON_to_simplified_artist);
+}
+
+static void materialize_track(Track track) {
+  pthread_mutex_lock(&lazy_lock);
+  if (!IS_NULL(track->pending)) {
+    bool reentered = talloc_reenter_arena(track);
+    cJSON *items[TRACK_FIELDS_COUNT];
+    read_fields(track->pending, &track_fields, items);
+    convert_track_members(track, items[TRACK_ALBUM], items[TRACK_ARTISTS],
+                          items[TRACK_RESTRICTIONS]);
+    track->pending = NULL;
+    if (reentered) talloc_leave_arena();
+  }
+  pthread_mutex_unlock(&lazy_lock);
+}
+
+static void delete_cJSON(void *cJSON_item) {
+  cJSON_Delete(cJSON_item);
+}
+
+static void read_fields(cJSON *cJSON_object, struct fields *fields,
+                        cJSON **items) {
+  END_IF(!cJSON_IsObject(cJSON_object));
+  if (!atomic_load_explicit(&fields->ready, memory_order_acquire)) {
+    build_fields(fields);
+  }
+
+  memset(items, 0, fields->count * sizeof(cJSON *));
+  cJSON *cJSON_child;
+  cJSON_ArrayForEach(cJSON_child, cJSON_object) {
+    if (IS_NULL(cJSON_child->string)) continue;
+    size_t slot = fields->slots[hash_key(cJSON_child->string, fields->seed)];
+    if (slot == 0) continue;
+    const struct field *field = &fields->list[slot - 1];
+    if (IS_NULL(items[slot - 1]) && !strcmp(field->key, cJSON_child->string)) {
+      items[slot - 1] = cJSON_child;
+    }
+  }
+
+  for (size_t i = 0; i < fields->count; i++) {
+    const struct field *field = &fields->list[i];
+    if (field->optional) continue;
+    if (!IS_NULL(field->cJSON_IsType)) {
+      END_IF(!field->cJSON_IsType(items[i]));
+    } else END_IF(IS_NULL(items[i]));
+  }
+}
+
+static void build_fields(struct fields *fields) {
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&lock);
+  if (atomic_load_explicit(&fields->ready, memory_order_relaxed)) {
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+
+  END_IF(fields->count >= FIELDS_SLOTS);
+  for (size_t i = 0; i < fields->count; i++) {
+    size_t slot = hash_key(fields->list[i].key, fields->seed);
+    END_IF(fields->slots[slot] != 0);
+    fields->slots[slot] = i + 1;
+  }
+  atomic_store_explicit(&fields->ready, true, memory_order_release);
+  pthread_mutex_unlock(&lock);
+}
+
+static size_t hash_key(string key, uint32_t seed) {
+  size_t length = strlen(key);
+  uint32_t hash = (2166136261u ^ seed) + (uint32_t) length;
+  if (length > 0) {
+    hash = (hash ^ (unsigned char) key[0]) * 16777619u;
+    hash = (hash ^ (unsigned char) key[length / 2]) * 16777619u;
+    hash = (hash ^ (unsigned char) key[length - 1]) * 16777619u;
+  }
+  return (hash ^ (hash >> 16)) % FIELDS_SLOTS;
 }
 
 static void *cJSON_to_string(cJSON *cJSON_string) {
-  string str = malloc(strlen(cJSON_string->valuestring) + 1);
+  string str = tmalloc(strlen(cJSON_string->valuestring) + 1);
   END_IF(IS_NULL(str));
   strcpy(str , cJSON_string->valuestring);
   return str;
 }
+
+static void *cJSON_to_interned_string(cJSON *cJSON_string) {
+  string str = intern_string(cJSON_string->valuestring);
+  END_IF(IS_NULL(str));
+  return str;
+}
+
+static void cJSON_to_id(cJSON *cJSON_id, char *id) {
+  END_IF(!spotify_id_copy(id, cJSON_id->valuestring));
+}
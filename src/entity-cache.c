@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "spotify-id.h"
+#include "tmem.h"
+#include "entity-cache.h"
+
+#define MIN_BUCKETS 64
+
+/*
+ * entry:
+ * An entity kept in the cache.
+ * hash is the hash of the entity's type and id, entity the converted entity,
+ * released using free_type, and bytes the estimated space taken by
+ * the entry.
+ * newer and older link the entries from the most to the least recently used,
+ * and next links the entries of a same bucket.
+ */
+struct entry {
+  enum entity_type type;
+  struct spotify_id id;
+  size_t hash;
+  void *entity;
+  void (*free_type)(void *type_struct_ptr);
+  size_t bytes;
+  struct entry *newer, *older;
+  struct entry *next;
+};
+
+/*
+ * cache:
+ * buckets is the hash table of the entries, buckets_count its size.
+ * newest and oldest are the ends of the list of entries ordered by use.
+ * budget is the space the entries can take, and lock protects the whole
+ * structure.
+ */
+static struct {
+  struct entry **buckets;
+  size_t buckets_count;
+  struct entry *newest, *oldest;
+  size_t budget;
+  struct entity_cache_stats stats;
+  pthread_mutex_t lock;
+} cache = {
+  .budget = ENTITY_CACHE_BUDGET,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * hash_key:
+ * Returns the hash of the key made of type and id.
+ */
+static size_t hash_key(enum entity_type type, struct spotify_id id);
+
+/*
+ * find_entry:
+ * Returns a pointer to the link pointing to the entry of type with an id
+ * of id (which points to null if there is no such entry).
+ * The cache must be locked and have buckets.
+ */
+static struct entry **find_entry(enum entity_type type, struct spotify_id id,
+                                 size_t hash);
+
+/*
+ * tree_size:
+ * Returns the estimated space taken by the cJSON tree item.
+ */
+static size_t tree_size(cJSON *item);
+
+/*
+ * grow_buckets:
+ * Doubles the number of buckets once there are more entries than buckets.
+ * The table keeps its size if not enough memory was available.
+ */
+static void grow_buckets(void);
+
+/*
+ * unlink_entry:
+ * Removes entry, linked from link, from the table and from the list of
+ * entries ordered by use, without releasing it.
+ */
+static void unlink_entry(struct entry **link, struct entry *entry);
+
+/*
+ * free_entry:
+ * Releases space taken by entry and the cache's reference to its entity.
+ */
+static void free_entry(struct entry *entry);
+
+/*
+ * evict_entries:
+ * Evicts the least recently used entries until the entries fit
+ * in the budget.
+ */
+static void evict_entries(void);
+
+void *entity_cache_get(enum entity_type type, string id) {
+  struct spotify_id key;
+  bool valid = spotify_id_pack(&key, id);
+  pthread_mutex_lock(&cache.lock);
+  struct entry *entry = NULL;
+  if (valid && cache.buckets != NULL) {
+    entry = *find_entry(type, key, hash_key(type, key));
+  }
+  if (entry == NULL) {
+    cache.stats.misses++;
+    pthread_mutex_unlock(&cache.lock);
+    return NULL;
+  }
+
+  cache.stats.hits++;
+  if (cache.newest != entry) {
+    entry->newer->older = entry->older;
+    if (entry->older != NULL) {
+      entry->older->newer = entry->newer;
+    } else cache.oldest = entry->newer;
+    entry->newer = NULL;
+    entry->older = cache.newest;
+    cache.newest->newer = entry;
+    cache.newest = entry;
+  }
+  void *entity = entry->entity;
+  talloc_share(entity);
+  pthread_mutex_unlock(&cache.lock);
+  return entity;
+}
+
+bool entity_cache_contains(enum entity_type type, string id) {
+  struct spotify_id key;
+  if (!spotify_id_pack(&key, id)) return false;
+  pthread_mutex_lock(&cache.lock);
+  bool contained = cache.buckets != NULL &&
+                   *find_entry(type, key, hash_key(type, key)) != NULL;
+  pthread_mutex_unlock(&cache.lock);
+  return contained;
+}
+
+void *entity_cache_put(enum entity_type type, string id, cJSON *cJSON_entity,
+                       void *(*cJSON_to_type)(cJSON *item),
+                       void (*free_type)(void *type_struct_ptr)) {
+  if (cJSON_entity == NULL) return NULL;
+  struct spotify_id key;
+  bool valid = spotify_id_pack(&key, id);
+  size_t bytes = sizeof(struct entry) + tree_size(cJSON_entity);
+
+  bool in_arena = talloc_begin_arena();
+  void *entity = cJSON_to_type(cJSON_entity);
+  if (in_arena) talloc_end_arena(entity);
+  cJSON_Delete(cJSON_entity);
+  if (entity == NULL || !in_arena || !valid) return entity;
+
+  struct entry *entry = malloc(sizeof(struct entry));
+  if (entry == NULL) return entity;
+  pthread_mutex_lock(&cache.lock);
+  if (cache.buckets == NULL) {
+    cache.buckets = calloc(MIN_BUCKETS, sizeof(struct entry *));
+    if (cache.buckets != NULL) cache.buckets_count = MIN_BUCKETS;
+  }
+  if (bytes > cache.budget || cache.buckets == NULL ||
+      !talloc_share(entity)) {
+    pthread_mutex_unlock(&cache.lock);
+    free(entry);
+    return entity;
+  }
+
+  size_t hash = hash_key(type, key);
+  struct entry **link = find_entry(type, key, hash), *previous = *link;
+  if (previous != NULL) {
+    unlink_entry(link, previous);
+    free_entry(previous);
+  }
+
+  *entry = (struct entry) {
+    .type = type, .id = key, .hash = hash, .entity = entity,
+    .free_type = free_type, .bytes = bytes, .newer = NULL,
+    .older = cache.newest, .next = cache.buckets[hash % cache.buckets_count],
+  };
+  cache.buckets[hash % cache.buckets_count] = entry;
+  if (cache.newest != NULL) {
+    cache.newest->newer = entry;
+  } else cache.oldest = entry;
+  cache.newest = entry;
+  cache.stats.entries++;
+  cache.stats.bytes += bytes;
+
+  evict_entries();
+  grow_buckets();
+  pthread_mutex_unlock(&cache.lock);
+  return entity;
+}
+
+void entity_cache_remove(enum entity_type type, string id) {
+  struct spotify_id key;
+  bool valid = spotify_id_pack(&key, id);
+  pthread_mutex_lock(&cache.lock);
+  if (valid && cache.buckets != NULL) {
+    struct entry **link = find_entry(type, key, hash_key(type, key));
+    struct entry *entry = *link;
+    if (entry != NULL) {
+      unlink_entry(link, entry);
+      free_entry(entry);
+    }
+  }
+  pthread_mutex_unlock(&cache.lock);
+}
+
+void entity_cache_set_budget(size_t bytes) {
+  pthread_mutex_lock(&cache.lock);
+  cache.budget = bytes;
+  evict_entries();
+  pthread_mutex_unlock(&cache.lock);
+}
+
+void entity_cache_clear(void) {
+  pthread_mutex_lock(&cache.lock);
+  struct entry *entry = cache.newest;
+  while (entry != NULL) {
+    struct entry *older = entry->older;
+    free_entry(entry);
+    entry = older;
+  }
+  free(cache.buckets);
+  cache.buckets = NULL;
+  cache.buckets_count = 0;
+  cache.newest = cache.oldest = NULL;
+  cache.stats = (struct entity_cache_stats) { 0 };
+  pthread_mutex_unlock(&cache.lock);
+}
+
+struct entity_cache_stats entity_cache_get_stats(void) {
+  pthread_mutex_lock(&cache.lock);
+  struct entity_cache_stats stats = cache.stats;
+  pthread_mutex_unlock(&cache.lock);
+  return stats;
+}
+
+static size_t hash_key(enum entity_type type, struct spotify_id id) {
+  return (spotify_id_hash(id) ^ type) * 1099511628211UL;
+}
+
+static struct entry **find_entry(enum entity_type type, struct spotify_id id,
+                                 size_t hash) {
+  struct entry **link = &cache.buckets[hash % cache.buckets_count];
+  while (*link != NULL && ((*link)->hash != hash || (*link)->type != type ||
+                           !spotify_id_equal((*link)->id, id))) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+static size_t tree_size(cJSON *item) {
+  size_t size = 0;
+  for (; item != NULL; item = item->next) {
+    size += sizeof(cJSON);
+    if (item->string != NULL) size += strlen(item->string) + 1;
+    if (item->valuestring != NULL) size += strlen(item->valuestring) + 1;
+    size += tree_size(item->child);
+  }
+  return size;
+}
+
+static void grow_buckets(void) {
+  if (cache.stats.entries <= cache.buckets_count) return;
+  size_t buckets_count = cache.buckets_count * 2;
+  struct entry **buckets = calloc(buckets_count, sizeof(struct entry *));
+  if (buckets == NULL) return;
+  for (struct entry *entry = cache.newest; entry != NULL;
+       entry = entry->older) {
+    entry->next = buckets[entry->hash % buckets_count];
+    buckets[entry->hash % buckets_count] = entry;
+  }
+  free(cache.buckets);
+  cache.buckets = buckets;
+  cache.buckets_count = buckets_count;
+}
+
+static void unlink_entry(struct entry **link, struct entry *entry) {
+  *link = entry->next;
+  if (entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  } else cache.newest = entry->older;
+  if (entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  } else cache.oldest = entry->newer;
+  cache.stats.entries--;
+  cache.stats.bytes -= entry->bytes;
+}
+
+static void free_entry(struct entry *entry) {
+  entry->free_type(entry->entity);
+  free(entry);
+}
+
+static void evict_entries(void) {
+  while (cache.oldest != NULL && cache.stats.bytes > cache.budget) {
+    struct entry *oldest = cache.oldest;
+    unlink_entry(find_entry(oldest->type, oldest->id, oldest->hash), oldest);
+    free_entry(oldest);
+    cache.stats.evictions++;
+  }
+}
@@ -1,7 +1,16 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
 #include <curl/curl.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#include "response-cache.h"
 #include "fetch.h"
 
 #define IS_METHOD(method) (IS_GET(method) || IS_POST(method) || \
@@ -11,11 +20,264 @@
 #define IS_PUT(method) !strcmp(method, "PUT")
 #define IS_DELETE(method) !strcmp(method, "DELETE")
 
+#define POOL_SIZE MAX_STREAMS
+#define MAX_EVENTS 16
+
+#define TOO_MANY_REQUESTS 429
+#define SERVER_ERROR 500
+#define BACKOFF_MS 500
+#define MAX_BACKOFF_MS (30 * 1000)
+#define RETRY_BACKOFF_MS 250
+
+/*
+ * response:
+ * content is the response's content received so far (a null pointer if
+ * none was received), of size characters, capacity being the number of
+ * characters content can hold.
+ * cache is the response's entry in the response cache, or null if the
+ * response isn't cached (e.g. if the request isn't a GET request).
+ * status is the HTTP status of the response (0 if none was received).
+ * retry_after_ms is the delay asked by the response's Retry-After header
+ * (-1 if it had none) and throttled the number of times the request
+ * was throttled so far.
+ * failed is the number of attempts that failed with a transient error,
+ * retry_at_ms the time before which the request mustn't be made again and
+ * started_ms the time its first attempt started (-1 if it didn't yet),
+ * on the monotonic clock.
+ * If converter isn't null, the content of a successful response is fed
+ * to it as it's received instead of being kept in content.
+ */
 typedef struct response {
   string content;
   size_t size;
+  size_t capacity;
+  ResponseCacheEntry cache;
+  long status;
+  long retry_after_ms;
+  size_t throttled;
+  size_t failed;
+  long retry_at_ms;
+  long started_ms;
+  StreamConverter converter;
 } *Response;
 
+struct fetch_request {
+  string url;
+  string method;
+  string body;
+  void (*callback)(FetchRequest request, void *data);
+  void *data;
+  CURL *curl;
+  struct curl_slist *headers;
+  struct response res;
+  CURLcode rc;
+  struct fetch_request_stats stats;
+  cJSON *response;
+  StreamConverter converter;
+  void *structure;
+  struct flight *flight;
+  bool submitted;
+  bool done;
+  FetchRequest next;
+};
+
+/*
+ * flight:
+ * A GET request in flight, made by a single caller (the leader) on behalf
+ * of every identical request made meanwhile.
+ * url is the leader's URL. waiters is the number of fetch calls waiting
+ * for the response and followers the list of submitted requests waiting
+ * for it (linked through their next member).
+ * Once the leader's response is received, the flight lands: it is removed
+ * from the flights in progress and response is set to a copy of the
+ * leader's response, that each waiter duplicates, the last one releasing
+ * it along with the flight.
+ */
+typedef struct flight {
+  string url;
+  size_t waiters;
+  FetchRequest followers;
+  cJSON *response;
+  bool landed;
+  struct flight *next;
+} *Flight;
+
+/*
+ * context:
+ * context holds the state shared by every request for the whole lifetime
+ * of the program (until fetch_cleanup is called).
+ * share is shared by every pooled handle so that DNS lookups and TLS
+ * sessions are reused from one request to the next. Open connections
+ * aren't shared: each handle keeps its own between requests, as
+ * a connection held by a handle outside the engine's multi handle would
+ * leave the engine's requests waiting for it without ever being woken up.
+ * handles is the pool of curl handles, handles_count being the number of
+ * handles created so far and in_use telling which of them are currently
+ * used by a request.
+ * pool_lock protects the pool and share_locks protect the data shared
+ * through share, as handles can be used by both the calling thread and
+ * the engine's thread. init_lock serializes fetch_init and fetch_cleanup,
+ * which can be called by several threads making their first request at
+ * the same time.
+ */
+static struct {
+  pthread_mutex_t init_lock;
+  bool initialized;
+  CURLSH *share;
+  pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+  pthread_mutex_t pool_lock;
+  CURL *handles[POOL_SIZE];
+  bool in_use[POOL_SIZE];
+  size_t handles_count;
+} context = {
+  .init_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * engine:
+ * engine holds the state of the asynchronous request engine.
+ * Every request submitted with fetch_submit is queued in pending (pending
+ * being the head of the queue and pending_tail its tail), then moved to
+ * multi by the engine's thread as soon as less than max_active requests
+ * are in flight. max_streams is the maximum number of concurrent streams
+ * multi was last told to open on a single connection, and is updated
+ * by the engine's thread when max_active changes.
+ * On Linux, the engine's thread waits for socket activity using epoll_fd,
+ * curl telling which sockets to watch through socket_cb and when to time
+ * out through timer_cb (deadline_ms, on the monotonic clock).
+ * wake_ms is the time at which the rate limiter or a retry's backoff will
+ * let the next pending request start (-1 if no request is waiting for it).
+ * wakeup_fd is used to wake the thread up when a request is submitted
+ * or when the engine is stopped.
+ * lock protects every member shared with the calling threads and
+ * done_cond is signaled each time a request completes.
+ */
+static struct {
+  bool running;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t done_cond;
+  CURLM *multi;
+  FetchRequest pending, pending_tail;
+  size_t active;
+  size_t max_active;
+  size_t max_streams;
+  long wake_ms;
+#ifdef __linux__
+  int epoll_fd;
+  int wakeup_fd;
+  long deadline_ms;
+#endif
+} engine = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .done_cond = PTHREAD_COND_INITIALIZER,
+  .max_active = MAX_STREAMS,
+  .wake_ms = -1,
+};
+
+/*
+ * limiter:
+ * limiter holds the state of the rate limiter shared by every request.
+ * It is a token bucket: a request can only start by taking one of the
+ * tokens, which are refilled at a rate of rate tokens per second (refilled_ms
+ * being the last time they were), up to rate tokens (or 1 if rate is lower).
+ * A rate of 0 disables the limiter.
+ * When the API throttles a request, no request starts before resume_ms,
+ * backoff being the number of consecutive throttled requests, which makes
+ * the delay grow exponentially. seed is used to add jitter to the delay.
+ * max_retries is the maximum number of times a throttled request is made
+ * again before its response is returned as is.
+ */
+static struct {
+  pthread_mutex_t lock;
+  double rate;
+  double tokens;
+  long refilled_ms;
+  long resume_ms;
+  unsigned backoff;
+  unsigned seed;
+  size_t max_retries;
+} limiter = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .rate = RATE_LIMIT,
+  .tokens = RATE_LIMIT,
+  .refilled_ms = -1,
+  .max_retries = MAX_THROTTLED_RETRIES,
+};
+
+/*
+ * retries:
+ * max_attempts is the maximum number of times a GET request failing with
+ * a transient error is made, and deadline_ms the time after which such
+ * a request isn't made again, counted from its first attempt (0 if there
+ * is no deadline). lock protects both.
+ */
+static struct {
+  pthread_mutex_t lock;
+  size_t max_attempts;
+  long deadline_ms;
+} retries = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .max_attempts = MAX_ATTEMPTS,
+  .deadline_ms = REQUEST_DEADLINE_MS,
+};
+
+/*
+ * flights:
+ * flights holds the GET requests currently in flight (see flight), lock
+ * protecting them and landed_cond being signaled each time one lands.
+ */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t landed_cond;
+  Flight list;
+} flights = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .landed_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * prefetch:
+ * A GET request started by fetch_prefetch, made to url (a copy owned by
+ * the prefetch).
+ */
+typedef struct prefetch {
+  string url;
+  FetchRequest request;
+  struct prefetch *next;
+} *Prefetch;
+
+/*
+ * prefetches:
+ * prefetches holds the prefetched requests whose response wasn't used yet
+ * (list) and those that were cancelled while in flight (dropped), count
+ * being the number of requests in both lists and budget the maximum
+ * number of them. lock protects every member.
+ */
+static struct {
+  pthread_mutex_t lock;
+  Prefetch list;
+  Prefetch dropped;
+  size_t count;
+  size_t budget;
+} prefetches = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .budget = PREFETCH_BUDGET,
+};
+
+/*
+ * stats:
+ * stats holds the measures accumulated over every request done since
+ * fetch_init was called, lock protecting them as requests are completed
+ * by both the calling threads and the engine's thread.
+ */
+static struct {
+  pthread_mutex_t lock;
+  struct fetch_stats totals;
+} stats = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
 /*
  * token:
  * token is the authorization token that will be sent for each API request.
@@ -24,118 +286,1829 @@ string token = NULL;
 
 /*
  * curl_cb:
- * Callback used by curl_easy_perform to write the response's content.
+ * Callback used by curl to write the response's content as it is received.
+ * The content is already decompressed by curl if it was sent compressed.
+ * It is also written to the response's cache entry if it can be stored.
  * contents is a pointer to the response's content,
  * size is the size of a "member" of contents,
  * nmemb is the number of "members" of contents,
- * res_ptr is a pointer defined by the user on 
+ * res_ptr is a pointer defined by the user on
  * a previous call of CURLOPT_WRITEDATA.
- * Returns the total size of written content (size * nmemb) 
+ * Returns the total size of written content (size * nmemb)
  * if no error occurred, else returns 0.
  */
-static size_t curl_cb(void *contents, size_t size, size_t nmemb, 
+static size_t curl_cb(void *contents, size_t size, size_t nmemb,
                       void *res_ptr);
 
+/*
+ * header_cb:
+ * Callback used by curl to pass each header line of the response
+ * (of nitems * size characters) as it is received.
+ * Records the line in the response's cache entry.
+ * Returns the size of the line.
+ */
+static size_t header_cb(char *line, size_t size, size_t nitems,
+                        void *res_ptr);
+
+/*
+ * open_cache:
+ * Sets res's cache entry for url if method is "GET".
+ * Returns true if a fresh response was stored for url and was read into
+ * res's content, in which case the API doesn't have to be called, else returns
+ * false.
+ */
+static bool open_cache(Response res, string url, string method);
+
+/*
+ * read_cached:
+ * Reads the body stored in res's cache entry into res's content.
+ * If it couldn't be read, discards what was read and returns false,
+ * else returns true.
+ */
+static bool read_cached(Response res);
+
+/*
+ * read_chunk:
+ * Callback used to append a chunk of a stored body to the content of
+ * the response pointed by res_ptr.
+ */
+static void read_chunk(void *res_ptr, const char *chunk, size_t size);
+
+/*
+ * append_content:
+ * Appends the size characters of chunk to res's content, growing it
+ * geometrically.
+ * Returns false if not enough memory was available, else returns true.
+ */
+static bool append_content(Response res, const char *chunk, size_t size);
+
+/*
+ * reuse_stored:
+ * If the API answered res's request with a 304 status, reads the stored
+ * body into res's content.
+ * Returns false if the stored body couldn't be read anymore (e.g. if it was
+ * evicted meanwhile), in which case res's cache entry is released and the
+ * request must be made again without it, else returns true.
+ */
+static bool reuse_stored(Response res);
+
+/*
+ * join_flight:
+ * Looks for a GET request to url in flight. If one is found, joins it,
+ * as one of its followers if request isn't null, else as a waiter, sets
+ * flight to it and returns true.
+ * Else, starts a new flight for url, sets flight to it (or to a null pointer
+ * if not enough memory was available, in which case the request isn't
+ * coalesced) and returns false, the caller being the flight's leader.
+ */
+static bool join_flight(string url, FetchRequest request, Flight *flight);
+
+/*
+ * land_flight:
+ * Lands flight once its leader received response: completes every request
+ * following it with a copy of response and wakes its waiters up.
+ * Does nothing if flight is null.
+ */
+static void land_flight(Flight flight, cJSON *response);
+
+/*
+ * wait_for_flight:
+ * Waits for flight, joined as a waiter, to land.
+ * Returns a copy of the response received by its leader.
+ */
+static cJSON *wait_for_flight(Flight flight);
+
+/*
+ * take_prefetch:
+ * Looks for a prefetched request to url. If one is found, waits for it to
+ * be done, sets response to its response and returns true, else returns
+ * false.
+ */
+static bool take_prefetch(string url, cJSON **response);
+
+/*
+ * unqueue_request:
+ * Removes request from the engine's pending requests if the engine didn't
+ * start it yet and no other request is waiting for it, releasing what it
+ * holds as if it was never submitted.
+ * Returns true if it was removed, else returns false.
+ */
+static bool unqueue_request(FetchRequest request);
+
+/*
+ * release_dropped_prefetches:
+ * Releases the cancelled prefetched requests that are done, or every
+ * cancelled prefetched request if wait is set, waiting for them.
+ */
+static void release_dropped_prefetches(bool wait);
+
+/*
+ * free_prefetch:
+ * Releases prefetch and its request, waiting for it if it's in flight.
+ */
+static void free_prefetch(Prefetch prefetch);
+
+/*
+ * finish_response:
+ * Stores res's content in the response cache if it can be stored, then
+ * parses it using cJSON module and releases res's content and cache entry.
+ * Returns the parsed response, which can be a null pointer if no data
+ * was returned. If res has an error status but its content isn't an error
+ * object (e.g. a gateway's HTML page), returns an error object instead.
+ */
+static cJSON *finish_response(Response res);
+
+/*
+ * convert_response:
+ * Ends the conversion of res's content (see fetch_request_convert), once
+ * response was returned by finish_response.
+ * Returns the structure converted, or null if response is an error or if
+ * the content didn't describe the structure expected, in which case
+ * response is set to an error object.
+ */
+static void *convert_response(Response res, cJSON **response);
+
 /*
  * call_api:
  * Uses curl to call an API using url, method and body.
  * method must be one of "GET", "POST", "PUT" and "DELETE".
  * If body is null, the request's body will be set to null.
- * Returns the API's response as a JSON string.
- * If url or method is null, if method isn't valid or if an error occurs
- * while calling the API, terminates the program.
+ * GET requests failing with a transient error are made again, as long as
+ * the retry policy allows it.
+ * Returns the API's response parsed using cJSON module, which can be
+ * a null pointer if no data was returned, or an error object if the API
+ * couldn't be called.
+ * If url or method is null or if method isn't valid, terminates
+ * the program.
+ */
+static cJSON *call_api(string url, string method, string body);
+
+/*
+ * perform_request:
+ * Makes the request of call_api for res, or reads its response from
+ * the response cache if it's fresh, using the synchronous API of curl
+ * if initialized is true.
+ * Returns the result of the last attempt.
+ */
+static CURLcode perform_request(string url, string method, string body,
+                                Response res, bool initialized);
+
+/*
+ * setup_handle:
+ * Sets curl's options to call url using method and body, writing the
+ * response's content in res.
+ * Returns the list of headers used by the request. The list must be
+ * released using curl_slist_free_all once the request is over.
+ */
+static struct curl_slist *setup_handle(CURL *curl, string url, string method,
+                                       string body, Response res);
+
+/*
+ * acquire_handle:
+ * Returns an idle handle from the context's pool, creating it if the pool
+ * isn't full yet. The handle is reset to its default options but keeps
+ * its live connections and caches.
+ * Returns a null pointer if no handle could be obtained.
+ */
+static CURL *acquire_handle(void);
+
+/*
+ * release_handle:
+ * Gives curl back to the context's pool so that it can be used by the
+ * next request. If curl doesn't belong to the pool, cleans it up.
+ */
+static void release_handle(CURL *curl);
+
+/*
+ * record_stats:
+ * Reads the measures taken by curl for the request it just completed,
+ * res being its decompressed response, adds them to the accumulated stats
+ * and returns them.
+ */
+static struct fetch_request_stats record_stats(CURL *curl, Response res);
+
+/*
+ * share_lock, share_unlock:
+ * Callbacks used by curl to lock/unlock the data shared between handles.
+ */
+static void share_lock(CURL *curl, curl_lock_data data,
+                       curl_lock_access access, void *userp);
+static void share_unlock(CURL *curl, curl_lock_data data, void *userp);
+
+/*
+ * start_engine:
+ * Starts the engine's thread if it isn't running yet.
+ * Must be called with engine.lock held.
+ * Returns true if the engine is running, else returns false.
+ */
+static bool start_engine(void);
+
+/*
+ * stop_engine:
+ * Stops the engine's thread, waiting for it to terminate.
+ */
+static void stop_engine(void);
+
+/*
+ * run_engine:
+ * Main function of the engine's thread. Moves pending requests to the
+ * multi handle, waits for activity and completes finished requests
+ * until the engine is stopped.
+ */
+static void *run_engine(void *arg);
+
+/*
+ * wake_engine:
+ * Wakes the engine's thread up if it is waiting for activity.
+ */
+static void wake_engine(void);
+
+/*
+ * start_pending_requests:
+ * Adds pending requests to the multi handle until max_active requests
+ * are in flight.
+ */
+static void start_pending_requests(void);
+
+/*
+ * complete_requests:
+ * Reads the multi handle's messages and completes every finished request.
+ */
+static void complete_requests(void);
+
+/*
+ * finish_request:
+ * Lands request's flight once its response is set, removes it from
+ * the active requests and marks it as done.
+ */
+static void finish_request(FetchRequest request);
+
+/*
+ * mark_done:
+ * Calls request's callback once its response is set, then marks it
+ * as done.
+ */
+static void mark_done(FetchRequest request);
+
+/*
+ * wait_for_activity:
+ * Waits until a socket used by a request is ready, until curl's timeout
+ * expires or until the engine is woken up, then lets curl handle
+ * the activity.
  */
-static string call_api(string url, string method, string body);
+static void wait_for_activity(void);
+
+#ifdef __linux__
+/*
+ * socket_cb:
+ * Callback used by curl to tell which events must be watched on s.
+ */
+static int socket_cb(CURL *curl, curl_socket_t s, int what, void *userp,
+                     void *socketp);
+
+/*
+ * timer_cb:
+ * Callback used by curl to tell in how much time it must be called
+ * if no activity happens on its sockets.
+ */
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp);
+#endif
+
+/*
+ * take_token:
+ * Takes a token from the rate limiter if one is available.
+ * Returns 0 if a token was taken, else returns the number of milliseconds
+ * to wait before trying again.
+ */
+static long take_token(void);
+
+/*
+ * wait_for_token:
+ * Blocks the calling thread until a token could be taken from the rate
+ * limiter.
+ */
+static void wait_for_token(void);
+
+/*
+ * init_response:
+ * Prepares res for a new request.
+ * Returns false if not enough memory was available, else returns true.
+ */
+static bool init_response(Response res);
+
+/*
+ * restart_response:
+ * Discards what was received for res so that its request can be
+ * made again.
+ */
+static void restart_response(Response res);
+
+/*
+ * retry_throttled:
+ * If res was throttled by the API (429 status), makes every request wait
+ * for the delay asked by the response, or for an exponential backoff with
+ * jitter if it's longer, and restarts res.
+ * Returns true if the request must be made again, or false if it wasn't
+ * throttled or was already retried the maximum number of times, in which
+ * case the response is kept.
+ */
+static bool retry_throttled(Response res);
+
+/*
+ * retry_failed:
+ * If res's request is a GET request (method) that failed with a transient
+ * error (rc being a transient curl error or res having a 5xx status),
+ * sets the time at which it can be made again using an exponential backoff
+ * with jitter, and restarts res.
+ * Returns true if the request must be made again, or false if it didn't
+ * fail, if the error isn't transient, if the request was already made
+ * the maximum number of times or if it would be retried after its deadline.
+ */
+static bool retry_failed(CURLcode rc, string method, Response res);
+
+/*
+ * fail_response:
+ * Releases res's content and cache entry, as res's request failed with rc.
+ * Returns an error object in the same format as the API's errors, with
+ * a status of 0 and the description of rc as its message.
+ */
+static cJSON *fail_response(Response res, CURLcode rc);
+
+/*
+ * is_error:
+ * Returns true if response is an error object (see fetch), else returns
+ * false.
+ */
+static bool is_error(cJSON *response);
+
+/*
+ * page_url:
+ * Returns url followed by the query selecting the page of limit items
+ * starting at offset. The string must be released by the caller.
+ * Terminates program if not enough memory was available.
+ */
+static string page_url(string url, size_t limit, size_t offset);
+
+/*
+ * create_error:
+ * Returns an error object in the same format as the API's errors, using
+ * status and message.
+ * Terminates program if not enough memory was available.
+ */
+static cJSON *create_error(long status, const char *message);
+
+/*
+ * sleep_until:
+ * Blocks the calling thread until time_ms (on the monotonic clock).
+ */
+static void sleep_until(long time_ms);
+
+/*
+ * sleep_for:
+ * Blocks the calling thread for wait_ms milliseconds.
+ */
+static void sleep_for(long wait_ms);
+
+/*
+ * now_ms:
+ * Returns the current time of the monotonic clock in milliseconds.
+ */
+static long now_ms(void);
+
+/*
+ * limiter_clock:
+ * limiter_clock returns the time in milliseconds used by the rate limiter,
+ * and limiter_sleep blocks the calling thread for wait_ms milliseconds
+ * while it waits for a token. They use the monotonic clock by default.
+ */
+long (*limiter_clock)(void) = now_ms;
+void (*limiter_sleep)(long wait_ms) = sleep_for;
+
+bool fetch_init(void) {
+  pthread_mutex_lock(&context.init_lock);
+  if (context.initialized) {
+    pthread_mutex_unlock(&context.init_lock);
+    return true;
+  }
+  if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+    pthread_mutex_unlock(&context.init_lock);
+    return false;
+  }
+
+  context.share = curl_share_init();
+  if (context.share == NULL) {
+    curl_global_cleanup();
+    pthread_mutex_unlock(&context.init_lock);
+    return false;
+  }
+  for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+    pthread_mutex_init(&context.share_locks[i], NULL);
+  }
+  pthread_mutex_init(&context.pool_lock, NULL);
+  curl_share_setopt(context.share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(context.share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(context.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(context.share, CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_SSL_SESSION);
+
+  context.handles_count = 0;
+  pthread_mutex_lock(&stats.lock);
+  stats.totals = (struct fetch_stats) { 0 };
+  pthread_mutex_unlock(&stats.lock);
+  context.initialized = true;
+  pthread_mutex_unlock(&context.init_lock);
+  return true;
+}
+
+void fetch_cleanup(void) {
+  pthread_mutex_lock(&context.init_lock);
+  if (!context.initialized) {
+    pthread_mutex_unlock(&context.init_lock);
+    return;
+  }
+  fetch_cancel_prefetches();
+  release_dropped_prefetches(true);
+  stop_engine();
+  for (size_t i = 0; i < context.handles_count; i++) {
+    curl_easy_cleanup(context.handles[i]);
+    context.handles[i] = NULL;
+    context.in_use[i] = false;
+  }
+  context.handles_count = 0;
+  curl_share_cleanup(context.share);
+  context.share = NULL;
+  pthread_mutex_destroy(&context.pool_lock);
+  for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+    pthread_mutex_destroy(&context.share_locks[i]);
+  }
+  curl_global_cleanup();
+  context.initialized = false;
+  pthread_mutex_unlock(&context.init_lock);
+}
 
 cJSON *fetch(string url, string method, string body) {
-  char *space;
-  while ((space = strchr(url, ' ')) != NULL) *space = '+';
-  string json_res = call_api(url, method, body);
-  cJSON *res = cJSON_Parse(json_res);
-  free(json_res);
-  return res;
+  cJSON *response;
+  if (url != NULL && method != NULL && IS_GET(method) &&
+      take_prefetch(url, &response)) {
+    return response;
+  }
+  return call_api(url, method, body);
+}
+
+void *fetch_struct(string url, enum stream_type type, cJSON **error) {
+  FetchRequest request = new_fetch_request(url, "GET", NULL);
+  if (request == NULL || !fetch_request_convert(request, type)) {
+    exit(EXIT_FAILURE);
+  }
+
+  void *structure = NULL;
+  if (fetch_submit(request, NULL, NULL)) {
+    structure = fetch_wait_struct(request, error);
+  } else *error = create_error(0, "The request couldn't be sent");
+  free_fetch_request(request);
+  return structure;
+}
+
+bool fetch_prefetch(string url) {
+  if (url == NULL) return false;
+  release_dropped_prefetches(false);
+
+  pthread_mutex_lock(&prefetches.lock);
+  Prefetch prefetch = prefetches.list;
+  while (prefetch != NULL && strcmp(prefetch->url, url)) {
+    prefetch = prefetch->next;
+  }
+  bool known = prefetch != NULL;
+  bool allowed = !known && prefetches.count < prefetches.budget;
+  if (allowed) prefetches.count++;
+  pthread_mutex_unlock(&prefetches.lock);
+  if (!allowed) {
+    if (!known) {
+      pthread_mutex_lock(&stats.lock);
+      stats.totals.skipped_prefetches++;
+      pthread_mutex_unlock(&stats.lock);
+    }
+    return known;
+  }
+
+  prefetch = malloc(sizeof(struct prefetch));
+  string copy = malloc(strlen(url) + 1);
+  FetchRequest request =
+    copy != NULL ? new_fetch_request(strcpy(copy, url), "GET", NULL) : NULL;
+  if (prefetch == NULL || request == NULL ||
+      !fetch_submit(request, NULL, NULL)) {
+    free(prefetch);
+    free(copy);
+    free_fetch_request(request);
+    pthread_mutex_lock(&prefetches.lock);
+    prefetches.count--;
+    pthread_mutex_unlock(&prefetches.lock);
+    return false;
+  }
+  prefetch->url = copy;
+  prefetch->request = request;
+
+  pthread_mutex_lock(&prefetches.lock);
+  prefetch->next = prefetches.list;
+  prefetches.list = prefetch;
+  pthread_mutex_unlock(&prefetches.lock);
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.prefetched_requests++;
+  pthread_mutex_unlock(&stats.lock);
+  return true;
+}
+
+void fetch_cancel_prefetches(void) {
+  pthread_mutex_lock(&prefetches.lock);
+  Prefetch list = prefetches.list;
+  prefetches.list = NULL;
+  pthread_mutex_unlock(&prefetches.lock);
+
+  size_t cancelled = 0;
+  while (list != NULL) {
+    Prefetch prefetch = list;
+    list = prefetch->next;
+    cancelled++;
+    if (unqueue_request(prefetch->request) ||
+        fetch_is_done(prefetch->request)) {
+      free_prefetch(prefetch);
+      pthread_mutex_lock(&prefetches.lock);
+      prefetches.count--;
+      pthread_mutex_unlock(&prefetches.lock);
+    } else {
+      pthread_mutex_lock(&prefetches.lock);
+      prefetch->next = prefetches.dropped;
+      prefetches.dropped = prefetch;
+      pthread_mutex_unlock(&prefetches.lock);
+    }
+  }
+
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.cancelled_prefetches += cancelled;
+  pthread_mutex_unlock(&stats.lock);
+}
+
+FetchRequest new_fetch_request(string url, string method, string body) {
+  if (url == NULL || method == NULL || !IS_METHOD(method)) exit(EXIT_FAILURE);
+  FetchRequest request = malloc(sizeof(struct fetch_request));
+  if (request == NULL) return request;
+  request->url = url;
+  request->method = method;
+  request->body = body;
+  request->callback = NULL;
+  request->data = NULL;
+  request->curl = NULL;
+  request->headers = NULL;
+  request->res.content = NULL;
+  request->res.cache = NULL;
+  request->rc = CURLE_OK;
+  request->stats = (struct fetch_request_stats) { 0 };
+  request->response = NULL;
+  request->converter = NULL;
+  request->structure = NULL;
+  request->flight = NULL;
+  request->submitted = request->done = false;
+  request->next = NULL;
+  return request;
+}
+
+void free_fetch_request(FetchRequest request) {
+  if (request == NULL) return;
+  if (request->submitted) fetch_wait(request);
+  cJSON_Delete(request->response);
+  free_stream_converter(request->converter);
+  free(request);
+}
+
+bool fetch_request_convert(FetchRequest request, enum stream_type type) {
+  if (request->submitted || !IS_GET(request->method)) return false;
+  free_stream_converter(request->converter);
+  request->converter = new_stream_converter(type);
+  return request->converter != NULL;
+}
+
+bool fetch_submit(FetchRequest request,
+                  void (*callback)(FetchRequest request, void *data),
+                  void *data) {
+  if (request == NULL || !fetch_init()) return false;
+
+  request->callback = callback;
+  request->data = data;
+  request->submitted = true;
+  Flight flight = NULL;
+  if (IS_GET(request->method) && request->converter == NULL &&
+      join_flight(request->url, request, &flight)) {
+    return true;
+  }
+  request->flight = flight;
+
+  bool initialized = init_response(&request->res);
+  request->res.converter = request->converter;
+  if (initialized &&
+      open_cache(&request->res, request->url, request->method)) {
+    request->response = finish_response(&request->res);
+    if (request->converter != NULL) {
+      request->structure = convert_response(&request->res,
+                                            &request->response);
+    }
+    land_flight(request->flight, request->response);
+    request->flight = NULL;
+    mark_done(request);
+    return true;
+  }
+
+  pthread_mutex_lock(&engine.lock);
+  if (!initialized || !start_engine()) {
+    pthread_mutex_unlock(&engine.lock);
+    request->submitted = false;
+    free(request->res.content);
+    request->res.content = NULL;
+    free_response_cache_entry(request->res.cache);
+    request->res.cache = NULL;
+    cJSON *response = create_error(0, "The request couldn't be sent");
+    land_flight(request->flight, response);
+    request->flight = NULL;
+    cJSON_Delete(response);
+    return false;
+  }
+  if (engine.pending_tail == NULL) engine.pending = request;
+  else engine.pending_tail->next = request;
+  engine.pending_tail = request;
+  pthread_mutex_unlock(&engine.lock);
+
+  wake_engine();
+  return true;
+}
+
+bool fetch_is_done(FetchRequest request) {
+  pthread_mutex_lock(&engine.lock);
+  bool done = request->done;
+  pthread_mutex_unlock(&engine.lock);
+  return done;
+}
+
+cJSON *fetch_wait(FetchRequest request) {
+  pthread_mutex_lock(&engine.lock);
+  while (!request->done) pthread_cond_wait(&engine.done_cond, &engine.lock);
+  pthread_mutex_unlock(&engine.lock);
+
+  cJSON *response = request->response;
+  request->response = NULL;
+  return response;
+}
+
+void *fetch_wait_struct(FetchRequest request, cJSON **error) {
+  *error = fetch_wait(request);
+  void *structure = request->structure;
+  request->structure = NULL;
+  return structure;
+}
+
+cJSON **fetch_many(string *urls, string method, string *bodies) {
+  size_t count = 0;
+  while (urls[count] != NULL) count++;
+
+  cJSON **responses = malloc((count + 1) * sizeof(cJSON *));
+  FetchRequest *requests = malloc((count + 1) * sizeof(FetchRequest));
+  if (responses == NULL || requests == NULL) exit(EXIT_FAILURE);
+
+  for (size_t i = 0; i < count; i++) {
+    requests[i] = new_fetch_request(urls[i], method,
+                                    bodies != NULL ? bodies[i] : NULL);
+    if (requests[i] == NULL) exit(EXIT_FAILURE);
+    if (!fetch_submit(requests[i], NULL, NULL)) {
+      free_fetch_request(requests[i]);
+      requests[i] = NULL;
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (requests[i] != NULL) {
+      responses[i] = fetch_wait(requests[i]);
+      free_fetch_request(requests[i]);
+    } else responses[i] = create_error(0, "The request couldn't be sent");
+  }
+  responses[count] = NULL;
+
+  free(requests);
+  return responses;
+}
+
+cJSON *fetch_all_pages(string url, size_t limit, size_t max_in_flight) {
+  string first_url = page_url(url, limit, 0);
+  FetchRequest first_request = new_fetch_request(first_url, "GET", NULL);
+  if (first_request == NULL ||
+      !fetch_submit(first_request, NULL, NULL)) {
+    exit(EXIT_FAILURE);
+  }
+  cJSON *cJSON_first_page = fetch_wait(first_request);
+  free_fetch_request(first_request);
+  free(first_url);
+  if (cJSON_first_page == NULL || is_error(cJSON_first_page)) {
+    return cJSON_first_page != NULL
+      ? cJSON_first_page
+      : create_error(0, "The API returned no page");
+  }
+
+  cJSON *cJSON_items =
+    cJSON_GetObjectItemCaseSensitive(cJSON_first_page, "items"),
+  *cJSON_limit = cJSON_GetObjectItemCaseSensitive(cJSON_first_page, "limit"),
+  *cJSON_total = cJSON_GetObjectItemCaseSensitive(cJSON_first_page, "total");
+  if (!cJSON_IsArray(cJSON_items) || !cJSON_IsNumber(cJSON_limit) ||
+      !cJSON_IsNumber(cJSON_total) || cJSON_limit->valueint <= 0 ||
+      cJSON_total->valueint <= cJSON_limit->valueint) {
+    return cJSON_first_page;
+  }
+
+  size_t page_limit = cJSON_limit->valueint, total = cJSON_total->valueint;
+  size_t pages_count = (total - 1) / page_limit;
+  if (max_in_flight == 0) max_in_flight = 1;
+  string *urls = malloc(pages_count * sizeof(string));
+  FetchRequest *requests = malloc(pages_count * sizeof(FetchRequest));
+  if (urls == NULL || requests == NULL) exit(EXIT_FAILURE);
+  for (size_t i = 0; i < pages_count; i++) {
+    urls[i] = page_url(url, page_limit, (i + 1) * page_limit);
+  }
+
+  size_t submitted = 0;
+  cJSON *cJSON_error = NULL;
+  for (size_t i = 0; i < pages_count; i++) {
+    while (cJSON_error == NULL && submitted < pages_count &&
+           submitted < i + max_in_flight) {
+      requests[submitted] = new_fetch_request(urls[submitted], "GET", NULL);
+      if (requests[submitted] == NULL ||
+          !fetch_submit(requests[submitted], NULL, NULL)) {
+        exit(EXIT_FAILURE);
+      }
+      submitted++;
+    }
+    if (i >= submitted) {
+      free(urls[i]);
+      continue;
+    }
+
+    cJSON *cJSON_page = fetch_wait(requests[i]);
+    free_fetch_request(requests[i]);
+    free(urls[i]);
+    if (cJSON_error != NULL || cJSON_page == NULL || is_error(cJSON_page)) {
+      if (cJSON_error == NULL) {
+        cJSON_error = cJSON_page != NULL
+          ? cJSON_page
+          : create_error(0, "The API returned no page");
+      } else cJSON_Delete(cJSON_page);
+      continue;
+    }
+
+    cJSON *cJSON_page_items =
+      cJSON_GetObjectItemCaseSensitive(cJSON_page, "items"),
+    *cJSON_item = NULL;
+    while (cJSON_IsArray(cJSON_page_items) &&
+           (cJSON_item = cJSON_DetachItemFromArray(cJSON_page_items, 0))) {
+      cJSON_AddItemToArray(cJSON_items, cJSON_item);
+    }
+    cJSON_Delete(cJSON_page);
+  }
+  free(urls);
+  free(requests);
+  if (cJSON_error != NULL) {
+    cJSON_Delete(cJSON_first_page);
+    return cJSON_error;
+  }
+
+  cJSON_ReplaceItemInObjectCaseSensitive(cJSON_first_page, "next",
+                                         cJSON_CreateNull());
+  return cJSON_first_page;
+}
+
+void fetch_set_prefetch_budget(size_t budget) {
+  pthread_mutex_lock(&prefetches.lock);
+  prefetches.budget = budget;
+  pthread_mutex_unlock(&prefetches.lock);
 }
 
-static size_t curl_cb(void *contents, size_t size, size_t nmemb, 
+void fetch_set_max_streams(size_t max_streams) {
+  if (max_streams == 0) return;
+  pthread_mutex_lock(&engine.lock);
+  engine.max_active = max_streams;
+  pthread_mutex_unlock(&engine.lock);
+  wake_engine();
+}
+
+void fetch_set_rate_limit(double requests_per_second) {
+  if (requests_per_second < 0) return;
+  pthread_mutex_lock(&limiter.lock);
+  limiter.rate = requests_per_second;
+  if (limiter.tokens > requests_per_second) {
+    limiter.tokens = requests_per_second < 1 ? 1 : requests_per_second;
+  }
+  pthread_mutex_unlock(&limiter.lock);
+  wake_engine();
+}
+
+void fetch_set_max_throttled_retries(size_t max_retries) {
+  pthread_mutex_lock(&limiter.lock);
+  limiter.max_retries = max_retries;
+  pthread_mutex_unlock(&limiter.lock);
+}
+
+void fetch_set_max_attempts(size_t max_attempts) {
+  if (max_attempts == 0) return;
+  pthread_mutex_lock(&retries.lock);
+  retries.max_attempts = max_attempts;
+  pthread_mutex_unlock(&retries.lock);
+}
+
+void fetch_set_request_deadline(long deadline_ms) {
+  if (deadline_ms < 0) return;
+  pthread_mutex_lock(&retries.lock);
+  retries.deadline_ms = deadline_ms;
+  pthread_mutex_unlock(&retries.lock);
+}
+
+struct fetch_request_stats fetch_request_stats(FetchRequest request) {
+  return request->stats;
+}
+
+struct fetch_stats fetch_get_stats(void) {
+  pthread_mutex_lock(&stats.lock);
+  struct fetch_stats totals = stats.totals;
+  pthread_mutex_unlock(&stats.lock);
+  return totals;
+}
+
+static size_t curl_cb(void *contents, size_t size, size_t nmemb,
                       void *res_ptr) {
   Response res = (struct response *) res_ptr;
 
   size_t total_size = size * nmemb;
-  string resized_content = realloc(res->content, res->size + total_size + 1);
-  if (resized_content == NULL) return 0;
-  res->content = resized_content;
+  if (res->converter != NULL && res->status < 300) {
+    stream_converter_feed(res->converter, contents, total_size);
+  } else if (!append_content(res, contents, total_size)) return 0;
+
+  response_cache_write(res->cache, contents, total_size);
 
-  memcpy(res->content + res->size, contents, total_size);
-  res->size += total_size;
+  return total_size;
+}
+
+static size_t header_cb(char *line, size_t size, size_t nitems,
+                        void *res_ptr) {
+  Response res = (struct response *) res_ptr;
+  size_t total_size = size * nitems;
+  response_cache_header(res->cache, line, total_size);
 
+  if (total_size >= strlen("HTTP/") &&
+      !strncmp(line, "HTTP/", strlen("HTTP/"))) {
+    char *status = memchr(line, ' ', total_size);
+    res->status = status != NULL ? strtol(status, NULL, 10) : 0;
+    res->retry_after_ms = -1;
+  } else if (total_size > strlen("Retry-After:") &&
+             !strncasecmp(line, "Retry-After:", strlen("Retry-After:"))) {
+    char value[64];
+    size_t value_size = total_size - strlen("Retry-After:");
+    if (value_size >= sizeof(value)) value_size = sizeof(value) - 1;
+    memcpy(value, line + strlen("Retry-After:"), value_size);
+    value[value_size] = '\0';
+
+    char *end;
+    long seconds = strtol(value, &end, 10);
+    if (end == value) {
+      time_t date = curl_getdate(value, NULL);
+      seconds = date < 0 ? -1 : (long) (date - time(NULL));
+      if (date >= 0 && seconds < 0) seconds = 0;
+    }
+    if (seconds >= 0) res->retry_after_ms = seconds * 1000;
+  }
   return total_size;
 }
 
-static string call_api(string url, string method, string body) {
+static bool open_cache(Response res, string url, string method) {
+  res->cache = IS_GET(method) ? new_response_cache_entry(url, token) : NULL;
+  if (res->cache == NULL || !response_cache_is_fresh(res->cache) ||
+      !read_cached(res)) {
+    return false;
+  }
+
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.cached_responses++;
+  pthread_mutex_unlock(&stats.lock);
+  return true;
+}
+
+static bool read_cached(Response res) {
+  if (response_cache_read(res->cache, read_chunk, res)) return true;
+  restart_response(res);
+  return false;
+}
+
+static void read_chunk(void *res_ptr, const char *chunk, size_t size) {
+  Response res = (struct response *) res_ptr;
+  if (res->converter != NULL) {
+    stream_converter_feed(res->converter, chunk, size);
+  } else if (!append_content(res, chunk, size)) exit(EXIT_FAILURE);
+}
+
+static bool append_content(Response res, const char *chunk, size_t size) {
+  if (res->size + size + 1 > res->capacity) {
+    size_t capacity = res->capacity ? res->capacity : 1024;
+    while (res->size + size + 1 > capacity) capacity *= 2;
+    string content = realloc(res->content, capacity);
+    if (content == NULL) return false;
+    res->content = content;
+    res->capacity = capacity;
+  }
+  memcpy(res->content + res->size, chunk, size);
+  res->size += size;
+  res->content[res->size] = '\0';
+  return true;
+}
+
+static bool reuse_stored(Response res) {
+  if (res->cache == NULL || response_cache_status(res->cache) != 304) {
+    return true;
+  }
+  if (!read_cached(res)) {
+    free_response_cache_entry(res->cache);
+    res->cache = NULL;
+    return false;
+  }
+
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.revalidated_responses++;
+  pthread_mutex_unlock(&stats.lock);
+  return true;
+}
+
+static cJSON *finish_response(Response res) {
+  if (res->cache != NULL) {
+    if (response_cache_status(res->cache) != 304) {
+      response_cache_store(res->cache);
+    }
+    free_response_cache_entry(res->cache);
+    res->cache = NULL;
+  }
+
+  cJSON *response = cJSON_Parse(res->content != NULL ? res->content : "");
+  free(res->content);
+  res->content = NULL;
+
+  if (res->status >= SERVER_ERROR) {
+    pthread_mutex_lock(&stats.lock);
+    stats.totals.failed_requests++;
+    pthread_mutex_unlock(&stats.lock);
+  }
+  if (res->status >= 400 && !is_error(response)) {
+    cJSON_Delete(response);
+    response = create_error(res->status, "The API returned an error");
+  }
+  return response;
+}
+
+static void *convert_response(Response res, cJSON **response) {
+  if (*response != NULL) return NULL;
+  void *structure = stream_converter_finish(res->converter);
+  if (structure == NULL) {
+    *response = create_error(res->status,
+                             "The API returned an invalid response");
+  }
+  return structure;
+}
+
+static cJSON *call_api(string url, string method, string body) {
   if (url == NULL || method == NULL || !IS_METHOD(method)) exit(EXIT_FAILURE);
 
-  CURL *curl;
-  CURLcode rc = (CURLcode) CURLE_OK - 1;
+  bool initialized = fetch_init();
+  Flight flight = NULL;
+  if (IS_GET(method) && join_flight(url, NULL, &flight)) {
+    return wait_for_flight(flight);
+  }
 
   struct response res;
-  res.content = malloc(sizeof(char));
-  if (res.content == NULL) return res.content;
-  res.size = 0;
-  res.content[res.size] = '\0';
-
-  curl_global_init(CURL_GLOBAL_DEFAULT);
-  curl = curl_easy_init();
-  if (curl) {
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&res);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-    struct curl_slist *list = NULL;
-    if (token != NULL) {
-      size_t authorization_size =
-        strlen("Authorization: Bearer ") + strlen(token) + 1;
-      char authorization_str[authorization_size];
-      strcpy(authorization_str, "Authorization: Bearer ");
-      strcat(authorization_str, token);
-      list = curl_slist_append(list, authorization_str);
-
-      if (body) {
-        list = curl_slist_append(list, "Content-Type: application/json");
+  cJSON *response = NULL;
+  if (!init_response(&res)) {
+    land_flight(flight, response);
+    return response;
+  }
+
+  CURLcode rc = perform_request(url, method, body, &res, initialized);
+  response = rc == CURLE_OK ? finish_response(&res) : fail_response(&res, rc);
+  land_flight(flight, response);
+  return response;
+}
+
+static CURLcode perform_request(string url, string method, string body,
+                                Response res, bool initialized) {
+  if (open_cache(res, url, method)) return CURLE_OK;
+
+  CURLcode rc = (CURLcode) CURLE_OK - 1;
+  CURL *curl = initialized ? acquire_handle() : NULL;
+  if (curl == NULL) return CURLE_FAILED_INIT;
+  do {
+    sleep_until(res->retry_at_ms);
+    wait_for_token();
+    struct curl_slist *list = setup_handle(curl, url, method, body, res);
+
+    rc = curl_easy_perform(curl);
+    res->status = 0;
+    if (rc == CURLE_OK) {
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &res->status);
+      record_stats(curl, res);
+    }
+
+    curl_slist_free_all(list);
+  } while (retry_throttled(res) || retry_failed(rc, method, res) ||
+           (rc == CURLE_OK && !reuse_stored(res)));
+
+  release_handle(curl);
+  if (!IS_GET(method)) response_cache_invalidate();
+  return rc;
+}
+
+static struct curl_slist *setup_handle(CURL *curl, string url, string method,
+                                       string body, Response res) {
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) res);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *) res);
+
+  pthread_mutex_lock(&retries.lock);
+  long deadline_ms = retries.deadline_ms;
+  pthread_mutex_unlock(&retries.lock);
+  if (res->started_ms < 0) res->started_ms = now_ms();
+  if (deadline_ms > 0) {
+    long timeout_ms = res->started_ms + deadline_ms - now_ms();
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms > 0 ? timeout_ms : 1);
+  }
+
+  struct curl_slist *list = NULL;
+  if (token != NULL) {
+    size_t authorization_size =
+      strlen("Authorization: Bearer ") + strlen(token) + 1;
+    char authorization_str[authorization_size];
+    strcpy(authorization_str, "Authorization: Bearer ");
+    strcat(authorization_str, token);
+    list = curl_slist_append(list, authorization_str);
+
+    if (body) {
+      list = curl_slist_append(list, "Content-Type: application/json");
+    }
+  }
+
+  string etag = res->cache != NULL ? response_cache_etag(res->cache) : NULL;
+  if (etag != NULL) {
+    size_t if_none_match_size =
+      strlen("If-None-Match: ") + strlen(etag) + 1;
+    char if_none_match_str[if_none_match_size];
+    strcpy(if_none_match_str, "If-None-Match: ");
+    strcat(if_none_match_str, etag);
+    list = curl_slist_append(list, if_none_match_str);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+
+  if (body != NULL) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+  }
+
+  if (IS_GET(method)) {
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+  } else if (IS_POST(method)) {
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  } else if (IS_PUT(method)) {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+  } else {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+  }
+
+  if (IS_POST(method) || IS_PUT(method)) {
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, 0);
+  }
+
+  return list;
+}
+
+static CURL *acquire_handle(void) {
+  pthread_mutex_lock(&context.pool_lock);
+  size_t i;
+  for (i = 0; i < context.handles_count && context.in_use[i]; i++);
+
+  CURL *curl;
+  if (i == POOL_SIZE) {
+    curl = curl_easy_init();
+  } else if (i == context.handles_count) {
+    curl = context.handles[i] = curl_easy_init();
+    if (curl != NULL) context.handles_count++;
+  } else {
+    curl = context.handles[i];
+    curl_easy_reset(curl);
+  }
+  if (curl != NULL && i < POOL_SIZE) context.in_use[i] = true;
+  pthread_mutex_unlock(&context.pool_lock);
+  if (curl == NULL) return NULL;
+
+  curl_easy_setopt(curl, CURLOPT_SHARE, context.share);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  return curl;
+}
+
+static void release_handle(CURL *curl) {
+  pthread_mutex_lock(&context.pool_lock);
+  for (size_t i = 0; i < context.handles_count; i++) {
+    if (context.handles[i] == curl) {
+      context.in_use[i] = false;
+      pthread_mutex_unlock(&context.pool_lock);
+      return;
+    }
+  }
+  pthread_mutex_unlock(&context.pool_lock);
+  curl_easy_cleanup(curl);
+}
+
+static struct fetch_request_stats record_stats(CURL *curl, Response res) {
+  curl_off_t time_us = 0, received_bytes = 0;
+  long connections = 0, version = 0;
+  curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &time_us);
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connections);
+  curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received_bytes);
+  struct fetch_request_stats request_stats = {
+    .time_us = (long) time_us,
+    .connections = connections,
+    .http2 = version == CURL_HTTP_VERSION_2_0,
+    .received_bytes = (size_t) received_bytes,
+    .decoded_bytes = res->size
+  };
+
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.requests++;
+  stats.totals.connections += connections;
+  if (request_stats.http2) stats.totals.http2_requests++;
+  stats.totals.received_bytes += request_stats.received_bytes;
+  stats.totals.decoded_bytes += request_stats.decoded_bytes;
+  stats.totals.total_time_us += request_stats.time_us;
+  if (request_stats.time_us > stats.totals.max_time_us) {
+    stats.totals.max_time_us = request_stats.time_us;
+  }
+  pthread_mutex_unlock(&stats.lock);
+  return request_stats;
+}
+
+static void share_lock(CURL *curl, curl_lock_data data,
+                       curl_lock_access access, void *userp) {
+  (void) curl;
+  (void) access;
+  (void) userp;
+  pthread_mutex_lock(&context.share_locks[data]);
+}
+
+static void share_unlock(CURL *curl, curl_lock_data data, void *userp) {
+  (void) curl;
+  (void) userp;
+  pthread_mutex_unlock(&context.share_locks[data]);
+}
+
+static bool start_engine(void) {
+  if (engine.running) return true;
+
+  engine.multi = curl_multi_init();
+  if (engine.multi == NULL) return false;
+#ifdef __linux__
+  engine.epoll_fd = epoll_create1(0);
+  engine.wakeup_fd = eventfd(0, EFD_NONBLOCK);
+  struct epoll_event event = { .events = EPOLLIN,
+                               .data.fd = engine.wakeup_fd };
+  if (engine.epoll_fd < 0 || engine.wakeup_fd < 0 ||
+      epoll_ctl(engine.epoll_fd, EPOLL_CTL_ADD, engine.wakeup_fd, &event)) {
+    if (engine.epoll_fd >= 0) close(engine.epoll_fd);
+    if (engine.wakeup_fd >= 0) close(engine.wakeup_fd);
+    curl_multi_cleanup(engine.multi);
+    return false;
+  }
+  engine.deadline_ms = -1;
+  curl_multi_setopt(engine.multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+  curl_multi_setopt(engine.multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+#endif
+  curl_multi_setopt(engine.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  engine.max_streams = engine.max_active;
+  curl_multi_setopt(engine.multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                    (long) engine.max_streams);
+
+  engine.active = 0;
+  engine.running = true;
+  if (pthread_create(&engine.thread, NULL, run_engine, NULL)) {
+    engine.running = false;
+#ifdef __linux__
+    close(engine.epoll_fd);
+    close(engine.wakeup_fd);
+#endif
+    curl_multi_cleanup(engine.multi);
+    return false;
+  }
+  return true;
+}
+
+static void stop_engine(void) {
+  pthread_mutex_lock(&engine.lock);
+  if (!engine.running) {
+    pthread_mutex_unlock(&engine.lock);
+    return;
+  }
+  engine.running = false;
+  pthread_mutex_unlock(&engine.lock);
+
+  wake_engine();
+  pthread_join(engine.thread, NULL);
+
+#ifdef __linux__
+  close(engine.epoll_fd);
+  close(engine.wakeup_fd);
+#endif
+  curl_multi_cleanup(engine.multi);
+  engine.multi = NULL;
+}
+
+static void *run_engine(void *arg) {
+  (void) arg;
+  for (;;) {
+    pthread_mutex_lock(&engine.lock);
+    bool running = engine.running;
+    pthread_mutex_unlock(&engine.lock);
+    if (!running) break;
+
+    start_pending_requests();
+    wait_for_activity();
+    complete_requests();
+  }
+  return NULL;
+}
+
+static void wake_engine(void) {
+  if (engine.multi == NULL) return;
+#ifdef __linux__
+  uint64_t value = 1;
+  if (write(engine.wakeup_fd, &value, sizeof(value)) < 0) return;
+#else
+  curl_multi_wakeup(engine.multi);
+#endif
+}
+
+static void start_pending_requests(void) {
+  pthread_mutex_lock(&engine.lock);
+  if (engine.max_streams != engine.max_active) {
+    engine.max_streams = engine.max_active;
+    curl_multi_setopt(engine.multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                      (long) engine.max_streams);
+  }
+  pthread_mutex_unlock(&engine.lock);
+
+  for (;;) {
+    pthread_mutex_lock(&engine.lock);
+    long now = now_ms();
+    engine.wake_ms = -1;
+    FetchRequest request = NULL, previous = NULL;
+    if (engine.active < engine.max_active) {
+      for (request = engine.pending; request != NULL;
+           previous = request, request = request->next) {
+        if (request->res.retry_at_ms <= now) break;
+        if (engine.wake_ms < 0 || request->res.retry_at_ms < engine.wake_ms) {
+          engine.wake_ms = request->res.retry_at_ms;
+        }
       }
+    }
+    long wait_ms = request != NULL ? take_token() : 0;
+    if (wait_ms > 0) {
+      engine.wake_ms = now + wait_ms;
+      request = NULL;
+    }
+    if (request != NULL) {
+      if (previous != NULL) {
+        previous->next = request->next;
+      } else engine.pending = request->next;
+      if (engine.pending_tail == request) engine.pending_tail = previous;
+      request->next = NULL;
+      engine.active++;
+    }
+    pthread_mutex_unlock(&engine.lock);
+    if (request == NULL) return;
 
-      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+    request->curl = acquire_handle();
+    if (request->curl == NULL) {
+      request->rc = CURLE_FAILED_INIT;
+      request->response = fail_response(&request->res, request->rc);
+      finish_request(request);
+      continue;
     }
+    request->headers = setup_handle(request->curl, request->url,
+                                    request->method, request->body,
+                                    &request->res);
+    curl_easy_setopt(request->curl, CURLOPT_PRIVATE, request);
+    curl_multi_add_handle(engine.multi, request->curl);
+  }
+}
 
-    if (body != NULL) {
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+static void complete_requests(void) {
+  CURLMsg *message;
+  int messages_left;
+  while ((message = curl_multi_info_read(engine.multi, &messages_left))) {
+    if (message->msg != CURLMSG_DONE) continue;
+    FetchRequest request;
+    curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &request);
+    request->rc = message->data.result;
+    request->res.status = 0;
+    if (request->rc == CURLE_OK) {
+      curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE,
+                        &request->res.status);
+      request->stats = record_stats(request->curl, &request->res);
     }
 
-    if (IS_GET(method)) {
-      curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-    } else if (IS_POST(method)) {
-      curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    } else if (IS_PUT(method)) {
-      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
-    } else {
-      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    curl_multi_remove_handle(engine.multi, request->curl);
+    curl_slist_free_all(request->headers);
+    request->headers = NULL;
+    release_handle(request->curl);
+    request->curl = NULL;
+
+    if (retry_throttled(&request->res) ||
+        retry_failed(request->rc, request->method, &request->res) ||
+        (request->rc == CURLE_OK && !reuse_stored(&request->res))) {
+      pthread_mutex_lock(&engine.lock);
+      engine.active--;
+      request->next = engine.pending;
+      engine.pending = request;
+      if (engine.pending_tail == NULL) engine.pending_tail = request;
+      pthread_mutex_unlock(&engine.lock);
+      continue;
+    }
+    request->response = request->rc == CURLE_OK
+      ? finish_response(&request->res)
+      : fail_response(&request->res, request->rc);
+    if (request->rc == CURLE_OK && request->converter != NULL) {
+      request->structure = convert_response(&request->res,
+                                            &request->response);
+    }
+    finish_request(request);
+  }
+}
+
+static void finish_request(FetchRequest request) {
+  if (!IS_GET(request->method)) response_cache_invalidate();
+  land_flight(request->flight, request->response);
+  request->flight = NULL;
+
+  pthread_mutex_lock(&engine.lock);
+  engine.active--;
+  pthread_mutex_unlock(&engine.lock);
+  mark_done(request);
+}
+
+static void mark_done(FetchRequest request) {
+  if (request->callback != NULL) request->callback(request, request->data);
+
+  pthread_mutex_lock(&engine.lock);
+  request->done = true;
+  pthread_cond_broadcast(&engine.done_cond);
+  pthread_mutex_unlock(&engine.lock);
+}
+
+#ifdef __linux__
+static void wait_for_activity(void) {
+  struct epoll_event events[MAX_EVENTS];
+  int running_handles;
+  long timeout_ms = -1;
+  if (engine.deadline_ms >= 0) {
+    timeout_ms = engine.deadline_ms - now_ms();
+    if (timeout_ms < 0) timeout_ms = 0;
+  }
+  if (engine.wake_ms >= 0) {
+    long limiter_timeout_ms = engine.wake_ms - now_ms();
+    if (limiter_timeout_ms < 0) limiter_timeout_ms = 0;
+    if (timeout_ms < 0 || limiter_timeout_ms < timeout_ms) {
+      timeout_ms = limiter_timeout_ms;
     }
+  }
+  int events_count = epoll_wait(engine.epoll_fd, events, MAX_EVENTS,
+                                (int) timeout_ms);
 
-    if (IS_POST(method) || IS_PUT(method)) {
-      curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, 0);
+  for (int i = 0; i < events_count; i++) {
+    if (events[i].data.fd == engine.wakeup_fd) {
+      uint64_t value;
+      if (read(engine.wakeup_fd, &value, sizeof(value)) < 0) continue;
+      continue;
     }
+    int action = (events[i].events & EPOLLIN ? CURL_CSELECT_IN : 0) |
+                 (events[i].events & EPOLLOUT ? CURL_CSELECT_OUT : 0) |
+                 (events[i].events & EPOLLERR ? CURL_CSELECT_ERR : 0);
+    curl_multi_socket_action(engine.multi, events[i].data.fd, action,
+                             &running_handles);
+  }
 
-    rc = curl_easy_perform(curl);
+  if (engine.deadline_ms >= 0 && now_ms() >= engine.deadline_ms) {
+    engine.deadline_ms = -1;
+    curl_multi_socket_action(engine.multi, CURL_SOCKET_TIMEOUT, 0,
+                             &running_handles);
+  }
+}
 
-    curl_slist_free_all(list);
+static int socket_cb(CURL *curl, curl_socket_t s, int what, void *userp,
+                     void *socketp) {
+  (void) curl;
+  (void) userp;
+  if (what == CURL_POLL_REMOVE) {
+    epoll_ctl(engine.epoll_fd, EPOLL_CTL_DEL, s, NULL);
+    return 0;
+  }
+
+  struct epoll_event event = {
+    .events = (what & CURL_POLL_IN ? EPOLLIN : 0) |
+              (what & CURL_POLL_OUT ? EPOLLOUT : 0),
+    .data.fd = s
+  };
+  if (socketp == NULL) {
+    epoll_ctl(engine.epoll_fd, EPOLL_CTL_ADD, s, &event);
+    curl_multi_assign(engine.multi, s, (void *) 1);
+  } else epoll_ctl(engine.epoll_fd, EPOLL_CTL_MOD, s, &event);
+  return 0;
+}
 
-    curl_easy_cleanup(curl);
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp) {
+  (void) multi;
+  (void) userp;
+  engine.deadline_ms = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+  return 0;
+}
+#else
+static void wait_for_activity(void) {
+  int running_handles;
+  curl_multi_perform(engine.multi, &running_handles);
+  long timeout_ms = 1000;
+  if (engine.wake_ms >= 0 && engine.wake_ms - now_ms() < timeout_ms) {
+    timeout_ms = engine.wake_ms - now_ms();
+    if (timeout_ms < 0) timeout_ms = 0;
   }
+  curl_multi_poll(engine.multi, NULL, 0, (int) timeout_ms, NULL);
+}
+#endif
 
-  curl_global_cleanup();
+static long take_token(void) {
+  pthread_mutex_lock(&limiter.lock);
+  long now = limiter_clock();
+  if (now < limiter.resume_ms) {
+    pthread_mutex_unlock(&limiter.lock);
+    return limiter.resume_ms - now;
+  }
+  if (limiter.rate <= 0) {
+    pthread_mutex_unlock(&limiter.lock);
+    return 0;
+  }
+
+  double capacity = limiter.rate < 1 ? 1 : limiter.rate;
+  if (limiter.refilled_ms >= 0) {
+    limiter.tokens += (now - limiter.refilled_ms) * limiter.rate / 1000;
+    if (limiter.tokens > capacity) limiter.tokens = capacity;
+  }
+  limiter.refilled_ms = now;
+
+  long wait_ms = 0;
+  if (limiter.tokens >= 1) {
+    limiter.tokens--;
+  } else {
+    wait_ms = (long) ((1 - limiter.tokens) * 1000 / limiter.rate) + 1;
+  }
+  pthread_mutex_unlock(&limiter.lock);
+  return wait_ms;
+}
+
+static void wait_for_token(void) {
+  long wait_ms;
+  while ((wait_ms = take_token()) > 0) limiter_sleep(wait_ms);
+}
+
+static bool init_response(Response res) {
+  res->content = NULL;
+  res->size = res->capacity = 0;
+  res->cache = NULL;
+  res->status = 0;
+  res->retry_after_ms = -1;
+  res->throttled = 0;
+  res->failed = 0;
+  res->retry_at_ms = 0;
+  res->started_ms = -1;
+  res->converter = NULL;
+  return true;
+}
+
+static void restart_response(Response res) {
+  res->size = 0;
+  if (res->converter != NULL) stream_converter_reset(res->converter);
+}
+
+static bool retry_throttled(Response res) {
+  pthread_mutex_lock(&limiter.lock);
+  if (res->status != TOO_MANY_REQUESTS) {
+    if (res->status != 0) limiter.backoff = 0;
+    pthread_mutex_unlock(&limiter.lock);
+    return false;
+  }
+
+  bool retry = res->throttled < limiter.max_retries;
+  if (retry) {
+    long delay_ms = MAX_BACKOFF_MS;
+    if (limiter.backoff < 16 && (BACKOFF_MS << limiter.backoff) < delay_ms) {
+      delay_ms = BACKOFF_MS << limiter.backoff;
+    }
+    if (res->retry_after_ms > delay_ms) delay_ms = res->retry_after_ms;
+    if (limiter.seed == 0) limiter.seed = (unsigned) time(NULL) | 1;
+    delay_ms += rand_r(&limiter.seed) % (delay_ms / 4 + 1);
 
+    long resume_ms = limiter_clock() + delay_ms;
+    if (resume_ms > limiter.resume_ms) limiter.resume_ms = resume_ms;
+    limiter.tokens = 0;
+    limiter.backoff++;
+  }
+  pthread_mutex_unlock(&limiter.lock);
+
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.throttled_requests++;
+  if (retry) {
+    stats.totals.retried_requests++;
+  } else stats.totals.dropped_requests++;
+  pthread_mutex_unlock(&stats.lock);
+  if (!retry) return false;
+
+  res->throttled++;
+  restart_response(res);
+  return true;
+}
+
+static bool retry_failed(CURLcode rc, string method, Response res) {
+  bool transient;
+  switch (rc) {
+    case CURLE_OK:
+      transient = res->status >= SERVER_ERROR;
+      break;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+    case CURLE_SSL_CONNECT_ERROR:
+      transient = true;
+      break;
+    default:
+      transient = false;
+  }
+  if (!transient || !IS_GET(method)) return false;
+
+  pthread_mutex_lock(&retries.lock);
+  size_t max_attempts = retries.max_attempts;
+  long deadline_ms = retries.deadline_ms;
+  pthread_mutex_unlock(&retries.lock);
+
+  long delay_ms = MAX_BACKOFF_MS;
+  if (res->failed < 16 && (RETRY_BACKOFF_MS << res->failed) < delay_ms) {
+    delay_ms = RETRY_BACKOFF_MS << res->failed;
+  }
+  if (res->retry_after_ms > delay_ms) delay_ms = res->retry_after_ms;
+  pthread_mutex_lock(&limiter.lock);
+  if (limiter.seed == 0) limiter.seed = (unsigned) time(NULL) | 1;
+  delay_ms += rand_r(&limiter.seed) % (delay_ms / 4 + 1);
+  pthread_mutex_unlock(&limiter.lock);
+
+  long retry_at_ms = now_ms() + delay_ms;
+  bool retry = res->failed + 1 < max_attempts &&
+               (deadline_ms <= 0 ||
+                retry_at_ms < res->started_ms + deadline_ms);
+  if (!retry) return false;
+
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.retried_requests++;
+  pthread_mutex_unlock(&stats.lock);
   if (rc != CURLE_OK) {
-    free(res.content);
+    free_response_cache_entry(res->cache);
+    res->cache = NULL;
+  }
+  res->failed++;
+  res->retry_at_ms = retry_at_ms;
+  restart_response(res);
+  return true;
+}
+
+static cJSON *fail_response(Response res, CURLcode rc) {
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.failed_requests++;
+  pthread_mutex_unlock(&stats.lock);
+  free_response_cache_entry(res->cache);
+  res->cache = NULL;
+  free(res->content);
+  res->content = NULL;
+  return create_error(0, curl_easy_strerror(rc));
+}
+
+static bool is_error(cJSON *response) {
+  return cJSON_IsObject(cJSON_GetObjectItemCaseSensitive(response, "error"));
+}
+
+static string page_url(string url, size_t limit, size_t offset) {
+  int size = snprintf(NULL, 0, "%s?limit=%zu&offset=%zu", url, limit,
+                      offset);
+  string page = malloc(size + 1);
+  if (page == NULL) exit(EXIT_FAILURE);
+  snprintf(page, size + 1, "%s?limit=%zu&offset=%zu", url, limit, offset);
+  return page;
+}
+
+static cJSON *create_error(long status, const char *message) {
+  cJSON *cJSON_response = cJSON_CreateObject();
+  cJSON *cJSON_error = cJSON_AddObjectToObject(cJSON_response, "error");
+  if (cJSON_error == NULL ||
+      cJSON_AddNumberToObject(cJSON_error, "status", status) == NULL ||
+      cJSON_AddStringToObject(cJSON_error, "message", message) == NULL) {
     exit(EXIT_FAILURE);
-  } else return res.content;
+  }
+  return cJSON_response;
+}
+
+static bool join_flight(string url, FetchRequest request, Flight *flight) {
+  pthread_mutex_lock(&flights.lock);
+  for (*flight = flights.list; *flight != NULL; *flight = (*flight)->next) {
+    if (!strcmp((*flight)->url, url)) break;
+  }
+  bool joined = *flight != NULL;
+  if (joined) {
+    if (request != NULL) {
+      request->next = (*flight)->followers;
+      (*flight)->followers = request;
+    } else (*flight)->waiters++;
+  } else if ((*flight = malloc(sizeof(struct flight))) != NULL) {
+    (*flight)->url = url;
+    (*flight)->waiters = 0;
+    (*flight)->followers = NULL;
+    (*flight)->response = NULL;
+    (*flight)->landed = false;
+    (*flight)->next = flights.list;
+    flights.list = *flight;
+  }
+  pthread_mutex_unlock(&flights.lock);
+
+  if (joined) {
+    pthread_mutex_lock(&stats.lock);
+    stats.totals.requests++;
+    stats.totals.coalesced_requests++;
+    pthread_mutex_unlock(&stats.lock);
+  }
+  return joined;
+}
+
+static void land_flight(Flight flight, cJSON *response) {
+  if (flight == NULL) return;
+  pthread_mutex_lock(&flights.lock);
+  Flight *link = &flights.list;
+  while (*link != flight) link = &(*link)->next;
+  *link = flight->next;
+  FetchRequest followers = flight->followers;
+  flight->followers = NULL;
+  bool waited = flight->waiters > 0;
+  if (waited) {
+    flight->response = cJSON_Duplicate(response, true);
+    flight->landed = true;
+    pthread_cond_broadcast(&flights.landed_cond);
+  }
+  pthread_mutex_unlock(&flights.lock);
+  if (!waited) free(flight);
+
+  while (followers != NULL) {
+    FetchRequest request = followers;
+    followers = request->next;
+    request->next = NULL;
+    request->response = cJSON_Duplicate(response, true);
+    mark_done(request);
+  }
+}
+
+static cJSON *wait_for_flight(Flight flight) {
+  pthread_mutex_lock(&flights.lock);
+  while (!flight->landed) {
+    pthread_cond_wait(&flights.landed_cond, &flights.lock);
+  }
+  pthread_mutex_unlock(&flights.lock);
+
+  cJSON *response = cJSON_Duplicate(flight->response, true);
+
+  pthread_mutex_lock(&flights.lock);
+  bool last = --flight->waiters == 0;
+  pthread_mutex_unlock(&flights.lock);
+  if (last) {
+    cJSON_Delete(flight->response);
+    free(flight);
+  }
+  return response;
+}
+
+static bool take_prefetch(string url, cJSON **response) {
+  pthread_mutex_lock(&prefetches.lock);
+  Prefetch *link = &prefetches.list;
+  while (*link != NULL && strcmp((*link)->url, url)) link = &(*link)->next;
+  Prefetch prefetch = *link;
+  if (prefetch != NULL) {
+    *link = prefetch->next;
+    prefetches.count--;
+  }
+  pthread_mutex_unlock(&prefetches.lock);
+  if (prefetch == NULL) return false;
+
+  *response = fetch_wait(prefetch->request);
+  free_prefetch(prefetch);
+  pthread_mutex_lock(&stats.lock);
+  stats.totals.prefetch_hits++;
+  pthread_mutex_unlock(&stats.lock);
+  return true;
+}
+
+static bool unqueue_request(FetchRequest request) {
+  pthread_mutex_lock(&flights.lock);
+  Flight flight = request->flight;
+  bool alone = flight == NULL ||
+               (flight->waiters == 0 && flight->followers == NULL);
+  bool unqueued = false;
+  pthread_mutex_lock(&engine.lock);
+  FetchRequest *link = &engine.pending;
+  FetchRequest previous = NULL;
+  while (*link != NULL && *link != request) {
+    previous = *link;
+    link = &(*link)->next;
+  }
+  if (alone && *link != NULL) {
+    *link = request->next;
+    if (engine.pending_tail == request) engine.pending_tail = previous;
+    request->next = NULL;
+    unqueued = true;
+  }
+  pthread_mutex_unlock(&engine.lock);
+  if (unqueued && flight != NULL) {
+    Flight *flight_link = &flights.list;
+    while (*flight_link != flight) flight_link = &(*flight_link)->next;
+    *flight_link = flight->next;
+  }
+  pthread_mutex_unlock(&flights.lock);
+  if (!unqueued) return false;
+
+  free(flight);
+  request->flight = NULL;
+  free(request->res.content);
+  request->res.content = NULL;
+  free_response_cache_entry(request->res.cache);
+  request->res.cache = NULL;
+  request->submitted = false;
+  return true;
+}
+
+static void release_dropped_prefetches(bool wait) {
+  pthread_mutex_lock(&prefetches.lock);
+  Prefetch *link = &prefetches.dropped;
+  Prefetch released = NULL;
+  while (*link != NULL) {
+    Prefetch prefetch = *link;
+    if (wait || fetch_is_done(prefetch->request)) {
+      *link = prefetch->next;
+      prefetch->next = released;
+      released = prefetch;
+      prefetches.count--;
+    } else link = &prefetch->next;
+  }
+  pthread_mutex_unlock(&prefetches.lock);
+
+  while (released != NULL) {
+    Prefetch prefetch = released;
+    released = prefetch->next;
+    free_prefetch(prefetch);
+  }
+}
+
+static void free_prefetch(Prefetch prefetch) {
+  free_fetch_request(prefetch->request);
+  free(prefetch->url);
+  free(prefetch);
+}
+
+static void sleep_until(long time_ms) {
+  long wait_ms;
+  while ((wait_ms = time_ms - now_ms()) > 0) sleep_for(wait_ms);
+}
+
+static void sleep_for(long wait_ms) {
+  struct timespec delay = { .tv_sec = wait_ms / 1000,
+                            .tv_nsec = (wait_ms % 1000) * 1000000 };
+  nanosleep(&delay, NULL);
+}
+
+static long now_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include "query.h"
@@ -6,14 +7,76 @@
 #include "tmem.h"
 #include "tprint.h"
 #include "readers.h"
+#include "cjson-converters.h"
+#include "library-snapshot.h"
 #include "helpers.h"
 
-#define IS_NULL(ptr) (ptr == NULL)
-
 User user = NULL;
-SimplifiedPlaylist *owned_playlists = NULL,
-                   *followed_playlists = NULL;
-Artist *followed_artists = NULL;
+SizedArray owned_playlists = { 0, NULL },
+           followed_playlists = { 0, NULL };
+SizedArray followed_artists = { 0, NULL };
+size_t library_version = 0;
+
+/*
+ * playlists_page and followed_artists_pages:
+ * Pages the user's playlists and followed artists were taken from.
+ * As the items of a page belong to the page's arena, the pages are kept
+ * until the items are updated again.
+ * library_version is incremented each time the playlists or the followed
+ * artists are updated.
+ */
+static Page playlists_page = NULL;
+static PtrArray followed_artists_pages = NULL;
+
+/*
+ * owned_by_user:
+ * Returns true if playlist belongs to user, else returns false.
+ */
+static bool owned_by_user(SimplifiedPlaylist playlist);
+
+/*
+ * find_playlist, find_artist:
+ * Return the index of the item of playlists (or artists) whose id is id,
+ * or -1 if there is none.
+ */
+static long find_playlist(SizedArray playlists, string id);
+static long find_artist(SizedArray artists, string id);
+
+/*
+ * patch_array:
+ * Replaces *array, an array such as the ones returned by get_sized_array,
+ * with a copy in which the item at index is replaced by item, or removed if
+ * item is a null pointer. If index is -1, item is appended instead.
+ * The replaced item is released using free_item, and *array is released.
+ * Terminates program if not enough memory was available.
+ */
+static void patch_array(SizedArray *array, long index, void *item,
+                        void (*free_item)(void *item));
+
+/*
+ * copy_string:
+ * Returns a copy of str, or an empty string if str is a null pointer, as
+ * the "free" functions (see the "tmem" header) release the strings of
+ * a structure up to the first null one.
+ * Terminates program if not enough memory was available.
+ */
+static string copy_string(string str);
+
+/*
+ * simplify_playlist:
+ * Returns a simplified playlist holding copies of playlist's details, with
+ * tracks_count tracks.
+ * Terminates program if not enough memory was available.
+ */
+static SimplifiedPlaylist simplify_playlist(Playlist playlist,
+                                            size_t tracks_count);
+
+/*
+ * copy_artist:
+ * Returns a copy of artist, which doesn't share any memory with it.
+ * Terminates program if not enough memory was available.
+ */
+static Artist copy_artist(Artist artist);
 
 
 int handle_option_choice(size_t options_count, ...) {
@@ -34,59 +97,277 @@ int handle_option_choice(size_t options_count, ...) {
   return option - 1;
 }
 
-void update_playlists(void) {
-  free_array((void **) owned_playlists, free_simplified_playlist);
-  free_array((void **) followed_playlists, free_simplified_playlist);
+bool query_failed(void *result) {
+  if (!IS_NULL(result)) return false;
+  print_query_error(query_last_error());
+  return true;
+}
+
+void print_query_error(long status) {
+  if (status > 0) {
+    print_to_stream("\nThe request failed (status %ld), please try again "
+                    "later\n", status);
+  } else {
+    print_to_stream("\nThe request failed, please check your connection "
+                    "and try again\n");
+  }
+}
+
+bool last_query_failed(void) {
+  long status = query_last_error();
+  if (status < 0) return false;
+  print_query_error(status);
+  return true;
+}
+
+SizedArray page_items(Page page) {
+  if (IS_NULL(page)) return (SizedArray) { 0, NULL };
+  return (SizedArray) { page->count, page->items };
+}
+
+void set_playlists(Page page) {
+  free_array(owned_playlists.items, free_simplified_playlist);
+  free_array(followed_playlists.items, free_simplified_playlist);
+  tfree(free_page, playlists_page);
+  library_version++;
 
   PtrArray owned_playlists_ptr_array = new_ptr_array();
   PtrArray followed_playlists_ptr_array = new_ptr_array();
-  
-  int playlists_count = 0;
-  for (;;) {
-    Page page = query_get_user_playlists(playlists_count);
-    SimplifiedPlaylist *playlists = page->items;
-    for (int i = 0; !IS_NULL(playlists[i]); i++) {
-      if (!strcmp(playlists[i]->owner->display_name, user->display_name)) {
-        add_item(owned_playlists_ptr_array, playlists[i]);
-      } else add_item(followed_playlists_ptr_array, playlists[i]);
-      playlists_count++;
-    }
-    if (playlists_count >= page->total) {
-      tfree(free_page, page);
-      break;
-    }
-    tfree(free_page, page);
+
+  playlists_page = page;
+  SimplifiedPlaylist *playlists = !IS_NULL(page) ? page->items : NULL;
+  size_t playlists_count = !IS_NULL(page) ? page->count : 0;
+  for (size_t i = 0; i < playlists_count; i++) {
+    if (owned_by_user(playlists[i])) {
+      add_item(owned_playlists_ptr_array, playlists[i]);
+    } else add_item(followed_playlists_ptr_array, playlists[i]);
   }
 
-  owned_playlists = 
-    (SimplifiedPlaylist *) get_array(owned_playlists_ptr_array);
-  followed_playlists =
-    (SimplifiedPlaylist *) get_array(followed_playlists_ptr_array);
+  shrink_ptr_array(owned_playlists_ptr_array);
+  shrink_ptr_array(followed_playlists_ptr_array);
+  owned_playlists = get_sized_array(owned_playlists_ptr_array);
+  followed_playlists = get_sized_array(followed_playlists_ptr_array);
   free_ptr_array(owned_playlists_ptr_array, false, NULL);
   free_ptr_array(followed_playlists_ptr_array, false, NULL);
 }
 
-void update_followed_artists(void) {
-  free_array((void **) followed_artists, free_artist);
-
-  PtrArray ptr_array = new_ptr_array();
-  int artists_count = 0;
+PtrArray fetch_followed_artists(bool *failed) {
+  PtrArray pages = new_ptr_array();
+  size_t count = 0;
   string previous = NULL;
   for (;;) {
     Page page = query_get_followed_artists(previous);
-    Artist *artists = page->items;
-    for (int i = 0; !IS_NULL(artists[i]); i++) {
-      add_item(ptr_array, artists[i]);
-      artists_count++;
-      previous = artists[i]->id;
-    }
-    if (artists_count >= page->total) {
-      tfree(free_page, page);
+    if (IS_NULL(page)) {
+      *failed = true;
       break;
     }
-    tfree(free_page, page);
+    Artist *artists = page->items;
+    size_t page_artists_count = page->count;
+    add_item(pages, page);
+    count += page_artists_count;
+    if (!page_artists_count || count >= page->total) break;
+    previous = artists[page_artists_count - 1]->id;
   }
+  return pages;
+}
 
-  followed_artists = (Artist *) get_array(ptr_array);
+void set_followed_artists(PtrArray pages) {
+  free_array(followed_artists.items, free_artist);
+  if (!IS_NULL(followed_artists_pages)) {
+    free_ptr_array(followed_artists_pages, true, free_page);
+  }
+  followed_artists_pages = pages;
+  library_version++;
+
+  PtrArray ptr_array = new_ptr_array();
+  Page *artists_pages = (Page *) get_array(pages);
+  for (size_t i = 0; i < get_size(pages); i++) {
+    add_items(ptr_array, artists_pages[i]->items, artists_pages[i]->count);
+  }
+
+  shrink_ptr_array(ptr_array);
+  followed_artists = get_sized_array(ptr_array);
   free_ptr_array(ptr_array, false, NULL);
 }
+
+void patch_playlist(Playlist playlist, long tracks_delta) {
+  SizedArray *playlists_ptr = &owned_playlists;
+  long index = find_playlist(owned_playlists, playlist->id);
+  if (index < 0) {
+    playlists_ptr = &followed_playlists;
+    index = find_playlist(followed_playlists, playlist->id);
+  }
+  if (index < 0) return;
+
+  SimplifiedPlaylist *playlists = (SimplifiedPlaylist *) playlists_ptr->items;
+  long tracks_count = (long) playlists[index]->tracks.total + tracks_delta;
+  SimplifiedPlaylist patched =
+    simplify_playlist(playlist, tracks_count > 0 ? tracks_count : 0);
+  patch_array(playlists_ptr, index, patched, free_simplified_playlist);
+  library_version++;
+}
+
+void add_followed_playlist(Playlist playlist) {
+  if (find_playlist(owned_playlists, playlist->id) >= 0 ||
+      find_playlist(followed_playlists, playlist->id) >= 0) {
+    return;
+  }
+
+  SimplifiedPlaylist added = simplify_playlist(
+    playlist, !IS_NULL(playlist->tracks) ? playlist->tracks->total : 0);
+  SizedArray *playlists_ptr = owned_by_user(added)
+    ? &owned_playlists
+    : &followed_playlists;
+  patch_array(playlists_ptr, -1, added, free_simplified_playlist);
+  library_version++;
+}
+
+void remove_followed_playlist(string id) {
+  SizedArray *playlists_ptr = &followed_playlists;
+  long index = find_playlist(followed_playlists, id);
+  if (index < 0) {
+    playlists_ptr = &owned_playlists;
+    index = find_playlist(owned_playlists, id);
+  }
+  if (index < 0) return;
+
+  patch_array(playlists_ptr, index, NULL, free_simplified_playlist);
+  library_version++;
+}
+
+void add_followed_artist(Artist artist) {
+  if (find_artist(followed_artists, artist->id) >= 0) return;
+  patch_array(&followed_artists, -1, copy_artist(artist), free_artist);
+  library_version++;
+}
+
+void remove_followed_artist(string id) {
+  long index = find_artist(followed_artists, id);
+  if (index < 0) return;
+  patch_array(&followed_artists, index, NULL, free_artist);
+  library_version++;
+}
+
+bool save_library(string path, string token, Page top_artists,
+                  Page top_tracks) {
+  if (IS_NULL(path)) return false;
+  PtrArray playlists_ptr_array = new_ptr_array();
+  END_IF(IS_NULL(playlists_ptr_array));
+  add_items(playlists_ptr_array, owned_playlists.items,
+            owned_playlists.length);
+  add_items(playlists_ptr_array, followed_playlists.items,
+            followed_playlists.length);
+  struct page playlists_page = {
+    .items = get_array(playlists_ptr_array),
+    .count = get_size(playlists_ptr_array)
+  };
+  struct page followed_artists_page = {
+    .items = followed_artists.items,
+    .count = followed_artists.length
+  };
+  struct library_snapshot snapshot = {
+    .user = user,
+    .playlists = &playlists_page,
+    .followed_artists = &followed_artists_page,
+    .top_artists = top_artists,
+    .top_tracks = top_tracks,
+  };
+  bool saved = library_snapshot_save(path, token, &snapshot);
+  free_ptr_array(playlists_ptr_array, false, NULL);
+  return saved;
+}
+
+static bool owned_by_user(SimplifiedPlaylist playlist) {
+  return !IS_NULL(playlist->owner) &&
+         !IS_NULL(playlist->owner->display_name) &&
+         !strcmp(playlist->owner->display_name, user->display_name);
+}
+
+static long find_playlist(SizedArray playlists, string id) {
+  SimplifiedPlaylist *items = (SimplifiedPlaylist *) playlists.items;
+  for (size_t i = 0; i < playlists.length; i++) {
+    if (!strcmp(items[i]->id, id)) return i;
+  }
+  return -1;
+}
+
+static long find_artist(SizedArray artists, string id) {
+  Artist *items = (Artist *) artists.items;
+  for (size_t i = 0; i < artists.length; i++) {
+    if (!strcmp(items[i]->id, id)) return i;
+  }
+  return -1;
+}
+
+static void patch_array(SizedArray *array, long index, void *item,
+                        void (*free_item)(void *item)) {
+  PtrArray ptr_array = new_ptr_array();
+  END_IF(IS_NULL(ptr_array) ||
+         !reserve_ptr_array(ptr_array, array->length + 1));
+  for (size_t i = 0; i < array->length; i++) {
+    if ((long) i != index) {
+      add_item(ptr_array, array->items[i]);
+    } else if (!IS_NULL(item)) add_item(ptr_array, item);
+  }
+  if (index < 0) add_item(ptr_array, item);
+  if (index >= 0) (*free_item)(array->items[index]);
+  free(array->items);
+
+  shrink_ptr_array(ptr_array);
+  *array = get_sized_array(ptr_array);
+  free_ptr_array(ptr_array, false, NULL);
+}
+
+static string copy_string(string str) {
+  if (IS_NULL(str)) str = "";
+  size_t size = strlen(str) + 1;
+  string copy = malloc(size);
+  END_IF(IS_NULL(copy));
+  return memcpy(copy, str, size);
+}
+
+static SimplifiedPlaylist simplify_playlist(Playlist playlist,
+                                            size_t tracks_count) {
+  SimplifiedPlaylist simplified_playlist = new_simplified_playlist();
+  END_IF(IS_NULL(simplified_playlist));
+  strcpy(simplified_playlist->id, playlist->id);
+  simplified_playlist->name = copy_string(playlist->name);
+  simplified_playlist->description = copy_string(playlist->description);
+  simplified_playlist->href = copy_string(NULL);
+  simplified_playlist->tracks.href = copy_string(NULL);
+  simplified_playlist->public = playlist->public;
+  simplified_playlist->snapshot_id = copy_string(playlist->snapshot_id);
+  simplified_playlist->tracks.total = tracks_count;
+  if (!IS_NULL(playlist->owner)) {
+    SimplifiedUser owner = new_simplified_user();
+    END_IF(IS_NULL(owner));
+    owner->href = copy_string(playlist->owner->href);
+    owner->id = copy_string(playlist->owner->id);
+    owner->display_name = copy_string(playlist->owner->display_name);
+    simplified_playlist->owner = owner;
+  }
+  return simplified_playlist;
+}
+
+static Artist copy_artist(Artist artist) {
+  Artist copy = new_artist();
+  END_IF(IS_NULL(copy));
+  strcpy(copy->id, artist->id);
+  copy->name = copy_string(artist->name);
+  copy->popularity = artist->popularity;
+  if (!IS_NULL(artist->followers)) {
+    copy->followers = new_followers();
+    END_IF(IS_NULL(copy->followers));
+    copy->followers->total = artist->followers->total;
+  }
+  if (!IS_NULL(artist->genres)) {
+    size_t genres_count = 0;
+    while (!IS_NULL(artist->genres[genres_count])) genres_count++;
+    copy->genres = (string *) allocate_array(genres_count, malloc);
+    END_IF(IS_NULL(copy->genres));
+    for (size_t i = 0; i < genres_count; i++) {
+      copy->genres[i] = copy_string(artist->genres[i]);
+    }
+  }
+  return copy;
+}
@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+#include "intern.h"
+
+#define MIN_BUCKETS 256
+
+/*
+ * interned:
+ * A string kept in the pool, allocated in the pool's arena along with
+ * its characters.
+ * hash is the hash of the string and next links the strings of a same
+ * bucket.
+ */
+struct interned {
+  struct interned *next;
+  size_t hash;
+  char chars[];
+};
+
+/*
+ * pool:
+ * buckets is the hash table of the interned strings, buckets_count its
+ * size, and arena the arena they are allocated from.
+ * lock protects the whole structure.
+ */
+static struct {
+  struct interned **buckets;
+  size_t buckets_count;
+  Arena arena;
+  struct intern_stats stats;
+  pthread_mutex_t lock;
+} pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * hash_string:
+ * Returns the hash of str (FNV-1a).
+ */
+static size_t hash_string(string str);
+
+/*
+ * find_interned:
+ * Returns the interned string equal to str, whose hash is hash, or null
+ * if str wasn't interned. The pool must be locked.
+ */
+static struct interned *find_interned(string str, size_t hash);
+
+/*
+ * grow_buckets:
+ * Doubles the number of buckets once there are more strings than buckets.
+ * The pool must be locked.
+ */
+static void grow_buckets(void);
+
+string intern_string(string str) {
+  if (str == NULL) return NULL;
+  size_t hash = hash_string(str);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.stats.lookups++;
+  struct interned *interned = find_interned(str, hash);
+  if (interned != NULL) {
+    pool.stats.hits++;
+    pool.stats.saved_bytes += strlen(str) + 1;
+    pthread_mutex_unlock(&pool.lock);
+    return interned->chars;
+  }
+
+  if (pool.buckets == NULL) {
+    pool.buckets = calloc(MIN_BUCKETS, sizeof(struct interned *));
+    pool.arena = pool.buckets != NULL ? new_arena() : NULL;
+    if (pool.arena == NULL) {
+      free(pool.buckets);
+      pool.buckets = NULL;
+      pthread_mutex_unlock(&pool.lock);
+      return NULL;
+    }
+    pool.buckets_count = MIN_BUCKETS;
+  }
+  size_t size = sizeof(struct interned) + strlen(str) + 1;
+  interned = arena_alloc(pool.arena, size);
+  if (interned == NULL) {
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+  }
+  strcpy(interned->chars, str);
+  interned->hash = hash;
+  interned->next = pool.buckets[hash % pool.buckets_count];
+  pool.buckets[hash % pool.buckets_count] = interned;
+  pool.stats.strings++;
+  pool.stats.bytes += size;
+  grow_buckets();
+  pthread_mutex_unlock(&pool.lock);
+  return interned->chars;
+}
+
+bool intern_owns(string str) {
+  if (str == NULL) return false;
+  size_t hash = hash_string(str);
+  pthread_mutex_lock(&pool.lock);
+  struct interned *interned = find_interned(str, hash);
+  bool owned = interned != NULL && interned->chars == str;
+  pthread_mutex_unlock(&pool.lock);
+  return owned;
+}
+
+void intern_clear(void) {
+  pthread_mutex_lock(&pool.lock);
+  free_arena(pool.arena);
+  free(pool.buckets);
+  pool.arena = NULL;
+  pool.buckets = NULL;
+  pool.buckets_count = 0;
+  pool.stats = (struct intern_stats) { 0 };
+  pthread_mutex_unlock(&pool.lock);
+}
+
+struct intern_stats intern_get_stats(void) {
+  pthread_mutex_lock(&pool.lock);
+  struct intern_stats stats = pool.stats;
+  pthread_mutex_unlock(&pool.lock);
+  return stats;
+}
+
+static size_t hash_string(string str) {
+  size_t hash = 14695981039346656037UL;
+  for (; *str != '\0'; str++) {
+    hash = (hash ^ (unsigned char) *str) * 1099511628211UL;
+  }
+  return hash;
+}
+
+static struct interned *find_interned(string str, size_t hash) {
+  if (pool.buckets == NULL) return NULL;
+  struct interned *interned = pool.buckets[hash % pool.buckets_count];
+  while (interned != NULL &&
+         (interned->hash != hash || strcmp(interned->chars, str))) {
+    interned = interned->next;
+  }
+  return interned;
+}
+
+static void grow_buckets(void) {
+  if (pool.stats.strings <= pool.buckets_count) return;
+  size_t buckets_count = pool.buckets_count * 2;
+  struct interned **buckets = calloc(buckets_count, sizeof(struct interned *));
+  if (buckets == NULL) return;
+  for (size_t i = 0; i < pool.buckets_count; i++) {
+    struct interned *interned = pool.buckets[i];
+    while (interned != NULL) {
+      struct interned *next = interned->next;
+      interned->next = buckets[interned->hash % buckets_count];
+      buckets[interned->hash % buckets_count] = interned;
+      interned = next;
+    }
+  }
+  free(pool.buckets);
+  pool.buckets = buckets;
+  pool.buckets_count = buckets_count;
+}
@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json-stream.h"
+
+#define IS_WHITESPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || \
+                          (c) == '\r')
+#define IS_NUMBER_CHAR(c) (((c) >= '0' && (c) <= '9') || (c) == '-' || \
+                           (c) == '+' || (c) == '.' || (c) == 'e' || \
+                           (c) == 'E')
+
+/*
+ * state:
+ * What the stream expects to read next.
+ * FIRST_VALUE and FIRST_KEY are used right after an array or an object was
+ * opened, as it can be closed immediately.
+ * SEPARATOR is used after a value inside an array or an object and END
+ * after the root value, where only whitespaces are allowed.
+ * STRING, NUMBER and LITERAL are used while a token is being read.
+ */
+enum state {
+  VALUE, FIRST_VALUE, KEY, FIRST_KEY, COLON, SEPARATOR, END,
+  STRING, NUMBER, LITERAL, FAILED
+};
+
+/*
+ * json_stream:
+ * handler and data receive the events read.
+ * containers is the stack of the arrays ('[') and objects ('{') currently
+ * open, depth being the number of open containers.
+ * token buffers the token being read. While a string is read, string_is_key
+ * tells whether it's a key, escape how many characters of an escape
+ * sequence remain to be read (-1 if none is being read), codepoint holds
+ * the code point of an \u escape and high_surrogate the first half of
+ * a surrogate pair. While a literal is read, literal is the literal expected
+ * and token_size the number of its characters already read.
+ */
+struct json_stream {
+  JsonHandler handler;
+  void *data;
+  enum state state;
+  char containers[JSON_STREAM_MAX_DEPTH];
+  size_t depth;
+  bool string_is_key;
+  char *token;
+  size_t token_size, token_capacity;
+  int escape;
+  unsigned long codepoint, high_surrogate;
+  const char *literal;
+};
+
+/*
+ * feed_char:
+ * Parses c, which isn't part of a string's content.
+ * Returns false if c is invalid, if the handler stopped parsing or if not
+ * enough memory was available, else returns true.
+ */
+static bool feed_char(JsonStream stream, char c);
+
+/*
+ * feed_string_char:
+ * Parses c, which is part of a string's content (or ends it).
+ * Returns false if c is invalid, if the handler stopped parsing or if not
+ * enough memory was available, else returns true.
+ */
+static bool feed_string_char(JsonStream stream, char c);
+
+/*
+ * read_value:
+ * Reports event, of the value read, with value and length (see JsonHandler)
+ * and updates the state accordingly. If the event starts an array or
+ * an object, opens it.
+ * Returns false if the handler stopped parsing or if the document is nested
+ * too deeply, else returns true.
+ */
+static bool read_value(JsonStream stream, enum json_event event,
+                       const char *value, size_t length);
+
+/*
+ * close_container:
+ * Closes the innermost container using c, which must be ']' or '}', and
+ * reports it.
+ * Returns false if c doesn't match the container or if the handler stopped
+ * parsing, else returns true.
+ */
+static bool close_container(JsonStream stream, char c);
+
+/*
+ * end_number:
+ * Checks the number read in token and reports it.
+ * Returns false if the number is invalid or if the handler stopped parsing,
+ * else returns true.
+ */
+static bool end_number(JsonStream stream);
+
+/*
+ * append_token:
+ * Appends the size first characters of chars to token.
+ * Returns false if not enough memory was available, else returns true.
+ */
+static bool append_token(JsonStream stream, const char *chars, size_t size);
+
+/*
+ * append_codepoint:
+ * Appends codepoint to token, encoded in UTF-8.
+ * Returns false if not enough memory was available, else returns true.
+ */
+static bool append_codepoint(JsonStream stream, unsigned long codepoint);
+
+JsonStream new_json_stream(JsonHandler handler, void *data) {
+  JsonStream stream = calloc(1, sizeof(struct json_stream));
+  if (stream == NULL) return stream;
+  stream->handler = handler;
+  stream->data = data;
+  json_stream_reset(stream);
+  return stream;
+}
+
+void free_json_stream(JsonStream stream) {
+  if (stream == NULL) return;
+  free(stream->token);
+  free(stream);
+}
+
+bool json_stream_feed(JsonStream stream, const char *chunk, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (stream->state == FAILED) return false;
+    if (stream->state != STRING) {
+      if (!feed_char(stream, chunk[i])) stream->state = FAILED;
+      continue;
+    }
+
+    size_t span = 0;
+    if (stream->escape < 0) {
+      while (i + span < size && chunk[i + span] != '"' &&
+             chunk[i + span] != '\\' &&
+             (unsigned char) chunk[i + span] >= 0x20) span++;
+    }
+    if (span > 0) {
+      if (stream->high_surrogate || !append_token(stream, chunk + i, span)) {
+        stream->state = FAILED;
+      }
+      i += span - 1;
+    } else if (!feed_string_char(stream, chunk[i])) stream->state = FAILED;
+  }
+  return stream->state != FAILED;
+}
+
+bool json_stream_finish(JsonStream stream) {
+  if (stream->state == NUMBER && stream->depth == 0 && !end_number(stream)) {
+    stream->state = FAILED;
+  }
+  return stream->state == END;
+}
+
+void json_stream_reset(JsonStream stream) {
+  stream->state = VALUE;
+  stream->depth = 0;
+  stream->token_size = 0;
+  stream->escape = -1;
+  stream->high_surrogate = 0;
+}
+
+static bool feed_char(JsonStream stream, char c) {
+  if (stream->state == NUMBER) {
+    if (IS_NUMBER_CHAR(c)) return append_token(stream, &c, 1);
+    if (!end_number(stream)) return false;
+  } else if (stream->state == LITERAL) {
+    if (c != stream->literal[stream->token_size]) return false;
+    if (stream->literal[++stream->token_size] != '\0') return true;
+    return read_value(stream, stream->literal[0] == 't' ? JSON_TRUE
+                              : stream->literal[0] == 'f' ? JSON_FALSE
+                              : JSON_NULL, NULL, 0);
+  }
+  if (IS_WHITESPACE(c)) return true;
+
+  switch (stream->state) {
+    case FIRST_VALUE:
+      if (c == ']') return close_container(stream, c);
+      // fall through
+    case VALUE:
+      stream->token_size = 0;
+      if (c == '{') return read_value(stream, JSON_OBJECT_START, NULL, 0);
+      if (c == '[') return read_value(stream, JSON_ARRAY_START, NULL, 0);
+      if (c == '"') {
+        stream->string_is_key = false;
+        stream->state = STRING;
+        return true;
+      }
+      if (c == '-' || (c >= '0' && c <= '9')) {
+        stream->state = NUMBER;
+        return append_token(stream, &c, 1);
+      }
+      stream->literal = c == 't' ? "true"
+                      : c == 'f' ? "false"
+                      : c == 'n' ? "null"
+                      : NULL;
+      if (stream->literal == NULL) return false;
+      stream->state = LITERAL;
+      stream->token_size = 1;
+      return true;
+    case FIRST_KEY:
+      if (c == '}') return close_container(stream, c);
+      // fall through
+    case KEY:
+      if (c != '"') return false;
+      stream->token_size = 0;
+      stream->string_is_key = true;
+      stream->state = STRING;
+      return true;
+    case COLON:
+      if (c != ':') return false;
+      stream->state = VALUE;
+      return true;
+    case SEPARATOR:
+      if (c == ']' || c == '}') return close_container(stream, c);
+      if (c != ',') return false;
+      stream->state = stream->containers[stream->depth - 1] == '['
+        ? VALUE
+        : KEY;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool feed_string_char(JsonStream stream, char c) {
+  if (stream->escape == 0) {
+    stream->escape = -1;
+    if (c == 'u') {
+      stream->escape = 4;
+      stream->codepoint = 0;
+      return true;
+    }
+    if (stream->high_surrogate) return false;
+    switch (c) {
+      case '"': case '\\': case '/': break;
+      case 'b': c = '\b'; break;
+      case 'f': c = '\f'; break;
+      case 'n': c = '\n'; break;
+      case 'r': c = '\r'; break;
+      case 't': c = '\t'; break;
+      default: return false;
+    }
+    return append_token(stream, &c, 1);
+  }
+
+  if (stream->escape > 0) {
+    int digit = c >= '0' && c <= '9' ? c - '0'
+              : c >= 'a' && c <= 'f' ? c - 'a' + 10
+              : c >= 'A' && c <= 'F' ? c - 'A' + 10
+              : -1;
+    if (digit < 0) return false;
+    stream->codepoint = stream->codepoint * 16 + digit;
+    if (--stream->escape > 0) return true;
+    stream->escape = -1;
+
+    unsigned long codepoint = stream->codepoint;
+    if (stream->high_surrogate) {
+      if (codepoint < 0xDC00 || codepoint > 0xDFFF) return false;
+      codepoint = 0x10000 + ((stream->high_surrogate - 0xD800) << 10) +
+                  (codepoint - 0xDC00);
+      stream->high_surrogate = 0;
+    } else if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+      stream->high_surrogate = codepoint;
+      return true;
+    } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) return false;
+    return append_codepoint(stream, codepoint);
+  }
+
+  if (c == '\\') {
+    stream->escape = 0;
+    return true;
+  }
+  if (c != '"' || stream->high_surrogate) return false;
+
+  size_t length = stream->token_size;
+  if (!append_token(stream, "", 1)) return false;
+  if (!stream->string_is_key) {
+    return read_value(stream, JSON_STRING, stream->token, length);
+  }
+  stream->state = COLON;
+  return stream->handler(stream->data, JSON_KEY, stream->token, length);
+}
+
+static bool read_value(JsonStream stream, enum json_event event,
+                       const char *value, size_t length) {
+  if (event == JSON_OBJECT_START || event == JSON_ARRAY_START) {
+    if (stream->depth == JSON_STREAM_MAX_DEPTH) return false;
+    stream->containers[stream->depth++] =
+      event == JSON_OBJECT_START ? '{' : '[';
+    stream->state = event == JSON_OBJECT_START ? FIRST_KEY : FIRST_VALUE;
+  } else stream->state = stream->depth == 0 ? END : SEPARATOR;
+  return stream->handler(stream->data, event, value, length);
+}
+
+static bool close_container(JsonStream stream, char c) {
+  char opening = c == ']' ? '[' : '{';
+  if (stream->containers[stream->depth - 1] != opening) return false;
+  stream->depth--;
+  stream->state = stream->depth == 0 ? END : SEPARATOR;
+  return stream->handler(stream->data,
+                         c == ']' ? JSON_ARRAY_END : JSON_OBJECT_END,
+                         NULL, 0);
+}
+
+static bool end_number(JsonStream stream) {
+  size_t length = stream->token_size;
+  if (!append_token(stream, "", 1)) return false;
+  char *end;
+  strtod(stream->token, &end);
+  if (end != stream->token + length) return false;
+  return read_value(stream, JSON_NUMBER, stream->token, length);
+}
+
+static bool append_token(JsonStream stream, const char *chars, size_t size) {
+  if (stream->token_size + size > stream->token_capacity) {
+    size_t capacity = stream->token_capacity ? stream->token_capacity : 64;
+    while (capacity < stream->token_size + size) capacity *= 2;
+    char *token = realloc(stream->token, capacity);
+    if (token == NULL) return false;
+    stream->token = token;
+    stream->token_capacity = capacity;
+  }
+  memcpy(stream->token + stream->token_size, chars, size);
+  stream->token_size += size;
+  return true;
+}
+
+static bool append_codepoint(JsonStream stream, unsigned long codepoint) {
+  char utf8[4];
+  size_t size;
+  if (codepoint < 0x80) {
+    utf8[0] = (char) codepoint;
+    size = 1;
+  } else if (codepoint < 0x800) {
+    utf8[0] = (char) (0xC0 | (codepoint >> 6));
+    utf8[1] = (char) (0x80 | (codepoint & 0x3F));
+    size = 2;
+  } else if (codepoint < 0x10000) {
+    utf8[0] = (char) (0xE0 | (codepoint >> 12));
+    utf8[1] = (char) (0x80 | ((codepoint >> 6) & 0x3F));
+    utf8[2] = (char) (0x80 | (codepoint & 0x3F));
+    size = 3;
+  } else {
+    utf8[0] = (char) (0xF0 | (codepoint >> 18));
+    utf8[1] = (char) (0x80 | ((codepoint >> 12) & 0x3F));
+    utf8[2] = (char) (0x80 | ((codepoint >> 6) & 0x3F));
+    utf8[3] = (char) (0x80 | (codepoint & 0x3F));
+    size = 4;
+  }
+  return append_token(stream, utf8, size);
+}
@@ -0,0 +1,839 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tmem.h"
+#include "ptrarray.h"
+#include "cjson-converters.h"
+#include "library-snapshot.h"
+
+#define MAGIC "cmuslib"
+#define BYTE_ORDER_MARK 0x01020304u
+#define NO_REF UINT32_MAX
+#define MIN_CAPACITY 256
+
+/*
+ * section_type:
+ * The sections of a snapshot, in the order of the header's sections.
+ * SECTION_STRINGS holds null terminated strings, SECTION_REFS lists of
+ * indexes or string offsets (uint32_t), and each other section records of
+ * a single kind.
+ */
+enum section_type {
+  SECTION_STRINGS, SECTION_REFS, SECTION_USER, SECTION_PLAYLISTS,
+  SECTION_FOLLOWED_ARTISTS, SECTION_TOP_ARTISTS, SECTION_TOP_TRACKS,
+  SECTION_ALBUMS, SECTION_SIMPLIFIED_ARTISTS, SECTIONS_COUNT
+};
+
+/*
+ * section:
+ * The place of a section in the file: offset is counted from the start of
+ * the file and size in bytes.
+ */
+struct section {
+  uint64_t offset;
+  uint64_t size;
+};
+
+/*
+ * header:
+ * The start of a snapshot. size is the size of the whole file, guarding
+ * against truncated files. owner and token are the hashes of the id of
+ * the user the snapshot was saved for and of the token it was saved with
+ * (see hash_key).
+ */
+struct header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t size;
+  uint64_t owner;
+  uint64_t token;
+  struct section sections[SECTIONS_COUNT];
+};
+
+/*
+ * list_record:
+ * A list of count entries of the refs section, starting at first.
+ */
+struct list_record {
+  uint32_t first;
+  uint32_t count;
+};
+
+/*
+ * Records:
+ * Fields named like those of the type structures hold the offset of their
+ * string in the string table, or their value for numbers. A track's album
+ * is the index of its record, lists of artists hold the indexes of theirs
+ * and lists of genres the offsets of their strings.
+ * NO_REF stands for a null pointer.
+ */
+
+struct user_record {
+  uint32_t display_name;
+  uint32_t id;
+  uint64_t followers;
+};
+
+struct playlist_record {
+  char id[SPOTIFY_ID_SIZE];
+  uint32_t description;
+  uint32_t href;
+  uint32_t name;
+  uint32_t snapshot_id;
+  uint32_t tracks_href;
+  uint32_t owner_href;
+  uint32_t owner_id;
+  uint32_t owner_display_name;
+  uint32_t public;
+  uint32_t padding;
+  uint64_t tracks_total;
+};
+
+struct artist_record {
+  char id[SPOTIFY_ID_SIZE];
+  uint32_t name;
+  uint32_t padding;
+  struct list_record genres;
+  uint64_t followers;
+  uint64_t popularity;
+};
+
+struct simplified_artist_record {
+  char id[SPOTIFY_ID_SIZE];
+  uint32_t href;
+  uint32_t name;
+};
+
+struct album_record {
+  char id[SPOTIFY_ID_SIZE];
+  uint32_t album_type;
+  uint32_t href;
+  uint32_t name;
+  uint32_t release_date;
+  uint32_t restrictions;
+  uint32_t padding;
+  struct list_record artists;
+  uint64_t total_tracks;
+};
+
+struct track_record {
+  char id[SPOTIFY_ID_SIZE];
+  uint32_t name;
+  uint32_t restrictions;
+  uint32_t album;
+  uint32_t padding;
+  struct list_record artists;
+  uint64_t duration_ms;
+  uint64_t popularity;
+};
+
+/*
+ * buffer:
+ * A growable section being written. failed is set once an append failed
+ * for lack of memory.
+ */
+struct buffer {
+  char *data;
+  size_t size;
+  size_t capacity;
+  bool failed;
+};
+
+/*
+ * writer:
+ * The sections of a snapshot being written.
+ */
+struct writer {
+  struct buffer sections[SECTIONS_COUNT];
+};
+
+/*
+ * mapping:
+ * A snapshot mapped in memory, shared by the arenas of the structures
+ * loaded from it: it is unmapped once refs drops to zero.
+ */
+struct mapping {
+  char *data;
+  size_t size;
+  atomic_int refs;
+};
+
+/*
+ * reader:
+ * A mapped snapshot being loaded, and the place of its sections.
+ */
+struct reader {
+  struct mapping *mapping;
+  const char *sections[SECTIONS_COUNT];
+  size_t sizes[SECTIONS_COUNT];
+};
+
+/*
+ * append:
+ * Appends the size bytes at data to buffer.
+ * Returns the offset of the bytes appended, counted in units of unit bytes
+ * (e.g. the index of a record of unit bytes).
+ */
+static uint32_t append(struct buffer *buffer, const void *data, size_t size,
+                       size_t unit);
+
+/*
+ * write_string:
+ * Appends str to the string table of writer.
+ * Returns its offset, or NO_REF if str is null.
+ */
+static uint32_t write_string(struct writer *writer, string str);
+
+/*
+ * write_*:
+ * Append the record of a structure (or list) to the section of writer
+ * where it belongs and return its index (or the list's place).
+ */
+static void write_user(struct writer *writer, User user);
+static uint32_t write_playlist(struct writer *writer,
+                               SimplifiedPlaylist playlist);
+static uint32_t write_artist(struct writer *writer,
+                             enum section_type section, Artist artist);
+static struct list_record write_artists_list(struct writer *writer,
+                                             SimplifiedArtist *artists);
+static uint32_t write_album(struct writer *writer, SimplifiedAlbum album);
+static uint32_t write_track(struct writer *writer, Track track);
+
+/*
+ * hash_key:
+ * Returns the hash (FNV-1a) of key, or of an empty string if key is null,
+ * which is all a snapshot keeps of its owner and token.
+ */
+static uint64_t hash_key(string key);
+
+/*
+ * write_file:
+ * Writes the sections of writer to the file at path, through a temporary
+ * file renamed once complete, for owner and with token.
+ * Returns false if the file couldn't be written.
+ */
+static bool write_file(struct writer *writer, string path, string owner,
+                       string token);
+
+/*
+ * map_file:
+ * Maps the snapshot at path and checks its header.
+ * Returns false if it isn't a valid snapshot of the current version saved
+ * for owner or with token, a null pointer matching neither.
+ */
+static bool map_file(string path, string owner, string token,
+                     struct reader *reader);
+
+/*
+ * release_mapping:
+ * Drops a reference to mapping, unmapping it when it was the last one.
+ */
+static void release_mapping(void *mapping);
+
+/*
+ * read_string:
+ * Returns a pointer to the string at offset in the string table of reader,
+ * or a null pointer if offset is NO_REF.
+ * Sets *valid to false if offset is out of bounds.
+ */
+static string read_string(struct reader *reader, uint32_t offset,
+                          bool *valid);
+
+/*
+ * read_record:
+ * Returns a pointer to the record at index in section, records being
+ * size bytes long, or a null pointer if index is out of bounds.
+ */
+static const void *read_record(struct reader *reader,
+                               enum section_type section, size_t index,
+                               size_t size);
+
+/*
+ * read_*:
+ * Create the structure (or list) held by a record, in the calling thread's
+ * current arena.
+ * Return a null pointer if a reference of the record is out of bounds or
+ * if not enough memory was available.
+ */
+static User read_user(struct reader *reader);
+static SimplifiedPlaylist read_playlist(struct reader *reader, size_t index);
+static Artist read_artist(struct reader *reader, enum section_type section,
+                          size_t index);
+static SimplifiedArtist *read_artists_list(struct reader *reader,
+                                           struct list_record list);
+static SimplifiedAlbum read_album(struct reader *reader, size_t index);
+static Track read_track(struct reader *reader, size_t index);
+
+/*
+ * read_page:
+ * Creates a page of the structures held by the records of section,
+ * of record_size bytes, using read_item.
+ * Returns a null pointer if any of them couldn't be created.
+ */
+static Page read_page(struct reader *reader, enum section_type section,
+                      size_t record_size,
+                      void *(*read_item)(struct reader *reader,
+                                         size_t index));
+
+/*
+ * read_page_*:
+ * Adapters of the read_* functions to read_page.
+ */
+static void *read_page_playlist(struct reader *reader, size_t index);
+static void *read_page_followed_artist(struct reader *reader, size_t index);
+static void *read_page_top_artist(struct reader *reader, size_t index);
+static void *read_page_track(struct reader *reader, size_t index);
+
+/*
+ * end_arena:
+ * Ends the calling thread's arena with root, keeping reader's mapping
+ * along with it. If root is null, or if the mapping couldn't be kept,
+ * releases the arena and returns a null pointer.
+ */
+static void *end_arena(struct reader *reader, void *root);
+
+bool library_snapshot_save(string path, string token,
+                           struct library_snapshot *snapshot) {
+  struct writer writer = { 0 };
+  write_string(&writer, "");
+
+  write_user(&writer, snapshot->user);
+  SimplifiedPlaylist *playlists =
+    snapshot->playlists != NULL ? snapshot->playlists->items : NULL;
+  for (size_t i = 0; playlists != NULL && playlists[i] != NULL; i++) {
+    write_playlist(&writer, playlists[i]);
+  }
+  Artist *followed_artists = snapshot->followed_artists != NULL
+    ? snapshot->followed_artists->items
+    : NULL;
+  for (size_t i = 0; followed_artists != NULL && followed_artists[i] != NULL;
+       i++) {
+    write_artist(&writer, SECTION_FOLLOWED_ARTISTS, followed_artists[i]);
+  }
+  Artist *top_artists =
+    snapshot->top_artists != NULL ? snapshot->top_artists->items : NULL;
+  for (size_t i = 0; top_artists != NULL && top_artists[i] != NULL; i++) {
+    write_artist(&writer, SECTION_TOP_ARTISTS, top_artists[i]);
+  }
+  Track *top_tracks =
+    snapshot->top_tracks != NULL ? snapshot->top_tracks->items : NULL;
+  for (size_t i = 0; top_tracks != NULL && top_tracks[i] != NULL; i++) {
+    write_track(&writer, top_tracks[i]);
+  }
+
+  bool failed = false;
+  for (int i = 0; i < SECTIONS_COUNT; i++) {
+    failed = failed || writer.sections[i].failed;
+  }
+  string owner = snapshot->user != NULL ? snapshot->user->id : NULL;
+  bool saved = !failed && write_file(&writer, path, owner, token);
+  for (int i = 0; i < SECTIONS_COUNT; i++) free(writer.sections[i].data);
+  return saved;
+}
+
+bool library_snapshot_load(string path, string owner, string token,
+                           struct library_snapshot *snapshot) {
+  struct reader reader;
+  if (!map_file(path, owner, token, &reader)) return false;
+
+  struct library_snapshot loaded = { 0 };
+  if (talloc_begin_arena()) {
+    loaded.user = end_arena(&reader, read_user(&reader));
+  }
+  if (loaded.user != NULL && talloc_begin_arena()) {
+    loaded.playlists = end_arena(&reader,
+                                 read_page(&reader, SECTION_PLAYLISTS,
+                                           sizeof(struct playlist_record),
+                                           read_page_playlist));
+  }
+  if (loaded.playlists != NULL && talloc_begin_arena()) {
+    loaded.followed_artists =
+      end_arena(&reader, read_page(&reader, SECTION_FOLLOWED_ARTISTS,
+                                   sizeof(struct artist_record),
+                                   read_page_followed_artist));
+  }
+  if (loaded.followed_artists != NULL && talloc_begin_arena()) {
+    loaded.top_artists =
+      end_arena(&reader, read_page(&reader, SECTION_TOP_ARTISTS,
+                                   sizeof(struct artist_record),
+                                   read_page_top_artist));
+  }
+  if (loaded.top_artists != NULL && talloc_begin_arena()) {
+    loaded.top_tracks =
+      end_arena(&reader, read_page(&reader, SECTION_TOP_TRACKS,
+                                   sizeof(struct track_record),
+                                   read_page_track));
+  }
+
+  bool complete = loaded.top_tracks != NULL;
+  if (complete) {
+    *snapshot = loaded;
+  } else {
+    if (loaded.user != NULL) free_user(loaded.user);
+    if (loaded.playlists != NULL) free_page(loaded.playlists);
+    if (loaded.followed_artists != NULL) free_page(loaded.followed_artists);
+    if (loaded.top_artists != NULL) free_page(loaded.top_artists);
+  }
+  release_mapping(reader.mapping);
+  return complete;
+}
+
+static uint32_t append(struct buffer *buffer, const void *data, size_t size,
+                       size_t unit) {
+  if (buffer->failed) return 0;
+  if (buffer->size + size > buffer->capacity) {
+    size_t capacity =
+      buffer->capacity > 0 ? buffer->capacity : MIN_CAPACITY;
+    while (capacity < buffer->size + size) capacity *= 2;
+    char *grown = realloc(buffer->data, capacity);
+    if (grown == NULL || capacity / unit > NO_REF) {
+      if (grown != NULL) buffer->data = grown;
+      buffer->failed = true;
+      return 0;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+  }
+  memcpy(buffer->data + buffer->size, data, size);
+  uint32_t offset = buffer->size / unit;
+  buffer->size += size;
+  return offset;
+}
+
+static uint32_t write_string(struct writer *writer, string str) {
+  if (str == NULL) return NO_REF;
+  return append(&writer->sections[SECTION_STRINGS], str, strlen(str) + 1, 1);
+}
+
+static void write_user(struct writer *writer, User user) {
+  struct user_record record = {
+    .display_name = write_string(writer, user->display_name),
+    .id = write_string(writer, user->id),
+    .followers = user->followers != NULL ? user->followers->total : 0,
+  };
+  append(&writer->sections[SECTION_USER], &record, sizeof(record),
+         sizeof(record));
+}
+
+static uint32_t write_playlist(struct writer *writer,
+                               SimplifiedPlaylist playlist) {
+  struct playlist_record record = {
+    .description = write_string(writer, playlist->description),
+    .href = write_string(writer, playlist->href),
+    .name = write_string(writer, playlist->name),
+    .snapshot_id = write_string(writer, playlist->snapshot_id),
+    .tracks_href = write_string(writer, playlist->tracks.href),
+    .owner_href = NO_REF,
+    .owner_id = NO_REF,
+    .owner_display_name = NO_REF,
+    .public = playlist->public,
+    .tracks_total = playlist->tracks.total,
+  };
+  memcpy(record.id, playlist->id, SPOTIFY_ID_SIZE);
+  if (playlist->owner != NULL) {
+    record.owner_href = write_string(writer, playlist->owner->href);
+    record.owner_id = write_string(writer, playlist->owner->id);
+    record.owner_display_name =
+      write_string(writer, playlist->owner->display_name);
+  }
+  return append(&writer->sections[SECTION_PLAYLISTS], &record,
+                sizeof(record), sizeof(record));
+}
+
+static uint32_t write_artist(struct writer *writer,
+                             enum section_type section, Artist artist) {
+  struct artist_record record = {
+    .name = write_string(writer, artist->name),
+    .genres = { .first = writer->sections[SECTION_REFS].size
+                         / sizeof(uint32_t) },
+    .followers = artist->followers != NULL ? artist->followers->total : 0,
+    .popularity = artist->popularity,
+  };
+  memcpy(record.id, artist->id, SPOTIFY_ID_SIZE);
+  for (size_t i = 0; artist->genres != NULL && artist->genres[i] != NULL;
+       i++) {
+    uint32_t genre = write_string(writer, artist->genres[i]);
+    append(&writer->sections[SECTION_REFS], &genre, sizeof(genre),
+           sizeof(genre));
+    record.genres.count++;
+  }
+  return append(&writer->sections[section], &record, sizeof(record),
+                sizeof(record));
+}
+
+static struct list_record write_artists_list(struct writer *writer,
+                                             SimplifiedArtist *artists) {
+  size_t count = 0;
+  while (artists != NULL && artists[count] != NULL) count++;
+  uint32_t indexes[count + 1];
+  for (size_t i = 0; i < count; i++) {
+    struct simplified_artist_record record = {
+      .href = write_string(writer, artists[i]->href),
+      .name = write_string(writer, artists[i]->name),
+    };
+    memcpy(record.id, artists[i]->id, SPOTIFY_ID_SIZE);
+    indexes[i] = append(&writer->sections[SECTION_SIMPLIFIED_ARTISTS],
+                        &record, sizeof(record), sizeof(record));
+  }
+
+  struct list_record list = {
+    .first = writer->sections[SECTION_REFS].size / sizeof(uint32_t),
+    .count = count,
+  };
+  append(&writer->sections[SECTION_REFS], indexes,
+         count * sizeof(uint32_t), sizeof(uint32_t));
+  return list;
+}
+
+static uint32_t write_album(struct writer *writer, SimplifiedAlbum album) {
+  struct album_record record = {
+    .album_type = write_string(writer, album->album_type),
+    .href = write_string(writer, album->href),
+    .name = write_string(writer, album->name),
+    .release_date = write_string(writer, album->release_date),
+    .restrictions = album->restrictions != NULL
+      ? write_string(writer, album->restrictions->reason)
+      : NO_REF,
+    .artists = write_artists_list(writer, album->artists),
+    .total_tracks = album->total_tracks,
+  };
+  memcpy(record.id, album->id, SPOTIFY_ID_SIZE);
+  return append(&writer->sections[SECTION_ALBUMS], &record, sizeof(record),
+                sizeof(record));
+}
+
+static uint32_t write_track(struct writer *writer, Track track) {
+  Restrictions restrictions = track_restrictions(track);
+  SimplifiedAlbum album = track_album(track);
+  struct track_record record = {
+    .name = write_string(writer, track->name),
+    .restrictions = restrictions != NULL
+      ? write_string(writer, restrictions->reason)
+      : NO_REF,
+    .album = album != NULL ? write_album(writer, album) : NO_REF,
+    .artists = write_artists_list(writer, track_artists(track)),
+    .duration_ms = track->duration_ms,
+    .popularity = track->popularity,
+  };
+  memcpy(record.id, track->id, SPOTIFY_ID_SIZE);
+  return append(&writer->sections[SECTION_TOP_TRACKS], &record,
+                sizeof(record), sizeof(record));
+}
+
+static uint64_t hash_key(string key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *c = key != NULL ? key : ""; *c != '\0'; c++) {
+    hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool write_file(struct writer *writer, string path, string owner,
+                       string token) {
+  struct header header = {
+    .magic = MAGIC,
+    .version = LIBRARY_SNAPSHOT_VERSION,
+    .byte_order = BYTE_ORDER_MARK,
+    .owner = hash_key(owner),
+    .token = hash_key(token),
+  };
+  uint64_t offset = sizeof(header);
+  for (int i = 0; i < SECTIONS_COUNT; i++) {
+    offset = (offset + 7) & ~(uint64_t) 7;
+    header.sections[i].offset = offset;
+    header.sections[i].size = writer->sections[i].size;
+    offset += writer->sections[i].size;
+  }
+  header.size = offset;
+
+  size_t temp_path_size = strlen(path) + sizeof(".XXXXXX");
+  char temp_path[temp_path_size];
+  snprintf(temp_path, temp_path_size, "%s.XXXXXX", path);
+  int fd = mkstemp(temp_path);
+  FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if (file == NULL) {
+    if (fd >= 0) {
+      close(fd);
+      unlink(temp_path);
+    }
+    return false;
+  }
+
+  static const char zeros[8] = { 0 };
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  uint64_t position = sizeof(header);
+  for (int i = 0; written && i < SECTIONS_COUNT; i++) {
+    size_t padding = header.sections[i].offset - position;
+    written = fwrite(zeros, 1, padding, file) == padding &&
+              fwrite(writer->sections[i].data, 1, writer->sections[i].size,
+                     file) == writer->sections[i].size;
+    position = header.sections[i].offset + header.sections[i].size;
+  }
+  written = !fclose(file) && written && !rename(temp_path, path);
+  if (!written) unlink(temp_path);
+  return written;
+}
+
+static bool map_file(string path, string owner, string token,
+                     struct reader *reader) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat info;
+  void *data = MAP_FAILED;
+  if (!fstat(fd, &info) && info.st_size >= (off_t) sizeof(struct header)) {
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  const struct header *header = data;
+  bool valid = !memcmp(header->magic, MAGIC, sizeof(MAGIC)) &&
+               header->version == LIBRARY_SNAPSHOT_VERSION &&
+               header->byte_order == BYTE_ORDER_MARK &&
+               header->size == (uint64_t) info.st_size &&
+               ((owner != NULL && header->owner == hash_key(owner)) ||
+                (token != NULL && header->token == hash_key(token)));
+  for (int i = 0; valid && i < SECTIONS_COUNT; i++) {
+    const struct section *section = &header->sections[i];
+    valid = section->offset % 8 == 0 && section->offset <= header->size &&
+            section->size <= header->size - section->offset;
+    reader->sections[i] = (const char *) data + section->offset;
+    reader->sizes[i] = section->size;
+  }
+  valid = valid && reader->sizes[SECTION_STRINGS] > 0 &&
+          reader->sections[SECTION_STRINGS][reader->sizes[SECTION_STRINGS]
+                                            - 1] == '\0' &&
+          reader->sizes[SECTION_USER] == sizeof(struct user_record);
+
+  struct mapping *mapping = valid ? malloc(sizeof(struct mapping)) : NULL;
+  if (mapping == NULL) {
+    munmap(data, info.st_size);
+    return false;
+  }
+  mapping->data = data;
+  mapping->size = info.st_size;
+  atomic_init(&mapping->refs, 1);
+  reader->mapping = mapping;
+  return true;
+}
+
+static void release_mapping(void *mapping_ptr) {
+  struct mapping *mapping = mapping_ptr;
+  if (atomic_fetch_sub(&mapping->refs, 1) > 1) return;
+  munmap(mapping->data, mapping->size);
+  free(mapping);
+}
+
+static string read_string(struct reader *reader, uint32_t offset,
+                          bool *valid) {
+  if (offset == NO_REF) return NULL;
+  if (offset >= reader->sizes[SECTION_STRINGS]) {
+    *valid = false;
+    return NULL;
+  }
+  return (string) reader->sections[SECTION_STRINGS] + offset;
+}
+
+static const void *read_record(struct reader *reader,
+                               enum section_type section, size_t index,
+                               size_t size) {
+  if (index >= reader->sizes[section] / size) return NULL;
+  return reader->sections[section] + index * size;
+}
+
+static User read_user(struct reader *reader) {
+  const struct user_record *record =
+    read_record(reader, SECTION_USER, 0, sizeof(struct user_record));
+  User user = new_user();
+  Followers followers = new_followers();
+  if (user == NULL || followers == NULL) return NULL;
+
+  bool valid = true;
+  user->display_name = read_string(reader, record->display_name, &valid);
+  user->id = read_string(reader, record->id, &valid);
+  followers->total = record->followers;
+  user->followers = followers;
+  return valid ? user : NULL;
+}
+
+static SimplifiedPlaylist read_playlist(struct reader *reader, size_t index) {
+  const struct playlist_record *record =
+    read_record(reader, SECTION_PLAYLISTS, index,
+                sizeof(struct playlist_record));
+  SimplifiedPlaylist playlist = new_simplified_playlist();
+  SimplifiedUser owner = new_simplified_user();
+  if (playlist == NULL || owner == NULL) return NULL;
+
+  bool valid = true;
+  memcpy(playlist->id, record->id, SPOTIFY_ID_SIZE);
+  playlist->id[SPOTIFY_ID_LENGTH] = '\0';
+  playlist->description = read_string(reader, record->description, &valid);
+  playlist->href = read_string(reader, record->href, &valid);
+  playlist->name = read_string(reader, record->name, &valid);
+  playlist->snapshot_id = read_string(reader, record->snapshot_id, &valid);
+  playlist->tracks.href = read_string(reader, record->tracks_href, &valid);
+  playlist->tracks.total = record->tracks_total;
+  playlist->public = record->public;
+  owner->href = read_string(reader, record->owner_href, &valid);
+  owner->id = read_string(reader, record->owner_id, &valid);
+  owner->display_name =
+    read_string(reader, record->owner_display_name, &valid);
+  playlist->owner = owner;
+  return valid ? playlist : NULL;
+}
+
+static Artist read_artist(struct reader *reader, enum section_type section,
+                          size_t index) {
+  const struct artist_record *record =
+    read_record(reader, section, index, sizeof(struct artist_record));
+  Artist artist = new_artist();
+  Followers followers = new_followers();
+  const uint32_t *refs = (const uint32_t *) reader->sections[SECTION_REFS];
+  size_t refs_count = reader->sizes[SECTION_REFS] / sizeof(uint32_t);
+  bool valid = record->genres.first <= refs_count &&
+               record->genres.count <= refs_count - record->genres.first;
+  string *genres = valid
+    ? (string *) allocate_array(record->genres.count, tmalloc)
+    : NULL;
+  if (artist == NULL || followers == NULL || genres == NULL) return NULL;
+
+  memcpy(artist->id, record->id, SPOTIFY_ID_SIZE);
+  artist->id[SPOTIFY_ID_LENGTH] = '\0';
+  artist->name = read_string(reader, record->name, &valid);
+  for (size_t i = 0; i < record->genres.count; i++) {
+    genres[i] = read_string(reader, refs[record->genres.first + i], &valid);
+  }
+  artist->genres = genres;
+  followers->total = record->followers;
+  artist->followers = followers;
+  artist->popularity = record->popularity;
+  return valid ? artist : NULL;
+}
+
+static SimplifiedArtist *read_artists_list(struct reader *reader,
+                                           struct list_record list) {
+  const uint32_t *refs = (const uint32_t *) reader->sections[SECTION_REFS];
+  size_t refs_count = reader->sizes[SECTION_REFS] / sizeof(uint32_t);
+  if (list.first > refs_count || list.count > refs_count - list.first) {
+    return NULL;
+  }
+  SimplifiedArtist *artists =
+    (SimplifiedArtist *) allocate_array(list.count, tmalloc);
+  if (artists == NULL) return NULL;
+
+  bool valid = true;
+  for (size_t i = 0; valid && i < list.count; i++) {
+    const struct simplified_artist_record *record =
+      read_record(reader, SECTION_SIMPLIFIED_ARTISTS, refs[list.first + i],
+                  sizeof(struct simplified_artist_record));
+    SimplifiedArtist artist = record != NULL ? new_simplified_artist() : NULL;
+    if (artist == NULL) return NULL;
+    memcpy(artist->id, record->id, SPOTIFY_ID_SIZE);
+    artist->id[SPOTIFY_ID_LENGTH] = '\0';
+    artist->href = read_string(reader, record->href, &valid);
+    artist->name = read_string(reader, record->name, &valid);
+    artists[i] = artist;
+  }
+  return valid ? artists : NULL;
+}
+
+static SimplifiedAlbum read_album(struct reader *reader, size_t index) {
+  const struct album_record *record =
+    read_record(reader, SECTION_ALBUMS, index, sizeof(struct album_record));
+  SimplifiedAlbum album = record != NULL ? new_simplified_album() : NULL;
+  if (album == NULL) return NULL;
+
+  bool valid = true;
+  memcpy(album->id, record->id, SPOTIFY_ID_SIZE);
+  album->id[SPOTIFY_ID_LENGTH] = '\0';
+  album->album_type = read_string(reader, record->album_type, &valid);
+  album->href = read_string(reader, record->href, &valid);
+  album->name = read_string(reader, record->name, &valid);
+  album->release_date = read_string(reader, record->release_date, &valid);
+  if (record->restrictions != NO_REF) {
+    album->restrictions = new_restrictions();
+    if (album->restrictions == NULL) return NULL;
+    album->restrictions->reason =
+      read_string(reader, record->restrictions, &valid);
+  }
+  album->artists = read_artists_list(reader, record->artists);
+  album->total_tracks = record->total_tracks;
+  return valid && album->artists != NULL ? album : NULL;
+}
+
+static Track read_track(struct reader *reader, size_t index) {
+  const struct track_record *record =
+    read_record(reader, SECTION_TOP_TRACKS, index,
+                sizeof(struct track_record));
+  Track track = new_track();
+  if (track == NULL) return NULL;
+
+  bool valid = true;
+  memcpy(track->id, record->id, SPOTIFY_ID_SIZE);
+  track->id[SPOTIFY_ID_LENGTH] = '\0';
+  track->name = read_string(reader, record->name, &valid);
+  if (record->restrictions != NO_REF) {
+    track->restrictions = new_restrictions();
+    if (track->restrictions == NULL) return NULL;
+    track->restrictions->reason =
+      read_string(reader, record->restrictions, &valid);
+  }
+  if (record->album != NO_REF) {
+    track->album = read_album(reader, record->album);
+    valid = valid && track->album != NULL;
+  }
+  track->artists = read_artists_list(reader, record->artists);
+  track->duration_ms = record->duration_ms;
+  track->popularity = record->popularity;
+  return valid && track->artists != NULL ? track : NULL;
+}
+
+static Page read_page(struct reader *reader, enum section_type section,
+                      size_t record_size,
+                      void *(*read_item)(struct reader *reader,
+                                         size_t index)) {
+  size_t count = reader->sizes[section] / record_size;
+  Page page = new_page();
+  void **items = allocate_array(count, tmalloc);
+  if (page == NULL || items == NULL) return NULL;
+
+  for (size_t i = 0; i < count; i++) {
+    items[i] = read_item(reader, i);
+    if (items[i] == NULL) return NULL;
+  }
+  page->items = items;
+  page->limit = page->total = page->count = count;
+  return page;
+}
+
+static void *read_page_playlist(struct reader *reader, size_t index) {
+  return read_playlist(reader, index);
+}
+
+static void *read_page_followed_artist(struct reader *reader, size_t index) {
+  return read_artist(reader, SECTION_FOLLOWED_ARTISTS, index);
+}
+
+static void *read_page_top_artist(struct reader *reader, size_t index) {
+  return read_artist(reader, SECTION_TOP_ARTISTS, index);
+}
+
+static void *read_page_track(struct reader *reader, size_t index) {
+  return read_track(reader, index);
+}
+
+static void *end_arena(struct reader *reader, void *root) {
+  atomic_fetch_add(&reader->mapping->refs, 1);
+  if (root == NULL || !talloc_keep(reader->mapping, release_mapping)) {
+    atomic_fetch_sub(&reader->mapping->refs, 1);
+    return talloc_end_arena(NULL);
+  }
+  return talloc_end_arena(root);
+}
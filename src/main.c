@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 #include "type-handlers.h"
 #include "tmem.h"
 #include "query.h"
@@ -9,6 +12,12 @@
 #include "readers.h"
 #include "ptrarray.h"
 #include "helpers.h"
+#include "fetch.h"
+#include "entity-cache.h"
+#include "response-cache.h"
+#include "playlist-store.h"
+#include "intern.h"
+#include "library-snapshot.h"
 
 #define IS_NULL(ptr) (ptr == NULL)
 #define IS_EMPTY(str) (str[0] == '\0')
@@ -16,17 +25,93 @@
 extern string token;
 
 extern User user;
-extern SimplifiedPlaylist *owned_playlists,
-                          *followed_playlists;
-extern Artist *followed_artists;
+extern SizedArray owned_playlists, followed_playlists;
+extern SizedArray followed_artists;
+extern size_t library_version;
 
 /*
- * handle_user_connection:
- * Queries the API to get user's informations.
- * Terminates program if the query fails, else stores
- * user informations in user.
+ * LIBRARY_REVALIDATION_MS:
+ * Time in milliseconds after which the user's playlists and followed
+ * artists, patched locally after each edit, are fetched again in
+ * the background (see revalidate_library).
  */
-void handle_user_connection(void);
+#define LIBRARY_REVALIDATION_MS 300000
+
+/*
+ * library_path:
+ * Path of the library snapshot (see the "library-snapshot" header), or null
+ * if the caches are disabled.
+ */
+static string library_path = NULL;
+
+/*
+ * favorite_artists_page and favorite_tracks_page:
+ * Pages of the user's favorite artists and tracks, or null pointers if
+ * they couldn't be fetched.
+ */
+static Page favorite_artists_page = NULL;
+static Page favorite_tracks_page = NULL;
+
+/*
+ * library_part:
+ * The parts of the library fetched at startup. PART_USER must be applied
+ * first, as the playlists are told apart using the user's name.
+ */
+enum library_part {
+  PART_USER, PART_PLAYLISTS, PART_FOLLOWED_ARTISTS, PART_TOP_ARTISTS,
+  PART_TOP_TRACKS, PARTS_COUNT
+};
+
+/*
+ * part_load:
+ * The fetch of a part of the library, made by its own thread if threaded
+ * is set. The thread only waits for its requests, which are made by
+ * the fetch engine (see fetch_submit). done is set once result was fetched,
+ * fetched_ms being the time it took since the program started, unless
+ * the fetch is a revalidation.
+ * failed is set if the fetch failed, with status the error's status (see
+ * query_last_error). pending stays set until the part is applied (see
+ * apply_library_part).
+ */
+struct part_load {
+  enum library_part part;
+  pthread_t thread;
+  bool threaded;
+  bool pending;
+  bool revalidation;
+  atomic_bool done;
+  void *result;
+  bool failed;
+  long status;
+  long fetched_ms;
+};
+
+/*
+ * library_load:
+ * The parts of the library fetched at startup, all at the same time, and
+ * the number of them still pending.
+ * from_snapshot is set if the library was loaded from the snapshot first.
+ * loaded is set once the library is in place, loaded from the snapshot or
+ * fetched: the parts aren't waited for anymore and a part that couldn't be
+ * fetched keeps its loaded version.
+ * version is the library_version once the last part was applied: the
+ * playlists and followed artists fetched are dropped if they were patched
+ * since (see the "helpers" header), and so are the parts applied after.
+ * start is the time the program started and first_menu_ms the time it took
+ * to show the first menu. revalidated_ms is the time of the last
+ * revalidation, revalidations their number.
+ */
+static struct {
+  struct part_load parts[PARTS_COUNT];
+  size_t pending;
+  bool from_snapshot;
+  bool loaded;
+  size_t version;
+  struct timespec start;
+  long first_menu_ms;
+  long revalidated_ms;
+  size_t revalidations;
+} library_load;
 
 /*
  * search:
@@ -55,9 +140,102 @@ void handle_followed(void);
  * Display the user's favorites artists and/or tracks and offers
  * the possibility to learn more about them.
  */
-void handle_favorites(Artist *favorite_artists, Track *favorite_tracks);
+void handle_favorites(SizedArray artists, SizedArray tracks);
+
+/*
+ * print_stats:
+ * If the CMUSIC_STATS environment variable is set, prints the measures
+ * taken by the fetch module and by the caches over the whole session, and
+ * the time it took to show the first menu.
+ */
+void print_stats(void);
+
+/*
+ * load_library:
+ * Loads the library snapshot saved with the token, or for the user with
+ * an id of owner (which can be null), if any, into the playlists and
+ * followed artists and the pages of favorites, and into user unless it
+ * was already fetched.
+ * Returns false if there is no such snapshot.
+ */
+bool load_library(string owner);
+
+/*
+ * start_library_load:
+ * Starts fetching every part of the library at the same time, each in its
+ * own thread (see library_load). The requests of every part go through
+ * the fetch engine, which multiplexes them over a single connection.
+ */
+void start_library_load(bool from_snapshot);
+
+/*
+ * start_library_part:
+ * Starts fetching part in its own thread, or fetches it right away if no
+ * thread could be created.
+ */
+void start_library_part(enum library_part part);
+
+/*
+ * revalidate_library:
+ * Starts fetching the user's playlists and followed artists again if
+ * LIBRARY_REVALIDATION_MS went by since the last fetch started,
+ * and if no part is still pending. The parts fetched replace the patched
+ * ones unless an edit was made since (see apply_library_part).
+ * The queries are answered from the response cache unless the library
+ * changed, so that a revalidation is cheap.
+ */
+void revalidate_library(void);
+
+/*
+ * fetch_library_part:
+ * Fetches the part of the library of load, a part_load structure.
+ * Runs in the thread of load.
+ */
+void *fetch_library_part(void *load);
+
+/*
+ * apply_library_part:
+ * If part was fetched, replaces the part loaded or the part that is missing
+ * with it, saving the library once every part was applied. If wait is set,
+ * waits for part to be fetched.
+ * Terminates program if the user couldn't be fetched and there is no
+ * snapshot, or if the API rejected the token.
+ */
+void apply_library_part(enum library_part part, bool wait);
+
+/*
+ * require_library_part:
+ * Waits for part to be fetched and applies it, if the library isn't loaded
+ * yet.
+ */
+void require_library_part(enum library_part part);
+
+/*
+ * elapsed_ms:
+ * Returns the time in milliseconds since the program started.
+ */
+long elapsed_ms(void);
+
+/*
+ * replace_page:
+ * Releases the page pointed by page_ptr, and its items using free_item,
+ * then replaces it with page.
+ */
+void replace_page(Page *page_ptr, Page page, void (*free_item)(void *item));
+
+/*
+ * setup_caches:
+ * Enables the response cache and the playlist store, storing their files
+ * in the directory set by the CMUSIC_CACHE_DIR environment variable, or in
+ * the cmusic directory of the user's cache directory ($XDG_CACHE_HOME,
+ * or ~/.cache) by default. Playlists are stored in its playlists directory
+ * and the library snapshot in its library file.
+ * The caches stay disabled if no directory can be found or created.
+ */
+void setup_caches(void);
 
 int main(int argc, char **argv) {
+  clock_gettime(CLOCK_MONOTONIC, &library_load.start);
   print_stream = stdout;
 
   if (argc != 2) {
@@ -65,31 +243,41 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   } else {
     token = argv[1];
-    handle_user_connection();
+    if (!fetch_init()) exit(EXIT_FAILURE);
+    setup_caches();
   }
 
+  bool from_snapshot = load_library(NULL);
+  start_library_load(from_snapshot);
+  require_library_part(PART_USER);
+  if (!from_snapshot && load_library(user->id)) {
+    library_load.from_snapshot = library_load.loaded = true;
+    library_load.version = library_version;
+  }
   print_to_stream("\nHello %s!\n", user->display_name);
-
-  update_playlists();
-  update_followed_artists();
-
-  Page favorite_artists_page = query_get_user_top_artists(0);
-  Page favorite_tracks_page = query_get_user_top_tracks(0);
+  library_load.first_menu_ms = elapsed_ms();
 
   for (;;) {
+    for (int i = 0; i < PARTS_COUNT; i++) apply_library_part(i, false);
+    revalidate_library();
     int option = handle_option_choice(4, "Search in catalog", 
                                       "Manage Playlists",
                                       "Manage followed Artists/Playlists",
                                       "Learn about your favorite "
                                       "artists/tracks");
 
-    int owned_playlists_count = 0;
-    while (!IS_NULL(owned_playlists[owned_playlists_count]))
-      owned_playlists_count++;
+    if (option >= 0 && option <= 2) {
+      require_library_part(PART_PLAYLISTS);
+      require_library_part(PART_FOLLOWED_ARTISTS);
+    } else if (option == 3) {
+      require_library_part(PART_TOP_ARTISTS);
+      require_library_part(PART_TOP_TRACKS);
+    }
+
     if (option == 0) {
       search();
     } else if (option == 1) {
-      if (owned_playlists_count) {
+      if (owned_playlists.length) {
         handle_user_playlists();
       } else {
         print_to_stream("\nNo playlist to manage\n");
@@ -97,28 +285,34 @@ int main(int argc, char **argv) {
     } else if (option == 2) {
       handle_followed();
     } else if (option == 3) {
-      handle_favorites((Artist *) favorite_artists_page->items, 
-                       (Track *) favorite_tracks_page->items);
+      enum library_part failed_part = IS_NULL(favorite_artists_page)
+        ? PART_TOP_ARTISTS
+        : PART_TOP_TRACKS;
+      if (IS_NULL(favorite_artists_page) || IS_NULL(favorite_tracks_page)) {
+        print_query_error(library_load.parts[failed_part].status);
+        continue;
+      }
+      handle_favorites(page_items(favorite_artists_page),
+                       page_items(favorite_tracks_page));
     } else break;
   }
-    
-  free_array(favorite_artists_page->items, free_artist);
-  tfree(free_page, favorite_artists_page);
-  free_array(favorite_tracks_page->items, free_track);
-  tfree(free_page, favorite_tracks_page);
+
+  for (int i = 0; i < PARTS_COUNT; i++) apply_library_part(i, true);
+  save_library(library_path, token, favorite_artists_page,
+                 favorite_tracks_page);
+  replace_page(&favorite_artists_page, NULL, free_artist);
+  replace_page(&favorite_tracks_page, NULL, free_track);
   tfree(free_user, user);
+  free(library_path);
+  print_stats();
+  entity_cache_clear();
+  intern_clear();
+  fetch_cleanup();
+  response_cache_set_dir(NULL);
+  playlist_store_set_dir(NULL);
 }
 
 
-void handle_user_connection(void) {
-  user = query_get_user();
-  if (IS_NULL(user) || IS_NULL(user->display_name)) {
-    print_to_stream("\nInvalid token. You can get a valid token by following "
-                    "the steps provided in the docs.\n");
-    exit(EXIT_FAILURE);
-  }
-}
-
 void search(void) {
   for (;;) {
     int option = handle_option_choice(4, "Search album", "Search artist", 
@@ -148,6 +342,8 @@ void search(void) {
         Search search = query_get_albums(name, IS_EMPTY(artist) ? NULL : artist,
                                          IS_EMPTY(year) ? NULL : year, new,
                                          hipster, offset);
+        query_cancel_prefetches();
+        if (query_failed(search)) break;
         Page albums_page = search->albums;
         is_last_page = albums_page->limit + offset >= albums_page->total;
         SimplifiedAlbum *albums = albums_page->items;
@@ -158,6 +354,16 @@ void search(void) {
           break;
         }
         print_array(albums, print_simplified_album_essentials);
+        if (!is_last_page) {
+          query_prefetch_albums(name, IS_EMPTY(artist) ? NULL : artist,
+                                IS_EMPTY(year) ? NULL : year, new, hipster,
+                                offset + albums_page->limit);
+        }
+        int albums_count = albums_page->count;
+        string ids[albums_count + 1];
+        for (int i = 0; i < albums_count; i++) ids[i] = albums[i]->id;
+        ids[albums_count] = NULL;
+        free_array((void **) query_get_several_albums(ids), free_album);
         print_to_stream("Enter album's number%s ",
                         is_last_page
                           ? ":"
@@ -171,8 +377,6 @@ void search(void) {
             tfree(free_search, search);
             continue;
           }
-          int albums_count = 0;
-          while (!IS_NULL(albums[albums_count])) albums_count++;
           if (choice >= 1 && choice <= albums_count) {
             Album album = query_get_album(albums[choice - 1]->id);
             handle_album(album);
@@ -182,6 +386,7 @@ void search(void) {
         tfree(free_search, search);
         break;
       } while (!is_last_page);
+      query_cancel_prefetches();
       free(name);
       free(artist);
       free(year);
@@ -204,6 +409,8 @@ void search(void) {
         Search search = query_get_artists(name, IS_EMPTY(year) ? NULL : year,
                                           IS_EMPTY(genre) ? NULL : genre,
                                           offset);
+        query_cancel_prefetches();
+        if (query_failed(search)) break;
         Page artists_page = search->artists;
         is_last_page = artists_page->limit + offset >= artists_page->total;
         Artist *artists = artists_page->items;
@@ -215,6 +422,11 @@ void search(void) {
         }
 
         print_array(artists, print_artist_essentials);
+        if (!is_last_page) {
+          query_prefetch_artists(name, IS_EMPTY(year) ? NULL : year,
+                                 IS_EMPTY(genre) ? NULL : genre,
+                                 offset + artists_page->limit);
+        }
         print_to_stream("Enter artist's number%s ",
                         is_last_page
                           ? ":"
@@ -228,8 +440,7 @@ void search(void) {
             tfree(free_search, search);
             continue;
           }
-          int artists_count = 0;
-          while (!IS_NULL(artists[artists_count])) artists_count++;
+          int artists_count = artists_page->count;
           if (choice >= 1 && choice <= artists_count) {
             handle_artist(artists[choice - 1]);
           }
@@ -237,6 +448,7 @@ void search(void) {
         tfree(free_search, search);
         break;
       } while (!is_last_page);
+      query_cancel_prefetches();
       free(name);
       free(year);
       free(genre);
@@ -252,6 +464,8 @@ void search(void) {
       bool is_last_page = false;
       do {
         Search search = query_get_playlists(name, offset);
+        query_cancel_prefetches();
+        if (query_failed(search)) break;
         Page playlists_page = search->playlists;
         is_last_page = playlists_page->limit + offset >= playlists_page->total;
         SimplifiedPlaylist *playlists = playlists_page->items;
@@ -263,6 +477,13 @@ void search(void) {
         }
 
         print_array(playlists, print_simplified_playlist_essentials);
+        if (!is_last_page) {
+          query_prefetch_playlists(name, offset + playlists_page->limit);
+        }
+        for (int i = 0; i < PREFETCHED_RESULTS && !IS_NULL(playlists[i]);
+             i++) {
+          query_prefetch_playlist(playlists[i]->id);
+        }
         print_to_stream("Enter playlist's number%s ",
                         is_last_page
                           ? ":"
@@ -276,8 +497,7 @@ void search(void) {
             tfree(free_search, search);
             continue;
           }
-          int playlists_count = 0;
-          while (!IS_NULL(playlists[playlists_count])) playlists_count++;
+          int playlists_count = playlists_page->count;
           if (choice >= 1 && choice <= playlists_count) {
             Playlist playlist = query_get_playlist(playlists[choice - 1]->id);
             handle_playlist(playlist);
@@ -287,6 +507,7 @@ void search(void) {
         tfree(free_search, search);
         break;
       } while (!is_last_page);
+      query_cancel_prefetches();
       free(name);
     } else if (option == 3) {
       print_to_stream("Enter track's name: ");
@@ -312,6 +533,8 @@ void search(void) {
                                          IS_EMPTY(year) ? NULL : year,
                                          IS_EMPTY(album) ? NULL : album,
                                          IS_EMPTY(genre) ? NULL : genre, offset);
+        query_cancel_prefetches();
+        if (query_failed(search)) break;
         Page tracks_page = search->tracks;
         is_last_page = tracks_page->limit + offset >= tracks_page->total;
         Track *tracks = tracks_page->items;
@@ -323,6 +546,13 @@ void search(void) {
         }
 
         print_array(tracks, print_track_essentials);
+        if (!is_last_page) {
+          query_prefetch_tracks(name, IS_EMPTY(artist) ? NULL : artist,
+                                IS_EMPTY(year) ? NULL : year,
+                                IS_EMPTY(album) ? NULL : album,
+                                IS_EMPTY(genre) ? NULL : genre,
+                                offset + tracks_page->limit);
+        }
         print_to_stream("Enter track's number%s ",
                         is_last_page
                           ? ":"
@@ -336,8 +566,7 @@ void search(void) {
             tfree(free_search, search);
             continue;
           }
-          int tracks_count = 0;
-          while (!IS_NULL(tracks[tracks_count])) tracks_count++;
+          int tracks_count = tracks_page->count;
           if (choice >= 1 && choice <= tracks_count) {
             handle_track(tracks[choice - 1]);
           }
@@ -345,6 +574,7 @@ void search(void) {
         tfree(free_search, search);
         break;
       } while (!is_last_page);
+      query_cancel_prefetches();
       free(name);
       free(artist);
       free(year);
@@ -356,9 +586,9 @@ void search(void) {
 
 void handle_user_playlists(void) {
   for (;;) {
-    SimplifiedPlaylist *playlists = owned_playlists;
-    int playlists_count = 0;
-    while (!IS_NULL(playlists[playlists_count])) playlists_count++;
+    SimplifiedPlaylist *playlists =
+      (SimplifiedPlaylist *) owned_playlists.items;
+    int playlists_count = owned_playlists.length;
     print_array(playlists, print_simplified_playlist_essentials);
     print_to_stream("Enter the number of the playlist you want to manage: ");
     bool success = false;
@@ -366,6 +596,7 @@ void handle_user_playlists(void) {
 
     if (!success || choice < 1 || choice > playlists_count) break;
     Playlist playlist = query_get_playlist(playlists[choice - 1]->id);
+    if (query_failed(playlist)) continue;
 
     int option = handle_option_choice(3, "Update playlist's details",
                                       "Remove tracks from playlist",
@@ -376,43 +607,36 @@ void handle_user_playlists(void) {
       if (!IS_EMPTY(playlist->name)) {
         print_to_stream("(%s) ", playlist->name);
       }
+      struct playlist details = *playlist;
       string new_name = read_string(stdin);
-      if (!IS_EMPTY(new_name)) {
-        free(playlist->name);
-        playlist->name = new_name;
-      } else free(new_name);
+      if (!IS_EMPTY(new_name)) details.name = new_name;
       print_to_stream("Enter playlist's description: ");
       if (!IS_EMPTY(playlist->description)) {
         print_to_stream("(%s) ", playlist->description);
       }
       string new_description = read_string(stdin);
-      if (!IS_EMPTY(new_description)) {
-        free(playlist->description);
-        playlist->description = new_description;
-      } else free(new_description);
-      
-      query_put_playlist_details(playlist);
-      update_playlists();
-      print_to_stream("\nPlaylist updated\n");
+      if (!IS_EMPTY(new_description)) details.description = new_description;
+
+      query_put_playlist_details(&details);
+      if (!last_query_failed()) {
+        patch_playlist(&details, 0);
+        print_to_stream("\nPlaylist updated\n");
+      }
+      free(new_name);
+      free(new_description);
     } else if (option == 1 || option == 2) {
+      Page page = query_get_all_playlist_tracks(playlist->id,
+                                                playlist->snapshot_id);
+      if (query_failed(page)) {
+        tfree(free_playlist, playlist);
+        continue;
+      }
+      PlaylistTrack *playlist_tracks = page->items;
+      int tracks_count = page->count;
       PtrArray ptr_array = new_ptr_array();
-      size_t offset = 0;
-      int tracks_count = 0;
-      for (;;) {
-        Page page = !offset
-          ? playlist->tracks
-          : query_get_playlist_tracks(playlist->id, offset);
-        PlaylistTrack *playlist_tracks = page->items;
-        for (int i = 0; !IS_NULL(playlist_tracks[i]); i++) {
-          add_item(ptr_array, playlist_tracks[i]->track);
-          tracks_count++;
-        }
-        if (offset) {
-          free_array((void **) playlist_tracks, free_playlist_track);
-          tfree(free_page, page);
-        }
-        offset = tracks_count;
-        if (tracks_count >= page->total) break;
+      reserve_ptr_array(ptr_array, tracks_count);
+      for (int i = 0; i < tracks_count; i++) {
+        add_item(ptr_array, playlist_tracks[i]->track);
       }
       Track *tracks = (Track *) get_array(ptr_array);
 
@@ -437,14 +661,19 @@ void handle_user_playlists(void) {
                           tracks_to_delete_count > 1 ? "s" : "", 
                           playlist->name);
           if (read_bool(stdin)) {
-            query_delete_playlist_tracks(
+            string snapshot_id = query_delete_playlist_tracks(
               playlist, 
               (Track *) get_array(tracks_to_delete_ptr_array));
-            update_playlists();
-            print_to_stream("\nTrack%s removed\n", 
-                            tracks_to_delete_count > 1
-                              ? "s"
-                              : "");
+            if (!last_query_failed()) {
+              struct playlist patched = *playlist;
+              patched.snapshot_id = snapshot_id;
+              patch_playlist(&patched, -(long) tracks_to_delete_count);
+              print_to_stream("\nTrack%s removed\n", 
+                              tracks_to_delete_count > 1
+                                ? "s"
+                                : "");
+            }
+            free(snapshot_id);
           }
         }
         free_ptr_array(tracks_to_delete_ptr_array, false, NULL);
@@ -458,10 +687,9 @@ void handle_user_playlists(void) {
         }
       }
 
-      if (playlist->tracks->total > playlist->tracks->limit) {
-        free_array(get_array(ptr_array) + playlist->tracks->limit, free_track);
-      }
-      free_ptr_array(ptr_array, false, NULL);
+      free_ptr_array(ptr_array, true, NULL);
+      free_array((void **) playlist_tracks, free_playlist_track);
+      tfree(free_page, page);
     } 
 
     tfree(free_playlist, playlist);
@@ -470,12 +698,11 @@ void handle_user_playlists(void) {
 
 void handle_followed(void) {
   for (;;) {
-    SimplifiedPlaylist *playlists = followed_playlists;
-    Artist *artists = followed_artists;
-    int artists_count = 0;
-    while (!IS_NULL(artists[artists_count])) artists_count++;
-    int playlists_count = 0;
-    while (!IS_NULL(playlists[playlists_count])) playlists_count++;
+    SimplifiedPlaylist *playlists =
+      (SimplifiedPlaylist *) followed_playlists.items;
+    Artist *artists = (Artist *) followed_artists.items;
+    int artists_count = followed_artists.length;
+    int playlists_count = followed_playlists.length;
     int option = handle_option_choice(4, "Unfollow artist", 
                                       "Unfollow playlist",
                                       "Learn more about followed artists",
@@ -493,8 +720,10 @@ void handle_followed(void) {
             add_item(artists_to_unfollow_ptr_array, artists[choice - 1]);
             query_delete_unfollow_artists(
               (Artist *) get_array(artists_to_unfollow_ptr_array));
-            update_followed_artists();
-            print_to_stream("\nArtist unfollowed\n");
+            if (!last_query_failed()) {
+              remove_followed_artist(artists[choice - 1]->id);
+              print_to_stream("\nArtist unfollowed\n");
+            }
             free_ptr_array(artists_to_unfollow_ptr_array, false, NULL);
           }
           else handle_artist(artists[choice - 1]);
@@ -508,10 +737,13 @@ void handle_followed(void) {
         int choice = read_integer(stdin, &success);
         if (success && choice >= 1 && choice <= playlists_count) {
           Playlist playlist = query_get_playlist(playlists[choice - 1]->id);
+          if (query_failed(playlist)) continue;
           if (option == 1) {
             query_delete_unfollow_playlist(playlist);
-            update_playlists();
-            print_to_stream("\nPlaylist Unfollowed\n");
+            if (!last_query_failed()) {
+              remove_followed_playlist(playlist->id);
+              print_to_stream("\nPlaylist Unfollowed\n");
+            }
           } else handle_playlist(playlist);
           tfree(free_playlist, playlist);
         }
@@ -520,11 +752,11 @@ void handle_followed(void) {
   }
 }
 
-void handle_favorites(Artist *favorite_artists, Track *favorite_tracks) {
-  int artists_count = 0;
-  while (!IS_NULL(favorite_artists[artists_count])) artists_count++;
-  int tracks_count = 0;
-  while (!IS_NULL(favorite_tracks[tracks_count])) tracks_count++;
+void handle_favorites(SizedArray artists, SizedArray tracks) {
+  Artist *favorite_artists = (Artist *) artists.items;
+  Track *favorite_tracks = (Track *) tracks.items;
+  int artists_count = artists.length;
+  int tracks_count = tracks.length;
   for (;;) {
     int option = handle_option_choice(2, "Learn more about one of your "
                                       "favorite artists",
@@ -556,3 +788,217 @@ void handle_favorites(Artist *favorite_artists, Track *favorite_tracks) {
     } else break;
   }
 }
+
+void print_stats(void) {
+  if (IS_NULL(getenv("CMUSIC_STATS"))) return;
+  struct fetch_stats stats = fetch_get_stats();
+  print_to_stream("\nRequests: %zu (%zu over HTTP/2)\n", stats.requests,
+                  stats.http2_requests);
+  print_to_stream("Connections opened: %zu\n", stats.connections);
+  print_to_stream("Bytes received: %zu (%zu once decompressed)\n",
+                  stats.received_bytes, stats.decoded_bytes);
+  print_to_stream("Total time: %ld ms, slowest request: %ld ms\n",
+                  stats.total_time_us / 1000, stats.max_time_us / 1000);
+  struct entity_cache_stats cache_stats = entity_cache_get_stats();
+  print_to_stream("Entity cache: %zu hits, %zu misses, %zu evictions "
+                  "(%zu entities, %zu bytes kept)\n", cache_stats.hits,
+                  cache_stats.misses, cache_stats.evictions,
+                  cache_stats.entries, cache_stats.bytes);
+  print_to_stream("Response cache: %zu responses reused, %zu revalidated\n",
+                  stats.cached_responses, stats.revalidated_responses);
+  print_to_stream("Throttled requests: %zu (%zu dropped)\n",
+                  stats.throttled_requests, stats.dropped_requests);
+  print_to_stream("Retried requests: %zu, failed requests: %zu\n",
+                  stats.retried_requests, stats.failed_requests);
+  print_to_stream("Coalesced requests: %zu\n", stats.coalesced_requests);
+  print_to_stream("Prefetched requests: %zu (%zu used, %zu cancelled, "
+                  "%zu over budget)\n", stats.prefetched_requests,
+                  stats.prefetch_hits, stats.cancelled_prefetches,
+                  stats.skipped_prefetches);
+  struct playlist_store_stats store_stats = playlist_store_get_stats();
+  print_to_stream("Playlist store: %zu hits, %zu misses\n", store_stats.hits,
+                  store_stats.misses);
+  struct intern_stats intern_stats = intern_get_stats();
+  print_to_stream("Interned strings: %zu (%zu of %zu lookups hit, "
+                  "%zu bytes saved)\n", intern_stats.strings,
+                  intern_stats.hits, intern_stats.lookups,
+                  intern_stats.saved_bytes);
+  long library_fetched_ms = 0;
+  for (int i = 0; i < PARTS_COUNT; i++) {
+    if (library_load.parts[i].fetched_ms > library_fetched_ms) {
+      library_fetched_ms = library_load.parts[i].fetched_ms;
+    }
+  }
+  print_to_stream("Time to first menu: %ld ms (%s), library fetched in "
+                  "%ld ms\n", library_load.first_menu_ms,
+                  library_load.from_snapshot ? "from snapshot" : "fetched",
+                  library_fetched_ms);
+  print_to_stream("Library revalidations: %zu\n",
+                  library_load.revalidations);
+}
+
+bool load_library(string owner) {
+  struct library_snapshot snapshot;
+  if (IS_NULL(library_path) ||
+      !library_snapshot_load(library_path, owner, token, &snapshot)) {
+    return false;
+  }
+
+  if (IS_NULL(user)) {
+    user = snapshot.user;
+  } else tfree(free_user, snapshot.user);
+  set_playlists(snapshot.playlists);
+  PtrArray followed_artists_pages = new_ptr_array();
+  add_item(followed_artists_pages, snapshot.followed_artists);
+  set_followed_artists(followed_artists_pages);
+  favorite_artists_page = snapshot.top_artists;
+  favorite_tracks_page = snapshot.top_tracks;
+  return true;
+}
+
+void start_library_load(bool from_snapshot) {
+  library_load.from_snapshot = library_load.loaded = from_snapshot;
+  library_load.version = library_version;
+  for (int i = 0; i < PARTS_COUNT; i++) start_library_part(i);
+}
+
+void start_library_part(enum library_part part) {
+  struct part_load *load = &library_load.parts[part];
+  load->part = part;
+  load->pending = true;
+  load->revalidation = library_load.revalidations > 0;
+  load->result = NULL;
+  load->failed = false;
+  atomic_store(&load->done, false);
+  library_load.pending++;
+  load->threaded =
+    !pthread_create(&load->thread, NULL, fetch_library_part, load);
+  if (!load->threaded) fetch_library_part(load);
+}
+
+void revalidate_library(void) {
+  long now = elapsed_ms();
+  if (library_load.pending ||
+      now - library_load.revalidated_ms < LIBRARY_REVALIDATION_MS) {
+    return;
+  }
+  library_load.revalidated_ms = now;
+  library_load.revalidations++;
+  library_load.version = library_version;
+  start_library_part(PART_PLAYLISTS);
+  start_library_part(PART_FOLLOWED_ARTISTS);
+}
+
+void *fetch_library_part(void *load_ptr) {
+  struct part_load *load = load_ptr;
+  if (load->part == PART_USER) {
+    load->result = query_get_user();
+  } else if (load->part == PART_PLAYLISTS) {
+    load->result = query_get_all_user_playlists();
+  } else if (load->part == PART_FOLLOWED_ARTISTS) {
+    load->result = fetch_followed_artists(&load->failed);
+  } else if (load->part == PART_TOP_ARTISTS) {
+    load->result = query_get_user_top_artists(0);
+  } else load->result = query_get_user_top_tracks(0);
+  load->failed = load->failed || IS_NULL(load->result);
+  load->status = query_last_error();
+  if (!load->revalidation) load->fetched_ms = elapsed_ms();
+  atomic_store(&load->done, true);
+  return NULL;
+}
+
+void apply_library_part(enum library_part part, bool wait) {
+  struct part_load *load = &library_load.parts[part];
+  if (!load->pending) return;
+  if (!wait && !atomic_load(&load->done)) return;
+  if (part == PART_PLAYLISTS) apply_library_part(PART_USER, true);
+  if (load->threaded) pthread_join(load->thread, NULL);
+  load->pending = false;
+  library_load.pending--;
+
+  bool loaded = library_load.loaded;
+  bool updated = library_version != library_load.version;
+  if (part == PART_USER) {
+    User fetched = load->result;
+    bool rejected = load->failed && load->status == 401;
+    if (load->failed && !rejected && !loaded) {
+      print_query_error(load->status);
+      exit(EXIT_FAILURE);
+    }
+    if (rejected || (!load->failed && IS_NULL(fetched->display_name))) {
+      print_to_stream("\nInvalid token. You can get a valid token by "
+                      "following the steps provided in the docs.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (!load->failed) {
+      tfree(free_user, user);
+      user = fetched;
+    }
+  } else if (part == PART_PLAYLISTS) {
+    if (load->failed && !loaded) print_query_error(load->status);
+    if (!updated && (!load->failed || !loaded)) {
+      set_playlists(load->result);
+    } else tfree(free_page, load->result);
+  } else if (part == PART_FOLLOWED_ARTISTS) {
+    if (load->failed && !loaded) print_query_error(load->status);
+    if (!updated && (!load->failed || !loaded)) {
+      set_followed_artists(load->result);
+    } else free_ptr_array(load->result, true, free_page);
+  } else if (!load->failed) {
+    replace_page(part == PART_TOP_ARTISTS
+                   ? &favorite_artists_page
+                   : &favorite_tracks_page,
+                 load->result,
+                 part == PART_TOP_ARTISTS ? free_artist : free_track);
+  }
+  if (!updated) library_load.version = library_version;
+
+  if (!library_load.pending) {
+    library_load.loaded = true;
+    save_library(library_path, token, favorite_artists_page,
+                 favorite_tracks_page);
+  }
+}
+
+void require_library_part(enum library_part part) {
+  if (!library_load.loaded) apply_library_part(part, true);
+}
+
+long elapsed_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - library_load.start.tv_sec) * 1000 +
+         (now.tv_nsec - library_load.start.tv_nsec) / 1000000;
+}
+
+void replace_page(Page *page_ptr, Page page, void (*free_item)(void *item)) {
+  if (!IS_NULL(*page_ptr)) free_array((*page_ptr)->items, free_item);
+  tfree(free_page, *page_ptr);
+  *page_ptr = page;
+}
+
+void setup_caches(void) {
+  string base = getenv("CMUSIC_CACHE_DIR");
+  string suffix = "";
+  if (IS_NULL(base) || IS_EMPTY(base)) {
+    base = getenv("XDG_CACHE_HOME");
+    suffix = "/cmusic";
+  }
+  if (IS_NULL(base) || IS_EMPTY(base)) {
+    base = getenv("HOME");
+    suffix = "/.cache/cmusic";
+  }
+  if (IS_NULL(base) || IS_EMPTY(base)) return;
+
+  char dir[strlen(base) + strlen(suffix) + strlen("/playlists") + 1];
+  strcpy(dir, base);
+  strcat(dir, suffix);
+  if (!response_cache_set_dir(dir)) return;
+  library_path = malloc(strlen(dir) + strlen("/library") + 1);
+  if (!IS_NULL(library_path)) {
+    strcpy(library_path, dir);
+    strcat(library_path, "/library");
+  }
+  strcat(dir, "/playlists");
+  playlist_store_set_dir(dir);
+}
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "playlist-store.h"
+
+#define MAGIC "cmusic-playlist 1"
+#define READ_SIZE (16 * 1024)
+
+/*
+ * unused_fields:
+ * Fields of the API's track objects that are never read by the converters
+ * and are removed before storing tracks, available_markets alone usually
+ * taking most of a track's space.
+ */
+static const char *unused_fields[] = {
+  "available_markets", "external_ids", "external_urls", "images",
+  "video_thumbnail", NULL
+};
+
+/*
+ * store:
+ * dir is the store's directory (null if the store is disabled).
+ * lock protects the whole structure.
+ */
+static struct {
+  string dir;
+  struct playlist_store_stats stats;
+  pthread_mutex_t lock;
+} store = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * create_path:
+ * Returns the path of the file where the playlist having an id of id
+ * is stored, followed by suffix.
+ * Returns a null pointer if the store is disabled, if id isn't a valid
+ * Spotify ID or if not enough memory was available.
+ */
+static string create_path(string id, string suffix);
+
+/*
+ * read_content:
+ * Returns the rest of file's content as a null-terminated string.
+ * Returns a null pointer if file couldn't be read or if not enough memory
+ * was available.
+ */
+static string read_content(FILE *file);
+
+/*
+ * compact:
+ * Removes the unused fields from item and from its children.
+ */
+static void compact(cJSON *item);
+
+bool playlist_store_set_dir(string dir) {
+  string copy = NULL;
+  if (dir != NULL) {
+    copy = malloc(strlen(dir) + 1);
+    struct stat info;
+    if (copy == NULL || (mkdir(dir, 0700) && errno != EEXIST) ||
+        stat(dir, &info) || !S_ISDIR(info.st_mode)) {
+      free(copy);
+      copy = NULL;
+    } else strcpy(copy, dir);
+  }
+
+  pthread_mutex_lock(&store.lock);
+  free(store.dir);
+  store.dir = copy;
+  store.stats = (struct playlist_store_stats) { 0 };
+  pthread_mutex_unlock(&store.lock);
+  return dir == NULL || copy != NULL;
+}
+
+cJSON *playlist_store_get(string id, string snapshot_id) {
+  string path = create_path(id, "");
+  FILE *file = path != NULL && snapshot_id != NULL ? fopen(path, "r") : NULL;
+  free(path);
+
+  cJSON *cJSON_tracks = NULL;
+  if (file != NULL) {
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length = getline(&line, &line_size, file);
+    bool found = length > 0 && !strcmp(line, MAGIC "\n");
+    length = found ? getline(&line, &line_size, file) : -1;
+    found = length > 0 && line[length - 1] == '\n' &&
+            !strncmp(line, snapshot_id, length - 1) &&
+            snapshot_id[length - 1] == '\0';
+    free(line);
+
+    string content = found ? read_content(file) : NULL;
+    if (content != NULL) {
+      cJSON_tracks = cJSON_ParseWithOpts(content, NULL, false);
+    }
+    free(content);
+    fclose(file);
+  }
+
+  pthread_mutex_lock(&store.lock);
+  if (cJSON_tracks != NULL) {
+    store.stats.hits++;
+  } else store.stats.misses++;
+  pthread_mutex_unlock(&store.lock);
+  return cJSON_tracks;
+}
+
+bool playlist_store_put(string id, string snapshot_id, cJSON *cJSON_tracks) {
+  if (snapshot_id == NULL || cJSON_tracks == NULL ||
+      strchr(snapshot_id, '\n') != NULL) {
+    return false;
+  }
+  string path = create_path(id, "");
+  string temp_path = create_path(id, ".XXXXXX");
+  if (path == NULL || temp_path == NULL) {
+    free(path);
+    free(temp_path);
+    return false;
+  }
+
+  compact(cJSON_tracks);
+  string json = cJSON_PrintUnformatted(cJSON_tracks);
+  int fd = json != NULL ? mkstemp(temp_path) : -1;
+  FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+  bool stored = false;
+  if (file != NULL) {
+    stored = fprintf(file, MAGIC "\n%s\n", snapshot_id) > 0 &&
+             fputs(json, file) >= 0;
+    stored = !fclose(file) && stored && !rename(temp_path, path);
+  } else if (fd >= 0) close(fd);
+  if (!stored && fd >= 0) unlink(temp_path);
+
+  free(json);
+  free(path);
+  free(temp_path);
+  return stored;
+}
+
+void playlist_store_remove(string id) {
+  string path = create_path(id, "");
+  if (path != NULL) unlink(path);
+  free(path);
+}
+
+struct playlist_store_stats playlist_store_get_stats(void) {
+  pthread_mutex_lock(&store.lock);
+  struct playlist_store_stats stats = store.stats;
+  pthread_mutex_unlock(&store.lock);
+  return stats;
+}
+
+static string create_path(string id, string suffix) {
+  if (id == NULL || *id == '\0') return NULL;
+  for (string c = id; *c != '\0'; c++) {
+    if (!isalnum((unsigned char) *c)) return NULL;
+  }
+
+  pthread_mutex_lock(&store.lock);
+  string path = NULL;
+  if (store.dir != NULL) {
+    size_t path_size = strlen(store.dir) + strlen(id) + strlen(suffix) + 2;
+    path = malloc(path_size);
+    if (path != NULL) {
+      snprintf(path, path_size, "%s/%s%s", store.dir, id, suffix);
+    }
+  }
+  pthread_mutex_unlock(&store.lock);
+  return path;
+}
+
+static void compact(cJSON *item) {
+  for (; item != NULL; item = item->next) {
+    if (cJSON_IsObject(item)) {
+      for (int i = 0; unused_fields[i] != NULL; i++) {
+        cJSON_DeleteItemFromObjectCaseSensitive(item, unused_fields[i]);
+      }
+    }
+    compact(item->child);
+  }
+}
+
+static string read_content(FILE *file) {
+  string content = NULL;
+  size_t size = 0, capacity = 0, read_size;
+  do {
+    if (size + READ_SIZE + 1 > capacity) {
+      capacity = capacity ? capacity * 2 : READ_SIZE + 1;
+      string resized_content = realloc(content, capacity);
+      if (resized_content == NULL) {
+        free(content);
+        return NULL;
+      }
+      content = resized_content;
+    }
+    read_size = fread(content + size, 1, READ_SIZE, file);
+    size += read_size;
+  } while (read_size == READ_SIZE);
+
+  if (ferror(file)) {
+    free(content);
+    return NULL;
+  }
+  content[size] = '\0';
+  return content;
+}
@@ -1,28 +1,48 @@
 #include <stdlib.h>
+#include <string.h>
 #include "ptrarray.h"
 
+#define MIN_CAPACITY 8
+
+/*
+ * ptr_array:
+ * array stores size pointers followed by a null pointer, and capacity is
+ * the number of pointers it can hold (not counting the null pointer)
+ * before growing.
+ */
 struct ptr_array {
   size_t size;
+  size_t capacity;
   void **array;
 };
 
 /*
  * resize_ptr_array:
- * Resizes ptr_array to fit for new_size pointers (+1 for the null pointer).
- * The function's return value will match new_size if no error occurred,
- * else it will return 0.
+ * Resizes ptr_array's array to fit for capacity pointers
+ * (+1 for the null pointer). capacity must not be lower than the number of
+ * items stored.
+ * Returns false if not enough memory was available, else returns true.
  */
-static size_t resize_ptr_array(PtrArray ptr_array, size_t new_size);
+static bool resize_ptr_array(PtrArray ptr_array, size_t capacity);
+
+/*
+ * grow_ptr_array:
+ * Makes sure ptr_array can hold at least size pointers, at least doubling
+ * its capacity if it has to grow.
+ * Returns false if not enough memory was available, else returns true.
+ */
+static bool grow_ptr_array(PtrArray ptr_array, size_t size);
 
 PtrArray new_ptr_array(void) {
-  PtrArray ptr_array = malloc(sizeof(ptr_array));
+  PtrArray ptr_array = malloc(sizeof(struct ptr_array));
   if (ptr_array == NULL) return ptr_array;
-  ptr_array->array = malloc(sizeof(void *));
-  if (ptr_array->array == NULL) {
+  ptr_array->array = NULL;
+  ptr_array->size = 0;
+  if (!resize_ptr_array(ptr_array, 0)) {
     free(ptr_array);
     return NULL;
   }
-  ptr_array->size = 0;
+  ptr_array->array[0] = NULL;
 
   return ptr_array;
 }
@@ -39,11 +59,27 @@ void free_ptr_array(PtrArray ptr_array, bool free_content,
 }
 
 size_t add_item(PtrArray ptr_array, void *ptr) {
-  if (!resize_ptr_array(ptr_array, ptr_array->size + 1)) return 0;
-  ptr_array->array[ptr_array->size - 1] = ptr;
+  return add_items(ptr_array, &ptr, 1);
+}
+
+size_t add_items(PtrArray ptr_array, void **items, size_t count) {
+  if (!grow_ptr_array(ptr_array, ptr_array->size + count)) return 0;
+  memcpy(ptr_array->array + ptr_array->size, items, count * sizeof(void *));
+  ptr_array->size += count;
+  ptr_array->array[ptr_array->size] = NULL;
   return ptr_array->size;
 }
 
+bool reserve_ptr_array(PtrArray ptr_array, size_t size) {
+  if (size <= ptr_array->capacity) return true;
+  return resize_ptr_array(ptr_array, size);
+}
+
+bool shrink_ptr_array(PtrArray ptr_array) {
+  if (ptr_array->capacity == ptr_array->size) return true;
+  return resize_ptr_array(ptr_array, ptr_array->size);
+}
+
 size_t get_size(PtrArray ptr_array) {
   return ptr_array->size;
 }
@@ -52,13 +88,44 @@ void **get_array(PtrArray ptr_array) {
   return ptr_array->array;
 }
 
-static size_t resize_ptr_array(PtrArray ptr_array, size_t new_size) {
-  void **new_array = realloc(ptr_array->array, 
-                             (new_size + 1) * sizeof(void *));
-  if (new_array == NULL) return 0;
-  ptr_array->array = new_array;
-  ptr_array->size = new_size;
-  ptr_array->array[ptr_array->size] = NULL;
+SizedArray get_sized_array(PtrArray ptr_array) {
+  return (SizedArray) { ptr_array->size, ptr_array->array };
+}
+
+SizedArray copy_array(PtrArray ptr_array, void *(*allocate)(size_t size)) {
+  size_t size = (ptr_array->size + 1) * sizeof(void *);
+  SizedArray copy = { ptr_array->size, (*allocate)(size) };
+  if (copy.items != NULL) memcpy(copy.items, ptr_array->array, size);
+  return copy;
+}
+
+void **allocate_array(size_t length, void *(*allocate)(size_t size)) {
+  size_t size = (length + 1) * sizeof(void *);
+  void **array = (*allocate)(size);
+  if (array == NULL) return NULL;
+  return memset(array, 0, size);
+}
+
+size_t array_length(void *array) {
+  size_t length = 0;
+  if (array != NULL) {
+    while (((void **) array)[length] != NULL) length++;
+  }
+  return length;
+}
+
+static bool resize_ptr_array(PtrArray ptr_array, size_t capacity) {
+  void **array = realloc(ptr_array->array, (capacity + 1) * sizeof(void *));
+  if (array == NULL) return false;
+  ptr_array->array = array;
+  ptr_array->capacity = capacity;
+
+  return true;
+}
 
-  return new_size;
+static bool grow_ptr_array(PtrArray ptr_array, size_t size) {
+  if (size <= ptr_array->capacity) return true;
+  size_t capacity = ptr_array->capacity ? ptr_array->capacity : MIN_CAPACITY;
+  while (capacity < size) capacity *= 2;
+  return resize_ptr_array(ptr_array, capacity);
 }
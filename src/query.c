@@ -4,8 +4,12 @@
 #include <stdarg.h>
 #include <cjson/cJSON.h>
 #include "tmem.h"
+#include "ptrarray.h"
+#include "string-builder.h"
 #include "fetch.h"
 #include "cjson-converters.h"
+#include "entity-cache.h"
+#include "playlist-store.h"
 #include "query.h"
 
 #define GET "GET"
@@ -15,21 +19,10 @@
 
 #define BASE_URL "https://api.spotify.com/v1"
 
-#define create_uri(type, id) create_string("spotify:%s:%s", type, id)
+#define USER_PLAYLISTS_LIMIT 50
+#define PLAYLIST_TRACKS_LIMIT 100
 
-#define cJSON_HasError(cJSON) \
-  cJSON_IsObject(cJSON_GetObjectItemCaseSensitive(cJSON, "error"))
-
-/*
- * extend_string:
- * Equivalent to str = create_string(format, ...) but freeing str after 
- * the allocation of the new string (possibly using str as a value
- * of the format string). str is then set to the new string.
- */
-#define extend_string(str, format, ...) \
- string _new_extended_string = create_string(format, __VA_ARGS__); \
- free(str); \
- str = _new_extended_string;
+#define cJSON_HasError(cJSON) record_error(cJSON)
 
 /*
  * create_string:
@@ -44,8 +37,186 @@
  */
 static string create_string(string format, ...);
 
+/*
+ * new_builder:
+ * Returns a new string builder (see the "string-builder" header) holding
+ * the string formatted using format and the other arguments.
+ * Terminates program if not enough memory was available.
+ */
+static StringBuilder new_builder(string format, ...);
+
+/*
+ * finish_builder:
+ * Returns the string held by builder, releasing builder
+ * (see string_builder_finish).
+ * Terminates program if not enough memory was available to build it.
+ */
+static string finish_builder(StringBuilder builder);
+
+/*
+ * append_filter:
+ * Appends the search filter named name to the search query held by builder,
+ * using value (percent-encoded) as the filter's value.
+ * Does nothing if value is a null pointer.
+ */
+static void append_filter(StringBuilder builder, string name, string value);
+
+/*
+ * *_url:
+ * Return the URL fetched by the matching query_get_ function when called
+ * with the same arguments, so that it can be prefetched.
+ */
+static string album_tracks_url(string id, size_t offset);
+static string artist_albums_url(string id, size_t offset);
+static string playlist_tracks_url(string id, size_t offset);
+static string albums_search_url(string album, string artist, string year,
+                                bool new, bool hipster, size_t offset);
+static string artists_search_url(string artist, string year, string genre,
+                                 size_t offset);
+static string playlists_search_url(string playlist, size_t offset);
+static string tracks_search_url(string track, string artist, string year,
+                                string album, string genre, size_t offset);
+
+/*
+ * prefetch_url:
+ * Prefetches url (see fetch_prefetch), then releases it.
+ */
+static void prefetch_url(string url);
+
+/*
+ * record_error:
+ * Records the status of the error returned by the API in cJSON_res as
+ * the calling thread's last error (see query_last_error), or records that
+ * no error occurred if cJSON_res isn't an error.
+ * Returns true if cJSON_res is an error, else returns false.
+ */
+static bool record_error(cJSON *cJSON_res);
+
+/*
+ * convert_page:
+ * Converts cJSON_page using cJSON_to_page, allocating the page and
+ * everything it contains in a single arena (see talloc_begin_arena), so that
+ * releasing the page releases all of its items at once.
+ * Terminates program if not enough memory was available.
+ */
+static Page convert_page(cJSON *cJSON_page,
+                         void *(*cJSON_to_item_type)(cJSON *item));
+
+/*
+ * convert_lazy_page:
+ * Equivalent to convert_page, but converts the tracks of the page lazily
+ * (see cJSON_begin_lazy), the page becoming the owner of cJSON_page.
+ */
+static Page convert_lazy_page(cJSON *cJSON_page,
+                              void *(*cJSON_to_item_type)(cJSON *item));
+
+/*
+ * convert_search:
+ * Converts cJSON_search using cJSON_to_search, allocating the search and
+ * everything it contains in a single arena, like convert_page.
+ * Its tracks are converted lazily, like convert_lazy_page, the search
+ * becoming the owner of cJSON_search.
+ */
+static Search convert_search(cJSON *cJSON_search);
+
+/*
+ * query_get_all_pages:
+ * Queries the API for the first page of the paginated resource at url,
+ * using limit as the page's size, then fetches every remaining page
+ * concurrently (see fetch_all_pages).
+ * Returns a page containing every item of the resource, converted using
+ * cJSON_to_item_type, or a null pointer if the API returned an error.
+ */
+static Page query_get_all_pages(string url, size_t limit,
+                                void *(*cJSON_to_item_type)(cJSON *item));
+
+/*
+ * query_get_several:
+ * Queries the API for the entities of type whose id is in ids, a null
+ * terminated array, converting them using cJSON_to_type.
+ * Entities found in the entity cache are taken from it. The others are
+ * fetched from the several-ids endpoint at path, by chunks of at most
+ * max_ids ids, the response listing them under key. Each fetched entity is
+ * then added to the entity cache.
+ * Returns a null terminated array of the entities found, in the order of
+ * ids, or a null pointer if the API returned an error, in which case
+ * the entities already converted are released using free_type.
+ */
+static void **query_get_several(enum entity_type type, string path,
+                                string key, size_t max_ids, string *ids,
+                                void *(*cJSON_to_type)(cJSON *item),
+                                void (*free_type)(void *type_struct_ptr));
+
+/*
+ * create_chunks:
+ * Splits the n first ids of ids into chunks of at most max_ids ids.
+ * Returns a null terminated array containing, for each chunk, url followed
+ * by the ids of the chunk, each one preceded by prefix, separated by commas.
+ * The array and its strings must be released by the caller.
+ */
+static string *create_chunks(string url, string prefix, string *ids,
+                             size_t n, size_t max_ids);
+
+/*
+ * write_in_chunks:
+ * Queries the API using method (and body, if it isn't null) at url followed
+ * by the ids of items, a null terminated array, by chunks of at most max_ids
+ * ids, the ids being read using get_id. The chunks are sent concurrently.
+ * Records the error of the first chunk that failed, if any.
+ */
+static void write_in_chunks(string url, string method, string body,
+                            void **items, string (*get_id)(void *item),
+                            size_t max_ids);
+
+/*
+ * update_snapshot_id:
+ * Replaces the string pointed to by snapshot_id with a copy of the snapshot
+ * id returned by the API in cJSON_res, if any, and records cJSON_res's error.
+ * Returns true if cJSON_res is an error, else returns false.
+ */
+static bool update_snapshot_id(string *snapshot_id, cJSON *cJSON_res);
+
+/*
+ * album_id, artist_id, track_id:
+ * Return the id of item, used as the get_id function of write_in_chunks.
+ */
+static string album_id(void *item);
+static string artist_id(void *item);
+static string track_id(void *item);
+
+/*
+ * pages_concurrency:
+ * Maximum number of pages fetched at the same time by the "query_get_all_"
+ * functions (see fetch_all_pages).
+ */
+static size_t pages_concurrency = PAGES_CONCURRENCY;
+
+/*
+ * last_error:
+ * Status of the error returned by the last API call made by the thread
+ * (0 if no response was received), or -1 if it succeeded.
+ */
+static _Thread_local long last_error = -1;
+
+void query_set_pages_concurrency(size_t max_pages) {
+  pages_concurrency = max_pages > 0 ? max_pages : 1;
+}
+
+long query_last_error(void) {
+  return last_error;
+}
+
+
+Album *query_get_several_albums(string *ids) {
+  return (Album *) query_get_several(ENTITY_ALBUM, "albums", "albums",
+                                     SEVERAL_ALBUMS_LIMIT, ids,
+                                     cJSON_to_album, free_album);
+}
 
 Album query_get_album(string id) {
+  Album album = entity_cache_get(ENTITY_ALBUM, id);
+  if (!IS_NULL(album)) return album;
+
   string url = create_string("%s/albums/%s", BASE_URL, id);
   cJSON *cJSON_album = fetch(url, GET, NULL);
   free(url);
@@ -54,15 +225,12 @@ Album query_get_album(string id) {
     return NULL;
   }
 
-  Album album = cJSON_to_album(cJSON_album);
-  cJSON_Delete(cJSON_album);
-
-  return album;
+  return entity_cache_put(ENTITY_ALBUM, id, cJSON_album, cJSON_to_album,
+                          free_album);
 }
 
 Page query_get_album_tracks(string id, size_t offset) {
-  string url = create_string("%s/albums/%s/tracks?limit=%u&offset=%u",
-                             BASE_URL, id, LIMIT, offset);
+  string url = album_tracks_url(id, offset);
   cJSON *cJSON_album_tracks = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_album_tracks)) {
@@ -70,25 +238,22 @@ Page query_get_album_tracks(string id, size_t offset) {
     return NULL;
   }
 
-  Page album_tracks = cJSON_to_page(cJSON_album_tracks,
-                                    cJSON_to_simplified_track);
+  Page album_tracks = convert_page(cJSON_album_tracks,
+                                   cJSON_to_simplified_track);
   cJSON_Delete(cJSON_album_tracks);
 
   return album_tracks;
 }
 
 Page query_get_user_saved_albums(size_t offset) {
-  string url = create_string("%s/me/albums?limit=%u&offset=%u" BASE_URL,
+  string url = create_string("%s/me/albums?limit=%u&offset=%zu", BASE_URL,
                              LIMIT, offset);
-  cJSON *cJSON_saved_albums = fetch(url, GET, NULL);
+  cJSON *cJSON_error;
+  Page saved_albums = fetch_struct(url, STREAM_SAVED_ALBUMS_PAGE,
+                                   &cJSON_error);
   free(url);
-  if (cJSON_HasError(cJSON_saved_albums)) {
-    cJSON_Delete(cJSON_saved_albums);
-    return NULL;
-  }
-
-  Page saved_albums = cJSON_to_page(cJSON_saved_albums, cJSON_to_saved_album);
-  cJSON_Delete(cJSON_saved_albums);
+  record_error(cJSON_error);
+  cJSON_Delete(cJSON_error);
 
   return saved_albums;
 }
@@ -96,29 +261,21 @@ Page query_get_user_saved_albums(size_t offset) {
 void query_put_user_saved_albums(Album *albums) {
   if (IS_NULL(*albums)) return;
   string url = create_string("%s/me/albums?ids=", BASE_URL);
-  for (int i = 0; !IS_NULL(albums[i]); i++) {
-    extend_string(url, "%s%s%s", url, albums[i]->id, 
-                  !IS_NULL(albums[i + 1]) ? "," : "");
-  }
-  cJSON *cJSON_res = fetch(url, PUT, "{}");
+  write_in_chunks(url, PUT, "{}", (void **) albums, album_id,
+                  SAVE_ALBUMS_LIMIT);
   free(url);
-  if (!IS_NULL(cJSON_res)) cJSON_Delete(cJSON_res);
 }
 
 void query_delete_user_saved_albums(Album *albums) {
   if (IS_NULL(*albums)) return;
-  string url = create_string("%s/me/albums?ids=" BASE_URL);
-  for (int i = 0; !IS_NULL(albums[i]); i++) {
-    extend_string(url, "%s%s%s", url, albums[i]->id,
-                  !IS_NULL(albums[i + 1]) ? "," : "");
-  }
-  cJSON *cJSON_res = fetch(url, DELETE, NULL);
+  string url = create_string("%s/me/albums?ids=", BASE_URL);
+  write_in_chunks(url, DELETE, NULL, (void **) albums, album_id,
+                  SAVE_ALBUMS_LIMIT);
   free(url);
-  cJSON_Delete(cJSON_res);
 }
 
 Page query_get_new_albums(size_t offset) {
-  string url = create_string("%s/browse/new-releases?limit=%u&offset=%u",
+  string url = create_string("%s/browse/new-releases?limit=%u&offset=%zu",
                              BASE_URL, LIMIT, offset);
   cJSON *cJSON_new_albums = fetch(url, GET, NULL);
   free(url);
@@ -127,13 +284,16 @@ Page query_get_new_albums(size_t offset) {
     return NULL;
   }
 
-  Page new_albums = cJSON_to_page(cJSON_new_albums, cJSON_to_simplified_album);
+  Page new_albums = convert_page(cJSON_new_albums, cJSON_to_simplified_album);
   cJSON_Delete(cJSON_new_albums);
 
   return new_albums;
 }
 
 Artist query_get_artist(string id) {
+  Artist artist = entity_cache_get(ENTITY_ARTIST, id);
+  if (!IS_NULL(artist)) return artist;
+
   string url = create_string("%s/artists/%s", BASE_URL, id);
   cJSON *cJSON_artist = fetch(url, GET, NULL);
   free(url);
@@ -142,15 +302,18 @@ Artist query_get_artist(string id) {
     return NULL;
   }
 
-  Artist artist = cJSON_to_artist(cJSON_artist);
-  cJSON_Delete(cJSON_artist);
-  
-  return artist;
+  return entity_cache_put(ENTITY_ARTIST, id, cJSON_artist, cJSON_to_artist,
+                          free_artist);
+}
+
+Artist *query_get_several_artists(string *ids) {
+  return (Artist *) query_get_several(ENTITY_ARTIST, "artists", "artists",
+                                      SEVERAL_ARTISTS_LIMIT, ids,
+                                      cJSON_to_artist, free_artist);
 }
 
 Page query_get_artist_albums(string id, size_t offset) {
-  string url = create_string("%s/artists/%s/albums?limit=%u&offset=%u", 
-                             BASE_URL, id, LIMIT, offset);
+  string url = artist_albums_url(id, offset);
   cJSON *cJSON_artist_albums = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_artist_albums)) {
@@ -158,8 +321,8 @@ Page query_get_artist_albums(string id, size_t offset) {
     return NULL;
   }
 
-  Page artist_albums = cJSON_to_page(cJSON_artist_albums,
-                                     cJSON_to_simplified_album);
+  Page artist_albums = convert_page(cJSON_artist_albums,
+                                    cJSON_to_simplified_album);
   cJSON_Delete(cJSON_artist_albums);
 
   return artist_albums;
@@ -184,6 +347,9 @@ Track *query_get_artist_top_tracks(string id) {
 }
 
 Playlist query_get_playlist(string id) {
+  Playlist playlist = entity_cache_get(ENTITY_PLAYLIST, id);
+  if (!IS_NULL(playlist)) return playlist;
+
   string url = create_string("%s/playlists/%s", BASE_URL, id);
   cJSON *cJSON_playlist = fetch(url, GET, NULL);
   free(url);
@@ -192,29 +358,29 @@ Playlist query_get_playlist(string id) {
     return NULL;
   }
 
-  Playlist playlist = cJSON_to_playlist(cJSON_playlist);
-  cJSON_Delete(cJSON_playlist);
-  
-  return playlist;
+  return entity_cache_put(ENTITY_PLAYLIST, id, cJSON_playlist,
+                          cJSON_to_playlist, free_playlist);
 }
 
 void query_put_playlist_details(Playlist playlist) {
   string url = create_string("%s/playlists/%s", BASE_URL, playlist->id);
-  string body = create_string(
-"{\
-  \"name\": \"%s\",\
-  \"description\": \"%s\"\
- }", playlist->name, playlist->description);
+  StringBuilder builder = new_builder("{\"name\": ");
+  string_builder_append_json(builder, playlist->name);
+  string_builder_append(builder, ", \"description\": ");
+  string_builder_append_json(builder, playlist->description);
+  string_builder_append(builder, "}");
+  string body = finish_builder(builder);
   cJSON *cJSON_res = fetch(url, PUT, body);
+  entity_cache_remove(ENTITY_PLAYLIST, playlist->id);
 
   free(url);
   free(body);
+  record_error(cJSON_res);
   cJSON_Delete(cJSON_res);
 }
 
 Page query_get_playlist_tracks(string id, size_t offset) {
-  string url = create_string("%s/playlists/%s/tracks?limit=%u&offset=%u",
-                             BASE_URL, id, LIMIT, offset);
+  string url = playlist_tracks_url(id, offset);
   cJSON *cJSON_playlist_tracks = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_playlist_tracks)) {
@@ -222,71 +388,74 @@ Page query_get_playlist_tracks(string id, size_t offset) {
     return NULL;
   }
 
-  Page playlist_tracks = cJSON_to_page(cJSON_playlist_tracks,
-                                       cJSON_to_playlist_track);
-  cJSON_Delete(cJSON_playlist_tracks);
+  Page playlist_tracks = convert_lazy_page(cJSON_playlist_tracks,
+                                           cJSON_to_playlist_track);
 
   return playlist_tracks;
 }
 
-void query_post_playlist_tracks(Playlist playlist, Track *tracks) {
-  if(IS_NULL(*tracks)) return;
-  string url = create_string("%s/playlists/%s/tracks?uris=", BASE_URL, 
+string query_post_playlist_tracks(Playlist playlist, Track *tracks) {
+  if(IS_NULL(*tracks)) return NULL;
+  size_t tracks_count = 0;
+  while (!IS_NULL(tracks[tracks_count])) tracks_count++;
+  string *ids = malloc(tracks_count * sizeof(string));
+  END_IF(IS_NULL(ids));
+  for (size_t i = 0; i < tracks_count; i++) ids[i] = tracks[i]->id;
+  string url = create_string("%s/playlists/%s/tracks?uris=", BASE_URL,
                              playlist->id);
-  for (int i = 0; !IS_NULL(tracks[i]); i++) {
-    string uri = create_uri("track", tracks[i]->id);
-    extend_string(url, "%s%s%s", url, uri, !IS_NULL(tracks[i + 1]) ? "," : "");
-    free(uri);
-  }
-  cJSON *cJSON_res = fetch(url, POST, "{}");
+  string *urls = create_chunks(url, "spotify:track:", ids, tracks_count,
+                               PLAYLIST_EDIT_LIMIT);
   free(url);
-
-  cJSON *cJSON_snapshot_id = 
-    cJSON_GetObjectItemCaseSensitive(cJSON_res, "snapshot_id");
-  if (cJSON_IsString(cJSON_snapshot_id)) {
-    free(playlist->snapshot_id);
-    playlist->snapshot_id = 
-      create_string("%s", cJSON_snapshot_id->valuestring);
+  free(ids);
+
+  string snapshot_id = NULL;
+  bool failed = false;
+  for (size_t c = 0; !IS_NULL(urls[c]); c++) {
+    if (!failed) {
+      cJSON *cJSON_res = fetch(urls[c], POST, "{}");
+      failed = update_snapshot_id(&snapshot_id, cJSON_res);
+      cJSON_Delete(cJSON_res);
+    }
+    free(urls[c]);
   }
-  cJSON_Delete(cJSON_res);
+  free(urls);
+  entity_cache_remove(ENTITY_PLAYLIST, playlist->id);
+  playlist_store_remove(playlist->id);
+  return snapshot_id;
 }
 
-void query_delete_playlist_tracks(Playlist playlist, Track *tracks) {
-  if(IS_NULL(*tracks)) return;
+string query_delete_playlist_tracks(Playlist playlist, Track *tracks) {
+  if(IS_NULL(*tracks)) return NULL;
   string url = create_string("%s/playlists/%s/tracks", BASE_URL, playlist->id);
-  string body = create_string("");
-  for (int i = 0; !IS_NULL(tracks[i]); i++) {
-    string uri = create_uri("track", tracks[i]->id);
-    extend_string(body, "%s\
- {\
-  \"uri\": \"%s\"\
- }%s", body, uri, !IS_NULL(tracks[i + 1]) ? "," : "");
-    free(uri);
+  string snapshot_id = create_string("%s", playlist->snapshot_id);
+  bool failed = false;
+  for (size_t start = 0; !failed && !IS_NULL(tracks[start]);
+       start += PLAYLIST_EDIT_LIMIT) {
+    StringBuilder builder = new_builder("{\"tracks\": [");
+    for (size_t i = start; !IS_NULL(tracks[i]) &&
+                           i < start + PLAYLIST_EDIT_LIMIT; i++) {
+      string_builder_appendf(builder, "%s{\"uri\": \"spotify:track:%s\"}",
+                             i > start ? ", " : "", tracks[i]->id);
+    }
+    string_builder_append(builder, "], \"snapshot_id\": ");
+    string_builder_append_json(builder, snapshot_id);
+    string_builder_append(builder, "}");
+    string body = finish_builder(builder);
+
+    cJSON *cJSON_res = fetch(url, DELETE, body);
+    failed = update_snapshot_id(&snapshot_id, cJSON_res);
+    cJSON_Delete(cJSON_res);
+    free(body);
   }
-
-  extend_string(body,
-"{\
-  \"tracks\": [\
-    %s\
-  ],\
-  \"snapshot_id\": \"%s\"\
- }", body, playlist->snapshot_id);
-  cJSON *cJSON_res = fetch(url, DELETE, body);
   free(url);
-  free(body);
-
-  cJSON *cJSON_snapshot_id = 
-    cJSON_GetObjectItemCaseSensitive(cJSON_res, "snapshot_id");
-  if (cJSON_IsString(cJSON_snapshot_id)) {
-    free(playlist->snapshot_id);
-    playlist->snapshot_id = 
-      create_string("%s", cJSON_snapshot_id->valuestring);
-  }
-  cJSON_Delete(cJSON_res);
+  entity_cache_remove(ENTITY_PLAYLIST, playlist->id);
+  playlist_store_remove(playlist->id);
+  return snapshot_id;
 }
   
 Page query_get_user_playlists(size_t offset) {
-  string url = create_string("%s/me/playlists", BASE_URL);
+  string url = create_string("%s/me/playlists?limit=%u&offset=%zu", BASE_URL,
+                             LIMIT, offset);
   cJSON *cJSON_user_playlists = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_user_playlists)) {
@@ -294,20 +463,50 @@ Page query_get_user_playlists(size_t offset) {
     return NULL;
   }
 
-  Page user_playlists = cJSON_to_page(cJSON_user_playlists, 
-                                      cJSON_to_simplified_playlist);
+  Page user_playlists = convert_page(cJSON_user_playlists, 
+                                     cJSON_to_simplified_playlist);
   cJSON_Delete(cJSON_user_playlists);
 
   return user_playlists;
 }
 
+Page query_get_all_playlist_tracks(string id, string snapshot_id) {
+  cJSON *cJSON_playlist_tracks = playlist_store_get(id, snapshot_id);
+  if (IS_NULL(cJSON_playlist_tracks)) {
+    string url = create_string("%s/playlists/%s/tracks", BASE_URL, id);
+    cJSON_playlist_tracks = fetch_all_pages(url, PLAYLIST_TRACKS_LIMIT,
+                                            pages_concurrency);
+    free(url);
+    if (cJSON_HasError(cJSON_playlist_tracks)) {
+      cJSON_Delete(cJSON_playlist_tracks);
+      return NULL;
+    }
+    playlist_store_put(id, snapshot_id, cJSON_playlist_tracks);
+  }
+
+  Page playlist_tracks = convert_lazy_page(cJSON_playlist_tracks,
+                                           cJSON_to_playlist_track);
+
+  return playlist_tracks;
+}
+
+Page query_get_all_user_playlists(void) {
+  string url = create_string("%s/me/playlists", BASE_URL);
+  Page user_playlists = query_get_all_pages(url, USER_PLAYLISTS_LIMIT,
+                                            cJSON_to_simplified_playlist);
+  free(url);
+
+  return user_playlists;
+}
+
 Playlist query_post_playlist(User user, Playlist playlist) {
   string url = create_string("%s/users/%s/playlists", BASE_URL, user->id);
-  string body = create_string(
-"{\
-  \"name\": \"%s\",\
-  \"description\": \"%s\"\
- }", playlist->name, playlist->description);
+  StringBuilder builder = new_builder("{\"name\": ");
+  string_builder_append_json(builder, playlist->name);
+  string_builder_append(builder, ", \"description\": ");
+  string_builder_append_json(builder, playlist->description);
+  string_builder_append(builder, "}");
+  string body = finish_builder(builder);
   cJSON *cJSON_playlist = fetch(url, POST, body);
   free(url);
   free(body);
@@ -325,33 +524,21 @@ Playlist query_post_playlist(User user, Playlist playlist) {
 Search query_get_all(string search_query, string album, string artist, 
                      string playlist, string track, string year, string genre,
                      bool new, bool hipster, size_t offset) {
-  string url = create_string("%s/search?q=%s", BASE_URL, search_query);
-  if (!IS_NULL(album)) {
-    extend_string(url, "%s%%20album:%s", url, album);
-  }
-  if (!IS_NULL(artist)) {
-    extend_string(url, "%s%%20artist:%s", url, artist);
-  }
-  if (!IS_NULL(playlist)) {
-    extend_string(url, "%s%%20playlist:%s", url, playlist);
-  }
-  if (!IS_NULL(track)) {
-    extend_string(url, "%s%%20track:%s", url, track);
-  }
-  if (!IS_NULL(year)) {
-    extend_string(url, "%s%%20year:%s", url, year);
-  }
-  if (!IS_NULL(genre)) {
-    extend_string(url, "%s%%20genre:%s", url, genre);
-  }
-  if (new) {
-    extend_string(url, "%s%%20tag:new", url);
-  }
-  if (hipster) {
-    extend_string(url, "%s%%20tag:hipster", url);
-  }
-  extend_string(url, "%s&limit=%u&offset=%u&type=album,artist,playlist,track",
-                LIMIT, offset);
+  StringBuilder builder = new_builder("%s/search?q=", BASE_URL);
+  string_builder_append_url(builder, search_query);
+  append_filter(builder, "album", album);
+  append_filter(builder, "artist", artist);
+  append_filter(builder, "playlist", playlist);
+  append_filter(builder, "track", track);
+  append_filter(builder, "year", year);
+  append_filter(builder, "genre", genre);
+  if (new) string_builder_append(builder, "%20tag:new");
+  if (hipster) string_builder_append(builder, "%20tag:hipster");
+  string_builder_appendf(builder,
+                         "&limit=%u&offset=%zu"
+                         "&type=album,artist,playlist,track",
+                         LIMIT, offset);
+  string url = finish_builder(builder);
   cJSON *cJSON_search = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_search)) {
@@ -359,28 +546,14 @@ Search query_get_all(string search_query, string album, string artist,
     return NULL;
   }
 
-  Search search = cJSON_to_search(cJSON_search);
-  cJSON_Delete(cJSON_search);
+  Search search = convert_search(cJSON_search);
 
   return search;
 }
 
 Search query_get_albums(string album, string artist, string year,
                         bool new, bool hipster, size_t offset) {
-  string url = create_string("%s/search?q=%s", BASE_URL, album);
-  if (!IS_NULL(artist)) {
-    extend_string(url, "%s%%20artist:%s", url, artist);
-  }
-  if (!IS_NULL(year)) {
-    extend_string(url, "%s%%20year:%s", url, year);
-  }
-  if (new) {
-    extend_string(url, "%s%%20tag:new", url);
-  }
-  if (hipster) {
-    extend_string(url, "%s%%20tag:hipster", url);
-  }
-  extend_string(url, "%s&limit=%u&offset=%u&type=album", url, LIMIT, offset);
+  string url = albums_search_url(album, artist, year, new, hipster, offset);
   cJSON *cJSON_search = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_search)) {
@@ -388,23 +561,14 @@ Search query_get_albums(string album, string artist, string year,
     return NULL;
   }
 
-  Search search = cJSON_to_search(cJSON_search);
-  cJSON_Delete(cJSON_search);
+  Search search = convert_search(cJSON_search);
 
   return search;
 }
 
 Search query_get_artists(string artist, string year, string genre, 
                          size_t offset) {
-  string url = create_string("%s/search?q=%s", BASE_URL, artist);
-  if (!IS_NULL(year)) {
-    extend_string(url, "%s%%20year:%s", url, year);
-  }
-  if (!IS_NULL(genre)) {
-    extend_string(url, "%s%%20genre:%s", url, genre);
-  }
-  extend_string(url, "%s&limit=%u&offset=%u&type=artist", url, LIMIT,
-                offset);
+  string url = artists_search_url(artist, year, genre, offset);
   cJSON *cJSON_search = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_search)) {
@@ -412,16 +576,13 @@ Search query_get_artists(string artist, string year, string genre,
     return NULL;
   }
 
-  Search search = cJSON_to_search(cJSON_search);
-  cJSON_Delete(cJSON_search);
+  Search search = convert_search(cJSON_search);
 
   return search;
 }
 
 Search query_get_playlists(string playlist, size_t offset) {
-  string url =
-    create_string("%s/search?q=%s&limit=%u&offset=%u&type=playlist", 
-               BASE_URL, playlist, LIMIT, offset);
+  string url = playlists_search_url(playlist, offset);
   cJSON *cJSON_search = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_search)) {
@@ -429,28 +590,14 @@ Search query_get_playlists(string playlist, size_t offset) {
     return NULL;
   }
 
-  Search search = cJSON_to_search(cJSON_search);
-  cJSON_Delete(cJSON_search);
+  Search search = convert_search(cJSON_search);
 
   return search;
 }
 
 Search query_get_tracks(string track, string artist, string year,
                         string album, string genre, size_t offset) {
-  string url = create_string("%s/search?q=%s", BASE_URL, track);
-  if (!IS_NULL(artist)) {
-    extend_string(url, "%s%%20artist:%s", url, artist);
-  }
-  if (!IS_NULL(year)) {
-    extend_string(url, "%s%%20year:%s", url, year);
-  }
-  if (!IS_NULL(album)) {
-    extend_string(url, "%s%%20album:%s", url, album);
-  }
-  if (!IS_NULL(genre)) {
-    extend_string(url, "%s%%20genre:%s", url, genre);
-  }
-  extend_string(url, "%s&limit=%u&offset=%u&type=track", url, LIMIT, offset);
+  string url = tracks_search_url(track, artist, year, album, genre, offset);
   cJSON *cJSON_search = fetch(url, GET, NULL);
   free(url);
   if (cJSON_HasError(cJSON_search)) {
@@ -458,13 +605,21 @@ Search query_get_tracks(string track, string artist, string year,
     return NULL;
   }
 
-  Search search = cJSON_to_search(cJSON_search);
-  cJSON_Delete(cJSON_search);
+  Search search = convert_search(cJSON_search);
 
   return search;
 }
 
+Track *query_get_several_tracks(string *ids) {
+  return (Track *) query_get_several(ENTITY_TRACK, "tracks", "tracks",
+                                     SEVERAL_TRACKS_LIMIT, ids,
+                                     cJSON_to_track, free_track);
+}
+
 Track query_get_track(string id) {
+  Track track = entity_cache_get(ENTITY_TRACK, id);
+  if (!IS_NULL(track)) return track;
+
   string url = create_string("%s/tracks/%s", BASE_URL, id);
   cJSON *cJSON_track = fetch(url, GET, NULL);
   free(url);
@@ -473,25 +628,20 @@ Track query_get_track(string id) {
     return NULL;
   }
 
-  Track track = cJSON_to_track(cJSON_track);
-  cJSON_Delete(cJSON_track);
-  
-  return track;
+  return entity_cache_put(ENTITY_TRACK, id, cJSON_track, cJSON_to_track,
+                          free_track);
 }
 
 Page query_get_user_saved_tracks(size_t offset) {
-  string url = create_string("%s/me/tracks?limit=%u&offset=%u", BASE_URL,
+  string url = create_string("%s/me/tracks?limit=%u&offset=%zu", BASE_URL,
                              LIMIT, offset);
-  cJSON *cJSON_saved_tracks = fetch(url, GET, NULL);
+  cJSON *cJSON_error;
+  Page saved_tracks = fetch_struct(url, STREAM_SAVED_TRACKS_PAGE,
+                                   &cJSON_error);
   free(url);
-  if (cJSON_HasError(cJSON_saved_tracks)) {
-    cJSON_Delete(cJSON_saved_tracks);
-    return NULL;
-  }
+  record_error(cJSON_error);
+  cJSON_Delete(cJSON_error);
 
-  Page saved_tracks = cJSON_to_page(cJSON_saved_tracks, cJSON_to_saved_track);
-  cJSON_Delete(cJSON_saved_tracks);
-  
   return saved_tracks;
 }
 
@@ -499,70 +649,48 @@ Page query_get_user_saved_tracks(size_t offset) {
 void query_put_user_saved_tracks(Track *tracks) {
   if (IS_NULL(*tracks)) return;
   string url = create_string("%s/me/tracks?ids=", BASE_URL);
-  for (int i = 0; !IS_NULL(tracks[i]); i++) {
-    extend_string(url, "%s%s%s", url, tracks[i]->id,
-                  !IS_NULL(tracks[i + 1]) ? "," : "");
-  }
-  cJSON *cJSON_res = fetch(url, PUT, "{}");
-
+  write_in_chunks(url, PUT, "{}", (void **) tracks, track_id,
+                  SAVE_TRACKS_LIMIT);
   free(url);
-  cJSON_Delete(cJSON_res);
 }
 
 void query_delete_user_saved_tracks(Track *tracks) {
   if (IS_NULL(*tracks)) return;
   string url = create_string("%s/me/tracks?ids=", BASE_URL);
-  for (int i = 0; !IS_NULL(tracks[i]); i++) {
-    extend_string(url, "%s%s%s", url, tracks[i]->id,
-                  !IS_NULL(tracks[i + 1]) ? "," : "");
-  }
-  cJSON *cJSON_res = fetch(url, DELETE, NULL);
-
+  write_in_chunks(url, DELETE, NULL, (void **) tracks, track_id,
+                  SAVE_TRACKS_LIMIT);
   free(url);
-  cJSON_Delete(cJSON_res);
 }
 
 User query_get_user(void) {
   string url = create_string("%s/me", BASE_URL);
-  cJSON *cJSON_user = fetch(url, GET, NULL);
+  cJSON *cJSON_error;
+  User user = fetch_struct(url, STREAM_USER, &cJSON_error);
   free(url);
-  if (cJSON_HasError(cJSON_user)) {
-    cJSON_Delete(cJSON_user);
-    return NULL;
-  }
-
-  User user = cJSON_to_user(cJSON_user);
-  cJSON_Delete(cJSON_user);
+  record_error(cJSON_error);
+  cJSON_Delete(cJSON_error);
 
   return user;
 }
 
 Page query_get_user_top_artists(size_t offset) {
   string url = create_string("%s/me/top/artists", BASE_URL);
-  cJSON *cJSON_top_artists = fetch(url, GET, NULL);
+  cJSON *cJSON_error;
+  Page top_artists = fetch_struct(url, STREAM_ARTISTS_PAGE, &cJSON_error);
   free(url);
-  if (cJSON_HasError(cJSON_top_artists)) {
-    cJSON_Delete(cJSON_top_artists);
-    return NULL;
-  }
+  record_error(cJSON_error);
+  cJSON_Delete(cJSON_error);
 
-  Page top_artists = cJSON_to_page(cJSON_top_artists, cJSON_to_artist);
-  cJSON_Delete(cJSON_top_artists);
-  
   return top_artists;
 }
 
 Page query_get_user_top_tracks(size_t offset) {
   string url = create_string("%s/me/top/tracks", BASE_URL);
-  cJSON *cJSON_top_tracks = fetch(url, GET, NULL);
+  cJSON *cJSON_error;
+  Page top_tracks = fetch_struct(url, STREAM_TRACKS_PAGE, &cJSON_error);
   free(url);
-  if (cJSON_HasError(cJSON_top_tracks)) {
-    cJSON_Delete(cJSON_top_tracks);
-    return NULL;
-  }
-
-  Page top_tracks = cJSON_to_page(cJSON_top_tracks, cJSON_to_track);
-  cJSON_Delete(cJSON_top_tracks);
+  record_error(cJSON_error);
+  cJSON_Delete(cJSON_error);
 
   return top_tracks;
 }
@@ -573,6 +701,7 @@ void query_put_follow_playlist(Playlist playlist) {
   cJSON *cJSON_res = fetch(url, PUT, "{}");
 
   free(url);
+  record_error(cJSON_res);
   cJSON_Delete(cJSON_res);
 }
 
@@ -582,27 +711,25 @@ void query_delete_unfollow_playlist(Playlist playlist) {
   cJSON *cJSON_res = fetch(url, DELETE, NULL);
 
   free(url);
+  record_error(cJSON_res);
   cJSON_Delete(cJSON_res);
 }
 
 Page query_get_followed_artists(string after) {
-  string url = create_string("%s/me/following?type=artist", BASE_URL);
+  StringBuilder builder = new_builder("%s/me/following?type=artist",
+                                     BASE_URL);
   if (!IS_NULL(after)) {
-    extend_string(url, "%s&after=%s", url, after);
+    string_builder_append(builder, "&after=");
+    string_builder_append_url(builder, after);
   }
-  extend_string(url, "%s&limit=%u", url, LIMIT);
-  cJSON *cJSON_followed_artists = fetch(url, GET, NULL);
-  cJSON *cJSON_followed_artists_page =
-    cJSON_GetObjectItemCaseSensitive(cJSON_followed_artists, "artists");
+  string_builder_appendf(builder, "&limit=%u", LIMIT);
+  string url = finish_builder(builder);
+  cJSON *cJSON_error;
+  Page followed_artists = fetch_struct(url, STREAM_FOLLOWED_ARTISTS_PAGE,
+                                       &cJSON_error);
   free(url);
-  if (cJSON_HasError(cJSON_followed_artists)) {
-    cJSON_Delete(cJSON_followed_artists);
-    return NULL;
-  }
-
-  Page followed_artists = cJSON_to_page(cJSON_followed_artists_page,
-                                        cJSON_to_artist);
-  cJSON_Delete(cJSON_followed_artists);
+  record_error(cJSON_error);
+  cJSON_Delete(cJSON_error);
 
   return followed_artists;
 }
@@ -611,45 +738,351 @@ void query_put_follow_artists(Artist *artists) {
   if (IS_NULL(*artists)) return;
   string url = create_string("%s/me/following?type=artist&ids=", BASE_URL);
   for (int i = 0; !IS_NULL(artists[i]); i++) {
-    extend_string(url, "%s%s%s", url, artists[i]->id,
-                  !IS_NULL(artists[i + 1]) ? "," : "");
+    entity_cache_remove(ENTITY_ARTIST, artists[i]->id);
   }
-  cJSON *cJSON_res = fetch(url, PUT, "{}");
-
+  write_in_chunks(url, PUT, "{}", (void **) artists, artist_id,
+                  FOLLOW_ARTISTS_LIMIT);
   free(url);
-  cJSON_Delete(cJSON_res);
 }
 
 void query_delete_unfollow_artists(Artist *artists) {
   if (IS_NULL(*artists)) return;
   string url = create_string("%s/me/following?type=artist&ids=", BASE_URL);
   for (int i = 0; !IS_NULL(artists[i]); i++) {
-    extend_string(url, "%s%s%s", url, artists[i]->id,
-                  !IS_NULL(artists[i + 1]) ? "," : "");
+    entity_cache_remove(ENTITY_ARTIST, artists[i]->id);
   }
-  cJSON *cJSON_res = fetch(url, DELETE, NULL);
-
+  write_in_chunks(url, DELETE, NULL, (void **) artists, artist_id,
+                  FOLLOW_ARTISTS_LIMIT);
   free(url);
-  cJSON_Delete(cJSON_res);
+}
+
+void query_prefetch_album(string id) {
+  if (entity_cache_contains(ENTITY_ALBUM, id)) return;
+  prefetch_url(create_string("%s/albums/%s", BASE_URL, id));
+}
+
+void query_prefetch_album_tracks(string id, size_t offset) {
+  prefetch_url(album_tracks_url(id, offset));
+}
+
+void query_prefetch_artist_albums(string id, size_t offset) {
+  prefetch_url(artist_albums_url(id, offset));
+}
+
+void query_prefetch_playlist_tracks(string id, size_t offset) {
+  prefetch_url(playlist_tracks_url(id, offset));
+}
+
+void query_prefetch_playlist(string id) {
+  if (entity_cache_contains(ENTITY_PLAYLIST, id)) return;
+  prefetch_url(create_string("%s/playlists/%s", BASE_URL, id));
+}
+
+void query_prefetch_albums(string album, string artist, string year,
+                           bool new, bool hipster, size_t offset) {
+  prefetch_url(albums_search_url(album, artist, year, new, hipster, offset));
+}
+
+void query_prefetch_artists(string artist, string year, string genre,
+                            size_t offset) {
+  prefetch_url(artists_search_url(artist, year, genre, offset));
+}
+
+void query_prefetch_playlists(string playlist, size_t offset) {
+  prefetch_url(playlists_search_url(playlist, offset));
+}
+
+void query_prefetch_tracks(string track, string artist, string year,
+                           string album, string genre, size_t offset) {
+  prefetch_url(tracks_search_url(track, artist, year, album, genre, offset));
+}
+
+void query_prefetch_track(string id) {
+  if (entity_cache_contains(ENTITY_TRACK, id)) return;
+  prefetch_url(create_string("%s/tracks/%s", BASE_URL, id));
+}
+
+void query_cancel_prefetches(void) {
+  fetch_cancel_prefetches();
 }
 
 static string create_string(string format, ...) {
-  size_t str_size = 1;
-  string str = malloc(str_size);
-  END_IF(IS_NULL(str));
+  StringBuilder builder = new_string_builder();
+  END_IF(IS_NULL(builder));
   va_list ap;
   va_start(ap, format);
-  size_t str_len = vsnprintf(str, str_size, format, ap);
+  string_builder_vappendf(builder, format, ap);
   va_end(ap);
 
-  while (str_len > str_size - 1) {
-    str_size = str_len + 1;
-    str = realloc(str, str_size);
-    END_IF(IS_NULL(str));
-    va_start(ap, format);
-    str_len = vsnprintf(str, str_size, format, ap);
-    va_end(ap);
-  }
+  return finish_builder(builder);
+}
+
+static StringBuilder new_builder(string format, ...) {
+  StringBuilder builder = new_string_builder();
+  END_IF(IS_NULL(builder));
+  va_list ap;
+  va_start(ap, format);
+  string_builder_vappendf(builder, format, ap);
+  va_end(ap);
 
+  return builder;
+}
+
+static string finish_builder(StringBuilder builder) {
+  string str = string_builder_finish(builder);
+  END_IF(IS_NULL(str));
   return str;
 }
+
+static void append_filter(StringBuilder builder, string name, string value) {
+  if (IS_NULL(value)) return;
+  string_builder_appendf(builder, "%%20%s:", name);
+  string_builder_append_url(builder, value);
+}
+
+static string album_tracks_url(string id, size_t offset) {
+  return create_string("%s/albums/%s/tracks?limit=%u&offset=%zu", BASE_URL,
+                       id, LIMIT, offset);
+}
+
+static string playlist_tracks_url(string id, size_t offset) {
+  return create_string("%s/playlists/%s/tracks?limit=%u&offset=%zu",
+                       BASE_URL, id, LIMIT, offset);
+}
+
+static string artist_albums_url(string id, size_t offset) {
+  return create_string("%s/artists/%s/albums?limit=%u&offset=%zu", BASE_URL,
+                       id, LIMIT, offset);
+}
+
+static string albums_search_url(string album, string artist, string year,
+                                bool new, bool hipster, size_t offset) {
+  StringBuilder builder = new_builder("%s/search?q=", BASE_URL);
+  string_builder_append_url(builder, album);
+  append_filter(builder, "artist", artist);
+  append_filter(builder, "year", year);
+  if (new) string_builder_append(builder, "%20tag:new");
+  if (hipster) string_builder_append(builder, "%20tag:hipster");
+  string_builder_appendf(builder, "&limit=%u&offset=%zu&type=album", LIMIT,
+                         offset);
+  return finish_builder(builder);
+}
+
+static string artists_search_url(string artist, string year, string genre,
+                                 size_t offset) {
+  StringBuilder builder = new_builder("%s/search?q=", BASE_URL);
+  string_builder_append_url(builder, artist);
+  append_filter(builder, "year", year);
+  append_filter(builder, "genre", genre);
+  string_builder_appendf(builder, "&limit=%u&offset=%zu&type=artist", LIMIT,
+                         offset);
+  return finish_builder(builder);
+}
+
+static string playlists_search_url(string playlist, size_t offset) {
+  StringBuilder builder = new_builder("%s/search?q=", BASE_URL);
+  string_builder_append_url(builder, playlist);
+  string_builder_appendf(builder, "&limit=%u&offset=%zu&type=playlist", LIMIT,
+                         offset);
+  return finish_builder(builder);
+}
+
+static string tracks_search_url(string track, string artist, string year,
+                                string album, string genre, size_t offset) {
+  StringBuilder builder = new_builder("%s/search?q=", BASE_URL);
+  string_builder_append_url(builder, track);
+  append_filter(builder, "artist", artist);
+  append_filter(builder, "year", year);
+  append_filter(builder, "album", album);
+  append_filter(builder, "genre", genre);
+  string_builder_appendf(builder, "&limit=%u&offset=%zu&type=track", LIMIT,
+                         offset);
+  return finish_builder(builder);
+}
+
+static void prefetch_url(string url) {
+  fetch_prefetch(url);
+  free(url);
+}
+
+static Page convert_page(cJSON *cJSON_page,
+                         void *(*cJSON_to_item_type)(cJSON *item)) {
+  END_IF(!talloc_begin_arena());
+  return talloc_end_arena(cJSON_to_page(cJSON_page, cJSON_to_item_type));
+}
+
+static Page convert_lazy_page(cJSON *cJSON_page,
+                              void *(*cJSON_to_item_type)(cJSON *item)) {
+  END_IF(!talloc_begin_arena());
+  bool lazy = cJSON_begin_lazy(cJSON_page);
+  Page page = cJSON_to_page(cJSON_page, cJSON_to_item_type);
+  if (lazy) {
+    cJSON_end_lazy();
+  } else cJSON_Delete(cJSON_page);
+  return talloc_end_arena(page);
+}
+
+static Search convert_search(cJSON *cJSON_search) {
+  END_IF(!talloc_begin_arena());
+  bool lazy = cJSON_begin_lazy(cJSON_search);
+  Search search = cJSON_to_search(cJSON_search);
+  if (lazy) {
+    cJSON_end_lazy();
+  } else cJSON_Delete(cJSON_search);
+  return talloc_end_arena(search);
+}
+
+static Page query_get_all_pages(string url, size_t limit,
+                                void *(*cJSON_to_item_type)(cJSON *item)) {
+  cJSON *cJSON_page = fetch_all_pages(url, limit, pages_concurrency);
+  if (cJSON_HasError(cJSON_page)) {
+    cJSON_Delete(cJSON_page);
+    return NULL;
+  }
+
+  Page page = convert_page(cJSON_page, cJSON_to_item_type);
+  cJSON_Delete(cJSON_page);
+
+  return page;
+}
+
+static bool record_error(cJSON *cJSON_res) {
+  cJSON *cJSON_error = cJSON_GetObjectItemCaseSensitive(cJSON_res, "error");
+  if (!cJSON_IsObject(cJSON_error)) {
+    last_error = -1;
+    return false;
+  }
+  cJSON *cJSON_status =
+    cJSON_GetObjectItemCaseSensitive(cJSON_error, "status");
+  last_error = cJSON_IsNumber(cJSON_status) ? cJSON_status->valueint : 0;
+  return true;
+}
+
+static void **query_get_several(enum entity_type type, string path,
+                                string key, size_t max_ids, string *ids,
+                                void *(*cJSON_to_type)(cJSON *item),
+                                void (*free_type)(void *type_struct_ptr)) {
+  size_t ids_count = 0;
+  while (!IS_NULL(ids[ids_count])) ids_count++;
+
+  void **items = malloc((ids_count + 1) * sizeof(void *));
+  size_t *missing = malloc((ids_count + 1) * sizeof(size_t));
+  END_IF(IS_NULL(items) || IS_NULL(missing));
+  size_t missing_count = 0;
+  for (size_t i = 0; i < ids_count; i++) {
+    items[i] = entity_cache_get(type, ids[i]);
+    if (IS_NULL(items[i])) missing[missing_count++] = i;
+  }
+
+  size_t chunks_count = (missing_count + max_ids - 1) / max_ids;
+  string *missing_ids = malloc((missing_count + 1) * sizeof(string));
+  END_IF(IS_NULL(missing_ids));
+  for (size_t i = 0; i < missing_count; i++) missing_ids[i] = ids[missing[i]];
+  string url = create_string("%s/%s?ids=", BASE_URL, path);
+  string *urls = create_chunks(url, "", missing_ids, missing_count, max_ids);
+  free(url);
+  free(missing_ids);
+
+  bool failed = false;
+  for (size_t c = 0; c < chunks_count; c++) {
+    cJSON *cJSON_res = failed ? NULL : fetch(urls[c], GET, NULL);
+    cJSON *cJSON_items = cJSON_GetObjectItemCaseSensitive(cJSON_res, key);
+    if (failed || cJSON_HasError(cJSON_res) || !cJSON_IsArray(cJSON_items)) {
+      failed = true;
+    }
+    for (size_t i = c * max_ids;
+         !failed && i < missing_count && i < (c + 1) * max_ids; i++) {
+      cJSON *cJSON_item = cJSON_DetachItemFromArray(cJSON_items, 0);
+      if (cJSON_IsObject(cJSON_item)) {
+        items[missing[i]] = entity_cache_put(type, ids[missing[i]],
+                                             cJSON_item, cJSON_to_type,
+                                             free_type);
+      } else cJSON_Delete(cJSON_item);
+    }
+    cJSON_Delete(cJSON_res);
+    free(urls[c]);
+  }
+  free(urls);
+  free(missing);
+
+  PtrArray ptr_array = failed ? NULL : new_ptr_array();
+  END_IF(!failed &&
+         (IS_NULL(ptr_array) || !reserve_ptr_array(ptr_array, ids_count)));
+  for (size_t i = 0; i < ids_count; i++) {
+    if (IS_NULL(items[i])) continue;
+    if (failed) {
+      tfree(free_type, items[i]);
+    } else add_item(ptr_array, items[i]);
+  }
+  free(items);
+  if (failed) return NULL;
+
+  void **array = get_array(ptr_array);
+  free_ptr_array(ptr_array, false, NULL);
+  return array;
+}
+
+static string *create_chunks(string url, string prefix, string *ids,
+                             size_t n, size_t max_ids) {
+  size_t chunks_count = (n + max_ids - 1) / max_ids;
+  string *urls = malloc((chunks_count + 1) * sizeof(string));
+  END_IF(IS_NULL(urls));
+  for (size_t c = 0; c < chunks_count; c++) {
+    StringBuilder builder = new_builder("%s", url);
+    for (size_t i = c * max_ids; i < n && i < (c + 1) * max_ids; i++) {
+      string_builder_appendf(builder, "%s%s%s", i > c * max_ids ? "," : "",
+                             prefix, ids[i]);
+    }
+    urls[c] = finish_builder(builder);
+  }
+  urls[chunks_count] = NULL;
+  return urls;
+}
+
+static void write_in_chunks(string url, string method, string body,
+                            void **items, string (*get_id)(void *item),
+                            size_t max_ids) {
+  size_t items_count = 0;
+  while (!IS_NULL(items[items_count])) items_count++;
+  size_t chunks_count = (items_count + max_ids - 1) / max_ids;
+  string *ids = malloc(items_count * sizeof(string));
+  string *bodies = malloc((chunks_count + 1) * sizeof(string));
+  END_IF(IS_NULL(ids) || IS_NULL(bodies));
+  for (size_t i = 0; i < items_count; i++) ids[i] = get_id(items[i]);
+  for (size_t c = 0; c < chunks_count; c++) bodies[c] = body;
+  string *urls = create_chunks(url, "", ids, items_count, max_ids);
+
+  cJSON **responses = fetch_many(urls, method, body != NULL ? bodies : NULL);
+  bool failed = false;
+  for (size_t c = 0; !IS_NULL(urls[c]); c++) {
+    if (!failed) failed = record_error(responses[c]);
+    cJSON_Delete(responses[c]);
+    free(urls[c]);
+  }
+  free(responses);
+  free(urls);
+  free(bodies);
+  free(ids);
+}
+
+static bool update_snapshot_id(string *snapshot_id, cJSON *cJSON_res) {
+  cJSON *cJSON_snapshot_id =
+    cJSON_GetObjectItemCaseSensitive(cJSON_res, "snapshot_id");
+  if (cJSON_IsString(cJSON_snapshot_id)) {
+    free(*snapshot_id);
+    *snapshot_id = create_string("%s", cJSON_snapshot_id->valuestring);
+  }
+  return record_error(cJSON_res);
+}
+
+static string album_id(void *item) {
+  return ((Album) item)->id;
+}
+
+static string artist_id(void *item) {
+  return ((Artist) item)->id;
+}
+
+static string track_id(void *item) {
+  return ((Track) item)->id;
+}
@@ -0,0 +1,578 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "response-cache.h"
+
+#define MAGIC "cmusic-cache 2"
+#define GENERATION_FILE "generation"
+#define KEY_LENGTH 16
+#define READ_SIZE (16 * 1024)
+
+/*
+ * response_cache_entry:
+ * key is made of the hash of the entry's owner and of its URL, and path is
+ * the file where its response is stored.
+ * generation is the cache's generation when the entry was created.
+ * stored tells whether a response was found in path when the entry was
+ * created, etag, expires and stored_generation being its ETag (or null),
+ * expiry date and the generation it was stored in, and body_offset
+ * the position of its body in the file.
+ * status, new_etag, max_age and no_store describe the response being
+ * received (max_age being -1 if it didn't have one), which is written
+ * in temp (a file named temp_path) as it is received.
+ * failed is set if the response couldn't be written.
+ */
+struct response_cache_entry {
+  string key;
+  string path;
+  unsigned long long generation;
+  bool stored;
+  string etag;
+  long long expires;
+  unsigned long long stored_generation;
+  long body_offset;
+  long status;
+  string new_etag;
+  long long max_age;
+  bool no_store;
+  string temp_path;
+  FILE *temp;
+  bool failed;
+};
+
+/*
+ * cached_file:
+ * A file found in the cache's directory while evicting responses.
+ */
+struct cached_file {
+  char name[KEY_LENGTH + 1];
+  size_t size;
+  struct timespec used;
+};
+
+/*
+ * cache:
+ * dir is the cache's directory (null if the cache is disabled), limit the
+ * space its files can take and eviction the policy used to evict them.
+ * bytes is the space taken by the files, which is only known once the
+ * directory was scanned (bytes_known).
+ * generation is incremented (and saved in the directory's GENERATION_FILE)
+ * each time the cache is invalidated: responses stored in a previous
+ * generation are never fresh.
+ * lock protects the whole structure.
+ */
+static struct {
+  string dir;
+  size_t limit;
+  enum response_cache_eviction eviction;
+  size_t bytes;
+  bool bytes_known;
+  unsigned long long generation;
+  pthread_mutex_t lock;
+} cache = {
+  .limit = RESPONSE_CACHE_LIMIT,
+  .eviction = RESPONSE_CACHE_LRU,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * make_dirs:
+ * Creates the directory dir and its missing parents.
+ * Returns true if dir exists once done, else returns false.
+ */
+static bool make_dirs(string dir);
+
+/*
+ * hash_string:
+ * Returns the FNV-1a hash of str, continuing from hash.
+ */
+static unsigned long long hash_string(unsigned long long hash,
+                                      const char *str);
+
+/*
+ * generation_path:
+ * Returns the path of the cache's GENERATION_FILE, or null if not enough
+ * memory was available. The cache must be locked and enabled.
+ */
+static string generation_path(void);
+
+/*
+ * duplicate_string:
+ * Returns a copy of the size first characters of str, or null if not enough
+ * memory was available.
+ */
+static string duplicate_string(const char *str, size_t size);
+
+/*
+ * load_entry:
+ * Reads the metadata of the response stored in entry's path, if it was
+ * stored for entry's key.
+ */
+static void load_entry(ResponseCacheEntry entry);
+
+/*
+ * parse_cache_control:
+ * Records the directives of the Cache-Control header's value in entry.
+ */
+static void parse_cache_control(ResponseCacheEntry entry, string value);
+
+/*
+ * is_storable:
+ * Returns true if the response being received for entry can be stored,
+ * else returns false.
+ */
+static bool is_storable(ResponseCacheEntry entry);
+
+/*
+ * update_expiry:
+ * Replaces the expiry date of the response stored in entry's path using
+ * the max-age of the response being received, and its generation with
+ * entry's.
+ */
+static void update_expiry(ResponseCacheEntry entry);
+
+/*
+ * file_size:
+ * Returns the size of the file at path, or 0 if it doesn't exist.
+ */
+static size_t file_size(string path);
+
+/*
+ * evict_files:
+ * Scans the cache's directory to know the space taken by its files and,
+ * if they take more space than the limit, removes files following the
+ * eviction policy until they fit in it.
+ * The cache must be locked.
+ */
+static void evict_files(void);
+
+/*
+ * compare_use:
+ * Orders cached files from the least to the most recently used.
+ */
+static int compare_use(const void *a, const void *b);
+
+bool response_cache_set_dir(string dir) {
+  string copy = NULL;
+  if (dir != NULL) {
+    copy = duplicate_string(dir, strlen(dir));
+    if (copy == NULL || !make_dirs(copy)) {
+      free(copy);
+      copy = NULL;
+    }
+  }
+
+  pthread_mutex_lock(&cache.lock);
+  free(cache.dir);
+  cache.dir = copy;
+  cache.bytes = 0;
+  cache.bytes_known = false;
+  cache.generation = 0;
+  string path = copy != NULL ? generation_path() : NULL;
+  FILE *file = path != NULL ? fopen(path, "r") : NULL;
+  if (file != NULL) {
+    if (fscanf(file, "%llu", &cache.generation) != 1) cache.generation = 0;
+    fclose(file);
+  }
+  free(path);
+  pthread_mutex_unlock(&cache.lock);
+  return dir == NULL || copy != NULL;
+}
+
+void response_cache_invalidate(void) {
+  pthread_mutex_lock(&cache.lock);
+  if (cache.dir == NULL) {
+    pthread_mutex_unlock(&cache.lock);
+    return;
+  }
+  cache.generation++;
+  string path = generation_path();
+  FILE *file = path != NULL ? fopen(path, "w") : NULL;
+  if (file != NULL) {
+    fprintf(file, "%llu\n", cache.generation);
+    fclose(file);
+  }
+  free(path);
+  pthread_mutex_unlock(&cache.lock);
+}
+
+void response_cache_set_limit(size_t bytes) {
+  pthread_mutex_lock(&cache.lock);
+  cache.limit = bytes;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+void response_cache_set_eviction(enum response_cache_eviction eviction) {
+  pthread_mutex_lock(&cache.lock);
+  cache.eviction = eviction;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+ResponseCacheEntry new_response_cache_entry(string url, string owner) {
+  if (url == NULL) return NULL;
+  unsigned long long owner_hash = hash_string(14695981039346656037ULL,
+                                              owner != NULL ? owner : "");
+  size_t key_size = KEY_LENGTH + strlen(url) + 2;
+  string key = malloc(key_size);
+  if (key == NULL) return NULL;
+  snprintf(key, key_size, "%016llx %s", owner_hash, url);
+
+  pthread_mutex_lock(&cache.lock);
+  if (cache.dir == NULL) {
+    pthread_mutex_unlock(&cache.lock);
+    free(key);
+    return NULL;
+  }
+  size_t path_size = strlen(cache.dir) + KEY_LENGTH + 2;
+  string path = malloc(path_size);
+  if (path != NULL) {
+    snprintf(path, path_size, "%s/%016llx", cache.dir,
+             hash_string(14695981039346656037ULL, key));
+  }
+  unsigned long long generation = cache.generation;
+  pthread_mutex_unlock(&cache.lock);
+
+  ResponseCacheEntry entry = malloc(sizeof(struct response_cache_entry));
+  if (path == NULL || entry == NULL) {
+    free(path);
+    free(entry);
+    free(key);
+    return NULL;
+  }
+  *entry = (struct response_cache_entry) {
+    .key = key, .path = path, .generation = generation, .stored = false,
+    .etag = NULL, .expires = 0, .stored_generation = 0, .body_offset = 0,
+    .status = 0, .new_etag = NULL, .max_age = -1, .no_store = false,
+    .temp_path = NULL, .temp = NULL, .failed = false,
+  };
+  load_entry(entry);
+  return entry;
+}
+
+void free_response_cache_entry(ResponseCacheEntry entry) {
+  if (entry == NULL) return;
+  if (entry->temp != NULL) {
+    fclose(entry->temp);
+    unlink(entry->temp_path);
+  }
+  free(entry->temp_path);
+  free(entry->new_etag);
+  free(entry->etag);
+  free(entry->path);
+  free(entry->key);
+  free(entry);
+}
+
+string response_cache_etag(ResponseCacheEntry entry) {
+  return entry->stored ? entry->etag : NULL;
+}
+
+bool response_cache_is_fresh(ResponseCacheEntry entry) {
+  return entry->stored && entry->stored_generation == entry->generation &&
+         (long long) time(NULL) < entry->expires;
+}
+
+void response_cache_header(ResponseCacheEntry entry, const char *line,
+                           size_t size) {
+  if (entry == NULL) return;
+  while (size > 0 && (line[size - 1] == '\r' || line[size - 1] == '\n')) {
+    size--;
+  }
+  if (size >= strlen("HTTP/") && !strncmp(line, "HTTP/", strlen("HTTP/"))) {
+    const char *space = memchr(line, ' ', size);
+    entry->status = space != NULL ? strtol(space + 1, NULL, 10) : 0;
+    free(entry->new_etag);
+    entry->new_etag = NULL;
+    entry->max_age = -1;
+    entry->no_store = false;
+    return;
+  }
+
+  const char *colon = memchr(line, ':', size);
+  if (colon == NULL) return;
+  size_t name_size = colon - line;
+  const char *value = colon + 1;
+  size_t value_size = size - name_size - 1;
+  while (value_size > 0 && (*value == ' ' || *value == '\t')) {
+    value++;
+    value_size--;
+  }
+
+  if (name_size == strlen("ETag") && !strncasecmp(line, "ETag", name_size)) {
+    free(entry->new_etag);
+    entry->new_etag = duplicate_string(value, value_size);
+  } else if (name_size == strlen("Cache-Control") &&
+             !strncasecmp(line, "Cache-Control", name_size)) {
+    string directives = duplicate_string(value, value_size);
+    if (directives == NULL) {
+      entry->no_store = true;
+      return;
+    }
+    parse_cache_control(entry, directives);
+    free(directives);
+  }
+}
+
+void response_cache_write(ResponseCacheEntry entry, const void *chunk,
+                          size_t size) {
+  if (entry == NULL || entry->failed || !is_storable(entry)) return;
+
+  if (entry->temp == NULL) {
+    entry->temp_path = malloc(strlen(entry->path) + strlen(".XXXXXX") + 1);
+    if (entry->temp_path == NULL) {
+      entry->failed = true;
+      return;
+    }
+    strcpy(entry->temp_path, entry->path);
+    strcat(entry->temp_path, ".XXXXXX");
+    int fd = mkstemp(entry->temp_path);
+    if (fd >= 0) entry->temp = fdopen(fd, "w");
+    if (entry->temp == NULL) {
+      if (fd >= 0) {
+        close(fd);
+        unlink(entry->temp_path);
+      }
+      entry->failed = true;
+      return;
+    }
+    long long max_age = entry->max_age > 0 ? entry->max_age : 0;
+    fprintf(entry->temp, MAGIC "\n%020lld %020llu\n%s\n%s\n",
+            (long long) time(NULL) + max_age, entry->generation,
+            entry->new_etag != NULL ? entry->new_etag : "", entry->key);
+  }
+
+  if (fwrite(chunk, 1, size, entry->temp) != size) entry->failed = true;
+}
+
+bool response_cache_store(ResponseCacheEntry entry) {
+  if (entry == NULL || entry->temp == NULL) return false;
+  bool written = fclose(entry->temp) == 0 && !entry->failed;
+  entry->temp = NULL;
+  if (!written) {
+    unlink(entry->temp_path);
+    return false;
+  }
+
+  pthread_mutex_lock(&cache.lock);
+  size_t previous_size = file_size(entry->path);
+  if (rename(entry->temp_path, entry->path)) {
+    pthread_mutex_unlock(&cache.lock);
+    unlink(entry->temp_path);
+    return false;
+  }
+  if (cache.bytes_known) {
+    cache.bytes += file_size(entry->path);
+    cache.bytes -= previous_size < cache.bytes ? previous_size : cache.bytes;
+  }
+  if (!cache.bytes_known || cache.bytes > cache.limit) evict_files();
+  pthread_mutex_unlock(&cache.lock);
+  return true;
+}
+
+bool response_cache_read(ResponseCacheEntry entry,
+                         void (*consume)(void *data, const char *chunk,
+                                         size_t size),
+                         void *data) {
+  if (entry == NULL || !entry->stored) return false;
+  struct stat previous;
+  if (stat(entry->path, &previous)) return false;
+  if (entry->status == 304 && entry->max_age >= 0) update_expiry(entry);
+
+  FILE *file = fopen(entry->path, "r");
+  if (file == NULL) return false;
+  bool read = !fseek(file, entry->body_offset, SEEK_SET);
+  char chunk[READ_SIZE];
+  size_t size;
+  while (read && (size = fread(chunk, 1, READ_SIZE, file)) > 0) {
+    consume(data, chunk, size);
+  }
+  read = read && !ferror(file);
+  fclose(file);
+
+  pthread_mutex_lock(&cache.lock);
+  enum response_cache_eviction eviction = cache.eviction;
+  pthread_mutex_unlock(&cache.lock);
+  if (eviction == RESPONSE_CACHE_LRU) {
+    utimensat(AT_FDCWD, entry->path, NULL, 0);
+  } else {
+    struct timespec times[2] = { previous.st_atim, previous.st_mtim };
+    utimensat(AT_FDCWD, entry->path, times, 0);
+  }
+  return read;
+}
+
+long response_cache_status(ResponseCacheEntry entry) {
+  return entry->status;
+}
+
+static bool make_dirs(string dir) {
+  for (char *slash = strchr(dir + 1, '/'); slash != NULL;
+       slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    bool made = !mkdir(dir, 0700) || errno == EEXIST;
+    *slash = '/';
+    if (!made) return false;
+  }
+  if (mkdir(dir, 0700) && errno != EEXIST) return false;
+  struct stat info;
+  return !stat(dir, &info) && S_ISDIR(info.st_mode);
+}
+
+static unsigned long long hash_string(unsigned long long hash,
+                                      const char *str) {
+  for (const char *c = str; *c != '\0'; c++) {
+    hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static string generation_path(void) {
+  size_t path_size = strlen(cache.dir) + strlen("/" GENERATION_FILE) + 1;
+  string path = malloc(path_size);
+  if (path != NULL) snprintf(path, path_size, "%s/" GENERATION_FILE, cache.dir);
+  return path;
+}
+
+static string duplicate_string(const char *str, size_t size) {
+  string copy = malloc(size + 1);
+  if (copy == NULL) return copy;
+  memcpy(copy, str, size);
+  copy[size] = '\0';
+  return copy;
+}
+
+static void load_entry(ResponseCacheEntry entry) {
+  FILE *file = fopen(entry->path, "r");
+  if (file == NULL) return;
+
+  string lines[4] = { NULL };
+  size_t sizes[4] = { 0 };
+  bool loaded = true;
+  for (int i = 0; i < 4 && loaded; i++) {
+    ssize_t length = getline(&lines[i], &sizes[i], file);
+    if (length <= 0 || lines[i][length - 1] != '\n') loaded = false;
+    else lines[i][length - 1] = '\0';
+  }
+  loaded = loaded && !strcmp(lines[0], MAGIC) &&
+           !strcmp(lines[3], entry->key);
+  if (loaded) {
+    char *end;
+    entry->stored = true;
+    entry->expires = strtoll(lines[1], &end, 10);
+    entry->stored_generation = strtoull(end, NULL, 10);
+    entry->body_offset = ftell(file);
+    if (lines[2][0] != '\0') {
+      entry->etag = lines[2];
+      lines[2] = NULL;
+    }
+  }
+
+  for (int i = 0; i < 4; i++) free(lines[i]);
+  fclose(file);
+}
+
+static void parse_cache_control(ResponseCacheEntry entry, string value) {
+  char *saveptr;
+  for (char *directive = strtok_r(value, ",", &saveptr); directive != NULL;
+       directive = strtok_r(NULL, ",", &saveptr)) {
+    while (*directive == ' ' || *directive == '\t') directive++;
+    if (!strncasecmp(directive, "no-store", strlen("no-store"))) {
+      entry->no_store = true;
+    } else if (!strncasecmp(directive, "no-cache", strlen("no-cache"))) {
+      entry->max_age = 0;
+    } else if (!strncasecmp(directive, "max-age=", strlen("max-age=")) &&
+               entry->max_age != 0) {
+      entry->max_age = strtoll(directive + strlen("max-age="), NULL, 10);
+    }
+  }
+}
+
+static bool is_storable(ResponseCacheEntry entry) {
+  if (entry->status != 200 || entry->no_store) return false;
+  if (entry->new_etag == NULL && entry->max_age <= 0) return false;
+  pthread_mutex_lock(&cache.lock);
+  bool storable = cache.limit > 0;
+  pthread_mutex_unlock(&cache.lock);
+  return storable;
+}
+
+static void update_expiry(ResponseCacheEntry entry) {
+  FILE *file = fopen(entry->path, "r+");
+  if (file == NULL) return;
+  entry->expires = (long long) time(NULL) + entry->max_age;
+  entry->stored_generation = entry->generation;
+  if (!fseek(file, strlen(MAGIC "\n"), SEEK_SET)) {
+    fprintf(file, "%020lld %020llu", entry->expires, entry->generation);
+  }
+  fclose(file);
+}
+
+static size_t file_size(string path) {
+  struct stat info;
+  return stat(path, &info) ? 0 : (size_t) info.st_size;
+}
+
+static void evict_files(void) {
+  DIR *dir = opendir(cache.dir);
+  if (dir == NULL) return;
+
+  struct cached_file *files = NULL;
+  size_t files_count = 0, capacity = 0;
+  size_t path_size = strlen(cache.dir) + KEY_LENGTH + 2;
+  char path[path_size];
+  cache.bytes = 0;
+  struct dirent *dirent;
+  while ((dirent = readdir(dir)) != NULL) {
+    if (strlen(dirent->d_name) != KEY_LENGTH ||
+        strspn(dirent->d_name, "0123456789abcdef") != KEY_LENGTH) {
+      continue;
+    }
+    snprintf(path, path_size, "%s/%s", cache.dir, dirent->d_name);
+    struct stat info;
+    if (stat(path, &info) || !S_ISREG(info.st_mode)) continue;
+    if (files_count == capacity) {
+      size_t new_capacity = capacity ? capacity * 2 : 64;
+      struct cached_file *new_files =
+        realloc(files, new_capacity * sizeof(struct cached_file));
+      if (new_files == NULL) break;
+      files = new_files;
+      capacity = new_capacity;
+    }
+    struct cached_file *file = &files[files_count++];
+    strcpy(file->name, dirent->d_name);
+    file->size = (size_t) info.st_size;
+    file->used = info.st_mtim;
+    cache.bytes += file->size;
+  }
+  closedir(dir);
+  cache.bytes_known = true;
+
+  if (cache.bytes > cache.limit) {
+    qsort(files, files_count, sizeof(struct cached_file), compare_use);
+    for (size_t i = 0; i < files_count && cache.bytes > cache.limit; i++) {
+      snprintf(path, path_size, "%s/%s", cache.dir, files[i].name);
+      if (!unlink(path)) cache.bytes -= files[i].size;
+    }
+  }
+  free(files);
+}
+
+static int compare_use(const void *a, const void *b) {
+  const struct timespec *used_a = &((const struct cached_file *) a)->used;
+  const struct timespec *used_b = &((const struct cached_file *) b)->used;
+  if (used_a->tv_sec != used_b->tv_sec) {
+    return used_a->tv_sec < used_b->tv_sec ? -1 : 1;
+  }
+  if (used_a->tv_nsec != used_b->tv_nsec) {
+    return used_a->tv_nsec < used_b->tv_nsec ? -1 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,36 @@
+#include <string.h>
+#include "spotify-id.h"
+
+#define WORDS_COUNT (SPOTIFY_ID_SIZE / sizeof(uint64_t))
+
+bool spotify_id_copy(char *dest, string str) {
+  size_t length = str != NULL ? strnlen(str, SPOTIFY_ID_LENGTH + 1) : 0;
+  bool valid = str != NULL && length <= SPOTIFY_ID_LENGTH;
+  memset(dest, '\0', SPOTIFY_ID_SIZE);
+  if (valid) memcpy(dest, str, length);
+  return valid;
+}
+
+bool spotify_id_pack(struct spotify_id *id, string str) {
+  char chars[SPOTIFY_ID_SIZE];
+  bool valid = spotify_id_copy(chars, str);
+  memcpy(id->words, chars, SPOTIFY_ID_SIZE);
+  return valid;
+}
+
+bool spotify_id_equal(struct spotify_id id, struct spotify_id other_id) {
+  uint64_t difference = 0;
+  for (size_t i = 0; i < WORDS_COUNT; i++) {
+    difference |= id.words[i] ^ other_id.words[i];
+  }
+  return difference == 0;
+}
+
+size_t spotify_id_hash(struct spotify_id id) {
+  uint64_t hash = 0;
+  for (size_t i = 0; i < WORDS_COUNT; i++) {
+    hash = (hash ^ id.words[i]) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
@@ -0,0 +1,591 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ptrarray.h"
+#include "tmem.h"
+#include "spotify-id.h"
+#include "intern.h"
+#include "json-stream.h"
+#include "stream-converters.h"
+
+#define END_IF(condition) if (condition) exit(EXIT_FAILURE)
+#define IS_NULL(ptr) ((ptr) == NULL)
+
+#define MAX_FRAMES 16
+
+/*
+ * field_kind:
+ * How the value of a field is stored in its structure:
+ * FIELD_STRING as a string (FIELD_NULLABLE_STRING being set to null
+ * if the value is null, and FIELD_INTERNED_STRING being interned),
+ * FIELD_ID as a Spotify ID stored in place, FIELD_NUMBER as a size_t,
+ * FIELD_OBJECT as a pointer to a structure, FIELD_ARRAY as a null-terminated
+ * array of pointers to structures (FIELD_PAGE_ITEMS being the items of
+ * a page, whose count is also stored) and FIELD_INTERNED_STRINGS as
+ * a null-terminated array of interned strings.
+ */
+enum field_kind {
+  FIELD_STRING, FIELD_NULLABLE_STRING, FIELD_INTERNED_STRING, FIELD_ID,
+  FIELD_NUMBER, FIELD_OBJECT, FIELD_ARRAY, FIELD_PAGE_ITEMS,
+  FIELD_INTERNED_STRINGS
+};
+
+/*
+ * stream_field:
+ * A field of a structure, whose value is stored offset bytes from the start
+ * of the structure. type is the structure of the value of a FIELD_OBJECT
+ * field, or of the items of a FIELD_ARRAY or FIELD_PAGE_ITEMS field.
+ * An optional field may be missing, and its value is skipped if it hasn't
+ * the expected type (e.g. if it's null).
+ */
+struct stream_field {
+  string key;
+  enum field_kind kind;
+  size_t offset;
+  const struct stream_struct *type;
+  bool optional;
+};
+
+/*
+ * stream_struct:
+ * A structure, allocated using new_type, and its fields (at most 64).
+ * If new_type is null, the object isn't converted to a structure of its
+ * own: its only field is an object stored in place of it (see WRAPPER).
+ */
+struct stream_struct {
+  void *(*new_type)(void);
+  const struct stream_field *fields;
+  size_t count;
+};
+
+/*
+ * STRUCT:
+ * Initializer of a stream_struct allocated using new_type, whose fields
+ * are listed after it.
+ */
+#define STRUCT(new_type, ...) { \
+  new_type, \
+  (const struct stream_field []) { __VA_ARGS__ }, \
+  sizeof((const struct stream_field []) { __VA_ARGS__ }) / \
+    sizeof(struct stream_field) \
+}
+
+/*
+ * FIELD, NESTED:
+ * Initializers of the stream_field of field, a member of struct_type.
+ * NESTED gives the structure of the field's value (or items) and whether
+ * the field is optional.
+ */
+#define FIELD(struct_type, field, field_kind) { \
+  .key = #field, .kind = field_kind, .offset = offsetof(struct_type, field) \
+}
+#define NESTED(struct_type, field, field_kind, nested, is_optional) { \
+  .key = #field, .kind = field_kind, .offset = offsetof(struct_type, field), \
+  .type = nested, .optional = is_optional \
+}
+
+/*
+ * PAGE:
+ * Initializer of the stream_struct of a page whose items are the structures
+ * described by item.
+ */
+#define PAGE(item) STRUCT(new_page, \
+  FIELD(struct page, href, FIELD_STRING), \
+  FIELD(struct page, limit, FIELD_NUMBER), \
+  FIELD(struct page, next, FIELD_NULLABLE_STRING), \
+  FIELD(struct page, total, FIELD_NUMBER), \
+  NESTED(struct page, items, FIELD_PAGE_ITEMS, item, false))
+
+/*
+ * WRAPPER:
+ * Initializer of the stream_struct of an object whose field field_key
+ * holds the structure described by nested, stored in place of the object.
+ */
+#define WRAPPER(field_key, nested) { \
+  NULL, \
+  (const struct stream_field []) { \
+    { .key = field_key, .kind = FIELD_OBJECT, .type = nested } \
+  }, \
+  1 \
+}
+
+static const struct stream_struct followers = STRUCT(new_followers,
+  FIELD(struct followers, total, FIELD_NUMBER));
+
+static const struct stream_struct restrictions = STRUCT(new_restrictions,
+  FIELD(struct restrictions, reason, FIELD_STRING));
+
+static const struct stream_struct simplified_artist = STRUCT(
+  new_simplified_artist,
+  FIELD(struct simplified_artist, href, FIELD_STRING),
+  FIELD(struct simplified_artist, id, FIELD_ID),
+  FIELD(struct simplified_artist, name, FIELD_INTERNED_STRING));
+
+static const struct stream_struct simplified_album = STRUCT(
+  new_simplified_album,
+  FIELD(struct simplified_album, album_type, FIELD_INTERNED_STRING),
+  FIELD(struct simplified_album, total_tracks, FIELD_NUMBER),
+  FIELD(struct simplified_album, href, FIELD_STRING),
+  FIELD(struct simplified_album, id, FIELD_ID),
+  FIELD(struct simplified_album, name, FIELD_STRING),
+  FIELD(struct simplified_album, release_date, FIELD_STRING),
+  NESTED(struct simplified_album, restrictions, FIELD_OBJECT, &restrictions,
+         true),
+  NESTED(struct simplified_album, artists, FIELD_ARRAY, &simplified_artist,
+         false));
+
+static const struct stream_struct simplified_track = STRUCT(
+  new_simplified_track,
+  NESTED(struct simplified_track, artists, FIELD_ARRAY, &simplified_artist,
+         false),
+  FIELD(struct simplified_track, duration_ms, FIELD_NUMBER),
+  FIELD(struct simplified_track, href, FIELD_STRING),
+  FIELD(struct simplified_track, id, FIELD_ID),
+  NESTED(struct simplified_track, restrictions, FIELD_OBJECT, &restrictions,
+         true),
+  FIELD(struct simplified_track, name, FIELD_STRING));
+
+static const struct stream_struct simplified_tracks_page =
+  PAGE(&simplified_track);
+
+static const struct stream_struct album = STRUCT(new_album,
+  FIELD(struct album, album_type, FIELD_INTERNED_STRING),
+  FIELD(struct album, total_tracks, FIELD_NUMBER),
+  FIELD(struct album, id, FIELD_ID),
+  FIELD(struct album, name, FIELD_STRING),
+  FIELD(struct album, release_date, FIELD_STRING),
+  NESTED(struct album, restrictions, FIELD_OBJECT, &restrictions, true),
+  NESTED(struct album, artists, FIELD_ARRAY, &simplified_artist, false),
+  NESTED(struct album, tracks, FIELD_OBJECT, &simplified_tracks_page, false),
+  FIELD(struct album, popularity, FIELD_NUMBER));
+
+static const struct stream_struct saved_album = STRUCT(new_saved_album,
+  FIELD(struct saved_album, added_at, FIELD_STRING),
+  NESTED(struct saved_album, album, FIELD_OBJECT, &album, false));
+
+static const struct stream_struct artist = STRUCT(new_artist,
+  NESTED(struct artist, followers, FIELD_OBJECT, &followers, false),
+  FIELD(struct artist, genres, FIELD_INTERNED_STRINGS),
+  FIELD(struct artist, id, FIELD_ID),
+  FIELD(struct artist, name, FIELD_STRING),
+  FIELD(struct artist, popularity, FIELD_NUMBER));
+
+static const struct stream_struct track = STRUCT(new_track,
+  NESTED(struct track, album, FIELD_OBJECT, &simplified_album, false),
+  NESTED(struct track, artists, FIELD_ARRAY, &simplified_artist, false),
+  FIELD(struct track, duration_ms, FIELD_NUMBER),
+  FIELD(struct track, id, FIELD_ID),
+  NESTED(struct track, restrictions, FIELD_OBJECT, &restrictions, true),
+  FIELD(struct track, name, FIELD_STRING),
+  FIELD(struct track, popularity, FIELD_NUMBER));
+
+static const struct stream_struct saved_track = STRUCT(new_saved_track,
+  FIELD(struct saved_track, added_at, FIELD_STRING),
+  NESTED(struct saved_track, track, FIELD_OBJECT, &track, false));
+
+static const struct stream_struct user = STRUCT(new_user,
+  FIELD(struct user, display_name, FIELD_NULLABLE_STRING),
+  NESTED(struct user, followers, FIELD_OBJECT, &followers, false),
+  FIELD(struct user, id, FIELD_STRING));
+
+static const struct stream_struct artists_page = PAGE(&artist);
+static const struct stream_struct tracks_page = PAGE(&track);
+static const struct stream_struct saved_tracks_page = PAGE(&saved_track);
+static const struct stream_struct saved_albums_page = PAGE(&saved_album);
+static const struct stream_struct followed_artists_page =
+  WRAPPER("artists", &artists_page);
+
+/*
+ * stream_structs:
+ * The structure of each stream_type.
+ */
+static const struct stream_struct *stream_structs[] = {
+  [STREAM_USER] = &user,
+  [STREAM_ARTISTS_PAGE] = &artists_page,
+  [STREAM_TRACKS_PAGE] = &tracks_page,
+  [STREAM_SAVED_TRACKS_PAGE] = &saved_tracks_page,
+  [STREAM_SAVED_ALBUMS_PAGE] = &saved_albums_page,
+  [STREAM_FOLLOWED_ARTISTS_PAGE] = &followed_artists_page,
+};
+
+/*
+ * frame:
+ * An object or an array of the document being converted.
+ * An object is converted to target, a structure of type, seen having
+ * the bit of each of its fields that was read set. field is the field
+ * whose value is read next, or null if the value must be skipped.
+ * The items of an array are gathered in items, the array being the value
+ * of the field of the enclosing object.
+ */
+struct frame {
+  const struct stream_struct *type;
+  void *target;
+  const struct stream_field *field;
+  uint64_t seen;
+  PtrArray items;
+};
+
+/*
+ * stream_converter:
+ * stream parses the document fed and reports its events to the converter.
+ * type is the structure of the document's root, root the structure
+ * converted from it and done is set once it was read entirely.
+ * frames is the stack of the objects and arrays open, depth being their
+ * number. skipped is the number of containers open in the value being
+ * skipped, if any.
+ * arena is the arena the structures are allocated in, set aside while
+ * the converter isn't fed.
+ */
+struct stream_converter {
+  JsonStream stream;
+  const struct stream_struct *type;
+  void *root;
+  bool done;
+  struct frame frames[MAX_FRAMES];
+  size_t depth;
+  size_t skipped;
+  void *arena;
+};
+
+/*
+ * convert_event:
+ * JsonHandler filling the structures of the converter pointed by
+ * converter_ptr.
+ */
+static bool convert_event(void *converter_ptr, enum json_event event,
+                          const char *value, size_t length);
+
+/*
+ * convert_value:
+ * Stores the value starting with event into the field of the innermost
+ * object, opening it if it's an object or an array.
+ * Returns false if the value can't be stored in the field, else returns
+ * true.
+ */
+static bool convert_value(StreamConverter converter, enum json_event event,
+                          const char *value, size_t length);
+
+/*
+ * convert_item:
+ * Adds the item starting with event to the innermost array, opening it if
+ * it's an object. Null items are skipped.
+ * Returns false if the item can't be stored in the array, else returns true.
+ */
+static bool convert_item(StreamConverter converter, enum json_event event,
+                         const char *value);
+
+/*
+ * open_frame:
+ * Pushes a new frame converting an object to a structure of type (if type
+ * isn't null) or gathering the items of an array, and sets target to
+ * the new structure. The frame of a wrapper (see WRAPPER) stores its field
+ * in target instead.
+ * Returns false if the document is nested too deeply, else returns true.
+ */
+static bool open_frame(StreamConverter converter,
+                       const struct stream_struct *type, void **target);
+
+/*
+ * close_frame:
+ * Pops the innermost frame, storing the items of an array into the field
+ * of the enclosing object.
+ * Returns false if a field of the object closed that isn't optional is
+ * missing, else returns true.
+ */
+static bool close_frame(StreamConverter converter);
+
+/*
+ * skip_value:
+ * Skips the value starting with event.
+ * Returns true.
+ */
+static bool skip_value(StreamConverter converter, enum json_event event);
+
+/*
+ * find_field:
+ * Returns the field of type whose key is key, or null if there is none.
+ */
+static const struct stream_field *find_field(const struct stream_struct *type,
+                                             const char *key);
+
+/*
+ * has_kind:
+ * Returns true if a value starting with event can be stored in field,
+ * else returns false.
+ */
+static bool has_kind(const struct stream_field *field, enum json_event event);
+
+/*
+ * copy_value:
+ * Copies value, of length characters, into a new string allocated using
+ * tmalloc.
+ * Terminates program if not enough memory was available.
+ */
+static string copy_value(const char *value, size_t length);
+
+/*
+ * to_size:
+ * Returns the number written in value as a size_t, 0 if it's negative.
+ */
+static size_t to_size(const char *value);
+
+/*
+ * begin_arena:
+ * Starts the arena of converter and sets it aside.
+ * Terminates program if not enough memory was available.
+ */
+static void begin_arena(StreamConverter converter);
+
+/*
+ * release_frames:
+ * Releases the arrays gathered by the frames of converter and empties
+ * its stack.
+ */
+static void release_frames(StreamConverter converter);
+
+StreamConverter new_stream_converter(enum stream_type type) {
+  StreamConverter converter = calloc(1, sizeof(struct stream_converter));
+  if (IS_NULL(converter)) return converter;
+  converter->stream = new_json_stream(convert_event, converter);
+  if (IS_NULL(converter->stream)) {
+    free(converter);
+    return NULL;
+  }
+  converter->type = stream_structs[type];
+  begin_arena(converter);
+  return converter;
+}
+
+void free_stream_converter(StreamConverter converter) {
+  if (IS_NULL(converter)) return;
+  release_frames(converter);
+  if (!IS_NULL(converter->arena)) {
+    void *previous = talloc_swap_arena(converter->arena);
+    talloc_end_arena(NULL);
+    talloc_swap_arena(previous);
+  }
+  free_json_stream(converter->stream);
+  free(converter);
+}
+
+bool stream_converter_feed(StreamConverter converter, const char *chunk,
+                           size_t size) {
+  if (IS_NULL(converter->arena)) return false;
+  void *previous = talloc_swap_arena(converter->arena);
+  bool fed = json_stream_feed(converter->stream, chunk, size);
+  converter->arena = talloc_swap_arena(previous);
+  return fed;
+}
+
+void *stream_converter_finish(StreamConverter converter) {
+  if (IS_NULL(converter->arena)) return NULL;
+  bool complete = json_stream_finish(converter->stream) && converter->done;
+  release_frames(converter);
+  void *previous = talloc_swap_arena(converter->arena);
+  void *root = talloc_end_arena(complete ? converter->root : NULL);
+  talloc_swap_arena(previous);
+  converter->arena = converter->root = NULL;
+  return root;
+}
+
+void stream_converter_reset(StreamConverter converter) {
+  release_frames(converter);
+  if (!IS_NULL(converter->arena)) {
+    void *previous = talloc_swap_arena(converter->arena);
+    talloc_end_arena(NULL);
+    talloc_swap_arena(previous);
+  }
+  json_stream_reset(converter->stream);
+  converter->root = NULL;
+  converter->done = false;
+  converter->skipped = 0;
+  begin_arena(converter);
+}
+
+static bool convert_event(void *converter_ptr, enum json_event event,
+                          const char *value, size_t length) {
+  StreamConverter converter = converter_ptr;
+  if (converter->skipped > 0) {
+    if (event == JSON_OBJECT_START || event == JSON_ARRAY_START) {
+      converter->skipped++;
+    } else if (event == JSON_OBJECT_END || event == JSON_ARRAY_END) {
+      converter->skipped--;
+    }
+    return true;
+  }
+
+  if (converter->depth == 0) {
+    return event == JSON_OBJECT_START && !converter->done &&
+           open_frame(converter, converter->type, &converter->root);
+  }
+  struct frame *frame = &converter->frames[converter->depth - 1];
+  if (!IS_NULL(frame->items)) {
+    if (event == JSON_ARRAY_END) return close_frame(converter);
+    return convert_item(converter, event, value);
+  }
+  if (event == JSON_OBJECT_END) return close_frame(converter);
+  if (event == JSON_KEY) {
+    frame->field = find_field(frame->type, value);
+    return true;
+  }
+  if (IS_NULL(frame->field)) return skip_value(converter, event);
+  return convert_value(converter, event, value, length);
+}
+
+static bool convert_value(StreamConverter converter, enum json_event event,
+                          const char *value, size_t length) {
+  struct frame *frame = &converter->frames[converter->depth - 1];
+  const struct stream_field *field = frame->field;
+  if (!has_kind(field, event)) {
+    return field->optional && skip_value(converter, event);
+  }
+  frame->seen |= (uint64_t) 1 << (field - frame->type->fields);
+
+  void *slot = (char *) frame->target + field->offset;
+  switch (field->kind) {
+    case FIELD_STRING:
+    case FIELD_NULLABLE_STRING:
+      *(string *) slot = event == JSON_NULL
+        ? NULL
+        : copy_value(value, length);
+      return true;
+    case FIELD_INTERNED_STRING:
+      *(string *) slot = intern_string((string) value);
+      END_IF(IS_NULL(*(string *) slot));
+      return true;
+    case FIELD_ID:
+      return spotify_id_copy(slot, (string) value);
+    case FIELD_NUMBER:
+      *(size_t *) slot = to_size(value);
+      return true;
+    case FIELD_OBJECT:
+      return open_frame(converter, field->type, slot);
+    default:
+      return open_frame(converter, NULL, NULL);
+  }
+}
+
+static bool convert_item(StreamConverter converter, enum json_event event,
+                         const char *value) {
+  struct frame *frame = &converter->frames[converter->depth - 1];
+  const struct stream_field *field =
+    converter->frames[converter->depth - 2].field;
+  if (event == JSON_NULL) return true;
+
+  if (field->kind == FIELD_INTERNED_STRINGS) {
+    if (event != JSON_STRING) return false;
+    string item = intern_string((string) value);
+    END_IF(IS_NULL(item) || !add_item(frame->items, item));
+    return true;
+  }
+  void *item = NULL;
+  if (event != JSON_OBJECT_START ||
+      !open_frame(converter, field->type, &item)) {
+    return false;
+  }
+  END_IF(!add_item(frame->items, item));
+  return true;
+}
+
+static bool open_frame(StreamConverter converter,
+                       const struct stream_struct *type, void **target) {
+  if (converter->depth == MAX_FRAMES) return false;
+  struct frame *frame = &converter->frames[converter->depth++];
+  frame->type = type;
+  frame->field = NULL;
+  frame->seen = 0;
+  frame->target = frame->items = NULL;
+  if (IS_NULL(type)) {
+    frame->items = new_ptr_array();
+    END_IF(IS_NULL(frame->items));
+  } else if (IS_NULL(type->new_type)) {
+    frame->target = target;
+  } else {
+    frame->target = *target = talloc(type->new_type);
+    END_IF(IS_NULL(frame->target));
+  }
+  return true;
+}
+
+static bool close_frame(StreamConverter converter) {
+  struct frame *frame = &converter->frames[--converter->depth];
+  if (!IS_NULL(frame->items)) {
+    struct frame *object = &converter->frames[converter->depth - 1];
+    SizedArray array = copy_array(frame->items, tmalloc);
+    END_IF(IS_NULL(array.items));
+    *(void ***) ((char *) object->target + object->field->offset) =
+      array.items;
+    if (object->field->kind == FIELD_PAGE_ITEMS) {
+      ((Page) object->target)->count = array.length;
+    }
+    free_ptr_array(frame->items, false, NULL);
+    frame->items = NULL;
+    return true;
+  }
+
+  for (size_t i = 0; i < frame->type->count; i++) {
+    if (!frame->type->fields[i].optional &&
+        !(frame->seen & ((uint64_t) 1 << i))) {
+      return false;
+    }
+  }
+  if (converter->depth == 0) converter->done = true;
+  return true;
+}
+
+static bool skip_value(StreamConverter converter, enum json_event event) {
+  if (event == JSON_OBJECT_START || event == JSON_ARRAY_START) {
+    converter->skipped = 1;
+  }
+  return true;
+}
+
+static const struct stream_field *find_field(const struct stream_struct *type,
+                                             const char *key) {
+  for (size_t i = 0; i < type->count; i++) {
+    if (!strcmp(type->fields[i].key, key)) return &type->fields[i];
+  }
+  return NULL;
+}
+
+static bool has_kind(const struct stream_field *field, enum json_event event) {
+  switch (field->kind) {
+    case FIELD_NULLABLE_STRING:
+      return event == JSON_STRING || event == JSON_NULL;
+    case FIELD_NUMBER:
+      return event == JSON_NUMBER;
+    case FIELD_OBJECT:
+      return event == JSON_OBJECT_START;
+    case FIELD_ARRAY:
+    case FIELD_PAGE_ITEMS:
+    case FIELD_INTERNED_STRINGS:
+      return event == JSON_ARRAY_START;
+    default:
+      return event == JSON_STRING;
+  }
+}
+
+static string copy_value(const char *value, size_t length) {
+  string str = tmalloc(length + 1);
+  END_IF(IS_NULL(str));
+  memcpy(str, value, length + 1);
+  return str;
+}
+
+static size_t to_size(const char *value) {
+  double number = strtod(value, NULL);
+  return number > 0 ? (size_t) number : 0;
+}
+
+static void begin_arena(StreamConverter converter) {
+  void *previous = talloc_swap_arena(NULL);
+  END_IF(!talloc_begin_arena());
+  converter->arena = talloc_swap_arena(previous);
+}
+
+static void release_frames(StreamConverter converter) {
+  for (size_t i = 0; i < converter->depth; i++) {
+    free_ptr_array(converter->frames[i].items, false, NULL);
+  }
+  converter->depth = 0;
+}
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "string-builder.h"
+
+#define MIN_CAPACITY 64
+
+/*
+ * string_builder:
+ * chars is the string built so far, length its length and capacity
+ * the number of characters it can hold (not counting the null character)
+ * before growing.
+ * failed is set once an append couldn't be made.
+ */
+struct string_builder {
+  char *chars;
+  size_t length;
+  size_t capacity;
+  bool failed;
+};
+
+/*
+ * grow_string_builder:
+ * Makes sure builder can hold at least size characters, at least doubling
+ * its capacity if it has to grow.
+ * Returns false if builder failed or if not enough memory was available
+ * (in which case builder fails), else returns true.
+ */
+static bool grow_string_builder(StringBuilder builder, size_t size);
+
+/*
+ * append_chars:
+ * Appends the count first characters of chars to the string held
+ * by builder.
+ * Returns false if builder failed, else returns true.
+ */
+static bool append_chars(StringBuilder builder, const char *chars,
+                         size_t count);
+
+StringBuilder new_string_builder(void) {
+  StringBuilder builder = malloc(sizeof(struct string_builder));
+  if (builder == NULL) return builder;
+  builder->chars = malloc(MIN_CAPACITY + 1);
+  if (builder->chars == NULL) {
+    free(builder);
+    return NULL;
+  }
+  builder->chars[0] = '\0';
+  builder->length = 0;
+  builder->capacity = MIN_CAPACITY;
+  builder->failed = false;
+
+  return builder;
+}
+
+void free_string_builder(StringBuilder builder) {
+  if (builder != NULL) free(builder->chars);
+  free(builder);
+}
+
+bool string_builder_append(StringBuilder builder, string str) {
+  if (str == NULL) return !builder->failed;
+  return append_chars(builder, str, strlen(str));
+}
+
+bool string_builder_appendf(StringBuilder builder, string format, ...) {
+  va_list args;
+  va_start(args, format);
+  bool appended = string_builder_vappendf(builder, format, args);
+  va_end(args);
+  return appended;
+}
+
+bool string_builder_vappendf(StringBuilder builder, string format,
+                             va_list args) {
+  if (builder->failed) return false;
+  va_list retry_args;
+  va_copy(retry_args, args);
+  size_t available = builder->capacity - builder->length + 1;
+  int length = vsnprintf(builder->chars + builder->length, available,
+                         format, args);
+  if (length >= 0 && (size_t) length >= available) {
+    length = grow_string_builder(builder, builder->length + length)
+               ? vsnprintf(builder->chars + builder->length, length + 1,
+                           format, retry_args)
+               : -1;
+  }
+  va_end(retry_args);
+
+  if (length < 0) {
+    builder->chars[builder->length] = '\0';
+    builder->failed = true;
+    return false;
+  }
+  builder->length += length;
+  return true;
+}
+
+bool string_builder_append_url(StringBuilder builder, string str) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (; str != NULL && *str != '\0'; str++) {
+    unsigned char c = *str;
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+        (c >= '0' && c <= '9') || strchr("-._~", c) != NULL) {
+      if (!append_chars(builder, (char *) &c, 1)) return false;
+    } else {
+      char encoded[] = { '%', hex[c >> 4], hex[c & 0xF] };
+      if (!append_chars(builder, encoded, 3)) return false;
+    }
+  }
+  return !builder->failed;
+}
+
+bool string_builder_append_json(StringBuilder builder, string str) {
+  if (str == NULL) return append_chars(builder, "null", 4);
+  if (!append_chars(builder, "\"", 1)) return false;
+  for (; *str != '\0'; str++) {
+    unsigned char c = *str;
+    string escaped = NULL;
+    switch (c) {
+      case '"': escaped = "\\\""; break;
+      case '\\': escaped = "\\\\"; break;
+      case '\b': escaped = "\\b"; break;
+      case '\f': escaped = "\\f"; break;
+      case '\n': escaped = "\\n"; break;
+      case '\r': escaped = "\\r"; break;
+      case '\t': escaped = "\\t"; break;
+    }
+    bool appended;
+    if (escaped != NULL) {
+      appended = string_builder_append(builder, escaped);
+    } else if (c < 0x20) {
+      appended = string_builder_appendf(builder, "\\u%04x", c);
+    } else appended = append_chars(builder, (char *) &c, 1);
+    if (!appended) return false;
+  }
+  return append_chars(builder, "\"", 1);
+}
+
+size_t string_builder_length(StringBuilder builder) {
+  return builder->length;
+}
+
+string string_builder_finish(StringBuilder builder) {
+  string str = !builder->failed ? builder->chars : NULL;
+  if (builder->failed) free(builder->chars);
+  free(builder);
+  return str;
+}
+
+static bool grow_string_builder(StringBuilder builder, size_t size) {
+  if (builder->failed) return false;
+  if (size <= builder->capacity) return true;
+  size_t capacity = builder->capacity;
+  while (capacity < size) capacity *= 2;
+  char *chars = realloc(builder->chars, capacity + 1);
+  if (chars == NULL) {
+    builder->failed = true;
+    return false;
+  }
+  builder->chars = chars;
+  builder->capacity = capacity;
+
+  return true;
+}
+
+static bool append_chars(StringBuilder builder, const char *chars,
+                         size_t count) {
+  if (!grow_string_builder(builder, builder->length + count)) return false;
+  memcpy(builder->chars + builder->length, chars, count);
+  builder->length += count;
+  builder->chars[builder->length] = '\0';
+  return true;
+}
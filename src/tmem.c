@@ -1,11 +1,86 @@
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "types.h"
+#include "arena.h"
+#include "intern.h"
 #include "tmem.h"
 
 #define RETURN_IF_NULL(ptr) if ((ptr) == NULL) return ptr
 #define RETURN_VOID_IF_NULL(ptr) if ((ptr) == NULL) return
 #define IF_NOT_NULL(ptr) if ((ptr) != NULL)
+#define RETURN_VOID_IF_IN_ARENA(ptr) if (release_arena_of(ptr)) return
+
+/*
+ * kept:
+ * Memory released along with an arena (see talloc_keep), allocated from
+ * the arena itself.
+ */
+struct kept {
+  void *ptr;
+  void (*release)(void *);
+  struct kept *next;
+};
+
+/*
+ * owned_arena:
+ * An arena in which structures were allocated, root being the structure
+ * that releases it (null until the arena is ended), references the number
+ * of times root must be released before the arena is, and kept the memory
+ * released along with it.
+ * It is the owner of its arena (see arena_set_owner) so that the "free"
+ * deallocation functions can recognize the structures allocated in it.
+ */
+struct owned_arena {
+  Arena arena;
+  void *root;
+  atomic_size_t references;
+  struct kept *kept;
+};
+
+/*
+ * spare_arena:
+ * An arena that was reset after its root was released, kept to be reused
+ * by the next call of talloc_begin_arena, protected by arenas_lock.
+ * current_arena is the arena started by the calling thread, if any, and
+ * left_arena the one it had before calling talloc_reenter_arena.
+ */
+static Arena spare_arena = NULL;
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local struct owned_arena *current_arena = NULL;
+static _Thread_local struct owned_arena *left_arena = NULL;
+
+/*
+ * release_arena_of:
+ * Searches the arena in which ptr was allocated.
+ * If ptr is the root of that arena, releases one of its references, and
+ * the arena itself if it was the last one.
+ * Returns true if ptr was allocated in an arena (meaning it mustn't be
+ * freed individually), else returns false.
+ */
+static bool release_arena_of(void *ptr);
+
+/*
+ * find_arena_of:
+ * Returns the arena in which ptr was allocated, or null if there is none.
+ */
+static struct owned_arena *find_arena_of(const void *ptr);
+
+/*
+ * release_kept:
+ * Releases the memory kept along with owned_arena, before the arena itself
+ * is released.
+ */
+static void release_kept(struct owned_arena *owned_arena);
+
+/*
+ * free_string:
+ * Releases memory taken by str, unless it was interned (see the "intern"
+ * header), in which case the string is shared and must be kept.
+ * Used for the fields that may hold an interned string.
+ */
+static void free_string(void *str);
 
 /*
  * free_all:
@@ -23,10 +98,90 @@ void *talloc(void *(new_type)(void)) {
   return (*new_type)();
 }
 
+void *tmalloc(size_t size) {
+  if (current_arena != NULL) return arena_alloc(current_arena->arena, size);
+  return malloc(size);
+}
+
+bool talloc_begin_arena(void) {
+  struct owned_arena *owned_arena = malloc(sizeof(struct owned_arena));
+  if (owned_arena == NULL) return false;
+
+  pthread_mutex_lock(&arenas_lock);
+  owned_arena->arena = spare_arena;
+  spare_arena = NULL;
+  pthread_mutex_unlock(&arenas_lock);
+
+  if (owned_arena->arena == NULL) owned_arena->arena = new_arena();
+  if (owned_arena->arena == NULL) {
+    free(owned_arena);
+    return false;
+  }
+  owned_arena->root = NULL;
+  owned_arena->kept = NULL;
+  arena_set_owner(owned_arena->arena, owned_arena);
+  current_arena = owned_arena;
+  return true;
+}
+
+void *talloc_end_arena(void *root) {
+  struct owned_arena *owned_arena = current_arena;
+  current_arena = NULL;
+  if (owned_arena == NULL) return root;
+  if (root == NULL) {
+    release_kept(owned_arena);
+    free_arena(owned_arena->arena);
+    free(owned_arena);
+    return root;
+  }
+
+  owned_arena->root = root;
+  atomic_init(&owned_arena->references, 1);
+  return root;
+}
+
+bool talloc_share(void *root) {
+  struct owned_arena *found = find_arena_of(root);
+  if (found == NULL || found->root != root) return false;
+  atomic_fetch_add_explicit(&found->references, 1, memory_order_relaxed);
+  return true;
+}
+
+bool talloc_keep(void *ptr, void (*release)(void *)) {
+  if (current_arena == NULL) return false;
+  struct kept *kept = arena_alloc(current_arena->arena, sizeof(struct kept));
+  if (kept == NULL) return false;
+  kept->ptr = ptr;
+  kept->release = release;
+  kept->next = current_arena->kept;
+  current_arena->kept = kept;
+  return true;
+}
+
+bool talloc_reenter_arena(const void *ptr) {
+  struct owned_arena *found = find_arena_of(ptr);
+  if (found == NULL || found->root == NULL) return false;
+  left_arena = current_arena;
+  current_arena = found;
+  return true;
+}
+
+void talloc_leave_arena(void) {
+  current_arena = left_arena;
+  left_arena = NULL;
+}
+
+void *talloc_swap_arena(void *arena) {
+  struct owned_arena *previous = current_arena;
+  current_arena = arena;
+  return previous;
+}
+
 void *new_album(void) {
-  Album album = malloc(sizeof(struct album));
+  Album album = tmalloc(sizeof(struct album));
   RETURN_IF_NULL(album);
-  album->album_type = album->id = album->name = album->release_date = NULL;
+  album->album_type = album->name = album->release_date = NULL;
+  album->id[0] = '\0';
   album->restrictions = NULL;
   album->artists = NULL;
   album->tracks = NULL;
@@ -34,46 +189,48 @@ void *new_album(void) {
 }
 
 void *new_simplified_album(void) {
-  SimplifiedAlbum simplified_album = malloc(sizeof(struct simplified_album));
+  SimplifiedAlbum simplified_album = tmalloc(sizeof(struct simplified_album));
   RETURN_IF_NULL(simplified_album);
   simplified_album->album_type = simplified_album->href = 
-  simplified_album->id = simplified_album->name =
-  simplified_album->release_date = NULL;
+  simplified_album->name = simplified_album->release_date = NULL;
+  simplified_album->id[0] = '\0';
   simplified_album->restrictions = NULL;
   simplified_album->artists = NULL;
   return simplified_album;
 }
 
 void *new_saved_album(void) {
-  SavedAlbum saved_album = malloc(sizeof(struct saved_album));
+  SavedAlbum saved_album = tmalloc(sizeof(struct saved_album));
   RETURN_IF_NULL(saved_album);
+  saved_album->added_at = NULL;
   saved_album->album = NULL;
   return saved_album;
 }
 
 void *new_artist(void) {
-  Artist artist = malloc(sizeof(struct artist));
+  Artist artist = tmalloc(sizeof(struct artist));
   RETURN_IF_NULL(artist);
   artist->followers = NULL;
   artist->genres = NULL;
-  artist->id = artist->name = NULL;
+  artist->name = NULL;
+  artist->id[0] = '\0';
   return artist;
 }
 
 void *new_simplified_artist(void) {
   SimplifiedArtist simplified_artist =
-    malloc(sizeof(struct simplified_artist));
+    tmalloc(sizeof(struct simplified_artist));
   RETURN_IF_NULL(simplified_artist);
-  simplified_artist->href = simplified_artist->id = simplified_artist->name =
-    NULL;
+  simplified_artist->href = simplified_artist->name = NULL;
+  simplified_artist->id[0] = '\0';
   return simplified_artist;
 }
 
 void *new_playlist(void) {
-  Playlist playlist = malloc(sizeof(struct playlist));
+  Playlist playlist = tmalloc(sizeof(struct playlist));
   RETURN_IF_NULL(playlist);
-  playlist->description = playlist->id = playlist->name = 
-  playlist->snapshot_id = NULL;
+  playlist->description = playlist->name = playlist->snapshot_id = NULL;
+  playlist->id[0] = '\0';
   playlist->tracks = NULL;
   playlist->owner = NULL;
   return playlist;
@@ -81,17 +238,18 @@ void *new_playlist(void) {
 
 void *new_simplified_playlist(void) {
   SimplifiedPlaylist simplified_playlist = 
-    malloc(sizeof(struct simplified_playlist));
+    tmalloc(sizeof(struct simplified_playlist));
   RETURN_IF_NULL(simplified_playlist);
   simplified_playlist->description = simplified_playlist->href =
-  simplified_playlist->id = simplified_playlist->name = 
-  simplified_playlist->snapshot_id = simplified_playlist->tracks.href = NULL;
+  simplified_playlist->name = simplified_playlist->snapshot_id =
+  simplified_playlist->tracks.href = NULL;
+  simplified_playlist->id[0] = '\0';
   simplified_playlist->owner = NULL;
   return simplified_playlist;
 }
 
 void *new_playlist_track(void) {
-  PlaylistTrack playlist_track = malloc(sizeof(struct playlist_track));
+  PlaylistTrack playlist_track = tmalloc(sizeof(struct playlist_track));
   RETURN_IF_NULL(playlist_track);
   playlist_track->added_at = playlist_track->added_by.href =
   playlist_track->added_by.id = NULL;
@@ -100,27 +258,29 @@ void *new_playlist_track(void) {
 }
 
 void *new_track(void) {
-  Track track = malloc(sizeof(struct track));
+  Track track = tmalloc(sizeof(struct track));
   RETURN_IF_NULL(track);
   track->album = NULL;
   track->artists = NULL;
-  track->id = track->name = NULL;
+  track->name = NULL;
+  track->id[0] = '\0';
   track->restrictions = NULL;
+  track->pending = NULL;
   return track;
 }
 
 void *new_simplified_track(void) {
-  SimplifiedTrack simplified_track = malloc(sizeof(struct simplified_track));
+  SimplifiedTrack simplified_track = tmalloc(sizeof(struct simplified_track));
   RETURN_IF_NULL(simplified_track);
   simplified_track->artists = NULL;
-  simplified_track->href = simplified_track->id = simplified_track->name =
-    NULL;
+  simplified_track->href = simplified_track->name = NULL;
+  simplified_track->id[0] = '\0';
   simplified_track->restrictions = NULL;
   return simplified_track;
 }
 
 void *new_saved_track(void) {
-  SavedTrack saved_track = malloc(sizeof(struct saved_track));
+  SavedTrack saved_track = tmalloc(sizeof(struct saved_track));
   RETURN_IF_NULL(saved_track);
   saved_track->added_at = NULL;
   saved_track->track = NULL;
@@ -128,7 +288,7 @@ void *new_saved_track(void) {
 }
 
 void *new_user(void) {
-  User user = malloc(sizeof(struct user));
+  User user = tmalloc(sizeof(struct user));
   RETURN_IF_NULL(user);
   user->display_name = user->id = NULL;
   user->followers = NULL;
@@ -136,7 +296,7 @@ void *new_user(void) {
 }
 
 void *new_simplified_user(void) {
-  SimplifiedUser simplified_user = malloc(sizeof(struct simplified_user));
+  SimplifiedUser simplified_user = tmalloc(sizeof(struct simplified_user));
   RETURN_IF_NULL(simplified_user);
   simplified_user->href = simplified_user->id = simplified_user->display_name =
     NULL;
@@ -144,25 +304,26 @@ void *new_simplified_user(void) {
 }
 
 void *new_followers(void) {
-  return malloc(sizeof(struct followers));
+  return tmalloc(sizeof(struct followers));
 }
 
 void *new_page(void) {
-  Page page = malloc(sizeof(struct page));
+  Page page = tmalloc(sizeof(struct page));
   RETURN_IF_NULL(page);
   page->href = page->next = page->items = NULL;
+  page->count = 0;
   return page;
 }
 
 void *new_restrictions(void) {
-  Restrictions restrictions = malloc(sizeof(struct restrictions));
+  Restrictions restrictions = tmalloc(sizeof(struct restrictions));
   RETURN_IF_NULL(restrictions);
   restrictions->reason = NULL;
   return restrictions;
 }
 
 void *new_search(void) {
-  Search search = malloc(sizeof(struct search));
+  Search search = tmalloc(sizeof(struct search));
   RETURN_IF_NULL(search);
   search->tracks = search->artists = search->albums = search->playlists = NULL;
   return search;
@@ -173,7 +334,7 @@ void tfree(void (*free_type)(void *type_struct_ptr), void *type_struct_ptr) {
 }
 
 void free_array(void **array, void (*free_item)(void *item)) {
-  if (array != NULL) {
+  if (array != NULL && !release_arena_of(array)) {
     for (int i = 0; array[i] != NULL; i++) {
       (*free_item)(array[i]);
     }
@@ -183,6 +344,7 @@ void free_array(void **array, void (*free_item)(void *item)) {
 
 void free_album(void *album_ptr) {
   RETURN_VOID_IF_NULL(album_ptr);
+  RETURN_VOID_IF_IN_ARENA(album_ptr);
   Album album = album_ptr;
   free_restrictions(album->restrictions);
   free_array((void **) album->artists, free_simplified_artist);
@@ -190,22 +352,24 @@ void free_album(void *album_ptr) {
     free_array(album->tracks->items, free_simplified_track);
     free_page(album->tracks);
   }
-  free_all(album->album_type, album->id, album->name, 
-           album->release_date, album, NULL);
+  free_string(album->album_type);
+  free_all(album->name, album->release_date, album, NULL);
 }
 
 void free_simplified_album(void *simplified_album_ptr) {
   RETURN_VOID_IF_NULL(simplified_album_ptr);
+  RETURN_VOID_IF_IN_ARENA(simplified_album_ptr);
   SimplifiedAlbum simplified_album = simplified_album_ptr;
   free_restrictions(simplified_album->restrictions);
   free_array((void **) simplified_album->artists, free_simplified_artist);
-  free_all(simplified_album->album_type, simplified_album->href,
-           simplified_album->id, simplified_album->name,
+  free_string(simplified_album->album_type);
+  free_all(simplified_album->href, simplified_album->name,
            simplified_album->release_date, simplified_album, NULL);
 }
 
 void free_saved_album(void *saved_album_ptr) {
   RETURN_VOID_IF_NULL(saved_album_ptr);
+  RETURN_VOID_IF_IN_ARENA(saved_album_ptr);
   SavedAlbum saved_album = saved_album_ptr;
   free_album(saved_album->album);
   free_all(saved_album->added_at, saved_album, NULL);
@@ -213,44 +377,48 @@ void free_saved_album(void *saved_album_ptr) {
 
 void free_artist(void *artist_ptr) {
   RETURN_VOID_IF_NULL(artist_ptr);
+  RETURN_VOID_IF_IN_ARENA(artist_ptr);
   Artist artist = artist_ptr;
   free_followers(artist->followers);
-  free_array((void **) artist->genres, free);
-  free_all(artist->id, artist->name, artist, NULL);
+  free_array((void **) artist->genres, free_string);
+  free_all(artist->name, artist, NULL);
 }
 
 void free_simplified_artist(void *simplified_artist_ptr) {
   RETURN_VOID_IF_NULL(simplified_artist_ptr);
+  RETURN_VOID_IF_IN_ARENA(simplified_artist_ptr);
   SimplifiedArtist simplified_artist = simplified_artist_ptr;
-  free_all(simplified_artist->href, simplified_artist->id,
-           simplified_artist->name, simplified_artist, NULL);
+  free_string(simplified_artist->name);
+  free_all(simplified_artist->href, simplified_artist, NULL);
 }
 
 void free_playlist(void *playlist_ptr) {
   RETURN_VOID_IF_NULL(playlist_ptr);
+  RETURN_VOID_IF_IN_ARENA(playlist_ptr);
   Playlist playlist = playlist_ptr;
   free_simplified_user(playlist->owner);
   IF_NOT_NULL(playlist->tracks) {
     free_array(playlist->tracks->items, free_playlist_track);
     free_page(playlist->tracks);
   }
-  free_all(playlist->description, playlist->id, playlist->name,
-           playlist->snapshot_id, playlist, NULL);
+  free_all(playlist->description, playlist->name, playlist->snapshot_id,
+           playlist, NULL);
 }
 
 void free_simplified_playlist(void *simplified_playlist_ptr) {
   RETURN_VOID_IF_NULL(simplified_playlist_ptr);
+  RETURN_VOID_IF_IN_ARENA(simplified_playlist_ptr);
   SimplifiedPlaylist simplified_playlist = simplified_playlist_ptr;
   free_simplified_user(simplified_playlist->owner);
   free_all(simplified_playlist->description, simplified_playlist->href,
-           simplified_playlist->id, simplified_playlist->name,
-           simplified_playlist->snapshot_id,
+           simplified_playlist->name, simplified_playlist->snapshot_id,
            simplified_playlist->tracks.href, simplified_playlist,
            NULL);
 }
 
 void free_playlist_track(void *playlist_track_ptr) {
   RETURN_VOID_IF_NULL(playlist_track_ptr);
+  RETURN_VOID_IF_IN_ARENA(playlist_track_ptr);
   PlaylistTrack playlist_track = playlist_track_ptr;
   free_track(playlist_track->track);
   free_all(playlist_track->added_at, playlist_track->added_by.href,
@@ -259,24 +427,27 @@ void free_playlist_track(void *playlist_track_ptr) {
 
 void free_track(void *track_ptr) {
   RETURN_VOID_IF_NULL(track_ptr);
+  RETURN_VOID_IF_IN_ARENA(track_ptr);
   Track track = track_ptr;
   free_simplified_album(track->album);
   free_array((void **) track->artists, free_simplified_artist);
   free_restrictions(track->restrictions);
-  free_all(track->id, track->name, track, NULL);
+  free_all(track->name, track, NULL);
 }
 
 void free_simplified_track(void *simplified_track_ptr) {
   RETURN_VOID_IF_NULL(simplified_track_ptr);
+  RETURN_VOID_IF_IN_ARENA(simplified_track_ptr);
   SimplifiedTrack simplified_track = simplified_track_ptr;
   free_array((void **) simplified_track->artists, free_simplified_artist);
   free_restrictions(simplified_track->restrictions);
-  free_all(simplified_track->href, simplified_track->id,
-           simplified_track->name, simplified_track, NULL);
+  free_all(simplified_track->href, simplified_track->name,
+           simplified_track, NULL);
 }
 
 void free_saved_track(void *saved_track_ptr) {
   RETURN_VOID_IF_NULL(saved_track_ptr);
+  RETURN_VOID_IF_IN_ARENA(saved_track_ptr);
   SavedTrack saved_track = saved_track_ptr;
   free_track(saved_track->track);
   free_all(saved_track->added_at, saved_track, NULL);
@@ -284,6 +455,7 @@ void free_saved_track(void *saved_track_ptr) {
 
 void free_user(void *user_ptr) {
   RETURN_VOID_IF_NULL(user_ptr);
+  RETURN_VOID_IF_IN_ARENA(user_ptr);
   User user = user_ptr;
   free_followers(user->followers);
   free_all(user->display_name, user->id, user, NULL);
@@ -291,29 +463,35 @@ void free_user(void *user_ptr) {
 
 void free_simplified_user(void *simplified_user_ptr) {
   RETURN_VOID_IF_NULL(simplified_user_ptr);
+  RETURN_VOID_IF_IN_ARENA(simplified_user_ptr);
   SimplifiedUser simplified_user = simplified_user_ptr;
   free_all(simplified_user->href, simplified_user->id,
            simplified_user->display_name, simplified_user, NULL);
 }
 
 void free_followers(void *followers_ptr) {
+  RETURN_VOID_IF_NULL(followers_ptr);
+  RETURN_VOID_IF_IN_ARENA(followers_ptr);
   free(followers_ptr);
 }
 
 void free_page(void *page_ptr) {
   RETURN_VOID_IF_NULL(page_ptr);
+  RETURN_VOID_IF_IN_ARENA(page_ptr);
   Page page = page_ptr;
   free_all(page->href, page->next, page, NULL);
 }
 
 void free_restrictions(void *restrictions_ptr) {
   RETURN_VOID_IF_NULL(restrictions_ptr);
+  RETURN_VOID_IF_IN_ARENA(restrictions_ptr);
   Restrictions restrictions = restrictions_ptr;
   free_all(restrictions->reason, restrictions, NULL);
 }
 
 void free_search(void *search_ptr) {
   RETURN_VOID_IF_NULL(search_ptr);
+  RETURN_VOID_IF_IN_ARENA(search_ptr);
   Search search = search_ptr;
   IF_NOT_NULL(search->tracks) {
     free_array(search->tracks->items, free_track);
@@ -335,6 +513,44 @@ void free_search(void *search_ptr) {
 }
 
 
+static bool release_arena_of(void *ptr) {
+  struct owned_arena *found = find_arena_of(ptr);
+  if (found == NULL || found->root != ptr) return found != NULL;
+  if (atomic_fetch_sub_explicit(&found->references, 1,
+                                memory_order_acq_rel) > 1) {
+    return true;
+  }
+
+  release_kept(found);
+  arena_reset(found->arena);
+  arena_set_owner(found->arena, NULL);
+
+  pthread_mutex_lock(&arenas_lock);
+  if (spare_arena == NULL) {
+    spare_arena = found->arena;
+  } else free_arena(found->arena);
+  pthread_mutex_unlock(&arenas_lock);
+  free(found);
+  return true;
+}
+
+static struct owned_arena *find_arena_of(const void *ptr) {
+  Arena arena = arena_of(ptr);
+  return arena != NULL ? arena_owner(arena) : NULL;
+}
+
+static void release_kept(struct owned_arena *owned_arena) {
+  for (struct kept *kept = owned_arena->kept; kept != NULL;
+       kept = kept->next) {
+    kept->release(kept->ptr);
+  }
+  owned_arena->kept = NULL;
+}
+
+static void free_string(void *str) {
+  if (!intern_owns(str)) free(str);
+}
+
 static void free_all(void *first_ptr, ...) {
   free(first_ptr);
 
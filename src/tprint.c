@@ -1,10 +1,12 @@
 #include <stdio.h>
+#include "cjson-converters.h"
 #include "tprint.h"
 
 #define BILLION 1000000000
 #define MILLION 1000000
 #define THOUSAND 1000
 
+FILE *print_stream = NULL;
 
 static void _print_album_details(string name, string release_date,
                                  SimplifiedArtist *artists, 
@@ -107,7 +109,7 @@ void print_simplified_playlist_essentials(SimplifiedPlaylist
 }
 
 void print_track_details(Track track) {
-  _print_track_details(track->name, track->duration_ms, track->artists);
+  _print_track_details(track->name, track->duration_ms, track_artists(track));
   print_empty_line();
 }
 
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
@@ -7,13 +8,11 @@
 #include "tprint.h"
 #include "readers.h"
 #include "helpers.h"
+#include "cjson-converters.h"
 #include "type-handlers.h"
 
-#define IS_NULL(ptr) (ptr == NULL)
-
-extern SimplifiedPlaylist *owned_playlists,
-                          *followed_playlists;
-extern Artist *followed_artists;
+extern SizedArray owned_playlists, followed_playlists;
+extern SizedArray followed_artists;
 
 void handle_album(Album album) {
   if (IS_NULL(album)) return;
@@ -45,8 +44,7 @@ void handle_album(Album album) {
     bool success = false;
     int choice = read_integer(stdin, &success);
     if (!success) return;
-    int len = 0;
-    while (!IS_NULL(album->artists[len])) len++;
+    int len = array_length(album->artists);
     if (choice < 1 || choice > len) return;
 
     Artist artist = query_get_artist(album->artists[choice - 1]->id);
@@ -59,11 +57,20 @@ void handle_album(Album album) {
       Page page = !offset
         ? album->tracks
         : query_get_album_tracks(album->id, offset);
+      query_cancel_prefetches();
+      if (query_failed(page)) break;
       is_last_page = page->limit + offset >= page->total;
       SimplifiedTrack *simplified_tracks = page->items; 
 
       print_array(simplified_tracks,
                   print_simplified_track_essentials);
+      if (!is_last_page) {
+        query_prefetch_album_tracks(album->id, offset + page->limit);
+      }
+      for (int i = 0;
+           i < PREFETCHED_RESULTS && !IS_NULL(simplified_tracks[i]); i++) {
+        query_prefetch_track(simplified_tracks[i]->id);
+      }
       print_to_stream("Enter track's number%s ",
                       is_last_page
                         ? ":"
@@ -79,8 +86,7 @@ void handle_album(Album album) {
           } else offset += page->limit;
           continue;
         }
-        int tracks_count = 0;
-        while (!IS_NULL(simplified_tracks[tracks_count])) tracks_count++;
+        int tracks_count = page->count;
         if (choice >= 1 && choice <= tracks_count) {
           SimplifiedTrack simplified_track = simplified_tracks[choice - 1];
           Track track = query_get_track(simplified_track->id);
@@ -94,6 +100,7 @@ void handle_album(Album album) {
       }
       break;
     } while (!is_last_page);
+    query_cancel_prefetches();
   }
 }
 
@@ -111,7 +118,10 @@ void handle_artist(Artist artist) {
     add_item(ptr_array, artist);
 
     query_put_follow_artists((Artist *) get_array(ptr_array));
-    update_followed_artists();
+    if (!last_query_failed()) {
+      add_followed_artist(artist);
+      print_to_stream("\nArtist followed\n");
+    }
 
     free_ptr_array(ptr_array, false, NULL);
   } else if (option == 1) {
@@ -119,9 +129,18 @@ void handle_artist(Artist artist) {
     size_t offset = 0;
     do {
       Page page = query_get_artist_albums(artist->id, offset);
+      query_cancel_prefetches();
+      if (query_failed(page)) break;
       SimplifiedAlbum *simplified_albums = page->items;
       print_array(simplified_albums, print_simplified_album_essentials);
       is_last_page = page->limit + offset >= page->total;
+      if (!is_last_page) {
+        query_prefetch_artist_albums(artist->id, offset + page->limit);
+      }
+      for (int i = 0;
+           i < PREFETCHED_RESULTS && !IS_NULL(simplified_albums[i]); i++) {
+        query_prefetch_album(simplified_albums[i]->id);
+      }
       print_to_stream("Enter albums's number%s ",
                       is_last_page 
                         ? ":" 
@@ -134,8 +153,7 @@ void handle_artist(Artist artist) {
           tfree(free_page, page);
           continue;
         }
-        int count_albums = 0;
-        while (!IS_NULL(simplified_albums[count_albums])) count_albums++;
+        int count_albums = page->count;
         if (choice >= 1 && choice <= count_albums) {
           Album album = query_get_album(simplified_albums[choice - 1]->id);
           handle_album(album);
@@ -145,15 +163,16 @@ void handle_artist(Artist artist) {
       tfree(free_page, page);
       break;
     } while (!is_last_page);
+    query_cancel_prefetches();
   } else if (option == 2) {
     Track *tracks = query_get_artist_top_tracks(artist->id);
+    if (query_failed(tracks)) return;
     print_array(tracks, print_track_essentials);
     print_to_stream("Enter track's number: ");
     bool success = false;
     int choice = read_integer(stdin, &success);
     if (success) {
-      int count_tracks = 0;
-      while (!IS_NULL(tracks[count_tracks])) count_tracks++;
+      int count_tracks = array_length(tracks);
       if (choice >= 1 && choice <= count_tracks) {
         handle_track(tracks[choice - 1]);
       }
@@ -172,30 +191,39 @@ void handle_playlist(Playlist playlist) {
 
   if (option == 0) {
     query_put_follow_playlist(playlist);
-    update_playlists();
-    print_to_stream("\nPlaylist Followed\n");
+    if (!last_query_failed()) {
+      add_followed_playlist(playlist);
+      print_to_stream("\nPlaylist Followed\n");
+    }
   } else if (option == 1) {
-    bool is_last_page = false;
     size_t offset = 0;
+    bool is_last_page = false;
     do {
-      Page page = !offset 
-        ? playlist->tracks 
+      Page page = !offset
+        ? playlist->tracks
         : query_get_playlist_tracks(playlist->id, offset);
+      query_cancel_prefetches();
+      if (query_failed(page)) break;
       is_last_page = page->limit + offset >= page->total;
-      PtrArray ptr_array = new_ptr_array();
       PlaylistTrack *items = page->items;
-      for (int i = 0; !IS_NULL(items[i]); i++) {
-        PlaylistTrack playlist_track = items[i];
-        add_item(ptr_array, playlist_track->track);
+
+      PtrArray ptr_array = new_ptr_array();
+      reserve_ptr_array(ptr_array, page->count);
+      for (size_t i = 0; i < page->count; i++) {
+        add_item(ptr_array, items[i]->track);
       }
       Track *tracks = (Track *) get_array(ptr_array);
       print_array(tracks, print_track_essentials);
-      free_ptr_array(ptr_array, false, NULL);
-      if (IS_NULL(tracks[0])) {
+      int tracks_count = get_size(ptr_array);
+      free_ptr_array(ptr_array, true, NULL);
+      if (!tracks_count) {
         print_to_stream("\nNo track in playlist\n");
-        tfree(free_page, page);
+        if (offset) tfree(free_page, page);
         break;
       }
+      if (!is_last_page) {
+        query_prefetch_playlist_tracks(playlist->id, offset + page->limit);
+      }
       print_to_stream("Enter track's number%s ",
                       is_last_page 
                         ? ":" 
@@ -211,11 +239,8 @@ void handle_playlist(Playlist playlist) {
           } else offset += page->limit;
           continue;
         }
-        int count_tracks = 0;
-        while (!IS_NULL(items[count_tracks])) count_tracks++;
-        if (choice >= 1 && choice <= count_tracks) {
-          PlaylistTrack playlist_track = items[choice - 1];
-          handle_track(playlist_track->track);
+        if (choice >= 1 && choice <= tracks_count) {
+          handle_track(items[choice - 1]->track);
         }
       }
       if (offset) {
@@ -224,15 +249,17 @@ void handle_playlist(Playlist playlist) {
       }
       break;
     } while (!is_last_page);
+    query_cancel_prefetches();
   }
 }
 
 
 void handle_track(Track track) {
   if (IS_NULL(track)) return;
-  if (!IS_NULL(track->restrictions)) {
+  Restrictions restrictions = track_restrictions(track);
+  if (!IS_NULL(restrictions)) {
     print_to_stream("\nThe track is restricted for the following reason: %s\n",
-                    track->restrictions->reason);
+                    restrictions->reason);
     print_to_stream("Some options might be unavailable due to the restriction."
                     "Do you still want to access to the track? (y/n) ");
     bool answer = read_bool(stdin);
@@ -246,42 +273,49 @@ void handle_track(Track track) {
                                     "Learn more about one of the artists");
 
   if (option == 0) {
-    print_array(owned_playlists, print_simplified_playlist_essentials);
+    SimplifiedPlaylist *playlists =
+      (SimplifiedPlaylist *) owned_playlists.items;
+    print_array(playlists, print_simplified_playlist_essentials);
     print_to_stream("Enter playlist's number: ");
     bool success;
     int choice = read_integer(stdin, &success);
     if (success) {
-      int count_playlists = 0;
-      while (owned_playlists[count_playlists] != NULL) count_playlists++;
+      int count_playlists = owned_playlists.length;
       if (choice >= 1 && choice <= count_playlists) {
-        Playlist playlist = 
-          query_get_playlist(owned_playlists[choice - 1]->id);
+        Playlist playlist = query_get_playlist(playlists[choice - 1]->id);
+        if (query_failed(playlist)) return;
         PtrArray ptr_array = new_ptr_array();
         add_item(ptr_array, track);
-        query_post_playlist_tracks(playlist, (Track *) get_array(ptr_array));
-        print_to_stream("\nTrack added to playlist\n");
-        update_playlists();
+        string snapshot_id =
+          query_post_playlist_tracks(playlist, (Track *) get_array(ptr_array));
+        if (!last_query_failed()) {
+          struct playlist patched = *playlist;
+          if (!IS_NULL(snapshot_id)) patched.snapshot_id = snapshot_id;
+          patch_playlist(&patched, 1);
+          print_to_stream("\nTrack added to playlist\n");
+        }
+        free(snapshot_id);
 
         tfree(free_playlist, playlist);
         free_ptr_array(ptr_array, false, NULL);
       }
     }
   } else if (option == 1) {
-    Album album = query_get_album(track->album->id);
+    Album album = query_get_album(track_album(track)->id);
     handle_album(album);
     tfree(free_album, album);
   } else if (option == 2) {
-    print_array(track->artists, print_simplified_artist_essentials);
+    SimplifiedArtist *artists = track_artists(track);
+    print_array(artists, print_simplified_artist_essentials);
     
     print_to_stream("Enter artist's number: ");
     bool success = false;
     int choice = read_integer(stdin, &success);
     
     if (!success) return;
-    int count_artists = 0;
-    while (!IS_NULL(track->artists[count_artists])) count_artists++;
+    int count_artists = array_length(artists);
     if (choice >= 1 && choice <= count_artists) {
-      Artist artist = query_get_artist(track->artists[choice - 1]->id);
+      Artist artist = query_get_artist(artists[choice - 1]->id);
       handle_artist(artist);
       tfree(free_artist, artist);
     }
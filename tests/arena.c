@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "arena.h"
+
+Arena arena = NULL;
+
+static void setup(void) {
+  arena = new_arena();
+  if (arena == NULL) exit(EXIT_FAILURE);
+}
+
+static void teardown(void) {
+  free_arena(arena);
+}
+
+Test(new_arena, returns_pointer_to_arena_structure, .fini = teardown) {
+  arena = new_arena();
+  cr_expect(arena != NULL,
+            "Expected arena to point to a new arena structure");
+}
+
+Test(arena_alloc, returns_distinct_aligned_pointers,
+     .init = setup, .fini = teardown) {
+  char *first = arena_alloc(arena, 3);
+  double *second = arena_alloc(arena, sizeof(double));
+  cr_assert(first != NULL && second != NULL,
+            "Expected arena_alloc to return non-null pointers");
+  cr_expect((void *) first != (void *) second,
+            "Expected arena_alloc to return distinct pointers");
+  cr_expect(zero(sz, (uintptr_t) second % _Alignof(max_align_t)),
+            "Expected arena_alloc to return aligned pointers");
+}
+
+Test(arena_alloc, allocates_blocks_larger_than_a_chunk,
+     .init = setup, .fini = teardown) {
+  size_t size = 1024 * 1024;
+  char *block = arena_alloc(arena, size);
+  cr_assert(block != NULL, "Expected arena_alloc to return a non-null pointer");
+  block[size - 1] = '\0';
+  cr_expect(arena_owns(arena, block + size - 1),
+            "Expected arena to own the whole block");
+}
+
+Test(arena_owns, returns_whether_pointer_was_allocated_from_arena,
+     .init = setup, .fini = teardown) {
+  int local = 0;
+  int *allocated = arena_alloc(arena, sizeof(int));
+  cr_expect(arena_owns(arena, allocated),
+            "Expected arena to own memory allocated from it");
+  cr_expect(not(arena_owns(arena, &local)),
+            "Expected arena not to own memory allocated elsewhere");
+}
+
+Test(arena_of, returns_arena_pointer_was_allocated_from,
+     .init = setup, .fini = teardown) {
+  int local = 0;
+  size_t size = 1024 * 1024;
+  char *block = arena_alloc(arena, size);
+  cr_assert(block != NULL, "Expected arena_alloc to return a non-null pointer");
+  cr_expect(arena_of(block + size - 1) == arena,
+            "Expected arena_of to return the arena of the whole block");
+  cr_expect(arena_of(&local) == NULL,
+            "Expected arena_of to return null for memory allocated elsewhere");
+}
+
+Test(arena_reset, releases_everything_allocated_from_arena,
+     .init = setup, .fini = teardown) {
+  int *allocated = arena_alloc(arena, sizeof(int));
+  arena_reset(arena);
+  cr_expect(not(arena_owns(arena, allocated)),
+            "Expected arena not to own memory allocated before reset");
+  cr_expect(arena_alloc(arena, sizeof(int)) != NULL,
+            "Expected arena to be reusable after reset");
+}
+
+Test(free_arena, removes_its_chunks_from_lookups) {
+  arena = new_arena();
+  cr_assert(arena != NULL, "Expected arena to be created");
+  int *allocated = arena_alloc(arena, sizeof(int));
+  free_arena(arena);
+  cr_expect(arena_of(allocated) == NULL,
+            "Expected arena_of to return null once the arena is released");
+}
@@ -4,6 +4,7 @@
 #include <criterion/new/assert.h>
 #include <cjson/cJSON.h>
 #include "tmem.h"
+#include "intern.h"
 #include "cjson-converters.h"
 
 #define ML_JSON 500
@@ -173,6 +174,8 @@ Test(cJSON_to_simplified_artist, creates_simplified_artist_structure,
             "Expected simplified artist's id to be %s", ID);
   cr_expect(eq(str, simplified_artist->name, ARTIST_NAME),
             "Expected simplified artist's name to be %s", ARTIST_NAME);
+  cr_expect(intern_owns(simplified_artist->name),
+            "Expected simplified artist's name to be interned");
   free_function = free_simplified_artist;
 }
 
@@ -271,6 +274,36 @@ Test(cJSON_to_track, terminates_program_when_given_invalid_data,
   free_function = free_track;
 }
 
+Test(cJSON_begin_lazy, converts_track_members_on_first_access,
+     .fini = teardown) {
+  cJSON *cJSON_track = cJSON_ParseWithOpts(get_track_json(), 0, 0);
+
+  cr_assert(talloc_begin_arena(), "Expected arena to be started");
+  cr_assert(cJSON_begin_lazy(cJSON_track),
+            "Expected the arena to take the cJSON tree");
+  Track track = cJSON_to_track(cJSON_track);
+  cJSON_end_lazy();
+  type_struct_ptr = talloc_end_arena(track);
+  free_function = free_track;
+
+  cr_expect(eq(str, track->name, TRACK_NAME),
+            "Expected track's name to be %s", TRACK_NAME);
+  cr_expect(track->album == NULL,
+            "Expected track's album not to be converted yet");
+  SimplifiedAlbum album = track_album(track);
+  cr_expect(album != NULL && eq(str, album->name, ALBUM_NAME),
+            "Expected track's album to be converted on access");
+  cr_expect(track_restrictions(track) != NULL,
+            "Expected track's restrictions to be converted");
+}
+
+Test(cJSON_begin_lazy, fails_without_current_arena, .fini = teardown) {
+  cjson_ptr = cJSON_ParseWithOpts(get_track_json(), 0, 0);
+
+  cr_expect(!cJSON_begin_lazy(cjson_ptr),
+            "Expected lazy conversion to require an arena");
+}
+
 Test(cJSON_to_simplified_track, creates_simplified_track_structure, 
      .fini = teardown) {
   cJSON *cJSON_simplified_track = cjson_ptr =
@@ -381,6 +414,7 @@ Test(cJSON_to_page, creates_page_structure, .fini = teardown) {
   cr_expect(eq(str, page->href, HREF),
             "Expected page's href to be %s", HREF);
   cr_expect(page->items != NULL, "Expected page's items array to be created");
+  cr_expect(zero(sz, page->count), "Expected page to count no items");
   free_function = free_page;
 }
 
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "tmem.h"
+#include "entity-cache.h"
+
+#define ID "4aawyAB9vmqN3uQ7FjRGTy"
+#define OTHER_ID "0sNOF9WDwhWunNAHPD3Baj"
+
+static int conversions = 0;
+
+static void *to_followers(cJSON *item) {
+  conversions++;
+  Followers followers = new_followers();
+  followers->total = cJSON_GetArraySize(item);
+  return followers;
+}
+
+static cJSON *new_entity(string id) {
+  cJSON *entity = cJSON_CreateObject();
+  cJSON_AddStringToObject(entity, "id", id);
+  return entity;
+}
+
+static void put_entity(enum entity_type type, string id) {
+  free_followers(entity_cache_put(type, id, new_entity(id), to_followers,
+                                  free_followers));
+}
+
+static void setup(void) {
+  conversions = 0;
+  entity_cache_set_budget(ENTITY_CACHE_BUDGET);
+}
+
+static void teardown(void) {
+  entity_cache_clear();
+}
+
+TestSuite(entity_cache, .init = setup, .fini = teardown);
+
+Test(entity_cache, returns_null_when_entity_isnt_cached) {
+  cr_expect(entity_cache_get(ENTITY_ALBUM, ID) == NULL,
+            "Expected entity_cache_get to return null");
+  cr_expect(eq(sz, entity_cache_get_stats().misses, 1),
+            "Expected lookup to be counted as a miss");
+}
+
+Test(entity_cache, returns_cached_entity_without_converting_it_again) {
+  Followers stored = entity_cache_put(ENTITY_ALBUM, ID, new_entity(ID),
+                                      to_followers, free_followers);
+  cr_assert(stored != NULL, "Expected entity to be converted");
+  cr_expect(eq(sz, entity_cache_get_stats().entries, 1),
+            "Expected entity to be stored");
+  free_followers(stored);
+
+  Followers cached = entity_cache_get(ENTITY_ALBUM, ID);
+  cr_assert(cached == stored, "Expected the stored entity to be returned");
+  cr_expect(eq(sz, cached->total, 1),
+            "Expected cached entity to have 1 field");
+  cr_expect(eq(int, conversions, 1),
+            "Expected entity to be converted once");
+  cr_expect(eq(sz, entity_cache_get_stats().hits, 1),
+            "Expected lookup to be counted as a hit");
+  free_followers(cached);
+}
+
+Test(entity_cache, keeps_entity_released_by_every_caller) {
+  put_entity(ENTITY_ALBUM, ID);
+  free_followers(entity_cache_get(ENTITY_ALBUM, ID));
+  Followers cached = entity_cache_get(ENTITY_ALBUM, ID);
+  cr_assert(cached != NULL, "Expected entity to be found");
+  cr_expect(eq(sz, cached->total, 1),
+            "Expected cached entity to be kept");
+  entity_cache_remove(ENTITY_ALBUM, ID);
+  cr_expect(eq(sz, cached->total, 1),
+            "Expected removed entity to be kept until released");
+  free_followers(cached);
+}
+
+Test(entity_cache, keys_entities_by_type_and_id) {
+  put_entity(ENTITY_ALBUM, ID);
+  cr_expect(entity_cache_get(ENTITY_TRACK, ID) == NULL,
+            "Expected entity of another type not to be found");
+  cr_expect(entity_cache_get(ENTITY_ALBUM, OTHER_ID) == NULL,
+            "Expected entity with another id not to be found");
+}
+
+Test(entity_cache, tells_whether_entity_is_cached) {
+  put_entity(ENTITY_ARTIST, ID);
+  cr_expect(entity_cache_contains(ENTITY_ARTIST, ID),
+            "Expected cached entity to be found");
+  cr_expect(not(entity_cache_contains(ENTITY_ARTIST, OTHER_ID)),
+            "Expected entity with another id not to be found");
+  cr_expect(zero(sz, entity_cache_get_stats().hits),
+            "Expected lookups not to be counted");
+}
+
+Test(entity_cache, removes_entity) {
+  put_entity(ENTITY_PLAYLIST, ID);
+  entity_cache_remove(ENTITY_PLAYLIST, ID);
+  cr_expect(entity_cache_get(ENTITY_PLAYLIST, ID) == NULL,
+            "Expected removed entity not to be found");
+  cr_expect(zero(sz, entity_cache_get_stats().entries),
+            "Expected cache to be empty");
+}
+
+Test(entity_cache, evicts_least_recently_used_entity) {
+  put_entity(ENTITY_ARTIST, ID);
+  size_t entity_bytes = entity_cache_get_stats().bytes;
+  entity_cache_set_budget(entity_bytes * 2);
+  put_entity(ENTITY_ARTIST, OTHER_ID);
+  free_followers(entity_cache_get(ENTITY_ARTIST, ID));
+
+  put_entity(ENTITY_TRACK, ID);
+  cr_expect(eq(sz, entity_cache_get_stats().evictions, 1),
+            "Expected one entity to be evicted");
+  Followers cached = entity_cache_get(ENTITY_ARTIST, ID);
+  cr_expect(cached != NULL,
+            "Expected recently used entity to be kept");
+  free_followers(cached);
+  cr_expect(entity_cache_get(ENTITY_ARTIST, OTHER_ID) == NULL,
+            "Expected least recently used entity to be evicted");
+}
+
+Test(entity_cache, refuses_entity_bigger_than_budget) {
+  entity_cache_set_budget(0);
+  Followers followers = entity_cache_put(ENTITY_TRACK, ID, new_entity(ID),
+                                         to_followers, free_followers);
+  cr_expect(followers != NULL, "Expected entity to be converted");
+  cr_expect(zero(sz, entity_cache_get_stats().entries),
+            "Expected entity not to be stored");
+  free_followers(followers);
+}
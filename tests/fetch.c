@@ -1,20 +1,96 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include <criterion/criterion.h>
 #include <criterion/new/assert.h>
 #include <fff/fff.h>
 #include <curl/curl.h>
+#include "tmem.h"
 #include "fetch.h"
 
 DEFINE_FFF_GLOBALS;
 
 #define OBJ_PROPERTY "property"
 #define OBJ_VALUE "value"
+#define JSON_TEMPLATE "/tmp/cmusic-fetch-test-XXXXXX"
+#define PAGE_TEMPLATE "/tmp/cmusic-fetch-test-page-XXXXXX"
+#define MISSING_URL "file:///tmp/cmusic-fetch-test-missing.json"
 
 FAKE_VALUE_FUNC(CURLcode, curl_easy_perform, CURL *);
 FAKE_VALUE_FUNC(cJSON *, cJSON_Parse, const char *);
 
 cJSON *cjson_object = NULL;
 
+extern long (*limiter_clock)(void);
+extern void (*limiter_sleep)(long wait_ms);
+
+static long clock_ms = 0;
+static long waits_ms[8];
+static size_t waits = 0;
+
+static char json_path[] = JSON_TEMPLATE;
+static char json_url[sizeof("file://") + sizeof(json_path)];
+
+static char page_path[] = PAGE_TEMPLATE;
+static char page_url[sizeof("file://") + sizeof(page_path)];
+
+static cJSON *parse_json(const char *value) {
+  return cJSON_ParseWithOpts(value, NULL, false);
+}
+
+static void create_json_file(string path, string template, string url,
+                             string content) {
+  strcpy(path, template);
+  int fd = mkstemp(path);
+  if (fd == -1) exit(EXIT_FAILURE);
+  FILE *json_file = fdopen(fd, "w");
+  if (json_file == NULL) exit(EXIT_FAILURE);
+  fputs(content, json_file);
+  fclose(json_file);
+  sprintf(url, "file://%s", path);
+}
+
+static long read_clock(void) {
+  return clock_ms;
+}
+
+static void record_wait(long wait_ms) {
+  if (waits < sizeof(waits_ms) / sizeof(*waits_ms)) {
+    waits_ms[waits++] = wait_ms;
+  }
+  clock_ms += wait_ms;
+}
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool started;
+} perform = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static CURLcode perform_until_coalesced(CURL *curl) {
+  size_t coalesced = fetch_get_stats().coalesced_requests;
+  pthread_mutex_lock(&perform.lock);
+  perform.started = true;
+  pthread_cond_broadcast(&perform.cond);
+  pthread_mutex_unlock(&perform.lock);
+  while (fetch_get_stats().coalesced_requests == coalesced) sched_yield();
+  return CURLE_OK;
+}
+
+static void *fetch_in_thread(void *url) {
+  return fetch(url, "GET", NULL);
+}
+
+static void count_call(FetchRequest request, void *calls) {
+  (*(int *) calls)++;
+}
+
 static void setup(void) {
   RESET_FAKE(cJSON_Parse);
   RESET_FAKE(curl_easy_perform);
@@ -28,6 +104,17 @@ static void setup(void) {
   curl_easy_perform_fake.return_val = CURLE_OK;
 }
 
+static void setup_parsing(void) {
+  setup();
+  cJSON_Parse_fake.custom_fake = parse_json;
+  create_json_file(json_path, JSON_TEMPLATE, json_url,
+                   "{\"" OBJ_PROPERTY "\": \"" OBJ_VALUE "\"}");
+}
+
+static void teardown_parsing(void) {
+  unlink(json_path);
+}
+
 TestSuite(fetch, .init = setup);
 
 Test(fetch, fetches_api_using_curl_easy_perform) {
@@ -40,7 +127,8 @@ Test(fetch, returns_json_parsed_with_cjson) {
   cJSON *cjson_returned = fetch("https://test.com", "GET", NULL);
   cr_assert(cjson_returned != NULL, 
             "Expected fetch to return non-null content");
-  cJSON *str_item = cJSON_GetObjectItemCaseSensitive(cjson_returned, OBJ_PROPERTY);
+  cJSON *str_item = cJSON_GetObjectItemCaseSensitive(cjson_returned,
+                                                     OBJ_PROPERTY);
   cr_assert(cJSON_IsString(str_item), "Expected str_item to be a string");
   cr_expect(eq(str, str_item->string, OBJ_PROPERTY),
             "Expected str_item property to be %s", OBJ_PROPERTY);
@@ -48,13 +136,236 @@ Test(fetch, returns_json_parsed_with_cjson) {
             "Expected str_item value to be %s", OBJ_VALUE);
 }
 
-Test(fetch, terminate_program_on_curl_error, .exit_code = EXIT_FAILURE, 
-     .description = "Test") {
+static long get_error_status(cJSON *response) {
+  cJSON *error = cJSON_GetObjectItemCaseSensitive(response, "error");
+  cJSON *status = cJSON_GetObjectItemCaseSensitive(error, "status");
+  return cJSON_IsNumber(status) ? status->valueint : -1;
+}
+
+Test(fetch, returns_error_on_curl_error) {
   curl_easy_perform_fake.return_val = (CURLcode) CURLE_OK + 1;
-  fetch("https://test.com", "GET", NULL);
+  cJSON *response = fetch("https://test.com", "GET", NULL);
+  cr_expect(eq(long, get_error_status(response), 0),
+            "Expected fetch to return an error with a status of 0");
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 1),
+            "Expected request not to be retried");
+  cJSON_Delete(response);
+}
+
+Test(fetch, retries_get_request_on_transient_error) {
+  fetch_set_max_attempts(3);
+  curl_easy_perform_fake.return_val = CURLE_COULDNT_CONNECT;
+  cJSON *response = fetch("https://test.com", "GET", NULL);
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 3),
+            "Expected request to be made 3 times");
+  cr_expect(eq(long, get_error_status(response), 0),
+            "Expected fetch to return an error once attempts are exhausted");
+  cJSON_Delete(response);
+}
+
+Test(fetch, doesnt_retry_non_get_request) {
+  curl_easy_perform_fake.return_val = CURLE_COULDNT_CONNECT;
+  cJSON_Delete(fetch("https://test.com", "POST", "{}"));
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 1),
+            "Expected POST request not to be retried");
 }
 
 Test(fetch, terminate_program_when_invalid_method_is_passed, 
      .exit_code = EXIT_FAILURE) {
   fetch("https://test.com", "METHOD", NULL);
 }
+
+Test(fetch, coalesces_identical_get_requests_in_flight) {
+  curl_easy_perform_fake.custom_fake = perform_until_coalesced;
+  size_t coalesced = fetch_get_stats().coalesced_requests;
+  char url[] = "https://test.com";
+  pthread_t thread;
+  cr_assert(eq(int, pthread_create(&thread, NULL, fetch_in_thread, url), 0),
+            "Expected thread to be created");
+  pthread_mutex_lock(&perform.lock);
+  while (!perform.started) pthread_cond_wait(&perform.cond, &perform.lock);
+  pthread_mutex_unlock(&perform.lock);
+  fetch(url, "GET", NULL);
+  pthread_join(thread, NULL);
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 1),
+            "Expected a single request to be made");
+  cr_expect(eq(sz, fetch_get_stats().coalesced_requests, coalesced + 1),
+            "Expected the identical request to be coalesced");
+}
+
+Test(fetch, limits_rate_of_requests) {
+  limiter_clock = read_clock;
+  limiter_sleep = record_wait;
+  fetch_set_rate_limit(2);
+  for (int i = 0; i < 4; i++) {
+    fetch("https://test.com", "GET", NULL);
+  }
+  cr_assert(eq(sz, waits, 2),
+            "Expected the 2 requests over the burst to wait");
+  cr_expect(eq(long, waits_ms[0], 501),
+            "Expected the first request to wait for a token to be refilled");
+  cr_expect(waits_ms[1] >= 499 && waits_ms[1] <= 501,
+            "Expected the second request to wait for the next token");
+}
+
+TestSuite(fetch_many, .init = setup_parsing, .fini = teardown_parsing);
+
+Test(fetch_many, returns_one_parsed_response_per_url) {
+  string urls[] = { json_url, json_url, NULL };
+  cJSON **responses = fetch_many(urls, "GET", NULL);
+  cr_assert(responses != NULL, "Expected fetch_many to return responses");
+  for (int i = 0; urls[i] != NULL; i++) {
+    cJSON *str_item = cJSON_GetObjectItemCaseSensitive(responses[i],
+                                                       OBJ_PROPERTY);
+    cr_assert(cJSON_IsString(str_item), "Expected str_item to be a string");
+    cr_expect(eq(str, str_item->valuestring, OBJ_VALUE),
+              "Expected str_item value to be %s", OBJ_VALUE);
+    cJSON_Delete(responses[i]);
+  }
+  free(responses);
+}
+
+Test(fetch_submit, calls_callback_once_request_is_done) {
+  int calls = 0;
+  FetchRequest request = new_fetch_request("file:///dev/null", "GET", NULL);
+  cr_assert(request != NULL, "Expected request to be created");
+  cr_assert(fetch_submit(request, count_call, &calls),
+            "Expected request to be submitted");
+  fetch_wait(request);
+  cr_expect(fetch_is_done(request), "Expected request to be done");
+  cr_expect(eq(int, calls, 1), "Expected callback to have been called once");
+  free_fetch_request(request);
+}
+
+Test(fetch_many, records_stats_of_each_request) {
+  string urls[] = { "file:///dev/null", "file:///dev/null", NULL };
+  size_t requests = fetch_get_stats().requests;
+  free(fetch_many(urls, "GET", NULL));
+  cr_expect(eq(sz, fetch_get_stats().requests, requests + 2),
+            "Expected stats to count every request");
+}
+
+Test(fetch_many, records_stats_of_requests_to_different_urls) {
+  string urls[] = { json_url, "file:///dev/null", NULL };
+  size_t requests = fetch_get_stats().requests;
+  cJSON **responses = fetch_many(urls, "GET", NULL);
+  cJSON_Delete(responses[0]);
+  free(responses);
+  cr_expect(eq(sz, fetch_get_stats().requests, requests + 2),
+            "Expected stats to count the request to each url");
+}
+
+TestSuite(fetch_prefetch, .init = setup_parsing, .fini = teardown_parsing);
+
+Test(fetch_prefetch, returns_prefetched_response_to_fetch) {
+  size_t hits = fetch_get_stats().prefetch_hits;
+  cr_assert(fetch_prefetch(json_url), "Expected url to be prefetched");
+  cJSON *response = fetch(json_url, "GET", NULL);
+  cJSON *str_item = cJSON_GetObjectItemCaseSensitive(response, OBJ_PROPERTY);
+  cr_assert(cJSON_IsString(str_item), "Expected str_item to be a string");
+  cr_expect(eq(str, str_item->valuestring, OBJ_VALUE),
+            "Expected str_item value to be %s", OBJ_VALUE);
+  cr_expect(eq(sz, fetch_get_stats().prefetch_hits, hits + 1),
+            "Expected prefetched response to be used");
+  cJSON_Delete(response);
+}
+
+Test(fetch_prefetch, doesnt_prefetch_over_budget) {
+  fetch_set_prefetch_budget(1);
+  size_t skipped = fetch_get_stats().skipped_prefetches;
+  cr_expect(fetch_prefetch(json_url), "Expected url to be prefetched");
+  cr_expect(not(fetch_prefetch("file:///dev/null")),
+            "Expected url over the budget not to be prefetched");
+  cr_expect(eq(sz, fetch_get_stats().skipped_prefetches, skipped + 1),
+            "Expected prefetch over the budget to be counted as skipped");
+  fetch_cancel_prefetches();
+  fetch_set_prefetch_budget(PREFETCH_BUDGET);
+}
+
+Test(fetch_prefetch, doesnt_return_cancelled_response) {
+  size_t cancelled = fetch_get_stats().cancelled_prefetches;
+  cr_assert(fetch_prefetch(MISSING_URL),
+            "Expected url to be prefetched");
+  fetch_cancel_prefetches();
+  cr_expect(eq(sz, fetch_get_stats().cancelled_prefetches, cancelled + 1),
+            "Expected prefetch to be cancelled");
+  cJSON_Delete(fetch(MISSING_URL, "GET", NULL));
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 1),
+            "Expected request to be made again once cancelled");
+}
+
+static void setup_page(void) {
+  setup();
+  cJSON_Parse_fake.custom_fake = parse_json;
+  create_json_file(page_path, PAGE_TEMPLATE, page_url,
+                   "{\"items\": [1, 2], \"limit\": 2, \"total\": 5, "
+                   "\"next\": \"next\"}");
+}
+
+static void teardown_page(void) {
+  unlink(page_path);
+}
+
+TestSuite(fetch_all_pages, .init = setup_page, .fini = teardown_page);
+
+Test(fetch_all_pages, appends_items_of_remaining_pages) {
+  size_t requests = fetch_get_stats().requests;
+  cJSON *page = fetch_all_pages(page_url, 2, 1);
+  cJSON *items = cJSON_GetObjectItemCaseSensitive(page, "items");
+  cr_assert(cJSON_IsArray(items), "Expected page to hold items");
+  cr_expect(eq(int, cJSON_GetArraySize(items), 6),
+            "Expected the items of the 3 pages to be appended");
+  cr_expect(cJSON_IsNull(cJSON_GetObjectItemCaseSensitive(page, "next")),
+            "Expected page not to have a next page");
+  cr_expect(eq(sz, fetch_get_stats().requests, requests + 3),
+            "Expected a request to be made for each page");
+  cJSON_Delete(page);
+}
+
+Test(fetch_all_pages, returns_error_when_a_page_fails) {
+  cJSON *page = fetch_all_pages(MISSING_URL, 2, 2);
+  cr_expect(eq(long, get_error_status(page), 0),
+            "Expected fetch_all_pages to return an error");
+  cJSON_Delete(page);
+}
+
+static void setup_struct(void) {
+  setup();
+  cJSON_Parse_fake.custom_fake = parse_json;
+  create_json_file(json_path, JSON_TEMPLATE, json_url,
+                   "{\"display_name\": \"Name\", \"followers\": "
+                   "{\"href\": null, \"total\": 1}, \"id\": \"user\"}");
+}
+
+TestSuite(fetch_struct, .init = setup_struct, .fini = teardown_parsing);
+
+Test(fetch_struct, converts_response_without_parsing_it) {
+  cJSON *error;
+  User user = fetch_struct(json_url, STREAM_USER, &error);
+  cr_assert(user != NULL, "Expected the response to be converted");
+  cr_expect(error == NULL, "Expected no error to be returned");
+  cr_expect(eq(str, user->id, "user"), "Expected the user's id to be read");
+  cr_expect(eq(str, (char *) cJSON_Parse_fake.arg0_val, ""),
+            "Expected the response not to be parsed using cJSON");
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 0),
+            "Expected the request to be made through the engine");
+  tfree(free_user, user);
+}
+
+Test(fetch_struct, returns_error_when_response_isnt_structure) {
+  cJSON *error;
+  cr_expect(fetch_struct(json_url, STREAM_TRACKS_PAGE, &error) == NULL,
+            "Expected a user not to be converted to a page");
+  cr_expect(eq(long, get_error_status(error), 0),
+            "Expected an error to be returned");
+  cJSON_Delete(error);
+}
+
+Test(fetch_struct, returns_error_when_request_fails) {
+  cJSON *error;
+  cr_expect(fetch_struct(MISSING_URL, STREAM_USER, &error) == NULL,
+            "Expected no structure to be returned");
+  cr_expect(eq(long, get_error_status(error), 0),
+            "Expected an error to be returned");
+  cJSON_Delete(error);
+}
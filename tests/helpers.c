@@ -0,0 +1,117 @@
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "tmem.h"
+#include "ptrarray.h"
+#include "helpers.h"
+
+#define PLAYLIST_ID "3cEYpjA9oz9GiPac4AsH4n"
+#define OTHER_PLAYLIST_ID "37i9dQZF1DXcBWIGoYBM5M"
+#define ARTIST_ID "0TnOYISbd1XYRBk9myaseg"
+
+extern User user;
+extern SizedArray owned_playlists, followed_playlists;
+extern SizedArray followed_artists;
+extern size_t library_version;
+
+static struct user test_user = { .display_name = "name", .id = "user" };
+static struct simplified_user test_owner = { .display_name = "name",
+                                             .id = "user" };
+static struct simplified_user other_owner = { .display_name = "other",
+                                              .id = "other" };
+
+static void init_playlist(struct playlist *playlist, string id,
+                          SimplifiedUser owner) {
+  *playlist = (struct playlist) { .name = "playlist", .owner = owner,
+                                  .snapshot_id = "snapshot" };
+  strcpy(playlist->id, id);
+}
+
+static void setup(void) {
+  user = &test_user;
+  set_playlists(NULL);
+  set_followed_artists(new_ptr_array());
+}
+
+static void teardown(void) {
+  set_playlists(NULL);
+  set_followed_artists(new_ptr_array());
+  user = NULL;
+}
+
+TestSuite(helpers, .init = setup, .fini = teardown);
+
+Test(helpers, adds_followed_playlist_by_owner) {
+  struct playlist owned, followed;
+  init_playlist(&owned, PLAYLIST_ID, &test_owner);
+  init_playlist(&followed, OTHER_PLAYLIST_ID, &other_owner);
+  add_followed_playlist(&owned);
+  add_followed_playlist(&followed);
+  add_followed_playlist(&followed);
+  cr_assert(eq(sz, owned_playlists.length, 1),
+            "Expected the user's playlist to be owned");
+  cr_assert(eq(sz, followed_playlists.length, 1),
+            "Expected the other playlist to be added once");
+  cr_expect(eq(sz, array_length(followed_playlists.items), 1),
+            "Expected the length to match the playlists held");
+  SimplifiedPlaylist *playlists =
+    (SimplifiedPlaylist *) followed_playlists.items;
+  cr_expect(eq(str, playlists[0]->id, OTHER_PLAYLIST_ID),
+            "Expected the followed playlist to have an id of %s",
+            OTHER_PLAYLIST_ID);
+  cr_expect(playlists[0]->name != followed.name,
+            "Expected the followed playlist to be copied");
+}
+
+Test(helpers, patches_playlist_tracks_and_snapshot) {
+  struct playlist playlist;
+  init_playlist(&playlist, PLAYLIST_ID, &test_owner);
+  add_followed_playlist(&playlist);
+  size_t version = library_version;
+
+  playlist.name = "renamed";
+  playlist.snapshot_id = "new snapshot";
+  patch_playlist(&playlist, 2);
+  patch_playlist(&playlist, -1);
+  cr_assert(eq(sz, owned_playlists.length, 1),
+            "Expected the playlist to be patched in place");
+  SimplifiedPlaylist *playlists = (SimplifiedPlaylist *) owned_playlists.items;
+  cr_expect(eq(str, playlists[0]->name, "renamed"),
+            "Expected the playlist's name to be patched");
+  cr_expect(eq(str, playlists[0]->snapshot_id, "new snapshot"),
+            "Expected the playlist's snapshot id to be patched");
+  cr_expect(eq(sz, playlists[0]->tracks.total, 1),
+            "Expected the playlist to have 1 track");
+  cr_expect(library_version > version,
+            "Expected the patch to update the library's version");
+}
+
+Test(helpers, removes_unfollowed_playlist) {
+  struct playlist playlist;
+  init_playlist(&playlist, OTHER_PLAYLIST_ID, &other_owner);
+  add_followed_playlist(&playlist);
+  remove_followed_playlist(OTHER_PLAYLIST_ID);
+  cr_expect(eq(sz, followed_playlists.length, 0),
+            "Expected the playlist to be removed");
+}
+
+Test(helpers, adds_and_removes_followed_artist) {
+  string genres[] = { "rock", NULL };
+  struct followers followers = { .total = 12 };
+  struct artist artist = { .followers = &followers, .genres = genres,
+                           .name = "artist", .popularity = 42 };
+  strcpy(artist.id, ARTIST_ID);
+  add_followed_artist(&artist);
+  add_followed_artist(&artist);
+  cr_assert(eq(sz, followed_artists.length, 1),
+            "Expected the artist to be added once");
+  Artist *artists = (Artist *) followed_artists.items;
+  cr_expect(eq(str, artists[0]->genres[0], "rock"),
+            "Expected the artist's genres to be copied");
+  cr_expect(eq(sz, artists[0]->followers->total, 12),
+            "Expected the artist's followers to be copied");
+
+  remove_followed_artist(ARTIST_ID);
+  cr_expect(eq(sz, followed_artists.length, 0),
+            "Expected the artist to be removed");
+}
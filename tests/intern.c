@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "intern.h"
+
+#define NAME "Miles Davis"
+
+static void teardown(void) {
+  intern_clear();
+}
+
+TestSuite(intern, .fini = teardown);
+
+Test(intern, returns_copy_of_string) {
+  char name[] = NAME;
+  string interned = intern_string(name);
+  cr_assert(interned != NULL, "Expected string to be interned");
+  cr_expect(interned != name, "Expected interned string to be a copy");
+  cr_expect(eq(str, interned, NAME), "Expected interned string to be %s",
+            NAME);
+}
+
+Test(intern, shares_equal_strings) {
+  char name[] = NAME, same_name[] = NAME;
+  string interned = intern_string(name);
+  cr_expect(intern_string(same_name) == interned,
+            "Expected equal strings to share the same copy");
+  cr_expect(intern_string("Bill Evans") != interned,
+            "Expected different strings not to share the same copy");
+}
+
+Test(intern, owns_only_interned_copies) {
+  char name[] = NAME;
+  string interned = intern_string(name);
+  cr_expect(intern_owns(interned), "Expected interned copy to be owned");
+  cr_expect(not(intern_owns(name)),
+            "Expected equal string that wasn't interned not to be owned");
+}
+
+Test(intern, records_hits_and_saved_bytes) {
+  for (int i = 0; i < 3; i++) intern_string(NAME);
+  struct intern_stats stats = intern_get_stats();
+  cr_expect(eq(sz, stats.lookups, 3), "Expected 3 lookups");
+  cr_expect(eq(sz, stats.hits, 2), "Expected 2 hits");
+  cr_expect(eq(sz, stats.strings, 1), "Expected 1 string to be kept");
+  cr_expect(eq(sz, stats.saved_bytes, 2 * sizeof(NAME)),
+            "Expected the hits' copies to be saved");
+}
+
+Test(intern, keeps_strings_when_growing) {
+  char strings[1000][8];
+  string interned[1000];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(strings[i], sizeof(strings[i]), "s%d", i);
+    interned[i] = intern_string(strings[i]);
+  }
+  for (int i = 0; i < 1000; i++) {
+    cr_expect(intern_string(strings[i]) == interned[i],
+              "Expected string to be found after the table grew");
+  }
+}
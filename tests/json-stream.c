@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "json-stream.h"
+
+#define MAX_EVENTS 32
+#define DOCUMENT \
+  "{\"name\": \"caf\\u00e9 \\\"bar\\\"\", \"tags\": [1, -2.5e3, true, null], " \
+  "\"empty\": {}}"
+
+static struct {
+  enum json_event events[MAX_EVENTS];
+  char values[MAX_EVENTS][32];
+  size_t count;
+} recorded;
+
+static JsonStream stream = NULL;
+
+static bool record_event(void *data, enum json_event event,
+                         const char *value, size_t length) {
+  (void) data;
+  if (recorded.count == MAX_EVENTS) return false;
+  recorded.events[recorded.count] = event;
+  if (value != NULL && length < sizeof(recorded.values[0])) {
+    memcpy(recorded.values[recorded.count], value, length + 1);
+  } else recorded.values[recorded.count][0] = '\0';
+  recorded.count++;
+  return true;
+}
+
+static void setup(void) {
+  memset(&recorded, 0, sizeof(recorded));
+  stream = new_json_stream(record_event, NULL);
+  cr_assert(stream != NULL, "Expected a new stream to be created");
+}
+
+static void teardown(void) {
+  free_json_stream(stream);
+  stream = NULL;
+}
+
+static void feed_by_byte(const char *document) {
+  for (size_t i = 0; document[i] != '\0'; i++) {
+    json_stream_feed(stream, document + i, 1);
+  }
+}
+
+TestSuite(json_stream, .init = setup, .fini = teardown);
+
+Test(json_stream, reports_events_of_document_fed_byte_by_byte) {
+  enum json_event expected[] = {
+    JSON_OBJECT_START, JSON_KEY, JSON_STRING, JSON_KEY, JSON_ARRAY_START,
+    JSON_NUMBER, JSON_NUMBER, JSON_TRUE, JSON_NULL, JSON_ARRAY_END, JSON_KEY,
+    JSON_OBJECT_START, JSON_OBJECT_END, JSON_OBJECT_END
+  };
+  feed_by_byte(DOCUMENT);
+  cr_assert(json_stream_finish(stream), "Expected the document to be valid");
+  cr_assert(eq(sz, recorded.count, sizeof(expected) / sizeof(*expected)),
+            "Expected every event of the document to be reported");
+  for (size_t i = 0; i < recorded.count; i++) {
+    cr_expect(eq(int, recorded.events[i], expected[i]),
+              "Expected event %zu to be %d", i, expected[i]);
+  }
+  cr_expect(eq(str, recorded.values[6], "-2.5e3"),
+            "Expected numbers to be reported as written");
+}
+
+Test(json_stream, unescapes_strings_split_between_chunks) {
+  feed_by_byte(DOCUMENT);
+  cr_expect(eq(str, recorded.values[1], "name"),
+            "Expected keys to be reported");
+  cr_expect(eq(str, recorded.values[2], "caf\xc3\xa9 \"bar\""),
+            "Expected escapes to be decoded");
+}
+
+Test(json_stream, reports_number_ending_document_on_finish) {
+  json_stream_feed(stream, "42", 2);
+  cr_expect(eq(sz, recorded.count, 0),
+            "Expected the number not to be reported before the end");
+  cr_expect(json_stream_finish(stream), "Expected the document to be valid");
+  cr_expect(eq(str, recorded.values[0], "42"),
+            "Expected the number to be reported on finish");
+}
+
+Test(json_stream, fails_on_mismatched_container) {
+  cr_expect(not(json_stream_feed(stream, "[1}", 3)),
+            "Expected a mismatched container to be invalid");
+  cr_expect(not(json_stream_feed(stream, "]", 1)),
+            "Expected the following chunks to be ignored");
+}
+
+Test(json_stream, fails_to_finish_incomplete_document) {
+  json_stream_feed(stream, "{\"name\": \"na", 12);
+  cr_expect(not(json_stream_finish(stream)),
+            "Expected an incomplete document to be invalid");
+}
+
+Test(json_stream, parses_new_document_once_reset) {
+  json_stream_feed(stream, "{\"name\"", 7);
+  json_stream_reset(stream);
+  recorded.count = 0;
+  json_stream_feed(stream, "[]", 2);
+  cr_expect(json_stream_finish(stream),
+            "Expected the new document to be valid");
+  cr_expect(eq(sz, recorded.count, 2),
+            "Expected only the events of the new document to be reported");
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "tmem.h"
+#include "library-snapshot.h"
+
+#define SNAPSHOT_PATH "/tmp/cmusic-library-snapshot-test"
+#define PLAYLIST_ID "3cEYpjA9oz9GiPac4AsH4n"
+#define ARTIST_ID "0TnOYISbd1XYRBk9myaseg"
+#define ALBUM_ID "4aawyAB9vmqN3uQ7FjRGTy"
+#define TRACK_ID "11dFghVXANMlKmJXsNCbNl"
+#define TOKEN "token"
+
+static void teardown(void) {
+  unlink(SNAPSHOT_PATH);
+}
+
+TestSuite(library_snapshot, .fini = teardown);
+
+Test(library_snapshot, loads_saved_library) {
+  struct followers followers = { .total = 12 };
+  struct user user = { .display_name = "name", .followers = &followers,
+                       .id = "user" };
+  struct simplified_user owner = { .id = "owner", .display_name = "Owner" };
+  struct simplified_playlist playlist = { .name = "playlist",
+                                          .owner = &owner,
+                                          .public = true,
+                                          .tracks = { .total = 3 } };
+  strcpy(playlist.id, PLAYLIST_ID);
+  SimplifiedPlaylist playlists[] = { &playlist, NULL };
+  string genres[] = { "rock", "pop", NULL };
+  struct artist artist = { .followers = &followers, .genres = genres,
+                           .name = "artist", .popularity = 42 };
+  strcpy(artist.id, ARTIST_ID);
+  Artist artists[] = { &artist, NULL };
+  struct simplified_artist simplified_artist = { .name = "artist" };
+  strcpy(simplified_artist.id, ARTIST_ID);
+  SimplifiedArtist simplified_artists[] = { &simplified_artist, NULL };
+  struct simplified_album album = { .artists = simplified_artists,
+                                    .name = "album", .total_tracks = 9 };
+  strcpy(album.id, ALBUM_ID);
+  struct track track = { .album = &album, .artists = simplified_artists,
+                         .duration_ms = 1000, .name = "track" };
+  strcpy(track.id, TRACK_ID);
+  Track tracks[] = { &track, NULL };
+  struct page playlists_page = { .items = playlists };
+  struct page artists_page = { .items = artists };
+  struct page tracks_page = { .items = tracks };
+  struct library_snapshot saved = {
+    .user = &user,
+    .playlists = &playlists_page,
+    .followed_artists = &artists_page,
+    .top_artists = NULL,
+    .top_tracks = &tracks_page,
+  };
+  cr_assert(library_snapshot_save(SNAPSHOT_PATH, TOKEN, &saved),
+            "Expected library to be saved");
+
+  struct library_snapshot loaded;
+  cr_assert(library_snapshot_load(SNAPSHOT_PATH, NULL, TOKEN, &loaded),
+            "Expected library to be loaded");
+  cr_expect(eq(str, loaded.user->display_name, "name"),
+            "Expected user to have a display name of name");
+  cr_expect(eq(sz, loaded.user->followers->total, 12),
+            "Expected user to have 12 followers");
+
+  SimplifiedPlaylist *loaded_playlists = loaded.playlists->items;
+  cr_assert(loaded_playlists[0] != NULL && loaded_playlists[1] == NULL,
+            "Expected one playlist to be loaded");
+  cr_expect(eq(str, loaded_playlists[0]->id, PLAYLIST_ID),
+            "Expected playlist to have an id of %s", PLAYLIST_ID);
+  cr_expect(loaded_playlists[0]->description == NULL,
+            "Expected playlist's null description to stay null");
+  cr_expect(eq(str, loaded_playlists[0]->owner->display_name, "Owner"),
+            "Expected playlist's owner to be Owner");
+  cr_expect(loaded_playlists[0]->public, "Expected playlist to be public");
+  cr_expect(eq(sz, loaded_playlists[0]->tracks.total, 3),
+            "Expected playlist to have 3 tracks");
+
+  Artist *loaded_artists = loaded.followed_artists->items;
+  cr_assert(loaded_artists[0] != NULL && loaded_artists[1] == NULL,
+            "Expected one followed artist to be loaded");
+  cr_expect(eq(sz, loaded.followed_artists->count, 1),
+            "Expected the followed artists' page to count its artist");
+  cr_expect(eq(str, loaded_artists[0]->genres[1], "pop"),
+            "Expected artist's second genre to be pop");
+  cr_expect(loaded_artists[0]->genres[2] == NULL,
+            "Expected artist's genres to be null terminated");
+  cr_expect(eq(sz, loaded_artists[0]->popularity, 42),
+            "Expected artist to have a popularity of 42");
+  cr_expect(((Artist *) loaded.top_artists->items)[0] == NULL,
+            "Expected null top artists to be loaded as empty");
+
+  Track loaded_track = ((Track *) loaded.top_tracks->items)[0];
+  cr_assert(loaded_track != NULL, "Expected top track to be loaded");
+  cr_expect(eq(str, loaded_track->id, TRACK_ID),
+            "Expected track to have an id of %s", TRACK_ID);
+  cr_expect(eq(str, loaded_track->album->id, ALBUM_ID),
+            "Expected track's album to have an id of %s", ALBUM_ID);
+  cr_expect(eq(str, loaded_track->album->artists[0]->id, ARTIST_ID),
+            "Expected album's artist to have an id of %s", ARTIST_ID);
+  cr_expect(eq(str, loaded_track->artists[0]->name, "artist"),
+            "Expected track's artist to be named artist");
+
+  free_user(loaded.user);
+  free_page(loaded.playlists);
+  free_page(loaded.followed_artists);
+  free_page(loaded.top_artists);
+  free_page(loaded.top_tracks);
+}
+
+Test(library_snapshot, rejects_missing_file) {
+  struct library_snapshot loaded;
+  cr_expect(!library_snapshot_load(SNAPSHOT_PATH, NULL, TOKEN, &loaded),
+            "Expected a missing snapshot not to be loaded");
+}
+
+Test(library_snapshot, rejects_truncated_file) {
+  struct user user = { .display_name = "name", .id = "user" };
+  struct library_snapshot saved = { .user = &user };
+  cr_assert(library_snapshot_save(SNAPSHOT_PATH, TOKEN, &saved),
+            "Expected library to be saved");
+  cr_assert(!truncate(SNAPSHOT_PATH, 64), "Expected snapshot to be truncated");
+
+  struct library_snapshot loaded;
+  cr_expect(!library_snapshot_load(SNAPSHOT_PATH, NULL, TOKEN, &loaded),
+            "Expected a truncated snapshot not to be loaded");
+}
+
+Test(library_snapshot, rejects_other_files) {
+  FILE *file = fopen(SNAPSHOT_PATH, "w");
+  cr_assert(file != NULL, "Expected file to be created");
+  for (int i = 0; i < 64; i++) fputs("not a snapshot ", file);
+  fclose(file);
+
+  struct library_snapshot loaded;
+  cr_expect(!library_snapshot_load(SNAPSHOT_PATH, NULL, TOKEN, &loaded),
+            "Expected another file not to be loaded");
+}
+
+Test(library_snapshot, rejects_snapshot_of_another_owner) {
+  struct user user = { .display_name = "name", .id = "user" };
+  struct library_snapshot saved = { .user = &user };
+  cr_assert(library_snapshot_save(SNAPSHOT_PATH, TOKEN, &saved),
+            "Expected library to be saved");
+
+  struct library_snapshot loaded;
+  cr_expect(!library_snapshot_load(SNAPSHOT_PATH, "other user", "other token",
+                                   &loaded),
+            "Expected the snapshot of another owner not to be loaded");
+  cr_expect(!library_snapshot_load(SNAPSHOT_PATH, NULL, NULL, &loaded),
+            "Expected the snapshot not to be loaded without owner nor token");
+}
+
+Test(library_snapshot, loads_snapshot_of_same_owner_with_new_token) {
+  struct user user = { .display_name = "name", .id = "user" };
+  struct library_snapshot saved = { .user = &user };
+  cr_assert(library_snapshot_save(SNAPSHOT_PATH, TOKEN, &saved),
+            "Expected library to be saved");
+
+  struct library_snapshot loaded;
+  cr_assert(library_snapshot_load(SNAPSHOT_PATH, "user", "new token",
+                                  &loaded),
+            "Expected the snapshot of the same owner to be loaded");
+  cr_expect(eq(str, loaded.user->id, "user"), "Expected user's id to be user");
+  free_user(loaded.user);
+  free_page(loaded.playlists);
+  free_page(loaded.followed_artists);
+  free_page(loaded.top_artists);
+  free_page(loaded.top_tracks);
+}
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "playlist-store.h"
+
+#define STORE_DIR "/tmp/cmusic-playlist-store-test"
+#define ID "3cEYpjA9oz9GiPac4AsH4n"
+#define SNAPSHOT_ID "AAAAB8C1tvdNLD6oUaN2jh5qxtTHRzds"
+#define OTHER_SNAPSHOT_ID "AAAACbXX7f1d6xWcCD2Cp2Et0rZgcrXv"
+#define TRACK_ID "4aawyAB9vmqN3uQ7FjRGTy"
+
+static cJSON *new_tracks(void) {
+  cJSON *cJSON_tracks = cJSON_CreateObject();
+  cJSON *cJSON_items = cJSON_AddArrayToObject(cJSON_tracks, "items");
+  cJSON *cJSON_item = cJSON_CreateObject();
+  cJSON *cJSON_track = cJSON_AddObjectToObject(cJSON_item, "track");
+  cJSON_AddStringToObject(cJSON_track, "id", TRACK_ID);
+  cJSON_AddArrayToObject(cJSON_track, "available_markets");
+  cJSON_AddItemToArray(cJSON_items, cJSON_item);
+  cJSON_AddNumberToObject(cJSON_tracks, "total", 1);
+  return cJSON_tracks;
+}
+
+static cJSON *get_track(cJSON *cJSON_tracks) {
+  cJSON *cJSON_items =
+    cJSON_GetObjectItemCaseSensitive(cJSON_tracks, "items");
+  return cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(cJSON_items, 0),
+                                          "track");
+}
+
+static void setup(void) {
+  cr_assert(playlist_store_set_dir(STORE_DIR),
+            "Expected dir to be created");
+}
+
+static void teardown(void) {
+  playlist_store_remove(ID);
+  playlist_store_set_dir(NULL);
+  rmdir(STORE_DIR);
+}
+
+TestSuite(playlist_store, .init = setup, .fini = teardown);
+
+Test(playlist_store, returns_null_when_playlist_isnt_stored) {
+  cr_expect(playlist_store_get(ID, SNAPSHOT_ID) == NULL,
+            "Expected playlist_store_get to return null");
+  cr_expect(eq(sz, playlist_store_get_stats().misses, 1),
+            "Expected lookup to be counted as a miss");
+}
+
+Test(playlist_store, returns_tracks_stored_for_snapshot) {
+  cJSON *cJSON_tracks = new_tracks();
+  cr_assert(playlist_store_put(ID, SNAPSHOT_ID, cJSON_tracks),
+            "Expected tracks to be stored");
+  cJSON_Delete(cJSON_tracks);
+
+  cJSON *cJSON_stored = playlist_store_get(ID, SNAPSHOT_ID);
+  cr_assert(cJSON_stored != NULL, "Expected tracks to be found");
+  cJSON *cJSON_id = cJSON_GetObjectItemCaseSensitive(get_track(cJSON_stored),
+                                                     "id");
+  cr_expect(eq(str, cJSON_id->valuestring, TRACK_ID),
+            "Expected stored track to have an id of %s", TRACK_ID);
+  cr_expect(eq(sz, playlist_store_get_stats().hits, 1),
+            "Expected lookup to be counted as a hit");
+  cJSON_Delete(cJSON_stored);
+}
+
+Test(playlist_store, returns_null_when_snapshot_changed) {
+  cJSON *cJSON_tracks = new_tracks();
+  playlist_store_put(ID, SNAPSHOT_ID, cJSON_tracks);
+  cJSON_Delete(cJSON_tracks);
+
+  cr_expect(playlist_store_get(ID, OTHER_SNAPSHOT_ID) == NULL,
+            "Expected tracks of another snapshot not to be found");
+}
+
+Test(playlist_store, removes_unused_fields) {
+  cJSON *cJSON_tracks = new_tracks();
+  playlist_store_put(ID, SNAPSHOT_ID, cJSON_tracks);
+  cJSON_Delete(cJSON_tracks);
+
+  cJSON *cJSON_stored = playlist_store_get(ID, SNAPSHOT_ID);
+  cr_assert(cJSON_stored != NULL, "Expected tracks to be found");
+  cr_expect(not(cJSON_HasObjectItem(get_track(cJSON_stored),
+                                    "available_markets")),
+            "Expected available_markets not to be stored");
+  cJSON_Delete(cJSON_stored);
+}
+
+Test(playlist_store, removes_playlist) {
+  cJSON *cJSON_tracks = new_tracks();
+  playlist_store_put(ID, SNAPSHOT_ID, cJSON_tracks);
+  cJSON_Delete(cJSON_tracks);
+
+  playlist_store_remove(ID);
+  cr_expect(playlist_store_get(ID, SNAPSHOT_ID) == NULL,
+            "Expected removed playlist not to be found");
+}
+
+Test(playlist_store, rejects_invalid_id) {
+  cJSON *cJSON_tracks = new_tracks();
+  cr_expect(not(playlist_store_put("../" ID, SNAPSHOT_ID, cJSON_tracks)),
+            "Expected tracks not to be stored");
+  cJSON_Delete(cJSON_tracks);
+}
@@ -50,3 +50,78 @@ Test(get_array, returns_null_terminated_array,
               "Expected item %s of array to have value %s", k, k + 1);
   }
 }
+
+Test(add_items, appends_every_item_in_order, .init = setup, .fini = teardown) {
+  int i = 1, j = 2, k = 3;
+  int *items[] = { &i, &j, &k };
+  add_item(ptr_array, &i);
+  cr_expect(eq(add_items(ptr_array, (void **) items, 3), 4),
+            "Expected add_items to return new number of items");
+  int **int_array = (int **) get_array(ptr_array);
+  for (int l = 0; l < 3; l++) {
+    cr_expect(int_array[l + 1] == items[l],
+              "Expected item %d of array to be added item %d", l + 1, l);
+  }
+  cr_expect(int_array[4] == NULL, "Expected array to be null terminated");
+}
+
+Test(reserve_ptr_array, keeps_items_when_reserving_space,
+     .init = setup, .fini = teardown) {
+  int i = 1;
+  add_item(ptr_array, &i);
+  cr_assert(reserve_ptr_array(ptr_array, 100),
+            "Expected reserve_ptr_array to succeed");
+  cr_expect(eq(get_size(ptr_array), 1),
+            "Expected reserve_ptr_array not to change the number of items");
+  cr_expect(*(int *) get_array(ptr_array)[0] == 1,
+            "Expected reserve_ptr_array to keep items");
+  cr_expect(shrink_ptr_array(ptr_array),
+            "Expected shrink_ptr_array to succeed");
+  cr_expect(get_array(ptr_array)[1] == NULL,
+            "Expected array to stay null terminated");
+}
+
+Test(array_length, returns_number_of_items_of_array,
+     .init = setup, .fini = teardown) {
+  cr_expect(zero(array_length(get_array(ptr_array))),
+            "Expected array_length to return the number of items in array");
+  for (int i = 0; i < 20; i++) add_item(ptr_array, ptr_array);
+  cr_expect(eq(array_length(get_array(ptr_array)), 20),
+            "Expected array_length to return the number of items in array");
+}
+
+Test(copy_array, returns_copy_of_array_along_with_its_length,
+     .init = setup, .fini = teardown) {
+  for (int i = 0; i < 20; i++) add_item(ptr_array, ptr_array);
+  SizedArray copy = copy_array(ptr_array, malloc);
+  cr_assert(copy.items != NULL, "Expected copy_array to return a copy");
+  cr_expect(eq(sz, copy.length, 20),
+            "Expected copy of array to carry its number of items");
+  cr_expect(eq(array_length(copy.items), 20),
+            "Expected copy of array to have the same number of items");
+  free(copy.items);
+  SizedArray array = get_sized_array(ptr_array);
+  cr_expect(array.items == get_array(ptr_array) && array.length == 20,
+            "Expected get_sized_array to return the array and its length");
+}
+
+Test(array_length, counts_items_of_any_null_terminated_array) {
+  int i = 1, j = 2;
+  int *items[] = { &i, &j, NULL };
+  cr_expect(eq(array_length(items), 2),
+            "Expected array_length to return the number of items in array");
+  cr_expect(zero(array_length(NULL)),
+            "Expected array_length to return 0 for a null array");
+}
+
+Test(allocate_array, returns_null_terminated_array_of_null_pointers) {
+  int i = 1;
+  void **array = allocate_array(3, malloc);
+  cr_assert(array != NULL, "Expected allocate_array to return an array");
+  cr_expect(array[0] == NULL && array[3] == NULL,
+            "Expected allocated array to be null terminated");
+  for (int l = 0; l < 3; l++) array[l] = &i;
+  cr_expect(eq(array_length(array), 3),
+            "Expected allocated array to hold 3 items once filled");
+  free(array);
+}
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <fff/fff.h>
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include "tmem.h"
+#include "ptrarray.h"
+#include "entity-cache.h"
+#include "cjson-converters.h"
+#include "query.h"
+
+#define PLAYLIST_ID "3cEYpjA9oz9GiPac4AsH4n"
+#define SNAPSHOT_ID "MSw4ZGQ3ZDA2YjI1"
+#define NEW_SNAPSHOT_ID "Miw0NmMyZTRiNDFj"
+#define CACHED_PLAYLIST \
+  "{\"id\": \"" PLAYLIST_ID "\", \"name\": \"playlist\", " \
+  "\"public\": false, \"snapshot_id\": \"" SNAPSHOT_ID "\", " \
+  "\"owner\": {\"href\": \"\", \"id\": \"user\", \"display_name\": null}, " \
+  "\"tracks\": {\"href\": \"\", \"limit\": 100, \"next\": null, " \
+  "\"total\": 0, \"items\": []}}"
+#define ALBUM \
+  "{\"album_type\": \"album\", \"total_tracks\": 0, \"id\": \"\", " \
+  "\"name\": \"album\", \"release_date\": \"2025\", \"artists\": [], " \
+  "\"tracks\": {\"href\": \"\", \"limit\": 50, \"next\": null, " \
+  "\"total\": 0, \"items\": []}, \"popularity\": 0}"
+
+DECLARE_FAKE_VALUE_FUNC(CURLcode, curl_easy_perform, CURL *);
+DECLARE_FAKE_VALUE_FUNC(cJSON *, cJSON_Parse, const char *);
+
+static struct track tracks[PLAYLIST_EDIT_LIMIT + 1];
+static Track track_ptrs[PLAYLIST_EDIT_LIMIT + 2];
+static struct playlist playlist = {
+  .name = "playlist", .snapshot_id = SNAPSHOT_ID
+};
+
+static Track *first_tracks(size_t count) {
+  for (size_t i = 0; i < count; i++) track_ptrs[i] = &tracks[i];
+  track_ptrs[count] = NULL;
+  return track_ptrs;
+}
+
+static void setup(void) {
+  RESET_FAKE(curl_easy_perform);
+  RESET_FAKE(cJSON_Parse);
+  curl_easy_perform_fake.return_val = CURLE_OK;
+  for (size_t i = 0; i < PLAYLIST_EDIT_LIMIT + 1; i++) {
+    snprintf(tracks[i].id, SPOTIFY_ID_SIZE, "%022zu", i);
+  }
+  strcpy(playlist.id, PLAYLIST_ID);
+}
+
+static cJSON *snapshot_response(const char *value) {
+  (void) value;
+  cJSON *response = cJSON_CreateObject();
+  cJSON_AddStringToObject(response, "snapshot_id", NEW_SNAPSHOT_ID);
+  return response;
+}
+
+static cJSON *albums_response(const char *value) {
+  (void) value;
+  cJSON *response = cJSON_CreateObject();
+  cJSON *albums = cJSON_AddArrayToObject(response, "albums");
+  for (size_t i = 0; i < SEVERAL_ALBUMS_LIMIT; i++) {
+    cJSON_AddItemToArray(albums, cJSON_ParseWithOpts(ALBUM, NULL, false));
+  }
+  return response;
+}
+
+static cJSON *error_response(const char *value) {
+  (void) value;
+  return cJSON_ParseWithOpts("{\"error\": {\"status\": 500}}", NULL, false);
+}
+
+static string *album_ids(size_t count) {
+  static char ids[SEVERAL_ALBUMS_LIMIT + 1][SPOTIFY_ID_SIZE];
+  static string id_ptrs[SEVERAL_ALBUMS_LIMIT + 2];
+  for (size_t i = 0; i < count; i++) {
+    snprintf(ids[i], SPOTIFY_ID_SIZE, "%022zu", i);
+    id_ptrs[i] = ids[i];
+  }
+  id_ptrs[count] = NULL;
+  return id_ptrs;
+}
+
+static Playlist cached_playlist(void) {
+  cJSON *cJSON_playlist = cJSON_ParseWithOpts(CACHED_PLAYLIST, NULL, false);
+  return entity_cache_put(ENTITY_PLAYLIST, PLAYLIST_ID, cJSON_playlist,
+                          cJSON_to_playlist, free_playlist);
+}
+
+TestSuite(query_playlist_tracks, .init = setup, .fini = entity_cache_clear);
+
+Test(query_playlist_tracks, adds_up_to_limit_tracks_in_one_request) {
+  free(query_post_playlist_tracks(&playlist,
+                                  first_tracks(PLAYLIST_EDIT_LIMIT)));
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 1),
+            "Expected %d tracks to be added in 1 request",
+            PLAYLIST_EDIT_LIMIT);
+}
+
+Test(query_playlist_tracks, adds_tracks_over_limit_in_another_request) {
+  free(query_post_playlist_tracks(&playlist,
+                                  first_tracks(PLAYLIST_EDIT_LIMIT + 1)));
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 2),
+            "Expected %d tracks to be added in 2 requests",
+            PLAYLIST_EDIT_LIMIT + 1);
+}
+
+Test(query_playlist_tracks, deletes_up_to_limit_tracks_in_one_request) {
+  free(query_delete_playlist_tracks(&playlist,
+                                    first_tracks(PLAYLIST_EDIT_LIMIT)));
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 1),
+            "Expected %d tracks to be deleted in 1 request",
+            PLAYLIST_EDIT_LIMIT);
+}
+
+Test(query_playlist_tracks, deletes_tracks_over_limit_in_another_request) {
+  free(query_delete_playlist_tracks(&playlist,
+                                    first_tracks(PLAYLIST_EDIT_LIMIT + 1)));
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 2),
+            "Expected %d tracks to be deleted in 2 requests",
+            PLAYLIST_EDIT_LIMIT + 1);
+}
+
+Test(query_playlist_tracks, adds_tracks_without_modifying_cached_playlist) {
+  cJSON_Parse_fake.custom_fake = snapshot_response;
+  Playlist cached = cached_playlist();
+  string snapshot_id = query_post_playlist_tracks(cached, first_tracks(1));
+  cr_expect(eq(str, snapshot_id, NEW_SNAPSHOT_ID),
+            "Expected the snapshot id of the added track to be returned");
+  cr_expect(eq(str, cached->snapshot_id, SNAPSHOT_ID),
+            "Expected the cached playlist to be left untouched");
+  free(snapshot_id);
+  tfree(free_playlist, cached);
+}
+
+Test(query_playlist_tracks, deletes_tracks_without_modifying_cached_playlist) {
+  cJSON_Parse_fake.custom_fake = snapshot_response;
+  Playlist cached = cached_playlist();
+  string snapshot_id =
+    query_delete_playlist_tracks(cached,
+                                 first_tracks(PLAYLIST_EDIT_LIMIT + 1));
+  cr_expect(eq(str, snapshot_id, NEW_SNAPSHOT_ID),
+            "Expected the snapshot id of the last chunk to be returned");
+  cr_expect(eq(str, cached->snapshot_id, SNAPSHOT_ID),
+            "Expected the cached playlist to be left untouched");
+  free(snapshot_id);
+  tfree(free_playlist, cached);
+}
+
+TestSuite(query_several_albums, .init = setup, .fini = entity_cache_clear);
+
+Test(query_several_albums, gets_albums_over_limit_in_another_request) {
+  cJSON_Parse_fake.custom_fake = albums_response;
+  Album *albums = query_get_several_albums(album_ids(SEVERAL_ALBUMS_LIMIT + 1));
+  cr_assert(albums != NULL, "Expected the albums to be returned");
+  cr_expect(eq(sz, array_length(albums), SEVERAL_ALBUMS_LIMIT + 1),
+            "Expected an album to be returned for each id");
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 2),
+            "Expected %d albums to be queried in 2 requests",
+            SEVERAL_ALBUMS_LIMIT + 1);
+  free_array((void **) albums, free_album);
+}
+
+Test(query_several_albums, takes_cached_albums_from_entity_cache) {
+  cJSON_Parse_fake.custom_fake = albums_response;
+  free_array((void **) query_get_several_albums(album_ids(1)), free_album);
+  Album *albums = query_get_several_albums(album_ids(2));
+  cr_expect(eq(sz, array_length(albums), 2),
+            "Expected an album to be returned for each id");
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 2),
+            "Expected only the album missing from the cache to be queried");
+
+  Album cached = query_get_album(album_ids(1)[0]);
+  cr_expect(eq(int, curl_easy_perform_fake.call_count, 2),
+            "Expected the queried albums to be added to the entity cache");
+  tfree(free_album, cached);
+  free_array((void **) albums, free_album);
+}
+
+Test(query_several_albums, returns_null_when_a_request_fails) {
+  cJSON_Parse_fake.custom_fake = error_response;
+  cr_expect(query_get_several_albums(album_ids(1)) == NULL,
+            "Expected no albums to be returned");
+  cr_expect(eq(long, query_last_error(), 500),
+            "Expected the error of the request to be recorded");
+}
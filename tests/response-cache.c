@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "response-cache.h"
+
+#define CACHE_DIR "/tmp/cmusic-response-cache-test"
+#define URL "https://api.spotify.com/v1/me"
+#define OTHER_URL "https://api.spotify.com/v1/me/playlists"
+#define TOKEN "token"
+#define OTHER_TOKEN "other token"
+#define ETAG "\"etag\""
+#define BODY "{\"id\": \"user\"}"
+
+static void collect(void *data, const char *chunk, size_t size) {
+  strncat(data, chunk, size);
+}
+
+static void receive(string url, string status, string cache_control,
+                    string etag) {
+  ResponseCacheEntry entry = new_response_cache_entry(url, TOKEN);
+  response_cache_header(entry, status, strlen(status));
+  if (cache_control != NULL) {
+    response_cache_header(entry, cache_control, strlen(cache_control));
+  }
+  if (etag != NULL) response_cache_header(entry, etag, strlen(etag));
+  response_cache_write(entry, BODY, strlen(BODY));
+  response_cache_store(entry);
+  free_response_cache_entry(entry);
+}
+
+static void setup(void) {
+  response_cache_set_limit(RESPONSE_CACHE_LIMIT);
+  response_cache_set_eviction(RESPONSE_CACHE_LRU);
+  cr_assert(response_cache_set_dir(CACHE_DIR), "Expected dir to be created");
+}
+
+static void teardown(void) {
+  DIR *dir = opendir(CACHE_DIR);
+  struct dirent *dirent;
+  char path[256];
+  while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+    snprintf(path, sizeof(path), "%s/%s", CACHE_DIR, dirent->d_name);
+    unlink(path);
+  }
+  if (dir != NULL) closedir(dir);
+  rmdir(CACHE_DIR);
+  response_cache_set_dir(NULL);
+}
+
+TestSuite(response_cache, .init = setup, .fini = teardown);
+
+Test(response_cache, returns_null_when_cache_is_disabled) {
+  response_cache_set_dir(NULL);
+  cr_expect(new_response_cache_entry(URL, TOKEN) == NULL,
+            "Expected no entry to be returned");
+}
+
+Test(response_cache, stores_response_with_etag) {
+  receive(URL, "HTTP/2 200\r\n", "cache-control: private, max-age=0\r\n",
+          "etag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  cr_assert(response_cache_etag(entry) != NULL,
+            "Expected stored response to have an ETag");
+  cr_expect(eq(str, response_cache_etag(entry), ETAG),
+            "Expected ETag to be %s", ETAG);
+  cr_expect(not(response_cache_is_fresh(entry)),
+            "Expected response to need revalidation");
+  char body[64] = "";
+  cr_expect(response_cache_read(entry, collect, body),
+            "Expected body to be read");
+  cr_expect(eq(str, body, BODY), "Expected body to be %s", BODY);
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, keys_responses_by_url) {
+  receive(URL, "HTTP/2 200\r\n", NULL, "ETag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(OTHER_URL, TOKEN);
+  cr_expect(response_cache_etag(entry) == NULL,
+            "Expected no response to be stored for another URL");
+  char body[64] = "";
+  cr_expect(not(response_cache_read(entry, collect, body)),
+            "Expected no body to be read");
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, keys_responses_by_owner) {
+  receive(URL, "HTTP/2 200\r\n", NULL, "ETag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, OTHER_TOKEN);
+  cr_expect(response_cache_etag(entry) == NULL,
+            "Expected no response to be stored for another owner");
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, keeps_response_fresh_until_max_age) {
+  receive(URL, "HTTP/2 200\r\n", "Cache-Control: max-age=3600\r\n", NULL);
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  cr_expect(response_cache_is_fresh(entry), "Expected response to be fresh");
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, doesnt_store_response_that_cant_be_reused) {
+  receive(URL, "HTTP/2 200\r\n", NULL, NULL);
+  receive(OTHER_URL, "HTTP/2 200\r\n", "Cache-Control: no-store\r\n",
+          "ETag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  ResponseCacheEntry other_entry = new_response_cache_entry(OTHER_URL, TOKEN);
+  char body[64] = "";
+  cr_expect(not(response_cache_read(entry, collect, body)),
+            "Expected response without validator not to be stored");
+  cr_expect(not(response_cache_read(other_entry, collect, body)),
+            "Expected no-store response not to be stored");
+  free_response_cache_entry(entry);
+  free_response_cache_entry(other_entry);
+}
+
+Test(response_cache, doesnt_store_error_response) {
+  receive(URL, "HTTP/2 404\r\n", NULL, "ETag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  cr_expect(response_cache_etag(entry) == NULL,
+            "Expected error response not to be stored");
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, records_not_modified_status) {
+  receive(URL, "HTTP/2 200\r\n", NULL, "ETag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  string status = "HTTP/2 304\r\n";
+  string cache_control = "Cache-Control: max-age=3600\r\n";
+  response_cache_header(entry, status, strlen(status));
+  response_cache_header(entry, cache_control, strlen(cache_control));
+  cr_expect(eq(long, response_cache_status(entry), 304),
+            "Expected status to be 304");
+  char body[64] = "";
+  cr_expect(response_cache_read(entry, collect, body),
+            "Expected stored body to be read");
+  cr_expect(eq(str, body, BODY), "Expected body to be %s", BODY);
+  free_response_cache_entry(entry);
+
+  entry = new_response_cache_entry(URL, TOKEN);
+  cr_expect(response_cache_is_fresh(entry),
+            "Expected revalidated response to be fresh");
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, evicts_responses_over_limit) {
+  receive(URL, "HTTP/2 200\r\n", NULL, "ETag: " ETAG "\r\n");
+  response_cache_set_limit(1);
+  receive(OTHER_URL, "HTTP/2 200\r\n", NULL, "ETag: " ETAG "\r\n");
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  cr_expect(response_cache_etag(entry) == NULL,
+            "Expected response to be evicted");
+  free_response_cache_entry(entry);
+}
+
+Test(response_cache, makes_responses_stale_when_invalidated) {
+  receive(URL, "HTTP/2 200\r\n", "Cache-Control: max-age=3600\r\n",
+          "ETag: " ETAG "\r\n");
+  response_cache_invalidate();
+
+  ResponseCacheEntry entry = new_response_cache_entry(URL, TOKEN);
+  cr_expect(not(response_cache_is_fresh(entry)),
+            "Expected response to need revalidation");
+  cr_expect(eq(str, response_cache_etag(entry), ETAG),
+            "Expected response to be kept for revalidation");
+  free_response_cache_entry(entry);
+
+  response_cache_set_dir(CACHE_DIR);
+  entry = new_response_cache_entry(URL, TOKEN);
+  cr_expect(not(response_cache_is_fresh(entry)),
+            "Expected invalidation to survive the next run");
+  free_response_cache_entry(entry);
+}
@@ -0,0 +1,45 @@
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "spotify-id.h"
+
+#define ID "4aawyAB9vmqN3uQ7FjRGTy"
+#define OTHER_ID "0sNOF9WDwhWunNAHPD3Baj"
+
+Test(spotify_id_copy, pads_id_with_null_characters) {
+  char id[SPOTIFY_ID_SIZE];
+  memset(id, 'x', SPOTIFY_ID_SIZE);
+  cr_assert(spotify_id_copy(id, "abc123"), "Expected id to be copied");
+  cr_expect(eq(str, id, "abc123"), "Expected id to be abc123");
+  for (int i = strlen("abc123"); i < SPOTIFY_ID_SIZE; i++) {
+    cr_expect(eq(int, id[i], '\0'), "Expected id to be padded");
+  }
+}
+
+Test(spotify_id_copy, rejects_id_too_long) {
+  char id[SPOTIFY_ID_SIZE];
+  cr_expect(not(spotify_id_copy(id, ID "x")),
+            "Expected id longer than %d characters to be rejected",
+            SPOTIFY_ID_LENGTH);
+  cr_expect(eq(str, id, ""), "Expected id to be empty");
+}
+
+Test(spotify_id_pack, packs_equal_ids_to_equal_keys) {
+  struct spotify_id key, same_key, other_key;
+  char id[SPOTIFY_ID_SIZE];
+  spotify_id_copy(id, ID);
+  cr_assert(spotify_id_pack(&key, ID), "Expected id to be packed");
+  spotify_id_pack(&same_key, id);
+  spotify_id_pack(&other_key, OTHER_ID);
+  cr_expect(spotify_id_equal(key, same_key), "Expected keys to be equal");
+  cr_expect(eq(sz, spotify_id_hash(key), spotify_id_hash(same_key)),
+            "Expected equal keys to have the same hash");
+  cr_expect(not(spotify_id_equal(key, other_key)),
+            "Expected keys of different ids to differ");
+}
+
+Test(spotify_id_pack, rejects_null_id) {
+  struct spotify_id key;
+  cr_expect(not(spotify_id_pack(&key, NULL)),
+            "Expected null id to be rejected");
+}
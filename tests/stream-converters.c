@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "tmem.h"
+#include "intern.h"
+#include "stream-converters.h"
+
+#define ARTIST \
+  "{\"href\": \"https://test.com\", \"id\": \"artist\", " \
+  "\"name\": \"Artist\", \"type\": \"artist\"}"
+#define TRACK \
+  "{\"album\": {\"album_type\": \"album\", \"total_tracks\": 9, " \
+  "\"href\": \"https://test.com\", \"id\": \"album\", \"name\": \"Album\", " \
+  "\"release_date\": \"2025-01-01\", \"images\": [{\"url\": \"x\"}], " \
+  "\"artists\": [" ARTIST "]}, \"artists\": [" ARTIST ", null], " \
+  "\"duration_ms\": 180000, \"id\": \"track\", \"restrictions\": null, " \
+  "\"name\": \"Track\", \"popularity\": 42}"
+#define TRACKS_PAGE \
+  "{\"href\": \"https://test.com\", \"limit\": 20, \"next\": null, " \
+  "\"total\": 2, \"items\": [" TRACK ", " TRACK "]}"
+#define ARTISTS_PAGE \
+  "{\"href\": \"https://test.com\", \"limit\": 20, \"next\": null, " \
+  "\"total\": 1, \"items\": [{\"followers\": {\"href\": null, " \
+  "\"total\": 3}, \"genres\": [\"rock\", \"pop\"], \"id\": \"artist\", " \
+  "\"name\": \"Artist\", \"popularity\": 7}]}"
+
+static StreamConverter converter = NULL;
+
+static void teardown(void) {
+  free_stream_converter(converter);
+  converter = NULL;
+}
+
+static void *convert_by_byte(enum stream_type type, string document) {
+  free_stream_converter(converter);
+  converter = new_stream_converter(type);
+  cr_assert(converter != NULL, "Expected a new converter to be created");
+  for (size_t i = 0; document[i] != '\0'; i++) {
+    stream_converter_feed(converter, document + i, 1);
+  }
+  return stream_converter_finish(converter);
+}
+
+TestSuite(stream_converter, .fini = teardown);
+
+Test(stream_converter, converts_page_of_tracks_fed_byte_by_byte) {
+  Page page = convert_by_byte(STREAM_TRACKS_PAGE, TRACKS_PAGE);
+  cr_assert(page != NULL, "Expected the page to be converted");
+  cr_expect(eq(sz, page->total, 2), "Expected the page's total to be read");
+  cr_expect(page->next == NULL, "Expected a null next page to be read");
+
+  Track *tracks = page->items;
+  cr_assert(tracks[0] != NULL && tracks[1] != NULL && tracks[2] == NULL,
+            "Expected the page to hold 2 tracks");
+  cr_expect(eq(sz, page->count, 2),
+            "Expected the page to count the tracks it holds");
+  cr_expect(eq(str, tracks[1]->name, "Track"),
+            "Expected the track's name to be read");
+  cr_expect(eq(str, tracks[1]->id, "track"),
+            "Expected the track's id to be read");
+  cr_expect(eq(sz, tracks[1]->duration_ms, 180000),
+            "Expected the track's duration to be read");
+  cr_expect(tracks[1]->restrictions == NULL,
+            "Expected null restrictions to be skipped");
+  cr_expect(eq(str, tracks[1]->album->name, "Album"),
+            "Expected the track's album to be read");
+  cr_expect(eq(str, tracks[1]->album->artists[0]->name, "Artist"),
+            "Expected the album's artists to be read");
+  cr_expect(tracks[1]->artists[0] != NULL && tracks[1]->artists[1] == NULL,
+            "Expected null artists to be skipped");
+  tfree(free_page, page);
+}
+
+Test(stream_converter, interns_albums_types_and_artists_genres_and_names) {
+  Page page = convert_by_byte(STREAM_ARTISTS_PAGE, ARTISTS_PAGE);
+  cr_assert(page != NULL, "Expected the page to be converted");
+  Artist artist = ((Artist *) page->items)[0];
+  cr_expect(eq(sz, artist->followers->total, 3),
+            "Expected the artist's followers to be read");
+  cr_expect(eq(str, artist->genres[1], "pop"),
+            "Expected the artist's genres to be read");
+  cr_expect(intern_owns(artist->genres[0]),
+            "Expected the artist's genres to be interned");
+  tfree(free_page, page);
+
+  Page tracks = convert_by_byte(STREAM_TRACKS_PAGE, TRACKS_PAGE);
+  cr_expect(intern_owns(((Track *) tracks->items)[0]->album->album_type),
+            "Expected the album's type to be interned");
+  cr_expect(intern_owns(((Track *) tracks->items)[0]->artists[0]->name),
+            "Expected the track's artists' names to be interned");
+  tfree(free_page, tracks);
+}
+
+Test(stream_converter, converts_page_listed_under_key) {
+  Page page = convert_by_byte(STREAM_FOLLOWED_ARTISTS_PAGE,
+                              "{\"artists\": " ARTISTS_PAGE "}");
+  cr_assert(page != NULL, "Expected the page to be converted");
+  cr_expect(eq(str, ((Artist *) page->items)[0]->name, "Artist"),
+            "Expected the page's artists to be read");
+  tfree(free_page, page);
+}
+
+Test(stream_converter, returns_null_when_required_field_is_missing) {
+  cr_expect(convert_by_byte(STREAM_USER, "{\"display_name\": null, "
+                            "\"followers\": {\"total\": 1}}") == NULL,
+            "Expected a user without an id not to be converted");
+}
+
+Test(stream_converter, returns_null_when_field_has_another_type) {
+  cr_expect(convert_by_byte(STREAM_USER, "{\"display_name\": null, "
+                            "\"followers\": {\"total\": \"1\"}, "
+                            "\"id\": \"user\"}") == NULL,
+            "Expected a user with invalid followers not to be converted");
+}
+
+Test(stream_converter, returns_null_when_document_is_incomplete) {
+  cr_expect(convert_by_byte(STREAM_TRACKS_PAGE, "{\"href\": \"\"") == NULL,
+            "Expected an incomplete page not to be converted");
+}
+
+Test(stream_converter, converts_new_document_once_reset) {
+  converter = new_stream_converter(STREAM_USER);
+  cr_assert(converter != NULL, "Expected a new converter to be created");
+  stream_converter_feed(converter, "{\"id\": 1", 8);
+  stream_converter_reset(converter);
+
+  string user_json = "{\"display_name\": \"Name\", "
+                     "\"followers\": {\"total\": 1}, \"id\": \"user\"}";
+  stream_converter_feed(converter, user_json, strlen(user_json));
+  User user = stream_converter_finish(converter);
+  cr_assert(user != NULL, "Expected the new document to be converted");
+  cr_expect(eq(str, user->display_name, "Name"),
+            "Expected the user's name to be read");
+  cr_expect(eq(str, user->id, "user"), "Expected the user's id to be read");
+  tfree(free_user, user);
+}
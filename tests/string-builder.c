@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include "string-builder.h"
+
+StringBuilder builder = NULL;
+
+static void setup(void) {
+  builder = new_string_builder();
+  if (builder == NULL) exit(EXIT_FAILURE);
+}
+
+static void teardown(void) {
+  free_string_builder(builder);
+}
+
+TestSuite(string_builder, .init = setup, .fini = teardown);
+
+Test(string_builder, appends_strings) {
+  string_builder_append(builder, "https://api.spotify.com");
+  string_builder_appendf(builder, "/v1/%s?limit=%d", "me/tracks", 20);
+  cr_expect(eq(sz, string_builder_length(builder), 45),
+            "Expected length to be 45");
+  string str = string_builder_finish(builder);
+  builder = NULL;
+  cr_expect(eq(str, str, "https://api.spotify.com/v1/me/tracks?limit=20"),
+            "Expected appended strings to be concatenated");
+  free(str);
+}
+
+Test(string_builder, grows_past_initial_capacity) {
+  for (int i = 0; i < 1000; i++) string_builder_appendf(builder, "%d,", i % 10);
+  string str = string_builder_finish(builder);
+  builder = NULL;
+  cr_expect(eq(sz, strlen(str), 2000), "Expected every piece to be appended");
+  cr_expect(eq(int, str[1998], '9'), "Expected pieces to stay in order");
+  free(str);
+}
+
+Test(string_builder, percent_encodes_url_values) {
+  string_builder_append_url(builder, "Miles Davis & co/~x_y.z-");
+  string str = string_builder_finish(builder);
+  builder = NULL;
+  cr_expect(eq(str, str, "Miles%20Davis%20%26%20co%2F~x_y.z-"),
+            "Expected reserved characters to be percent-encoded");
+  free(str);
+}
+
+Test(string_builder, escapes_json_strings) {
+  string_builder_append_json(builder, "say \"hi\"\\\n\x01");
+  string_builder_append(builder, " ");
+  string_builder_append_json(builder, NULL);
+  string str = string_builder_finish(builder);
+  builder = NULL;
+  cr_expect(eq(str, str, "\"say \\\"hi\\\"\\\\\\n\\u0001\" null"),
+            "Expected special characters to be escaped");
+  free(str);
+}
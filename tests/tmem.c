@@ -6,8 +6,14 @@
 #define CR_NOT_NULL(ptr, ...) cr_expect(ptr != NULL, __VA_ARGS__) 
 
 void *type_structure_ptr = NULL;
+int released_count = 0;
 void (*free_type_structure)(void *type_structure_ptr) = NULL;
 
+static void count_release(void *ptr) {
+  (void) ptr;
+  released_count++;
+}
+
 static void teardown(void) {
   if (type_structure_ptr != NULL && free_type_structure != NULL) {
     (*free_type_structure)(type_structure_ptr);
@@ -149,3 +155,68 @@ Test(new_search, allocates_memory_for_search_structure, .fini = teardown) {
               "Expected search structure to be created");
   free_type_structure = free_search;
 }
+
+Test(talloc_end_arena, returns_root_allocated_in_arena, .fini = teardown) {
+  cr_assert(talloc_begin_arena(), "Expected arena to be started");
+  Page page = new_page();
+  page->items = tmalloc(sizeof(void *));
+  type_structure_ptr = talloc_end_arena(page);
+  cr_expect(type_structure_ptr == page,
+            "Expected talloc_end_arena to return the root structure");
+  free_type_structure = free_page;
+}
+
+Test(free_array, does_nothing_with_array_allocated_in_arena,
+     .fini = teardown) {
+  cr_assert(talloc_begin_arena(), "Expected arena to be started");
+  Page page = new_page();
+  Artist *artists = tmalloc(2 * sizeof(Artist));
+  artists[0] = new_artist();
+  artists[1] = NULL;
+  page->items = artists;
+  type_structure_ptr = talloc_end_arena(page);
+  free_type_structure = free_page;
+
+  free_array(page->items, free_artist);
+  cr_expect(page->items == artists && artists[1] == NULL,
+            "Expected array to be released only with its root");
+}
+
+Test(talloc_keep, releases_kept_memory_with_root) {
+  cr_assert(talloc_begin_arena(), "Expected arena to be started");
+  Page page = new_page();
+  cr_expect(talloc_keep(page, count_release),
+            "Expected memory to be kept with the arena");
+  talloc_end_arena(page);
+
+  cr_expect(eq(int, released_count, 0),
+            "Expected kept memory to outlive the arena's end");
+  free_page(page);
+  cr_expect(eq(int, released_count, 1),
+            "Expected kept memory to be released with the root");
+}
+
+Test(talloc_keep, fails_without_current_arena) {
+  cr_expect(!talloc_keep(NULL, count_release),
+            "Expected talloc_keep to require an arena");
+}
+
+Test(talloc_reenter_arena, allocates_in_the_arena_of_a_structure,
+     .fini = teardown) {
+  cr_assert(talloc_begin_arena(), "Expected arena to be started");
+  Page page = new_page();
+  type_structure_ptr = talloc_end_arena(page);
+  free_type_structure = free_page;
+
+  cr_assert(talloc_reenter_arena(page), "Expected arena to be reentered");
+  Artist artist = new_artist();
+  talloc_leave_arena();
+  free_artist(artist);
+  cr_expect(artist->id[0] == '\0',
+            "Expected artist to be released only with the page");
+
+  Artist individual = new_artist();
+  cr_expect(!talloc_reenter_arena(individual),
+            "Expected no arena for a structure allocated individually");
+  free_artist(individual);
+}